@@ -49,6 +49,7 @@ main (int argc, char **argv)
 	gboolean embedded_icons = FALSE;
 	gboolean hidpi_enabled = FALSE;
 	gboolean include_failed = FALSE;
+	gboolean package_cache = FALSE;
 	gboolean ret;
 	gboolean uncompressed_icons = FALSE;
 	gboolean verbose = FALSE;
@@ -65,6 +66,7 @@ main (int argc, char **argv)
 	g_autofree gchar *old_metadata = NULL;
 	g_autofree gchar *origin = NULL;
 	g_autofree gchar *output_dir = NULL;
+	g_autofree gchar *profile_json = NULL;
 	g_autofree gchar *temp_dir = NULL;
 	g_autofree gchar **veto_ignore = NULL;
 	g_autoptr(GPtrArray) packages = NULL;
@@ -107,6 +109,9 @@ main (int argc, char **argv)
 		{ "cache-dir", '\0', 0, G_OPTION_ARG_FILENAME, &cache_dir,
 			/* TRANSLATORS: command line option */
 			_("Set the cache directory"), "DIR" },
+		{ "package-cache", '\0', 0, G_OPTION_ARG_NONE, &package_cache,
+			/* TRANSLATORS: command line option */
+			_("Reuse the results of packages that have not changed"), NULL },
 		{ "basename", '\0', 0, G_OPTION_ARG_STRING, &basename,
 			/* TRANSLATORS: command line option */
 			_("Set the basenames of the output files"), "NAME" },
@@ -125,6 +130,9 @@ main (int argc, char **argv)
 		{ "veto-ignore", '\0', 0, G_OPTION_ARG_STRING_ARRAY, &veto_ignore,
 			/* TRANSLATORS: command line option */
 			_("Ignore certain types of veto"), "NAME" },
+		{ "profile-json", '\0', 0, G_OPTION_ARG_FILENAME, &profile_json,
+			/* TRANSLATORS: command line option */
+			_("Save the profile in the Chrome trace format"), "FILE" },
 		{ NULL}
 	};
 
@@ -169,14 +177,9 @@ main (int argc, char **argv)
 		origin = g_strdup ("example");
 	}
 
-	/* no longer threaded */
-	if (max_threads > 0)
-		g_print ("--max-threads now does nothing and will be removed in future versions");
-	if (old_metadata != NULL)
-		g_print ("--old-metadata now does nothing and will be removed in future versions");
-
 	ctx = asb_context_new ();
 	asb_context_set_api_version (ctx, 0.8);
+	asb_context_set_max_threads (ctx, max_threads);
 	asb_context_set_log_dir (ctx, log_dir);
 	asb_context_set_temp_dir (ctx, temp_dir);
 	asb_context_set_output_dir (ctx, output_dir);
@@ -185,6 +188,7 @@ main (int argc, char **argv)
 	asb_context_set_basename (ctx, basename);
 	asb_context_set_origin (ctx, origin);
 	asb_context_set_min_icon_size (ctx, min_icon_size);
+	asb_context_set_old_metadata (ctx, old_metadata);
 
 	/* parse the veto ignore flags */
 	if (veto_ignore != NULL) {
@@ -230,14 +234,17 @@ main (int argc, char **argv)
 	/* set build flags */
 	if (hidpi_enabled)
 		g_printerr ("--enable-hidpi now does nothing and will be removed in future versions\n");
-	if (add_cache_id)
-		g_print ("--add-cache-id now does nothing and will be removed in future versions\n");
+	/* the next run can only reuse components that have a cache ID */
+	if (add_cache_id || old_metadata != NULL)
+		flags |= ASB_CONTEXT_FLAG_ADD_CACHE_ID;
 	if (embedded_icons)
 		flags |= ASB_CONTEXT_FLAG_EMBEDDED_ICONS;
 	if (include_failed)
 		flags |= ASB_CONTEXT_FLAG_INCLUDE_FAILED;
 	if (uncompressed_icons)
 		flags |= ASB_CONTEXT_FLAG_UNCOMPRESSED_ICONS;
+	if (package_cache)
+		flags |= ASB_CONTEXT_FLAG_PACKAGE_CACHE;
 	asb_context_set_flags (ctx, flags);
 
 	ret = asb_context_setup (ctx, &error);
@@ -303,6 +310,16 @@ main (int argc, char **argv)
 		goto out;
 	}
 
+	/* profile */
+	if (profile_json != NULL &&
+	    !as_profile_export_json (asb_context_get_profile (ctx),
+				     profile_json, &error)) {
+		/* TRANSLATORS: error message */
+		g_warning ("%s: %s", _("Failed to save profile"), error->message);
+		retval = EXIT_FAILURE;
+		goto out;
+	}
+
 	/* success */
 	/* TRANSLATORS: information message */
 	g_print ("%s\n", _("Done!"));
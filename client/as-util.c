@@ -4432,6 +4432,7 @@ main (int argc, char *argv[])
 	GError *error = NULL;
 	gint retval = 1;
 	g_autofree gchar *cmd_descriptions = NULL;
+	g_autofree gchar *profile_json = NULL;
 	const GOptionEntry options[] = {
 		{ "nonet", '\0', 0, G_OPTION_ARG_NONE, &nonet,
 			/* TRANSLATORS: this is the --nonet argument */
@@ -4445,6 +4446,9 @@ main (int argc, char *argv[])
 		{ "profile", '\0', 0, G_OPTION_ARG_NONE, &enable_profiling,
 			/* TRANSLATORS: command line option */
 			_("Enable profiling"), NULL },
+		{ "profile-json", '\0', 0, G_OPTION_ARG_FILENAME, &profile_json,
+			/* TRANSLATORS: command line option */
+			_("Save the profile in the Chrome trace format"), "FILE" },
 		{ NULL}
 	};
 
@@ -4771,6 +4775,12 @@ main (int argc, char *argv[])
 	/* profile */
 	if (enable_profiling)
 		as_profile_dump (priv->profile);
+	if (profile_json != NULL &&
+	    !as_profile_export_json (priv->profile, profile_json, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		goto out;
+	}
 
 	/* success */
 	retval = 0;
@@ -102,6 +102,60 @@ asb_app_set_package (AsbApp *app, AsbPackage *pkg)
 		as_app_add_pkgname (AS_APP (app), asb_package_get_name (pkg));
 }
 
+/**
+ * asb_app_save_icons_to_prefix:
+ * @app: A #AsbApp
+ * @prefix: directory to save the icons into
+ * @error: A #GError or %NULL
+ *
+ * Saves and optimizes any cached icons that have pixel data into @prefix,
+ * using the same `WxH/name` layout as the icons directory, and then frees
+ * the pixel data. asb_app_save_resources() then copies the already
+ * optimized file rather than encoding the icon again.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_app_save_icons_to_prefix (AsbApp *app, const gchar *prefix, GError **error)
+{
+	AsbAppPrivate *priv = GET_PRIVATE (app);
+	GPtrArray *icons = as_app_get_icons (AS_APP (app));
+
+	for (guint i = 0; i < icons->len; i++) {
+		AsIcon *icon = g_ptr_array_index (icons, i);
+		GdkPixbuf *pixbuf = as_icon_get_pixbuf (icon);
+		g_autofree gchar *dir = NULL;
+		g_autofree gchar *fn = NULL;
+		g_autofree gchar *size_str = NULL;
+		g_autoptr(GError) error_local = NULL;
+
+		if (as_icon_get_kind (icon) != AS_ICON_KIND_CACHED)
+			continue;
+		if (pixbuf == NULL)
+			continue;
+		size_str = g_strdup_printf ("%ix%i",
+					    as_icon_get_width (icon),
+					    as_icon_get_height (icon));
+		dir = g_build_filename (prefix, size_str, NULL);
+		if (!asb_utils_ensure_exists (dir, error))
+			return FALSE;
+		fn = g_build_filename (dir, as_icon_get_name (icon), NULL);
+		if (!gdk_pixbuf_save (pixbuf, fn, "png", error, NULL))
+			return FALSE;
+		if (!asb_utils_optimize_png (fn, &error_local)) {
+			asb_package_log (priv->pkg,
+					 ASB_PACKAGE_LOG_LEVEL_WARNING,
+					 "Failed to optimize icon: %s",
+					 error_local->message);
+		}
+		as_icon_set_prefix (icon, prefix);
+		as_icon_set_pixbuf (icon, NULL);
+	}
+	return TRUE;
+}
+
 /**
  * asb_app_save_resources:
  * @app: A #AsbApp
@@ -142,11 +196,6 @@ asb_app_save_resources (AsbApp *app, AsbAppSaveFlags save_flags, GError **error)
 		    as_icon_get_kind (icon) == AS_ICON_KIND_REMOTE)
 			continue;
 
-		/* missing cached icons */
-		pixbuf = as_icon_get_pixbuf (icon);
-		if (pixbuf == NULL)
-			continue;
-
 		/* save to disk */
 		tmpdir = asb_package_get_config (priv->pkg, "IconsDir");
 		dir = g_strdup_printf ("%ix%i", as_icon_get_width (icon),
@@ -154,6 +203,33 @@ asb_app_save_resources (AsbApp *app, AsbAppSaveFlags save_flags, GError **error)
 		filename = g_build_filename (tmpdir, dir,
 					     as_icon_get_name (icon),
 					     NULL);
+
+		/* already saved and optimized in the package cache */
+		pixbuf = as_icon_get_pixbuf (icon);
+		if (pixbuf == NULL) {
+			g_autofree gchar *fn_cache = NULL;
+			g_autoptr(GFile) file_src = NULL;
+			g_autoptr(GFile) file_dest = NULL;
+			if (as_icon_get_prefix (icon) == NULL)
+				continue;
+			fn_cache = g_build_filename (as_icon_get_prefix (icon), dir,
+						     as_icon_get_name (icon),
+						     NULL);
+			if (!g_file_test (fn_cache, G_FILE_TEST_EXISTS))
+				continue;
+			if (g_strcmp0 (fn_cache, filename) == 0)
+				continue;
+			file_src = g_file_new_for_path (fn_cache);
+			file_dest = g_file_new_for_path (filename);
+			if (!g_file_copy (file_src, file_dest,
+					  G_FILE_COPY_OVERWRITE,
+					  NULL, NULL, NULL, error))
+				return FALSE;
+			asb_package_log (priv->pkg,
+					 ASB_PACKAGE_LOG_LEVEL_DEBUG,
+					 "Copied cached icon %s", filename);
+			continue;
+		}
 		if (!gdk_pixbuf_save (pixbuf, filename, "png", error, NULL))
 			return FALSE;
 
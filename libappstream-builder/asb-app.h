@@ -57,6 +57,9 @@ AsbPackage	*asb_app_get_package		(AsbApp		*app);
 gboolean	 asb_app_save_resources		(AsbApp		*app,
 						 AsbAppSaveFlags save_flags,
 						 GError		**error);
+gboolean	 asb_app_save_icons_to_prefix	(AsbApp		*app,
+						 const gchar	*prefix,
+						 GError		**error);
 
 
 G_END_DECLS
@@ -13,3 +13,19 @@
 GPtrArray	*asb_context_get_file_globs	(AsbContext	*ctx);
 GPtrArray	*asb_context_get_packages	(AsbContext	*ctx);
 AsbPluginLoader	*asb_context_get_plugin_loader	(AsbContext	*ctx);
+gchar		*asb_context_get_package_cache_dir (AsbContext	*ctx,
+						 AsbPackage	*pkg,
+						 GPtrArray	*extra_pkgs,
+						 GError		**error);
+gchar		*asb_context_get_package_checksum (AsbContext	*ctx,
+						 AsbPackage	*pkg,
+						 GError		**error);
+GHashTable	*asb_context_explode_extra_package (AsbContext	*ctx,
+						 AsbPackage	*pkg,
+						 GError		**error);
+gboolean	 asb_context_explode_extra_package_dir (AsbContext	*ctx,
+						 AsbPackage	*pkg,
+						 const gchar	*dir,
+						 GError		**error);
+void		 asb_context_release_extra_package (AsbContext	*ctx,
+						 AsbPackage	*pkg);
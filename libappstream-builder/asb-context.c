@@ -17,6 +17,7 @@
 #include "config.h"
 
 #include <stdlib.h>
+#include <glib/gstdio.h>
 #include <appstream-glib.h>
 
 #include "asb-context.h"
@@ -40,15 +41,38 @@ typedef struct
 	AsStore			*store_failed;
 	AsStore			*store_ignore;
 	GList			*apps;			/* of AsbApp */
-	GMutex			 apps_mutex;		/* for ->apps */
+	GList			*apps_reused;		/* of AsbApp */
+	GMutex			 apps_mutex;		/* for ->apps and ->apps_reused */
+	GThreadPool		*plugins_pool;		/* of AsbTask */
+	GMutex			 plugins_mutex;		/* for ->plugins_pending */
+	GCond			 plugins_cond;
+	guint			 plugins_pending;
+	GThreadPool		*icons_pool;		/* of AsbApp */
+	GMutex			 icons_mutex;		/* for ->icons_pending */
+	GCond			 icons_cond;
+	guint			 icons_pending;
+	GHashTable		*extra_pkgs;		/* filename : AsbContextExtraPkg */
+	GMutex			 extra_pkgs_mutex;	/* for ->extra_pkgs */
 	GPtrArray		*file_globs;		/* of AsbPackage */
 	GPtrArray		*packages;		/* of AsbPackage */
 	AsbPluginLoader		*plugin_loader;
+	AsProfile		*profile;
 	AsbContextFlags		 flags;
+	guint			 max_threads;
 	guint			 min_icon_size;
 	gdouble			 api_version;
 	gchar			*log_dir;
 	gchar			*cache_dir;
+	gchar			*cache_salt;
+	GHashTable		*cache_used;		/* of package cache entry names */
+	GHashTable		*cache_checksums;	/* filename : SHA-256 */
+	GMutex			 cache_mutex;		/* for ->cache_used and ->cache_checksums */
+	gchar			*old_metadata;
+	gchar			*old_icons_dir;
+	GHashTable		*old_apps;		/* nevra : GPtrArray of AsApp */
+	GHashTable		*old_ignore;		/* nevra : GPtrArray of AsApp */
+	guint			 old_reused;
+	guint			 old_queued;	/* enabled packages processed */
 	gchar			*temp_dir;
 	gchar			*output_dir;
 	gchar			*icons_dir;
@@ -56,6 +80,12 @@ typedef struct
 	gchar			*origin;
 } AsbContextPrivate;
 
+typedef struct {
+	GMutex			 mutex;			/* held while exploding */
+	GHashTable		*files;			/* filename : GBytes */
+	guint			 refcount;		/* for ->extra_pkgs_mutex */
+} AsbContextExtraPkg;
+
 G_DEFINE_TYPE_WITH_PRIVATE (AsbContext, asb_context, G_TYPE_OBJECT)
 
 #define GET_PRIVATE(o) (asb_context_get_instance_private (o))
@@ -117,13 +147,17 @@ asb_context_set_flags (AsbContext *ctx, AsbContextFlags flags)
  * @max_threads: integer
  *
  * Sets the maximum number of threads to use when processing packages.
- * This function now has no affect as only one thread is ever used.
+ * If set to zero then one thread per CPU is used.
  *
  * Since: 0.1.0
  **/
 void
 asb_context_set_max_threads (AsbContext *ctx, guint max_threads)
 {
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	if (max_threads == 0)
+		max_threads = g_get_num_processors ();
+	priv->max_threads = max_threads;
 }
 
 /**
@@ -162,16 +196,24 @@ asb_context_get_min_icon_size (AsbContext *ctx)
 /**
  * asb_context_set_old_metadata:
  * @ctx: A #AsbContext
- * @old_metadata: filename, or %NULL
+ * @old_metadata: directory or filename, or %NULL
+ *
+ * Sets the location of the metadata created by a previous run, either the
+ * output directory or the main XML file inside it.
  *
- * Sets the filename location of the old metadata file.
- * This function now has no affect as no cache ID is available.
+ * Packages with a NEVRA that matches the cache ID of a component in the old
+ * metadata are not processed again, and the old components are reused
+ * instead. Only metadata created with %ASB_CONTEXT_FLAG_ADD_CACHE_ID set
+ * contains cache IDs.
  *
  * Since: 0.1.0
  **/
 void
 asb_context_set_old_metadata (AsbContext *ctx, const gchar *old_metadata)
 {
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	g_free (priv->old_metadata);
+	priv->old_metadata = g_strdup (old_metadata);
 }
 
 /**
@@ -195,7 +237,9 @@ asb_context_set_log_dir (AsbContext *ctx, const gchar *log_dir)
  * @ctx: A #AsbContext
  * @cache_dir: directory
  *
- * Sets the cache directory to use when building metadata.
+ * Sets the cache directory to use when building metadata. This is used to
+ * store generated screenshots and the results of processing each package, so
+ * unchanged packages do not have to be exploded on the next run.
  *
  * Since: 0.1.0
  **/
@@ -389,6 +433,23 @@ asb_context_get_plugin_loader (AsbContext *ctx)
 	return priv->plugin_loader;
 }
 
+/**
+ * asb_context_get_profile:
+ * @ctx: A #AsbContext
+ *
+ * Gets the profile that records how long each stage of processing took.
+ *
+ * Returns: (transfer none): the #AsProfile
+ *
+ * Since: 0.8.5
+ **/
+AsProfile *
+asb_context_get_profile (AsbContext *ctx)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	return priv->profile;
+}
+
 /**
  * asb_context_get_packages:
  * @ctx: A #AsbContext
@@ -492,6 +553,553 @@ asb_context_get_file_globs (AsbContext *ctx)
 	return priv->file_globs;
 }
 
+static gboolean
+asb_context_load_old_store (AsbContext *ctx,
+			    const gchar *filename,
+			    GHashTable *hash,
+			    GError **error)
+{
+	GPtrArray *apps;
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autoptr(GFile) file = g_file_new_for_path (filename);
+
+	/* not an error, as the old run may not have created it */
+	if (!g_file_test (filename, G_FILE_TEST_EXISTS)) {
+		g_debug ("no old metadata %s", filename);
+		return TRUE;
+	}
+	if (!as_store_from_file (store, file, NULL, NULL, error)) {
+		g_prefix_error (error, "Failed to load old metadata %s: ",
+				filename);
+		return FALSE;
+	}
+	apps = as_store_get_apps (store);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		GPtrArray *array;
+		const gchar *cache_id;
+
+		cache_id = as_app_get_metadata_item (app, "X-CacheID");
+		if (cache_id == NULL)
+			continue;
+		array = g_hash_table_lookup (hash, cache_id);
+		if (array == NULL) {
+			array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+			g_hash_table_insert (hash, g_strdup (cache_id), array);
+		}
+		g_ptr_array_add (array, g_object_ref (app));
+	}
+	return TRUE;
+}
+
+static gboolean
+asb_context_load_old_metadata (AsbContext *ctx, GError **error)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	g_autofree gchar *dirname = NULL;
+	g_autofree gchar *fn_failed = NULL;
+	g_autofree gchar *fn_icons = NULL;
+	g_autofree gchar *fn_ignore = NULL;
+	g_autofree gchar *fn_xml = NULL;
+
+	/* not enabled */
+	if (priv->old_metadata == NULL)
+		return TRUE;
+
+	/* the other files are always written alongside the main one */
+	if (g_file_test (priv->old_metadata, G_FILE_TEST_IS_DIR)) {
+		dirname = g_strdup (priv->old_metadata);
+		fn_xml = g_strdup_printf ("%s/%s.xml.gz", dirname, priv->basename);
+	} else {
+		dirname = g_path_get_dirname (priv->old_metadata);
+		fn_xml = g_strdup (priv->old_metadata);
+	}
+	fn_failed = g_strdup_printf ("%s/%s-failed.xml.gz", dirname, priv->basename);
+	fn_ignore = g_strdup_printf ("%s/%s-ignore.xml.gz", dirname, priv->basename);
+	fn_icons = g_strdup_printf ("%s/%s-icons.tar.gz", dirname, priv->basename);
+
+	/* vetoed components are reused too, so they end up failed again */
+	priv->old_apps = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, (GDestroyNotify) g_ptr_array_unref);
+	if (!asb_context_load_old_store (ctx, fn_xml, priv->old_apps, error))
+		return FALSE;
+	if (!asb_context_load_old_store (ctx, fn_failed, priv->old_apps, error))
+		return FALSE;
+	priv->old_ignore = g_hash_table_new_full (g_str_hash, g_str_equal,
+						  g_free, (GDestroyNotify) g_ptr_array_unref);
+	if (!asb_context_load_old_store (ctx, fn_ignore, priv->old_ignore, error))
+		return FALSE;
+
+	/* the icons for the reused components, where the old icons directory
+	 * is used as-is when the icons were never packed into a tarball */
+	if (g_file_test (fn_icons, G_FILE_TEST_EXISTS)) {
+		priv->old_icons_dir = g_build_filename (priv->temp_dir, "old-icons", NULL);
+		if (!asb_utils_ensure_exists_and_empty (priv->old_icons_dir, error))
+			return FALSE;
+		if (!asb_utils_explode (fn_icons, priv->old_icons_dir, NULL, error)) {
+			g_prefix_error (error, "Failed to decompress %s: ", fn_icons);
+			return FALSE;
+		}
+	} else {
+		priv->old_icons_dir = g_strdup (priv->icons_dir);
+	}
+	g_print ("Loaded %u components and %u ignored packages from old metadata\n",
+		 g_hash_table_size (priv->old_apps),
+		 g_hash_table_size (priv->old_ignore));
+	return TRUE;
+}
+
+/* only reuse components when every resource they reference can be found */
+static gboolean
+asb_context_old_app_is_reusable (AsbContext *ctx, AsApp *app)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	GPtrArray *icons = as_app_get_icons (app);
+	GPtrArray *screenshots = as_app_get_screenshots (app);
+
+	for (guint i = 0; i < icons->len; i++) {
+		AsIcon *icon = g_ptr_array_index (icons, i);
+		g_autofree gchar *fn = NULL;
+		g_autofree gchar *size_str = NULL;
+		if (as_icon_get_kind (icon) != AS_ICON_KIND_CACHED)
+			continue;
+		size_str = g_strdup_printf ("%ix%i",
+					    as_icon_get_width (icon),
+					    as_icon_get_height (icon));
+		fn = g_build_filename (priv->old_icons_dir, size_str,
+				       as_icon_get_name (icon), NULL);
+		if (!g_file_test (fn, G_FILE_TEST_EXISTS))
+			return FALSE;
+	}
+
+	/* locally generated screenshots are not kept between runs */
+	for (guint i = 0; i < screenshots->len; i++) {
+		AsScreenshot *ss = g_ptr_array_index (screenshots, i);
+		GPtrArray *images = as_screenshot_get_images (ss);
+		for (guint j = 0; j < images->len; j++) {
+			AsImage *im = g_ptr_array_index (images, j);
+			const gchar *url = as_image_get_url (im);
+			if (url != NULL && g_str_has_prefix (url, "file:"))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static gboolean
+asb_context_reuse_old_metadata (AsbContext *ctx, AsbPackage *pkg)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	GPtrArray *apps_old;
+	const gchar *nevra = asb_package_get_nevra (pkg);
+
+	/* not enabled */
+	if (priv->old_apps == NULL)
+		return FALSE;
+
+	/* the package produced nothing useful last time */
+	apps_old = g_hash_table_lookup (priv->old_apps, nevra);
+	if (apps_old == NULL) {
+		if (g_hash_table_lookup (priv->old_ignore, nevra) == NULL)
+			return FALSE;
+		asb_package_log (pkg,
+				 ASB_PACKAGE_LOG_LEVEL_DEBUG,
+				 "%s was ignored in the old metadata",
+				 nevra);
+		asb_context_add_app_ignore (ctx, pkg);
+		return TRUE;
+	}
+
+	/* copy each component */
+	for (guint i = 0; i < apps_old->len; i++) {
+		AsApp *app_old = g_ptr_array_index (apps_old, i);
+		if (!asb_context_old_app_is_reusable (ctx, app_old))
+			return FALSE;
+	}
+	for (guint i = 0; i < apps_old->len; i++) {
+		AsApp *app_old = g_ptr_array_index (apps_old, i);
+		GPtrArray *icons;
+		g_autoptr(AsbApp) app = NULL;
+
+		/* this includes any vetos */
+		app = asb_app_new (pkg, as_app_get_id (app_old));
+		as_app_subsume (AS_APP (app), app_old);
+		icons = as_app_get_icons (AS_APP (app));
+		for (guint j = 0; j < icons->len; j++) {
+			AsIcon *icon = g_ptr_array_index (icons, j);
+			if (as_icon_get_kind (icon) == AS_ICON_KIND_CACHED)
+				as_icon_set_prefix (icon, priv->old_icons_dir);
+		}
+
+		/* these were already merged when the old metadata was built */
+		g_mutex_lock (&priv->apps_mutex);
+		asb_plugin_add_app (&priv->apps_reused, AS_APP (app));
+		g_mutex_unlock (&priv->apps_mutex);
+	}
+	asb_package_log (pkg,
+			 ASB_PACKAGE_LOG_LEVEL_DEBUG,
+			 "Reused %u components from the old metadata for %s",
+			 apps_old->len, nevra);
+	return TRUE;
+}
+
+static gchar *
+asb_context_get_cache_salt (AsbContext *ctx)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	GPtrArray *plugins;
+	GString *str = g_string_new (NULL);
+	gchar version[G_ASCII_DTOSTR_BUF_SIZE];
+	g_autofree gchar *builder_id = asb_utils_get_builder_id ();
+
+	/* anything that changes what the plugins produce */
+	g_ascii_formatd (version, sizeof (version), "%.1f", priv->api_version);
+	g_string_append_printf (str, "%s;%s;%s;%u;%u\n",
+				builder_id, PACKAGE_VERSION, version,
+				(guint) priv->flags, priv->min_icon_size);
+
+	/* a rebuilt plugin invalidates everything it could have touched */
+	plugins = asb_plugin_loader_get_plugins (priv->plugin_loader);
+	for (guint i = 0; i < plugins->len; i++) {
+		AsbPlugin *plugin = g_ptr_array_index (plugins, i);
+		const gchar *fn = g_module_name (plugin->module);
+		GStatBuf st = { 0 };
+		if (g_stat (fn, &st) != 0)
+			g_debug ("failed to stat plugin %s", fn);
+		g_string_append_printf (str, "%s;%i;%" G_GINT64_FORMAT ";%" G_GINT64_FORMAT "\n",
+					plugin->name, plugin->enabled,
+					(gint64) st.st_size,
+					(gint64) st.st_mtime);
+	}
+	return g_string_free (str, FALSE);
+}
+
+/* the name, size and modification time, which are cheap to compare */
+static gboolean
+asb_context_package_cache_key_add (GChecksum *checksum,
+				   AsbPackage *pkg,
+				   GError **error)
+{
+	const gchar *fn = asb_package_get_filename (pkg);
+	GStatBuf st = { 0 };
+	g_autofree gchar *str = NULL;
+
+	if (g_stat (fn, &st) != 0) {
+		g_set_error (error,
+			     ASB_PLUGIN_ERROR,
+			     ASB_PLUGIN_ERROR_FAILED,
+			     "failed to stat %s", fn);
+		return FALSE;
+	}
+	str = g_strdup_printf ("\n%s;%s;%" G_GINT64_FORMAT ";%" G_GINT64_FORMAT,
+			       asb_package_get_nevra (pkg),
+			       asb_package_get_basename (pkg),
+			       (gint64) st.st_size,
+			       (gint64) st.st_mtime);
+	g_checksum_update (checksum, (const guchar *) str, -1);
+	return TRUE;
+}
+
+/**
+ * asb_context_get_package_cache_dir:
+ * @ctx: A #AsbContext
+ * @pkg: A #AsbPackage
+ * @extra_pkgs: (element-type AsbPackage): packages exploded alongside @pkg
+ * @error: A #GError or %NULL
+ *
+ * Gets the cache directory for the results of processing a package. The
+ * location depends on the NEVRA, size and modification time of @pkg and of
+ * every other package that gets exploded alongside it, the loaded plugins
+ * and the context settings. The package contents are not read, so the
+ * entry has to be checked with asb_context_get_package_checksum() before
+ * it is reused.
+ *
+ * The entry is kept when asb_context_process() removes the entries that
+ * were not used in the run.
+ *
+ * Returns: (transfer full): a directory name, or %NULL for error
+ *
+ * Since: 0.8.5
+ **/
+gchar *
+asb_context_get_package_cache_dir (AsbContext *ctx,
+				   AsbPackage *pkg,
+				   GPtrArray *extra_pkgs,
+				   GError **error)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+	/* not set up */
+	if (priv->cache_salt == NULL) {
+		g_set_error_literal (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_FAILED,
+				     "context not set up");
+		return NULL;
+	}
+
+	g_checksum_update (checksum, (const guchar *) priv->cache_salt, -1);
+	if (!asb_context_package_cache_key_add (checksum, pkg, error))
+		return NULL;
+
+	/* the extra packages exploded into the same tree */
+	for (guint i = 0; i < extra_pkgs->len; i++) {
+		AsbPackage *pkg_extra = g_ptr_array_index (extra_pkgs, i);
+		if (!asb_context_package_cache_key_add (checksum, pkg_extra, error))
+			return NULL;
+	}
+	g_mutex_lock (&priv->cache_mutex);
+	g_hash_table_add (priv->cache_used,
+			  g_strdup (g_checksum_get_string (checksum)));
+	g_mutex_unlock (&priv->cache_mutex);
+	return g_build_filename (priv->cache_dir, "packages",
+				 g_checksum_get_string (checksum), NULL);
+}
+
+/**
+ * asb_context_get_package_checksum:
+ * @ctx: A #AsbContext
+ * @pkg: A #AsbPackage
+ * @error: A #GError or %NULL
+ *
+ * Gets the SHA-256 checksum of the package file, which is saved in each
+ * package cache entry so that a package rebuilt with the same NEVRA, size
+ * and modification time does not reuse stale results.
+ *
+ * Each file is only read once per context, as the same extra package is
+ * checked by every task that uses it.
+ *
+ * Returns: (transfer full): a checksum, or %NULL for error
+ *
+ * Since: 0.8.5
+ **/
+gchar *
+asb_context_get_package_checksum (AsbContext *ctx, AsbPackage *pkg, GError **error)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	const gchar *fn = asb_package_get_filename (pkg);
+	gchar *checksum;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+
+	g_mutex_lock (&priv->cache_mutex);
+	checksum = g_strdup (g_hash_table_lookup (priv->cache_checksums, fn));
+	g_mutex_unlock (&priv->cache_mutex);
+	if (checksum != NULL)
+		return checksum;
+
+	mapped_file = g_mapped_file_new (fn, FALSE, error);
+	if (mapped_file == NULL)
+		return NULL;
+	checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+						(const guchar *) g_mapped_file_get_contents (mapped_file),
+						g_mapped_file_get_length (mapped_file));
+	g_mutex_lock (&priv->cache_mutex);
+	g_hash_table_insert (priv->cache_checksums, g_strdup (fn), g_strdup (checksum));
+	g_mutex_unlock (&priv->cache_mutex);
+	return checksum;
+}
+
+/* removes the package cache entries that no task asked for in this run, so
+ * that the cache does not keep growing as packages are updated */
+static gboolean
+asb_context_prune_package_cache (AsbContext *ctx, GError **error)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	const gchar *fn;
+	guint cnt = 0;
+	g_autofree gchar *packages_dir = NULL;
+	g_autoptr(GDir) dir = NULL;
+
+	packages_dir = g_build_filename (priv->cache_dir, "packages", NULL);
+	if (!g_file_test (packages_dir, G_FILE_TEST_EXISTS))
+		return TRUE;
+	dir = g_dir_open (packages_dir, 0, error);
+	if (dir == NULL)
+		return FALSE;
+	while ((fn = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *path = NULL;
+		if (g_hash_table_contains (priv->cache_used, fn))
+			continue;
+		path = g_build_filename (packages_dir, fn, NULL);
+		if (!asb_utils_rmtree (path, error))
+			return FALSE;
+		cnt++;
+	}
+	if (cnt > 0)
+		g_print ("Removed %u unused package cache entries\n", cnt);
+	return TRUE;
+}
+
+static void
+asb_context_extra_pkg_free (AsbContextExtraPkg *extra)
+{
+	g_mutex_clear (&extra->mutex);
+	if (extra->files != NULL)
+		g_hash_table_unref (extra->files);
+	g_free (extra);
+}
+
+/* the entry is kept until the last task using it has finished */
+static AsbContextExtraPkg *
+asb_context_extra_pkg_ref (AsbContext *ctx, AsbPackage *pkg)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	AsbContextExtraPkg *extra;
+
+	g_mutex_lock (&priv->extra_pkgs_mutex);
+	extra = g_hash_table_lookup (priv->extra_pkgs,
+				     asb_package_get_filename (pkg));
+	if (extra == NULL) {
+		extra = g_new0 (AsbContextExtraPkg, 1);
+		g_mutex_init (&extra->mutex);
+		g_hash_table_insert (priv->extra_pkgs,
+				     g_strdup (asb_package_get_filename (pkg)),
+				     extra);
+	}
+	extra->refcount++;
+	g_mutex_unlock (&priv->extra_pkgs_mutex);
+	return extra;
+}
+
+/**
+ * asb_context_release_extra_package:
+ * @ctx: A #AsbContext
+ * @pkg: A #AsbPackage
+ *
+ * Releases a package returned by asb_context_explode_extra_package(). The
+ * decompressed files are freed when no other task is using them.
+ **/
+void
+asb_context_release_extra_package (AsbContext *ctx, AsbPackage *pkg)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	AsbContextExtraPkg *extra;
+
+	g_mutex_lock (&priv->extra_pkgs_mutex);
+	extra = g_hash_table_lookup (priv->extra_pkgs,
+				     asb_package_get_filename (pkg));
+	if (extra == NULL) {
+		g_warning ("extra pkg %s was not in use",
+			   asb_package_get_name (pkg));
+	} else if (--extra->refcount == 0) {
+		g_debug ("freeing extra pkg %s", asb_package_get_name (pkg));
+		g_hash_table_remove (priv->extra_pkgs,
+				     asb_package_get_filename (pkg));
+	}
+	g_mutex_unlock (&priv->extra_pkgs_mutex);
+}
+
+/**
+ * asb_context_explode_extra_package:
+ * @ctx: A #AsbContext
+ * @pkg: A #AsbPackage
+ * @error: A #GError or %NULL
+ *
+ * Decompresses a package that other packages depend on into memory. The
+ * result is shared between all the tasks that are using the package at the
+ * same time, and on success each caller has to use
+ * asb_context_release_extra_package() once it has finished.
+ *
+ * Returns: (transfer full) (element-type utf8 GBytes): the files, or %NULL
+ **/
+GHashTable *
+asb_context_explode_extra_package (AsbContext *ctx,
+				   AsbPackage *pkg,
+				   GError **error)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	AsbContextExtraPkg *extra;
+	GHashTable *files = NULL;
+
+	/* any other task wanting the same package waits here */
+	extra = asb_context_extra_pkg_ref (ctx, pkg);
+	g_mutex_lock (&extra->mutex);
+	if (extra->files == NULL) {
+		g_autoptr(GHashTable) files_tmp = NULL;
+		g_debug ("decompressing extra pkg %s", asb_package_get_name (pkg));
+		if (!asb_package_hold (pkg,
+				       ASB_PACKAGE_ENSURE_FILES |
+				       ASB_PACKAGE_ENSURE_DEPS,
+				       error))
+			goto out;
+		files_tmp = g_hash_table_new_full (g_str_hash, g_str_equal,
+						   g_free, (GDestroyNotify) g_bytes_unref);
+		if (!asb_package_explode_memory (pkg, files_tmp,
+						 priv->file_globs,
+						 error)) {
+			asb_package_unhold (pkg,
+					    ASB_PACKAGE_ENSURE_DEPS |
+					    ASB_PACKAGE_ENSURE_FILES,
+					    NULL);
+			goto out;
+		}
+
+		/* free resources, unless the task for the package is using it */
+		if (!asb_package_unhold (pkg,
+					 ASB_PACKAGE_ENSURE_DEPS |
+					 ASB_PACKAGE_ENSURE_FILES,
+					 error))
+			goto out;
+		extra->files = g_steal_pointer (&files_tmp);
+	}
+	files = g_hash_table_ref (extra->files);
+out:
+	g_mutex_unlock (&extra->mutex);
+	if (files == NULL)
+		asb_context_release_extra_package (ctx, pkg);
+	return files;
+}
+
+/**
+ * asb_context_explode_extra_package_dir:
+ * @ctx: A #AsbContext
+ * @pkg: A #AsbPackage
+ * @dir: directory to decompress into
+ * @error: A #GError or %NULL
+ *
+ * Decompresses a package that other packages depend on into a directory,
+ * for when asb_context_explode_extra_package() cannot be used.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ **/
+gboolean
+asb_context_explode_extra_package_dir (AsbContext *ctx,
+				       AsbPackage *pkg,
+				       const gchar *dir,
+				       GError **error)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	AsbContextExtraPkg *extra;
+	gboolean ret;
+
+	/* the package object is shared with the other tasks */
+	extra = asb_context_extra_pkg_ref (ctx, pkg);
+	g_mutex_lock (&extra->mutex);
+	g_debug ("decompressing extra pkg %s to %s",
+		 asb_package_get_name (pkg), dir);
+	ret = asb_package_hold (pkg,
+				ASB_PACKAGE_ENSURE_FILES |
+				ASB_PACKAGE_ENSURE_DEPS,
+				error);
+	if (ret) {
+		g_autoptr(GError) error_local = NULL;
+		ret = asb_package_explode (pkg, dir, priv->file_globs, error);
+
+		/* free resources, unless the task for the package is using it */
+		if (!asb_package_unhold (pkg,
+					 ASB_PACKAGE_ENSURE_DEPS |
+					 ASB_PACKAGE_ENSURE_FILES,
+					 &error_local) && ret) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			ret = FALSE;
+		}
+	}
+	g_mutex_unlock (&extra->mutex);
+	asb_context_release_extra_package (ctx, pkg);
+	return ret;
+}
+
 /**
  * asb_context_setup:
  * @ctx: A #AsbContext
@@ -510,8 +1118,13 @@ asb_context_setup (AsbContext *ctx, GError **error)
 	g_autofree gchar *icons_dir = NULL;
 	g_autofree gchar *icons_dir_hidpi = NULL;
 	g_autofree gchar *icons_dir_lodpi = NULL;
+	g_autofree gchar *packages_dir = NULL;
 	g_autofree gchar *screenshot_dir1 = NULL;
 	g_autofree gchar *screenshot_dir2 = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsbContext:setup");
 
 	/* required stuff set */
 	if (priv->origin == NULL) {
@@ -581,6 +1194,16 @@ asb_context_setup (AsbContext *ctx, GError **error)
 	/* get a cache of the file globs */
 	priv->file_globs = asb_plugin_loader_get_globs (priv->plugin_loader);
 
+	/* per-package results are only valid for this exact configuration */
+	packages_dir = g_build_filename (priv->cache_dir, "packages", NULL);
+	if (!asb_utils_ensure_exists (packages_dir, error))
+		return FALSE;
+	priv->cache_salt = asb_context_get_cache_salt (ctx);
+
+	/* load the components we might be able to reuse */
+	if (!asb_context_load_old_metadata (ctx, error))
+		return FALSE;
+
 	return TRUE;
 }
 
@@ -591,6 +1214,10 @@ asb_context_write_icons (AsbContext *ctx,
 {
 	AsbContextPrivate *priv = GET_PRIVATE (ctx);
 	g_autofree gchar *filename = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsbContext:write-icons");
 
 	/* not enabled */
 	if (priv->flags & ASB_CONTEXT_FLAG_UNCOMPRESSED_ICONS)
@@ -601,7 +1228,8 @@ asb_context_write_icons (AsbContext *ctx,
 	filename = g_strdup_printf ("%s/%s-icons.tar.gz",
 				    priv->output_dir, priv->basename);
 	g_print ("Writing %s...\n", filename);
-	return asb_utils_write_archive_dir (filename, priv->icons_dir, error);
+	return asb_utils_write_archive_dir_full (filename, priv->icons_dir,
+						 priv->max_threads, error);
 }
 
 static gboolean
@@ -610,8 +1238,16 @@ asb_context_write_screenshots (AsbContext *ctx,
 			       GError **error)
 {
 	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	const gchar *tmp;
 	g_autofree gchar *filename = NULL;
 	g_autofree gchar *screenshot_dir = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GPtrArray) pngs = NULL;
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsbContext:write-screenshots");
 
 	/* not enabled */
 	if (priv->flags & ASB_CONTEXT_FLAG_UNCOMPRESSED_ICONS)
@@ -620,10 +1256,27 @@ asb_context_write_screenshots (AsbContext *ctx,
 	screenshot_dir = g_build_filename (temp_dir, "screenshots", NULL);
 	if (!g_file_test (screenshot_dir, G_FILE_TEST_EXISTS))
 		return TRUE;
+
+	/* optimize all the generated screenshots at once, without losing detail */
+	dir = g_dir_open (screenshot_dir, 0, error);
+	if (dir == NULL)
+		return FALSE;
+	pngs = g_ptr_array_new_with_free_func (g_free);
+	while ((tmp = g_dir_read_name (dir)) != NULL) {
+		if (!g_str_has_suffix (tmp, ".png"))
+			continue;
+		g_ptr_array_add (pngs, g_build_filename (screenshot_dir, tmp, NULL));
+	}
+	if (!asb_utils_optimize_pngs (pngs, priv->max_threads, &error_local)) {
+		g_print ("WARNING: Failed to optimize screenshots: %s\n",
+			 error_local->message);
+	}
+
 	filename = g_strdup_printf ("%s/%s-screenshots.tar",
 				    priv->output_dir, priv->basename);
 	g_print ("Writing %s...\n", filename);
-	return asb_utils_write_archive_dir (filename, screenshot_dir, error);
+	return asb_utils_write_archive_dir_full (filename, screenshot_dir,
+						 priv->max_threads, error);
 }
 
 static gboolean
@@ -633,9 +1286,13 @@ asb_context_write_xml (AsbContext *ctx, GError **error)
 	AsbContextPrivate *priv = GET_PRIVATE (ctx);
 	GList *l;
 	g_autofree gchar *filename = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
 	g_autoptr(AsStore) store = NULL;
 	g_autoptr(GFile) file = NULL;
 
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsbContext:write-xml");
+
 	/* convert any vetod applications into dummy components */
 	for (l = priv->apps; l != NULL; l = l->next) {
 		app = AS_APP (l->data);
@@ -710,6 +1367,10 @@ asb_context_save_resources (AsbContext *ctx, GError **error)
 	AsApp *app;
 	AsbContextPrivate *priv = GET_PRIVATE (ctx);
 	GList *l;
+	g_autoptr(AsProfileTask) ptask = NULL;
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsbContext:save-resources");
 
 	for (l = priv->apps; l != NULL; l = l->next) {
 		app = AS_APP (l->data);
@@ -1016,6 +1677,331 @@ asb_context_disable_multiarch_pkgs (AsbContext *ctx)
 	}
 }
 
+static void
+asb_context_pool_free (GThreadPool *pool)
+{
+	g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+static void
+asb_context_save_icons_cb (gpointer data, gpointer user_data)
+{
+	AsbContext *ctx = ASB_CONTEXT (user_data);
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	AsbPackage *pkg;
+	g_autofree gchar *prefix = NULL;
+	g_autoptr(AsbApp) app = ASB_APP (data);
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* any icons not saved here are saved in asb_context_save_resources() */
+	pkg = asb_app_get_package (app);
+	if (pkg != NULL) {
+		ptask = as_profile_start (priv->profile, "AsbContext:save-icons{%s}",
+					  as_app_get_id (AS_APP (app)));
+		as_profile_task_set_threaded (ptask, TRUE);
+		prefix = g_build_filename (priv->temp_dir, "icons-pending",
+					   asb_package_get_basename (pkg), NULL);
+		if (!asb_app_save_icons_to_prefix (app, prefix, &error_local)) {
+			asb_package_log (pkg,
+					 ASB_PACKAGE_LOG_LEVEL_WARNING,
+					 "Failed to save icons early: %s",
+					 error_local->message);
+		}
+	}
+
+	/* let the next component in */
+	g_mutex_lock (&priv->icons_mutex);
+	priv->icons_pending--;
+	g_cond_signal (&priv->icons_cond);
+	g_mutex_unlock (&priv->icons_mutex);
+}
+
+typedef struct {
+	AsbContext	*ctx;
+	GMutex		 mutex;		/* for ->error */
+	GError		*error;
+} AsbContextProcessHelper;
+
+static gboolean
+asb_context_process_helper_failed (AsbContextProcessHelper *helper)
+{
+	gboolean ret;
+	g_mutex_lock (&helper->mutex);
+	ret = helper->error != NULL;
+	g_mutex_unlock (&helper->mutex);
+	return ret;
+}
+
+static void
+asb_context_process_helper_set_error (AsbContextProcessHelper *helper,
+				      GError **error)
+{
+	/* save the first error only */
+	g_mutex_lock (&helper->mutex);
+	if (helper->error == NULL)
+		helper->error = g_steal_pointer (error);
+	g_mutex_unlock (&helper->mutex);
+}
+
+static void
+asb_context_plugins_done (AsbContext *ctx)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+
+	/* let the next exploded package in */
+	g_mutex_lock (&priv->plugins_mutex);
+	priv->plugins_pending--;
+	g_cond_signal (&priv->plugins_cond);
+	g_mutex_unlock (&priv->plugins_mutex);
+}
+
+static void
+asb_context_run_plugins_cb (gpointer data, gpointer user_data)
+{
+	AsbContextProcessHelper *helper = (AsbContextProcessHelper *) user_data;
+	AsbContextPrivate *priv = GET_PRIVATE (helper->ctx);
+	g_autoptr(AsbTask) task = ASB_TASK (data);
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* another task already failed, so just drop the exploded tree */
+	if (!asb_context_process_helper_failed (helper)) {
+		ptask = as_profile_start (priv->profile, "AsbContext:run-plugins{%s}",
+					  asb_package_get_basename (asb_task_get_package (task)));
+		as_profile_task_set_threaded (ptask, TRUE);
+		if (!asb_task_run_plugins (task, &error_local))
+			asb_context_process_helper_set_error (helper, &error_local);
+	}
+	asb_context_plugins_done (helper->ctx);
+}
+
+static void
+asb_context_explode_task_cb (gpointer data, gpointer user_data)
+{
+	AsbContextProcessHelper *helper = (AsbContextProcessHelper *) user_data;
+	AsbContextPrivate *priv = GET_PRIVATE (helper->ctx);
+	g_autoptr(AsbPackage) pkg = ASB_PACKAGE (data);
+	g_autoptr(AsbTask) task = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* another task already failed, so don't bother */
+	if (asb_context_process_helper_failed (helper))
+		return;
+
+	/* profile */
+	ptask = as_profile_start (priv->profile, "AsbContext:explode-package{%s}",
+				  asb_package_get_basename (pkg));
+	as_profile_task_set_threaded (ptask, TRUE);
+
+	/* unchanged since the old metadata was built; the header is read
+	 * here so that it overlaps with other packages being exploded */
+	if (!asb_package_ensure (pkg, ASB_PACKAGE_ENSURE_NEVRA, &error_local))
+		goto out;
+	if (asb_context_reuse_old_metadata (helper->ctx, pkg)) {
+		g_atomic_int_inc (&priv->old_reused);
+		if (asb_package_log_flush (pkg, &error_local))
+			return;
+		goto out;
+	}
+
+	/* decompress the tree */
+	task = asb_task_new (helper->ctx);
+	asb_task_set_package (task, pkg);
+	if (!asb_task_explode (task, &error_local))
+		goto out;
+	g_clear_pointer (&ptask, as_profile_task_free);
+
+	/* each exploded tree is held in memory until the plugins have run,
+	 * so block here rather than letting the queue grow without limit */
+	g_mutex_lock (&priv->plugins_mutex);
+	while (priv->plugins_pending >= priv->max_threads * 2)
+		g_cond_wait (&priv->plugins_cond, &priv->plugins_mutex);
+	priv->plugins_pending++;
+	g_mutex_unlock (&priv->plugins_mutex);
+	if (g_thread_pool_push (priv->plugins_pool, g_object_ref (task), &error_local))
+		return;
+	g_object_unref (task);
+	asb_context_plugins_done (helper->ctx);
+out:
+	asb_context_process_helper_set_error (helper, &error_local);
+}
+
+static gint
+asb_context_app_pkg_sort_cb (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	GHashTable *pkg_idx = (GHashTable *) user_data;
+	guint idx_a = 0;
+	guint idx_b = 0;
+
+	if (ASB_IS_APP (a)) {
+		AsbPackage *pkg = asb_app_get_package (ASB_APP (a));
+		idx_a = GPOINTER_TO_UINT (g_hash_table_lookup (pkg_idx, pkg));
+	}
+	if (ASB_IS_APP (b)) {
+		AsbPackage *pkg = asb_app_get_package (ASB_APP (b));
+		idx_b = GPOINTER_TO_UINT (g_hash_table_lookup (pkg_idx, pkg));
+	}
+
+	/* apps are prepended, so the newest package is at the start */
+	if (idx_a < idx_b)
+		return 1;
+	if (idx_a > idx_b)
+		return -1;
+	return 0;
+}
+
+static gboolean
+asb_context_process_packages (AsbContext *ctx, GError **error)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	AsbContextProcessHelper helper;
+	GThreadPool *pool;
+	gboolean ret = TRUE;
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GHashTable) pkg_idx = NULL;
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsbContext:process-packages");
+
+	/* icons are saved by a second stage as each package completes,
+	 * unless they are going to be embedded after the merge */
+	if ((priv->flags & ASB_CONTEXT_FLAG_EMBEDDED_ICONS) == 0) {
+		priv->icons_pending = 0;
+		priv->icons_pool = g_thread_pool_new (asb_context_save_icons_cb,
+						      ctx,
+						      (gint) priv->max_threads,
+						      TRUE,
+						      error);
+		if (priv->icons_pool == NULL)
+			return FALSE;
+	}
+
+	/* each task has its own temp directory, so they can run in parallel;
+	 * packages are exploded by one pool and handed to a second pool that
+	 * runs the plugins, so decompression overlaps with plugin execution */
+	helper.ctx = ctx;
+	helper.error = NULL;
+	g_mutex_init (&helper.mutex);
+	priv->plugins_pending = 0;
+	priv->plugins_pool = g_thread_pool_new (asb_context_run_plugins_cb,
+						&helper,
+						(gint) priv->max_threads,
+						TRUE,
+						error);
+	if (priv->plugins_pool == NULL) {
+		g_mutex_clear (&helper.mutex);
+		g_clear_pointer (&priv->icons_pool, asb_context_pool_free);
+		return FALSE;
+	}
+	pool = g_thread_pool_new (asb_context_explode_task_cb,
+				  &helper,
+				  (gint) priv->max_threads,
+				  TRUE,
+				  error);
+	if (pool == NULL) {
+		g_clear_pointer (&priv->plugins_pool, asb_context_pool_free);
+		g_mutex_clear (&helper.mutex);
+		g_clear_pointer (&priv->icons_pool, asb_context_pool_free);
+		return FALSE;
+	}
+	pkg_idx = g_hash_table_new (g_direct_hash, g_direct_equal);
+	priv->old_reused = 0;
+	priv->old_queued = 0;
+	for (guint i = 0; i < priv->packages->len; i++) {
+		AsbPackage *pkg = g_ptr_array_index (priv->packages, i);
+
+		g_hash_table_insert (pkg_idx, pkg, GUINT_TO_POINTER (i + 1));
+		if (!asb_package_get_enabled (pkg)) {
+			asb_package_log (pkg,
+					 ASB_PACKAGE_LOG_LEVEL_DEBUG,
+					 "%s is not enabled",
+					 asb_package_get_nevr (pkg));
+			asb_context_add_app_ignore (ctx, pkg);
+			if (!asb_package_log_flush (pkg, error)) {
+				ret = FALSE;
+				break;
+			}
+			continue;
+		}
+
+		/* set locations of external resources */
+		asb_package_set_config (pkg, "LogDir", priv->log_dir);
+		asb_package_set_config (pkg, "TempDir", priv->temp_dir);
+		asb_package_set_config (pkg, "IconsDir", priv->icons_dir);
+		asb_package_set_config (pkg, "OutputDir", priv->output_dir);
+
+		/* the task is created in the pool, which unrefs the package */
+		if (!g_thread_pool_push (pool, g_object_ref (pkg), error)) {
+			g_object_unref (pkg);
+			ret = FALSE;
+			break;
+		}
+		priv->old_queued++;
+	}
+
+	/* wait for each stage to drain in turn */
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_clear_pointer (&priv->plugins_pool, asb_context_pool_free);
+	g_clear_pointer (&priv->icons_pool, asb_context_pool_free);
+	g_mutex_clear (&helper.mutex);
+	if (!ret) {
+		g_clear_error (&helper.error);
+		return FALSE;
+	}
+	if (helper.error != NULL) {
+		g_propagate_error (error, helper.error);
+		return FALSE;
+	}
+
+	/* tasks finish in any order, so make the app list deterministic */
+	priv->apps = g_list_sort_with_data (priv->apps,
+					    asb_context_app_pkg_sort_cb,
+					    pkg_idx);
+	priv->apps_reused = g_list_sort_with_data (priv->apps_reused,
+						   asb_context_app_pkg_sort_cb,
+						   pkg_idx);
+	return TRUE;
+}
+
+/* the components reused from the old metadata are added after the merge
+ * plugins have run, as they were already merged in the previous run */
+static void
+asb_context_add_reused_apps (AsbContext *ctx)
+{
+	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	g_autoptr(GHashTable) hash = NULL;
+
+	/* the merge only removed duplicates from the new components */
+	hash = g_hash_table_new (g_str_hash, g_str_equal);
+	for (GList *l = priv->apps_reused; l != NULL; l = l->next) {
+		AsApp *app = AS_APP (l->data);
+		if (as_app_get_vetos(app)->len > 0)
+			continue;
+		g_hash_table_insert (hash, (gpointer) as_app_get_id (app), app);
+	}
+	for (GList *l = priv->apps; l != NULL; l = l->next) {
+		AsApp *app = AS_APP (l->data);
+		AsApp *found;
+		const gchar *tmp;
+		if (!ASB_IS_APP (app))
+			continue;
+		if (as_app_get_vetos(app)->len > 0)
+			continue;
+		found = g_hash_table_lookup (hash, as_app_get_id (app));
+		if (found == NULL)
+			continue;
+		tmp = asb_package_get_nevr (asb_app_get_package (ASB_APP (found)));
+		as_app_add_veto (app, "duplicate of %s", tmp);
+		asb_package_log (asb_app_get_package (ASB_APP (app)),
+				 ASB_PACKAGE_LOG_LEVEL_WARNING,
+				 "duplicate %s not included as added from %s",
+				 as_app_get_id (app), tmp);
+	}
+	priv->apps = g_list_concat (priv->apps, g_steal_pointer (&priv->apps_reused));
+}
+
 /**
  * asb_context_process:
  * @ctx: A #AsbContext
@@ -1031,6 +2017,11 @@ gboolean
 asb_context_process (AsbContext *ctx, GError **error)
 {
 	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(AsProfileTask) ptask_merge = NULL;
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsbContext:process");
 
 	/* only process the newest packages */
 	asb_context_disable_multiarch_pkgs (ctx);
@@ -1038,38 +2029,26 @@ asb_context_process (AsbContext *ctx, GError **error)
 
 	/* add each package */
 	g_print ("Processing packages...\n");
-	for (guint i = 0; i < priv->packages->len; i++) {
-		g_autoptr(AsbTask) task = NULL;
-		AsbPackage *pkg = g_ptr_array_index (priv->packages, i);
-		if (!asb_package_get_enabled (pkg)) {
-			asb_package_log (pkg,
-					 ASB_PACKAGE_LOG_LEVEL_DEBUG,
-					 "%s is not enabled",
-					 asb_package_get_nevr (pkg));
-			asb_context_add_app_ignore (ctx, pkg);
-			if (!asb_package_log_flush (pkg, error))
-				return FALSE;
-			continue;
-		}
-
-		/* set locations of external resources */
-		asb_package_set_config (pkg, "LogDir", priv->log_dir);
-		asb_package_set_config (pkg, "TempDir", priv->temp_dir);
-		asb_package_set_config (pkg, "IconsDir", priv->icons_dir);
-		asb_package_set_config (pkg, "OutputDir", priv->output_dir);
-
-		/* create task */
-		task = asb_task_new (ctx);
-		asb_task_set_package (task, pkg);
+	if (!asb_context_process_packages (ctx, error))
+		return FALSE;
 
-		/* run the task */
-		if (!asb_task_process (task, error))
+	/* only once every package has been processed */
+	if (priv->flags & ASB_CONTEXT_FLAG_PACKAGE_CACHE) {
+		if (!asb_context_prune_package_cache (ctx, error))
 			return FALSE;
 	}
 
+	if (priv->old_apps != NULL) {
+		g_print ("Reused %u of %u packages from old metadata\n",
+			 priv->old_reused, priv->old_queued);
+	}
+
 	/* merge */
 	g_print ("Merging applications...\n");
+	ptask_merge = as_profile_start_literal (priv->profile, "AsbContext:merge");
 	asb_plugin_loader_merge (priv->plugin_loader, priv->apps);
+	asb_context_add_reused_apps (ctx);
+	g_clear_pointer (&ptask_merge, as_profile_task_free);
 
 	/* print any warnings */
 	if ((priv->flags & ASB_CONTEXT_FLAG_IGNORE_MISSING_INFO) == 0) {
@@ -1164,6 +2143,18 @@ asb_context_find_by_pkgname (AsbContext *ctx, const gchar *pkgname)
 	return NULL;
 }
 
+static gboolean
+asb_context_app_has_pixbufs (AsbApp *app)
+{
+	GPtrArray *icons = as_app_get_icons (AS_APP (app));
+	for (guint i = 0; i < icons->len; i++) {
+		AsIcon *icon = g_ptr_array_index (icons, i);
+		if (as_icon_get_pixbuf (icon) != NULL)
+			return TRUE;
+	}
+	return FALSE;
+}
+
 /**
  * asb_context_add_app:
  * @ctx: A #AsbContext
@@ -1177,9 +2168,38 @@ void
 asb_context_add_app (AsbContext *ctx, AsbApp *app)
 {
 	AsbContextPrivate *priv = GET_PRIVATE (ctx);
+	g_autoptr(GError) error_local = NULL;
+
+	/* used to find the component in the old metadata next time */
+	if (priv->flags & ASB_CONTEXT_FLAG_ADD_CACHE_ID) {
+		AsbPackage *pkg = asb_app_get_package (app);
+		if (pkg != NULL) {
+			as_app_add_metadata (AS_APP (app), "X-CacheID",
+					     asb_package_get_nevra (pkg));
+		}
+	}
 	g_mutex_lock (&priv->apps_mutex);
 	asb_plugin_add_app (&priv->apps, AS_APP (app));
 	g_mutex_unlock (&priv->apps_mutex);
+
+	/* encode the icons while other packages are still being processed,
+	 * unless they were restored from the cache and are already saved */
+	if (priv->icons_pool != NULL && asb_context_app_has_pixbufs (app)) {
+		g_mutex_lock (&priv->icons_mutex);
+		while (priv->icons_pending >= priv->max_threads * 4)
+			g_cond_wait (&priv->icons_cond, &priv->icons_mutex);
+		priv->icons_pending++;
+		g_mutex_unlock (&priv->icons_mutex);
+		if (!g_thread_pool_push (priv->icons_pool, g_object_ref (app), &error_local)) {
+			/* saved later in asb_context_save_resources() instead */
+			g_warning ("failed to save icons early: %s", error_local->message);
+			g_object_unref (app);
+			g_mutex_lock (&priv->icons_mutex);
+			priv->icons_pending--;
+			g_cond_signal (&priv->icons_cond);
+			g_mutex_unlock (&priv->icons_mutex);
+		}
+	}
 }
 
 void
@@ -1196,6 +2216,8 @@ asb_context_add_app_ignore (AsbContext *ctx, AsbPackage *pkg)
 				     asb_package_get_arch (pkg));
 	as_app_set_id (app, name_arch);
 	as_app_add_pkgname (app, asb_package_get_name (pkg));
+	if (priv->flags & ASB_CONTEXT_FLAG_ADD_CACHE_ID)
+		as_app_add_metadata (app, "X-CacheID", asb_package_get_nevra (pkg));
 	as_store_add_app (priv->store_ignore, app);
 }
 
@@ -1208,14 +2230,32 @@ asb_context_finalize (GObject *object)
 	g_object_unref (priv->store_failed);
 	g_object_unref (priv->store_ignore);
 	g_object_unref (priv->plugin_loader);
+	g_object_unref (priv->profile);
 	g_ptr_array_unref (priv->packages);
 	g_list_foreach (priv->apps, (GFunc) g_object_unref, NULL);
 	g_list_free (priv->apps);
+	g_list_free_full (priv->apps_reused, g_object_unref);
 	if (priv->file_globs != NULL)
 		g_ptr_array_unref (priv->file_globs);
 	g_mutex_clear (&priv->apps_mutex);
+	g_mutex_clear (&priv->plugins_mutex);
+	g_cond_clear (&priv->plugins_cond);
+	g_mutex_clear (&priv->icons_mutex);
+	g_cond_clear (&priv->icons_cond);
+	g_hash_table_unref (priv->extra_pkgs);
+	g_mutex_clear (&priv->extra_pkgs_mutex);
 	g_free (priv->log_dir);
 	g_free (priv->cache_dir);
+	g_free (priv->cache_salt);
+	g_hash_table_unref (priv->cache_used);
+	g_hash_table_unref (priv->cache_checksums);
+	g_mutex_clear (&priv->cache_mutex);
+	g_free (priv->old_metadata);
+	g_free (priv->old_icons_dir);
+	if (priv->old_apps != NULL)
+		g_hash_table_unref (priv->old_apps);
+	if (priv->old_ignore != NULL)
+		g_hash_table_unref (priv->old_ignore);
 	g_free (priv->temp_dir);
 	g_free (priv->output_dir);
 	g_free (priv->icons_dir);
@@ -1231,8 +2271,20 @@ asb_context_init (AsbContext *ctx)
 	AsbContextPrivate *priv = GET_PRIVATE (ctx);
 
 	priv->plugin_loader = asb_plugin_loader_new (ctx);
+	priv->profile = as_profile_new ();
 	priv->packages = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	g_mutex_init (&priv->apps_mutex);
+	g_mutex_init (&priv->plugins_mutex);
+	g_cond_init (&priv->plugins_cond);
+	g_mutex_init (&priv->icons_mutex);
+	g_cond_init (&priv->icons_cond);
+	priv->extra_pkgs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						  (GDestroyNotify) asb_context_extra_pkg_free);
+	g_mutex_init (&priv->extra_pkgs_mutex);
+	priv->cache_used = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	priv->cache_checksums = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	g_mutex_init (&priv->cache_mutex);
+	priv->max_threads = 1;
 	priv->store_failed = as_store_new ();
 	priv->store_ignore = as_store_new ();
 	priv->min_icon_size = 32;
@@ -36,7 +36,7 @@ struct _AsbContextClass
  * @ASB_CONTEXT_FLAG_NONE:			No special actions to use
  * @ASB_CONTEXT_FLAG_IGNORE_MISSING_INFO:	Ignore missing information
  * @ASB_CONTEXT_FLAG_IGNORE_MISSING_PARENTS:	Ignore missing parents
- * @ASB_CONTEXT_FLAG_ADD_CACHE_ID:		Unused
+ * @ASB_CONTEXT_FLAG_ADD_CACHE_ID:		Add the package NEVRA to each component
  * @ASB_CONTEXT_FLAG_HIDPI_ICONS:		Unused
  * @ASB_CONTEXT_FLAG_EMBEDDED_ICONS:		Embed the icons in the XML
  * @ASB_CONTEXT_FLAG_NO_NETWORK:		Do not download files
@@ -48,6 +48,7 @@ struct _AsbContextClass
  * @ASB_CONTEXT_FLAG_IGNORE_SETTINGS:		Include apps that are marked as settings
  * @ASB_CONTEXT_FLAG_USE_FALLBACKS:		Fall back to suboptimal data where required
  * @ASB_CONTEXT_FLAG_ADD_DEFAULT_ICONS:		Add artificial icons and categories where required
+ * @ASB_CONTEXT_FLAG_PACKAGE_CACHE:		Reuse and save per-package results
  *
  * The flags to use when processing the context.
  **/
@@ -67,6 +68,7 @@ typedef enum {
 	ASB_CONTEXT_FLAG_IGNORE_SETTINGS	= 1 << 10,	/* Since: 0.4.1 */
 	ASB_CONTEXT_FLAG_USE_FALLBACKS		= 1 << 11,	/* Since: 0.4.1 */
 	ASB_CONTEXT_FLAG_ADD_DEFAULT_ICONS	= 1 << 12,	/* Since: 0.4.1 */
+	ASB_CONTEXT_FLAG_PACKAGE_CACHE		= 1 << 13,	/* Since: 0.8.5 */
 	/*< private >*/
 	ASB_CONTEXT_FLAG_LAST,
 } AsbContextFlags;
@@ -111,6 +113,7 @@ gboolean	 asb_context_get_flag		(AsbContext	*ctx,
 						 AsbContextFlags flag);
 gdouble		 asb_context_get_api_version	(AsbContext	*ctx);
 guint		 asb_context_get_min_icon_size	(AsbContext	*ctx);
+AsProfile	*asb_context_get_profile	(AsbContext	*ctx);
 
 gboolean	 asb_context_setup		(AsbContext	*ctx,
 						 GError		**error);
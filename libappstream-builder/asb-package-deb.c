@@ -171,12 +171,46 @@ asb_package_deb_explode (AsbPackage *pkg,
 	return TRUE;
 }
 
+static gboolean
+asb_package_deb_explode_memory (AsbPackage *pkg,
+				GHashTable *files,
+				GPtrArray *glob,
+				GError **error)
+{
+	guint i;
+	const gchar *data_names[] = { "/data.tar.xz",
+				      "/data.tar.bz2",
+				      "/data.tar.gz",
+				      "/data.tar.lzma",
+				      "/data.tar",
+				      NULL };
+	g_autoptr(GHashTable) members = NULL;
+
+	/* first decompress the main deb */
+	members = g_hash_table_new_full (g_str_hash, g_str_equal,
+					 g_free, (GDestroyNotify) g_bytes_unref);
+	if (!asb_utils_explode_memory (asb_package_get_filename (pkg),
+				       members, NULL, error))
+		return FALSE;
+
+	/* then decompress the data file */
+	for (i = 0; data_names[i] != NULL; i++) {
+		GBytes *data = g_hash_table_lookup (members, data_names[i]);
+		if (data == NULL)
+			continue;
+		if (!asb_utils_explode_bytes (data, files, glob, error))
+			return FALSE;
+	}
+	return TRUE;
+}
+
 static void
 asb_package_deb_class_init (AsbPackageDebClass *klass)
 {
 	AsbPackageClass *package_class = ASB_PACKAGE_CLASS (klass);
 	package_class->open = asb_package_deb_open;
 	package_class->explode = asb_package_deb_explode;
+	package_class->explode_memory = asb_package_deb_explode_memory;
 }
 
 /**
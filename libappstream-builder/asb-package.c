@@ -27,8 +27,10 @@ typedef struct
 	gboolean	 is_open;
 	gchar		**filelist;
 	guint		 filelist_refcount;
+	GHashTable	*files;		/* of path:GBytes, or NULL */
 	GPtrArray	*deps;
 	guint		 deps_refcount;
+	guint		 hold_refcount;	/* closed when this drops to zero */
 	gchar		*filename;
 	gchar		*basename;
 	gchar		*name;
@@ -52,6 +54,7 @@ typedef struct
 	GPtrArray	*releases;
 	GHashTable	*releases_hash;
 	GMutex		 mutex_log;
+	GRecMutex	 mutex;		/* for open, close, ensure and clear */
 } AsbPackagePrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (AsbPackage, asb_package, G_TYPE_OBJECT)
@@ -65,7 +68,10 @@ asb_package_finalize (GObject *object)
 	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
 
 	g_mutex_clear (&priv->mutex_log);
+	g_rec_mutex_clear (&priv->mutex);
 	g_strfreev (priv->filelist);
+	if (priv->files != NULL)
+		g_hash_table_unref (priv->files);
 	g_ptr_array_unref (priv->deps);
 	g_free (priv->filename);
 	g_free (priv->basename);
@@ -104,6 +110,7 @@ asb_package_init (AsbPackage *pkg)
 	priv->releases_hash = g_hash_table_new_full (g_str_hash, g_str_equal,
 						     g_free, (GDestroyNotify) g_object_unref);
 	g_mutex_init (&priv->mutex_log);
+	g_rec_mutex_init (&priv->mutex);
 }
 
 /**
@@ -500,6 +507,31 @@ asb_package_get_deps (AsbPackage *pkg)
 	return priv->deps;
 }
 
+/**
+ * asb_package_dup_deps:
+ * @pkg: A #AsbPackage
+ *
+ * Gets a copy of the package dependency list, which is safe to use while
+ * another task is adding to or clearing the dependencies of the package.
+ *
+ * Returns: (transfer container) (element-type utf8): deplist
+ *
+ * Since: 0.8.5
+ **/
+GPtrArray *
+asb_package_dup_deps (AsbPackage *pkg)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	GPtrArray *deps = g_ptr_array_new_with_free_func (g_free);
+	g_rec_mutex_lock (&priv->mutex);
+	for (guint i = 0; i < priv->deps->len; i++) {
+		const gchar *dep = g_ptr_array_index (priv->deps, i);
+		g_ptr_array_add (deps, g_strdup (dep));
+	}
+	g_rec_mutex_unlock (&priv->mutex);
+	return deps;
+}
+
 /**
  * asb_package_set_kind:
  * @pkg: A #AsbPackage
@@ -700,7 +732,9 @@ void
 asb_package_add_dep (AsbPackage *pkg, const gchar *dep)
 {
 	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	g_rec_mutex_lock (&priv->mutex);
 	g_ptr_array_add (priv->deps, g_strdup (dep));
+	g_rec_mutex_unlock (&priv->mutex);
 }
 
 /**
@@ -881,22 +915,8 @@ asb_package_set_filename (AsbPackage *pkg, const gchar *filename)
 	asb_package_guess_from_filename (pkg);
 }
 
-/**
- * asb_package_open:
- * @pkg: A #AsbPackage
- * @filename: package filename
- * @error: A #GError or %NULL
- *
- * Opens a package and parses the contents.
- * As little i/o should be done at this point, and implementations
- * should rely on asb_package_ensure() to set data.
- *
- * Returns: %TRUE for success, %FALSE otherwise
- *
- * Since: 0.1.0
- **/
-gboolean
-asb_package_open (AsbPackage *pkg, const gchar *filename, GError **error)
+static gboolean
+asb_package_open_unlocked (AsbPackage *pkg, const gchar *filename, GError **error)
 {
 	AsbPackageClass *klass = ASB_PACKAGE_GET_CLASS (pkg);
 	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
@@ -916,19 +936,8 @@ asb_package_open (AsbPackage *pkg, const gchar *filename, GError **error)
 	return TRUE;
 }
 
-/**
- * asb_package_close:
- * @pkg: A #AsbPackage
- * @error: A #GError or %NULL
- *
- * Closes a package, which can be re-opened if required.
- *
- * Returns: %TRUE for success, %FALSE otherwise
- *
- * Since: 0.3.5
- **/
-gboolean
-asb_package_close (AsbPackage *pkg, GError **error)
+static gboolean
+asb_package_close_unlocked (AsbPackage *pkg, GError **error)
 {
 	AsbPackageClass *klass = ASB_PACKAGE_GET_CLASS (pkg);
 	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
@@ -936,6 +945,10 @@ asb_package_close (AsbPackage *pkg, GError **error)
 	/* already closed */
 	if (!priv->is_open)
 		return TRUE;
+
+	/* the last holder closes it */
+	if (priv->hold_refcount > 0)
+		return TRUE;
 	priv->is_open = FALSE;
 
 	/* call distro-specific method */
@@ -944,29 +957,17 @@ asb_package_close (AsbPackage *pkg, GError **error)
 	return TRUE;
 }
 
-/**
- * asb_package_ensure:
- * @pkg: A #AsbPackage
- * @flags: #AsbPackageEnsureFlags
- * @error: A #GError or %NULL
- *
- * Ensures data exists.
- *
- * Returns: %TRUE for success, %FALSE otherwise
- *
- * Since: 0.3.0
- **/
-gboolean
-asb_package_ensure (AsbPackage *pkg,
-		    AsbPackageEnsureFlags flags,
-		    GError **error)
+static gboolean
+asb_package_ensure_unlocked (AsbPackage *pkg,
+			     AsbPackageEnsureFlags flags,
+			     GError **error)
 {
 	AsbPackageClass *klass = ASB_PACKAGE_GET_CLASS (pkg);
 	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
 
 	/* reopen as required */
 	if (!priv->is_open) {
-		if (!asb_package_open (pkg, priv->filename, error))
+		if (!asb_package_open_unlocked (pkg, priv->filename, error))
 			return FALSE;
 	}
 
@@ -1005,16 +1006,83 @@ asb_package_ensure (AsbPackage *pkg,
 }
 
 /**
- * asb_package_clear:
+ * asb_package_open:
  * @pkg: A #AsbPackage
- * @flags: #AsbPackageEnsureFlags
+ * @filename: package filename
+ * @error: A #GError or %NULL
  *
- * Deallocates previously ensured data.
+ * Opens a package and parses the contents.
+ * As little i/o should be done at this point, and implementations
+ * should rely on asb_package_ensure() to set data.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.1.0
+ **/
+gboolean
+asb_package_open (AsbPackage *pkg, const gchar *filename, GError **error)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	gboolean ret;
+	g_rec_mutex_lock (&priv->mutex);
+	ret = asb_package_open_unlocked (pkg, filename, error);
+	g_rec_mutex_unlock (&priv->mutex);
+	return ret;
+}
+
+/**
+ * asb_package_close:
+ * @pkg: A #AsbPackage
+ * @error: A #GError or %NULL
+ *
+ * Closes a package, which can be re-opened if required. A package held
+ * with asb_package_hold() is instead closed by the last asb_package_unhold().
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
  *
  * Since: 0.3.5
  **/
-void
-asb_package_clear (AsbPackage *pkg, AsbPackageEnsureFlags flags)
+gboolean
+asb_package_close (AsbPackage *pkg, GError **error)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	gboolean ret;
+	g_rec_mutex_lock (&priv->mutex);
+	ret = asb_package_close_unlocked (pkg, error);
+	g_rec_mutex_unlock (&priv->mutex);
+	return ret;
+}
+
+/**
+ * asb_package_ensure:
+ * @pkg: A #AsbPackage
+ * @flags: #AsbPackageEnsureFlags
+ * @error: A #GError or %NULL
+ *
+ * Ensures data exists.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.3.0
+ **/
+gboolean
+asb_package_ensure (AsbPackage *pkg,
+		    AsbPackageEnsureFlags flags,
+		    GError **error)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	gboolean ret;
+
+	/* the same package can be used as an extra package by several
+	 * tasks running at the same time */
+	g_rec_mutex_lock (&priv->mutex);
+	ret = asb_package_ensure_unlocked (pkg, flags, error);
+	g_rec_mutex_unlock (&priv->mutex);
+	return ret;
+}
+
+static void
+asb_package_clear_unlocked (AsbPackage *pkg, AsbPackageEnsureFlags flags)
 {
 	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
 
@@ -1027,10 +1095,95 @@ asb_package_clear (AsbPackage *pkg, AsbPackageEnsureFlags flags)
 		if (priv->filelist_refcount > 0 && --priv->filelist_refcount == 0) {
 			g_strfreev (priv->filelist);
 			priv->filelist = NULL;
+			g_clear_pointer (&priv->files, g_hash_table_unref);
 		}
 	}
 }
 
+/**
+ * asb_package_clear:
+ * @pkg: A #AsbPackage
+ * @flags: #AsbPackageEnsureFlags
+ *
+ * Deallocates previously ensured data.
+ *
+ * Since: 0.3.5
+ **/
+void
+asb_package_clear (AsbPackage *pkg, AsbPackageEnsureFlags flags)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	g_rec_mutex_lock (&priv->mutex);
+	asb_package_clear_unlocked (pkg, flags);
+	g_rec_mutex_unlock (&priv->mutex);
+}
+
+/**
+ * asb_package_hold:
+ * @pkg: A #AsbPackage
+ * @flags: #AsbPackageEnsureFlags
+ * @error: A #GError or %NULL
+ *
+ * Ensures data exists and keeps the package open until the matching call
+ * to asb_package_unhold(). While the package is held asb_package_close()
+ * does nothing, so a task using the package cannot close it under another
+ * task that is using it at the same time.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_package_hold (AsbPackage *pkg,
+		  AsbPackageEnsureFlags flags,
+		  GError **error)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	gboolean ret;
+
+	g_rec_mutex_lock (&priv->mutex);
+	priv->hold_refcount++;
+	ret = asb_package_ensure_unlocked (pkg, flags, error);
+	if (!ret) {
+		asb_package_clear_unlocked (pkg, flags);
+		priv->hold_refcount--;
+	}
+	g_rec_mutex_unlock (&priv->mutex);
+	return ret;
+}
+
+/**
+ * asb_package_unhold:
+ * @pkg: A #AsbPackage
+ * @flags: #AsbPackageEnsureFlags
+ * @error: A #GError or %NULL
+ *
+ * Deallocates the data ensured by asb_package_hold(), and closes the package
+ * if this was the last holder.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_package_unhold (AsbPackage *pkg,
+		    AsbPackageEnsureFlags flags,
+		    GError **error)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	gboolean ret = TRUE;
+
+	g_rec_mutex_lock (&priv->mutex);
+	asb_package_clear_unlocked (pkg, flags);
+	if (priv->hold_refcount == 0) {
+		g_warning ("package %s was not held", priv->filename);
+	} else if (--priv->hold_refcount == 0) {
+		ret = asb_package_close_unlocked (pkg, error);
+	}
+	g_rec_mutex_unlock (&priv->mutex);
+	return ret;
+}
+
 /**
  * asb_package_explode:
  * @pkg: A #AsbPackage
@@ -1057,6 +1210,161 @@ asb_package_explode (AsbPackage *pkg,
 	return asb_utils_explode (priv->filename, dir, glob, error);
 }
 
+/**
+ * asb_package_explode_memory:
+ * @pkg: A #AsbPackage
+ * @files: (element-type utf8 GBytes): a hash table to add the files to
+ * @glob: (element-type utf8): the glob list, or %NULL
+ * @error: A #GError or %NULL
+ *
+ * Decompresses a package into memory, optionally using a glob list.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_package_explode_memory (AsbPackage *pkg,
+			    GHashTable *files,
+			    GPtrArray *glob,
+			    GError **error)
+{
+	AsbPackageClass *klass = ASB_PACKAGE_GET_CLASS (pkg);
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	if (klass->explode_memory != NULL)
+		return klass->explode_memory (pkg, files, glob, error);
+	return asb_utils_explode_memory (priv->filename, files, glob, error);
+}
+
+/**
+ * asb_package_set_files:
+ * @pkg: A #AsbPackage
+ * @files: (element-type utf8 GBytes) (nullable): decompressed files, or %NULL
+ *
+ * Sets the files decompressed into memory using asb_package_explode_memory(),
+ * which are used in preference to the temporary directory until
+ * asb_package_write_files() is called.
+ *
+ * Since: 0.8.5
+ **/
+void
+asb_package_set_files (AsbPackage *pkg, GHashTable *files)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	g_rec_mutex_lock (&priv->mutex);
+	if (priv->files != NULL)
+		g_hash_table_unref (priv->files);
+	priv->files = files != NULL ? g_hash_table_ref (files) : NULL;
+	g_rec_mutex_unlock (&priv->mutex);
+}
+
+/**
+ * asb_package_dup_files:
+ * @pkg: A #AsbPackage
+ *
+ * Gets the files decompressed into memory, which can be used instead of the
+ * temporary directory by plugins that set %ASB_PLUGIN_FLAG_IN_MEMORY.
+ *
+ * Returns: (transfer container) (element-type utf8 GBytes) (nullable): the
+ * files, or %NULL if they have been written to the temporary directory
+ *
+ * Since: 0.8.5
+ **/
+GHashTable *
+asb_package_dup_files (AsbPackage *pkg)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	GHashTable *files = NULL;
+	g_rec_mutex_lock (&priv->mutex);
+	if (priv->files != NULL)
+		files = g_hash_table_ref (priv->files);
+	g_rec_mutex_unlock (&priv->mutex);
+	return files;
+}
+
+/**
+ * asb_package_get_file_data:
+ * @pkg: A #AsbPackage
+ * @tmpdir: the directory the package is exploded into
+ * @filename: the filename in the package, e.g. `/usr/share/metainfo/foo.xml`
+ * @error: A #GError or %NULL
+ *
+ * Gets the contents of a file from the package, either from memory or from
+ * the temporary directory if the files have already been written.
+ *
+ * Returns: (transfer full): the file data, or %NULL for error
+ *
+ * Since: 0.8.5
+ **/
+GBytes *
+asb_package_get_file_data (AsbPackage *pkg,
+			   const gchar *tmpdir,
+			   const gchar *filename,
+			   GError **error)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	GBytes *blob = NULL;
+	gchar *data = NULL;
+	gsize len = 0;
+	g_autofree gchar *fn = NULL;
+
+	g_rec_mutex_lock (&priv->mutex);
+	if (priv->files != NULL) {
+		blob = g_hash_table_lookup (priv->files, filename);
+		if (blob != NULL)
+			g_bytes_ref (blob);
+		g_rec_mutex_unlock (&priv->mutex);
+		if (blob == NULL) {
+			g_set_error (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_FAILED,
+				     "%s was not decompressed",
+				     filename);
+		}
+		return blob;
+	}
+	g_rec_mutex_unlock (&priv->mutex);
+
+	/* fall back to the tree on disk */
+	fn = g_build_filename (tmpdir, filename, NULL);
+	if (!g_file_get_contents (fn, &data, &len, error))
+		return NULL;
+	return g_bytes_new_take (data, len);
+}
+
+/**
+ * asb_package_write_files:
+ * @pkg: A #AsbPackage
+ * @tmpdir: the directory to write into
+ * @error: A #GError or %NULL
+ *
+ * Writes any files decompressed into memory into the temporary directory
+ * for plugins that need a real tree, and then frees the in-memory copy.
+ * This does nothing if the files have already been written.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_package_write_files (AsbPackage *pkg, const gchar *tmpdir, GError **error)
+{
+	AsbPackagePrivate *priv = GET_PRIVATE (pkg);
+	gboolean ret = TRUE;
+
+	g_rec_mutex_lock (&priv->mutex);
+	if (priv->files != NULL) {
+		asb_package_log (pkg,
+				 ASB_PACKAGE_LOG_LEVEL_DEBUG,
+				 "Writing %u files to %s",
+				 g_hash_table_size (priv->files), tmpdir);
+		ret = asb_utils_write_files (priv->files, tmpdir, error);
+		g_clear_pointer (&priv->files, g_hash_table_unref);
+	}
+	g_rec_mutex_unlock (&priv->mutex);
+	return ret;
+}
+
 /**
  * asb_package_set_config:
  * @pkg: A #AsbPackage
@@ -45,8 +45,11 @@ struct _AsbPackageClass
 						 AsbPackage	*pkg2);
 	gboolean		 (*close)	(AsbPackage	*pkg,
 						 GError		**error);
+	gboolean		 (*explode_memory) (AsbPackage	*pkg,
+						 GHashTable	*files,
+						 GPtrArray	*glob,
+						 GError		**error);
 	/*< private >*/
-	void (*_asb_reserved1)	(void);
 	void (*_asb_reserved2)	(void);
 	void (*_asb_reserved3)	(void);
 	void (*_asb_reserved4)	(void);
@@ -88,10 +91,30 @@ gboolean	 asb_package_ensure		(AsbPackage	*pkg,
 						 GError		**error);
 void		 asb_package_clear		(AsbPackage	*pkg,
 						 AsbPackageEnsureFlags flags);
+gboolean	 asb_package_hold		(AsbPackage	*pkg,
+						 AsbPackageEnsureFlags flags,
+						 GError		**error);
+gboolean	 asb_package_unhold		(AsbPackage	*pkg,
+						 AsbPackageEnsureFlags flags,
+						 GError		**error);
 gboolean	 asb_package_explode		(AsbPackage	*pkg,
 						 const gchar	*dir,
 						 GPtrArray	*glob,
 						 GError		**error);
+gboolean	 asb_package_explode_memory	(AsbPackage	*pkg,
+						 GHashTable	*files,
+						 GPtrArray	*glob,
+						 GError		**error);
+void		 asb_package_set_files		(AsbPackage	*pkg,
+						 GHashTable	*files);
+GHashTable	*asb_package_dup_files		(AsbPackage	*pkg);
+GBytes		*asb_package_get_file_data	(AsbPackage	*pkg,
+						 const gchar	*tmpdir,
+						 const gchar	*filename,
+						 GError		**error);
+gboolean	 asb_package_write_files	(AsbPackage	*pkg,
+						 const gchar	*tmpdir,
+						 GError		**error);
 AsbPackageKind	 asb_package_get_kind		(AsbPackage	*pkg);
 guint		 asb_package_get_epoch		(AsbPackage	*pkg);
 const gchar	*asb_package_get_filename	(AsbPackage	*pkg);
@@ -138,6 +161,7 @@ void		 asb_package_set_filelist	(AsbPackage	*pkg,
 						 gchar		**filelist);
 gchar		**asb_package_get_filelist	(AsbPackage	*pkg);
 GPtrArray	*asb_package_get_deps		(AsbPackage	*pkg);
+GPtrArray	*asb_package_dup_deps		(AsbPackage	*pkg);
 GPtrArray	*asb_package_get_releases	(AsbPackage	*pkg);
 void		 asb_package_set_config		(AsbPackage	*pkg,
 						 const gchar	*key,
@@ -159,6 +159,8 @@ asb_plugin_loader_process_app (AsbPluginLoader *plugin_loader,
 				 ASB_PACKAGE_LOG_LEVEL_DEBUG,
 				 "Running asb_plugin_process_app() from %s",
 				 plugin->name);
+		if (!asb_plugin_ensure_files (plugin, pkg, tmpdir, error))
+			return FALSE;
 		if (!plugin_func (plugin, pkg, app, tmpdir, &error_local)) {
 			asb_package_log (pkg,
 					 ASB_PACKAGE_LOG_LEVEL_WARNING,
@@ -21,6 +21,35 @@
 #include "asb-plugin.h"
 #include "asb-utils.h"
 
+/**
+ * asb_plugin_ensure_files:
+ * @plugin: A #AsbPlugin
+ * @pkg: A #AsbPackage
+ * @tmpdir: the temporary location
+ * @error: A #GError or %NULL
+ *
+ * Writes the package files to @tmpdir if the plugin does not set
+ * %ASB_PLUGIN_FLAG_IN_MEMORY and so expects a real tree on disk.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_plugin_ensure_files (AsbPlugin *plugin,
+			 AsbPackage *pkg,
+			 const gchar *tmpdir,
+			 GError **error)
+{
+	AsbPluginGetFlagsFunc plugin_func = NULL;
+	if (g_module_symbol (plugin->module,
+			     "asb_plugin_get_flags",
+			     (gpointer *) &plugin_func) &&
+	    (plugin_func () & ASB_PLUGIN_FLAG_IN_MEMORY) > 0)
+		return TRUE;
+	return asb_package_write_files (pkg, tmpdir, error);
+}
+
 /**
  * asb_plugin_process:
  * @plugin: A #AsbPlugin
@@ -58,6 +87,8 @@ asb_plugin_process (AsbPlugin *plugin,
 				     "no asb_plugin_process");
 		return NULL;
 	}
+	if (!asb_plugin_ensure_files (plugin, pkg, tmpdir, error))
+		return NULL;
 	return plugin_func (plugin, pkg, tmpdir, error);
 }
 
@@ -37,12 +37,27 @@ typedef enum {
 	ASB_PLUGIN_ERROR_LAST
 } AsbPluginError;
 
+/**
+ * AsbPluginFlags:
+ * @ASB_PLUGIN_FLAG_NONE:		No special flags set
+ * @ASB_PLUGIN_FLAG_IN_MEMORY:		Does not need the package exploded on disk
+ *
+ * The flags returned by the optional asb_plugin_get_flags() vfunc.
+ **/
+typedef enum {
+	ASB_PLUGIN_FLAG_NONE		= 0,
+	ASB_PLUGIN_FLAG_IN_MEMORY	= 1 << 0,	/* Since: 0.8.5 */
+	/*< private >*/
+	ASB_PLUGIN_FLAG_LAST,
+} AsbPluginFlags;
+
 /* helpers */
 #define	ASB_PLUGIN_ERROR				1
 #define	ASB_PLUGIN_GET_PRIVATE(x)			g_new0 (x,1)
 #define	ASB_PLUGIN(x)					((AsbPlugin *) x);
 
 typedef const gchar	*(*AsbPluginGetNameFunc)	(void);
+typedef AsbPluginFlags	 (*AsbPluginGetFlagsFunc)	(void);
 typedef void		 (*AsbPluginFunc)		(AsbPlugin	*plugin);
 typedef void		 (*AsbPluginGetGlobsFunc)	(AsbPlugin	*plugin,
 							 GPtrArray	*array);
@@ -61,6 +76,7 @@ typedef gboolean	 (*AsbPluginProcessAppFunc)	(AsbPlugin	*plugin,
 							 GError		**error);
 
 const gchar	*asb_plugin_get_name			(void);
+AsbPluginFlags	 asb_plugin_get_flags			(void);
 void		 asb_plugin_initialize			(AsbPlugin	*plugin);
 void		 asb_plugin_destroy			(AsbPlugin	*plugin);
 GList		*asb_plugin_process			(AsbPlugin	*plugin,
@@ -76,6 +92,10 @@ gboolean	 asb_plugin_process_app			(AsbPlugin	*plugin,
 							 AsbApp		*app,
 							 const gchar	*tmp_dir,
 							 GError		**error);
+gboolean	 asb_plugin_ensure_files		(AsbPlugin	*plugin,
+							 AsbPackage	*pkg,
+							 const gchar	*tmpdir,
+							 GError		**error);
 gboolean	 asb_plugin_check_filename		(AsbPlugin	*plugin,
 							 const gchar	*filename);
 void		 asb_plugin_add_app			(GList		**list,
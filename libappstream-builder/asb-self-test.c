@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <locale.h>
 #include <fnmatch.h>
+#include <string.h>
 
 #include "asb-context-private.h"
 #include "asb-plugin.h"
@@ -79,7 +80,13 @@ asb_test_package_rpm_func (void)
 	gboolean ret;
 	gchar *tmp;
 	g_autofree gchar *filename = NULL;
+	g_autoptr(AsbContext) ctx = NULL;
 	g_autoptr(AsbPackage) pkg = NULL;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GBytes) blob2 = NULL;
+	g_autoptr(GHashTable) files = NULL;
+	g_autoptr(GHashTable) files_extra1 = NULL;
+	g_autoptr(GHashTable) files_extra2 = NULL;
 	g_autoptr(GPtrArray) glob = NULL;
 
 	/* open file */
@@ -189,6 +196,51 @@ asb_test_package_rpm_func (void)
 	g_assert_no_error (error);
 	g_assert (ret);
 	g_assert (g_file_test ("/tmp/asb-test/usr/share/test-0.1/README", G_FILE_TEST_EXISTS));
+
+	/* explode into memory, then write */
+	ret = asb_utils_ensure_exists_and_empty ("/tmp/asb-test", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	files = g_hash_table_new_full (g_str_hash, g_str_equal,
+				       g_free, (GDestroyNotify) g_bytes_unref);
+	ret = asb_package_explode_memory (pkg, files, glob, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert (g_hash_table_lookup (files, "/usr/share/test-0.1/README") != NULL);
+	g_assert (!g_file_test ("/tmp/asb-test/usr/share/test-0.1/README", G_FILE_TEST_EXISTS));
+	asb_package_set_files (pkg, files);
+	blob = asb_package_get_file_data (pkg, "/tmp/asb-test", "/usr/share/test-0.1/README", &error);
+	g_assert_no_error (error);
+	g_assert (blob != NULL);
+	ret = asb_package_write_files (pkg, "/tmp/asb-test", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert (g_file_test ("/tmp/asb-test/usr/share/test-0.1/README", G_FILE_TEST_EXISTS));
+	blob2 = asb_package_get_file_data (pkg, "/tmp/asb-test", "/usr/share/test-0.1/README", &error);
+	g_assert_no_error (error);
+	g_assert (blob2 != NULL);
+	g_assert (g_bytes_equal (blob, blob2));
+
+	/* explode as an extra package shared by two tasks */
+	ctx = asb_context_new ();
+	files_extra1 = asb_context_explode_extra_package (ctx, pkg, &error);
+	g_assert_no_error (error);
+	g_assert (files_extra1 != NULL);
+	files_extra2 = asb_context_explode_extra_package (ctx, pkg, &error);
+	g_assert_no_error (error);
+	g_assert (files_extra1 == files_extra2);
+	g_assert (g_hash_table_lookup (files_extra1, "/usr/share/test-0.1/README") != NULL);
+	asb_context_release_extra_package (ctx, pkg);
+	asb_context_release_extra_package (ctx, pkg);
+
+	/* explode as an extra package on disk */
+	ret = asb_utils_ensure_exists_and_empty ("/tmp/asb-test", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = asb_context_explode_extra_package_dir (ctx, pkg, "/tmp/asb-test", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert (g_file_test ("/tmp/asb-test/usr/share/test-0.1/README", G_FILE_TEST_EXISTS));
 }
 #endif
 
@@ -228,6 +280,37 @@ asb_test_package_func (void)
 	asb_package_set_release (pkg2, "2.fc22");
 }
 
+static void
+asb_test_package_hold_func (void)
+{
+	gboolean ret;
+	g_autoptr(AsbPackage) pkg = asb_package_new ();
+	g_autoptr(GError) error = NULL;
+
+	/* another task is exploding it as an extra package */
+	asb_package_set_filename (pkg, "/tmp/gambit-c-doc-4.7.3-2.fc22.noarch.rpm");
+	ret = asb_package_hold (pkg, ASB_PACKAGE_ENSURE_DEPS, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	asb_package_add_dep (pkg, "gambit-c");
+
+	/* the task for the package finishes first */
+	ret = asb_package_ensure (pkg, ASB_PACKAGE_ENSURE_DEPS, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = asb_package_close (pkg, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	asb_package_clear (pkg, ASB_PACKAGE_ENSURE_DEPS);
+	g_assert_cmpint (asb_package_get_deps (pkg)->len, ==, 1);
+
+	/* the last user frees it */
+	ret = asb_package_unhold (pkg, ASB_PACKAGE_ENSURE_DEPS, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (asb_package_get_deps (pkg)->len, ==, 0);
+}
+
 static void
 asb_test_package_guess_from_fn_func (void)
 {
@@ -256,6 +339,279 @@ asb_test_utils_glob_func (void)
 	g_assert_cmpstr (asb_glob_value_search (array, "gimp.appdata.xml"), ==, "APPDATA");
 }
 
+static void
+asb_test_utils_archive_func (void)
+{
+	gboolean ret;
+	gsize len1 = 0;
+	gsize len2 = 0;
+	g_autofree gchar *data1 = NULL;
+	g_autofree gchar *data2 = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) files = NULL;
+
+	/* enough files to need several chunks */
+	ret = asb_utils_ensure_exists_and_empty ("/tmp/asb-test-archive/src/64x64", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	for (guint i = 0; i < 300; i++) {
+		g_autofree gchar *fn = NULL;
+		g_autofree gchar *data = NULL;
+		fn = g_strdup_printf ("/tmp/asb-test-archive/src/64x64/icon%03u.png", i);
+		data = g_strdup_printf ("icon %u", i);
+		ret = g_file_set_contents (fn, data, -1, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+	}
+
+	/* the output does not depend on the number or timing of the threads */
+	ret = asb_utils_write_archive_dir ("/tmp/asb-test-archive/1.tar.gz",
+					   "/tmp/asb-test-archive/src", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = asb_utils_write_archive_dir_full ("/tmp/asb-test-archive/2.tar.gz",
+						"/tmp/asb-test-archive/src",
+						1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = g_file_get_contents ("/tmp/asb-test-archive/1.tar.gz", &data1, &len1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = g_file_get_contents ("/tmp/asb-test-archive/2.tar.gz", &data2, &len2, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (len1, ==, len2);
+	g_assert (memcmp (data1, data2, len1) == 0);
+
+	/* every member is read back */
+	files = g_hash_table_new_full (g_str_hash, g_str_equal,
+				       g_free, (GDestroyNotify) g_bytes_unref);
+	ret = asb_utils_explode_memory ("/tmp/asb-test-archive/1.tar.gz", files, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (g_hash_table_size (files), ==, 300);
+	g_assert (g_hash_table_lookup (files, "/64x64/icon000.png") != NULL);
+	g_assert (g_hash_table_lookup (files, "/64x64/icon299.png") != NULL);
+}
+
+static void
+asb_test_utils_png_func (void)
+{
+	GdkPixbuf *pixbuf2;
+	gboolean ret;
+	guint8 *pixels;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GdkPixbufLoader) loader = NULL;
+	g_autoptr(GError) error = NULL;
+
+	/* a few colors, one fully transparent, one translucent */
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, TRUE, 8, 16, 16);
+	pixels = gdk_pixbuf_get_pixels (pixbuf);
+	for (guint y = 0; y < 16; y++) {
+		for (guint x = 0; x < 16; x++) {
+			guint8 *p = pixels + y * gdk_pixbuf_get_rowstride (pixbuf) + x * 4;
+			p[0] = (guint8) (x * 16);
+			p[1] = (guint8) (y * 16);
+			p[2] = 0x80;
+			p[3] = x == 0 ? 0x00 : x == 1 ? 0x80 : 0xff;
+			if (p[3] == 0)
+				p[0] = p[1] = p[2] = 0;
+		}
+	}
+
+	/* fewer than 256 colors are encoded exactly */
+	blob = asb_utils_png_encode_paletted (pixbuf, &error);
+	g_assert_no_error (error);
+	g_assert (blob != NULL);
+	loader = gdk_pixbuf_loader_new_with_type ("png", &error);
+	g_assert_no_error (error);
+	g_assert (loader != NULL);
+	ret = gdk_pixbuf_loader_write_bytes (loader, blob, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = gdk_pixbuf_loader_close (loader, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	pixbuf2 = gdk_pixbuf_loader_get_pixbuf (loader);
+	g_assert (pixbuf2 != NULL);
+	g_assert_cmpint (gdk_pixbuf_get_width (pixbuf2), ==, 16);
+	g_assert_cmpint (gdk_pixbuf_get_height (pixbuf2), ==, 16);
+	g_assert (gdk_pixbuf_get_has_alpha (pixbuf2));
+	for (guint y = 0; y < 16; y++) {
+		const guint8 *p1 = pixels + y * gdk_pixbuf_get_rowstride (pixbuf);
+		const guint8 *p2 = gdk_pixbuf_read_pixels (pixbuf2) +
+				   y * gdk_pixbuf_get_rowstride (pixbuf2);
+		g_assert (memcmp (p1, p2, 16 * 4) == 0);
+	}
+}
+
+static void
+asb_test_utils_add_files_func (void)
+{
+	gboolean ret;
+	g_autofree gchar *data = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GHashTable) files = NULL;
+	g_autoptr(GHashTable) files_extra = NULL;
+
+	/* the main package and an extra package both ship the same path */
+	files = g_hash_table_new_full (g_str_hash, g_str_equal,
+				       g_free, (GDestroyNotify) g_bytes_unref);
+	files_extra = g_hash_table_new_full (g_str_hash, g_str_equal,
+					     g_free, (GDestroyNotify) g_bytes_unref);
+	g_hash_table_insert (files, g_strdup ("/usr/share/app/conflict.txt"),
+			     g_bytes_new_static ("main", 4));
+	g_hash_table_insert (files_extra, g_strdup ("/usr/share/app/conflict.txt"),
+			     g_bytes_new_static ("extra", 5));
+	g_hash_table_insert (files_extra, g_strdup ("/usr/share/app/extra.txt"),
+			     g_bytes_new_static ("extra", 5));
+
+	/* the file from the main package is kept in memory */
+	asb_utils_add_files (files, files_extra);
+	g_assert_cmpint (g_hash_table_size (files), ==, 2);
+	g_assert_cmpint (g_bytes_get_size (g_hash_table_lookup (files, "/usr/share/app/conflict.txt")), ==, 4);
+	g_assert (g_hash_table_lookup (files, "/usr/share/app/extra.txt") != NULL);
+
+	/* ...and on disk */
+	ret = asb_utils_ensure_exists_and_empty ("/tmp/asb-test-add-files", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = asb_utils_write_files (files, "/tmp/asb-test-add-files", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = asb_utils_write_files (files_extra, "/tmp/asb-test-add-files", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = g_file_get_contents ("/tmp/asb-test-add-files/usr/share/app/conflict.txt",
+				   &data, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpstr (data, ==, "main");
+}
+
+static GdkPixbuf *
+asb_test_utils_png_decode (GBytes *blob)
+{
+	gboolean ret;
+	g_autoptr(GdkPixbufLoader) loader = NULL;
+	g_autoptr(GError) error = NULL;
+
+	loader = gdk_pixbuf_loader_new_with_type ("png", &error);
+	g_assert_no_error (error);
+	g_assert (loader != NULL);
+	ret = gdk_pixbuf_loader_write_bytes (loader, blob, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = gdk_pixbuf_loader_close (loader, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	return g_object_ref (gdk_pixbuf_loader_get_pixbuf (loader));
+}
+
+static void
+asb_test_utils_png_lossy_func (void)
+{
+	guint64 diff = 0;
+	guint8 *pixels;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GBytes) blob_noise = NULL;
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GdkPixbuf) pixbuf2 = NULL;
+	g_autoptr(GdkPixbuf) pixbuf_noise = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GRand) rand = g_rand_new_with_seed (1);
+
+	/* a smooth gradient with more than 256 colors */
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 64, 64);
+	pixels = gdk_pixbuf_get_pixels (pixbuf);
+	for (guint y = 0; y < 64; y++) {
+		for (guint x = 0; x < 64; x++) {
+			guint8 *p = pixels + y * gdk_pixbuf_get_rowstride (pixbuf) + x * 3;
+			p[0] = (guint8) (x + 0x40);
+			p[1] = (guint8) (y + 0x40);
+			p[2] = 0x80;
+		}
+	}
+
+	/* this is dithered, and looks much like the original */
+	blob = asb_utils_png_encode_paletted (pixbuf, &error);
+	g_assert_no_error (error);
+	g_assert (blob != NULL);
+	pixbuf2 = asb_test_utils_png_decode (blob);
+	g_assert_cmpint (gdk_pixbuf_get_width (pixbuf2), ==, 64);
+	g_assert_cmpint (gdk_pixbuf_get_height (pixbuf2), ==, 64);
+	for (guint y = 0; y < 64; y++) {
+		const guint8 *p1 = pixels + y * gdk_pixbuf_get_rowstride (pixbuf);
+		const guint8 *p2 = gdk_pixbuf_read_pixels (pixbuf2) +
+				   y * gdk_pixbuf_get_rowstride (pixbuf2);
+		guint n_channels2 = (guint) gdk_pixbuf_get_n_channels (pixbuf2);
+		for (guint x = 0; x < 64; x++) {
+			for (guint j = 0; j < 3; j++)
+				diff += (guint64) ABS (p1[x * 3 + j] - p2[x * n_channels2 + j]);
+		}
+	}
+	g_assert_cmpint (diff / (64 * 64 * 3), <, 4);
+
+	/* random noise can not be reduced to 256 colors */
+	pixbuf_noise = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 64, 64);
+	pixels = gdk_pixbuf_get_pixels (pixbuf_noise);
+	for (guint y = 0; y < 64; y++) {
+		for (guint x = 0; x < 64 * 3; x++) {
+			guint8 *p = pixels + y * gdk_pixbuf_get_rowstride (pixbuf_noise) + x;
+			*p = (guint8) g_rand_int_range (rand, 0, 256);
+		}
+	}
+	blob_noise = asb_utils_png_encode_paletted (pixbuf_noise, &error);
+	g_assert_error (error, ASB_PLUGIN_ERROR, ASB_PLUGIN_ERROR_NOT_SUPPORTED);
+	g_assert (blob_noise == NULL);
+}
+
+static void
+asb_test_utils_png_lossless_func (void)
+{
+	const gchar *fn = "/tmp/asb-test-screenshot.png";
+	gboolean ret;
+	gsize len = 0;
+	gsize len_orig = 0;
+	guint8 *pixels;
+	g_autofree gchar *data = NULL;
+	g_autofree gchar *data_orig = NULL;
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GPtrArray) filenames = NULL;
+
+	/* a gradient with more than 256 colors, like a screenshot */
+	pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, 64, 64);
+	pixels = gdk_pixbuf_get_pixels (pixbuf);
+	for (guint y = 0; y < 64; y++) {
+		for (guint x = 0; x < 64; x++) {
+			guint8 *p = pixels + y * gdk_pixbuf_get_rowstride (pixbuf) + x * 3;
+			p[0] = (guint8) (x * 4);
+			p[1] = (guint8) (y * 4);
+			p[2] = 0x80;
+		}
+	}
+	ret = gdk_pixbuf_save (pixbuf, fn, "png", &error, NULL);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = g_file_get_contents (fn, &data_orig, &len_orig, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the batch optimizer never reduces the colors */
+	filenames = g_ptr_array_new ();
+	g_ptr_array_add (filenames, (gpointer) fn);
+	ret = asb_utils_optimize_pngs (filenames, 0, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = g_file_get_contents (fn, &data, &len, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (len, ==, len_orig);
+	g_assert (memcmp (data, data_orig, len) == 0);
+}
+
 static void
 asb_test_plugin_loader_func (void)
 {
@@ -296,10 +652,10 @@ asb_test_plugin_loader_func (void)
 	g_assert_cmpstr (plugin->name, ==, "appdata");
 }
 
+#ifdef HAVE_RPM
 static void
-asb_test_context_func (void)
+asb_test_context_run (guint max_threads)
 {
-#ifdef HAVE_RPM
 	AsApp *app;
 	AsbPluginLoader *loader;
 	GError *error = NULL;
@@ -341,7 +697,7 @@ asb_test_context_func (void)
 
 	/* set up the context */
 	ctx = asb_context_new ();
-	asb_context_set_max_threads (ctx, 1);
+	asb_context_set_max_threads (ctx, max_threads);
 	asb_context_set_api_version (ctx, 0.9);
 	asb_context_set_flags (ctx, ASB_CONTEXT_FLAG_NO_NETWORK |
 				    ASB_CONTEXT_FLAG_INCLUDE_FAILED |
@@ -627,6 +983,234 @@ asb_test_context_func (void)
 	g_assert (g_file_test ("/tmp/asbuilder/temp/icons/64x64/app.png", G_FILE_TEST_EXISTS));
 	g_assert (g_file_test ("/tmp/asbuilder/temp/icons/128x128/app.png", G_FILE_TEST_EXISTS));
 	g_assert (!g_file_test ("/tmp/asbuilder/temp/icons/app.png", G_FILE_TEST_EXISTS));
+}
+#endif
+
+static void
+asb_test_context_func (void)
+{
+#ifdef HAVE_RPM
+	asb_test_context_run (1);
+#endif
+}
+
+static void
+asb_test_context_threads_func (void)
+{
+#ifdef HAVE_RPM
+	/* the output has to be the same whatever order packages finish in */
+	asb_test_context_run (4);
+#endif
+}
+
+#ifdef HAVE_RPM
+static gchar *
+asb_test_context_process_subset (const gchar *tmpdir,
+				 AsbContextFlags flags,
+				 const gchar *old_metadata)
+{
+	gboolean ret;
+	g_autoptr(AsbContext) ctx = NULL;
+	g_autoptr(AsStore) store = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GString) xml = NULL;
+	g_autofree gchar *filename = NULL;
+	g_autofree gchar *fn_icon = NULL;
+	g_autofree gchar *icons_dir = NULL;
+	g_autofree gchar *output_dir = NULL;
+	g_autofree gchar *temp_dir = NULL;
+	const gchar *filenames[] = {
+		"app-1-1.fc25.x86_64.rpm",		/* a GUI app */
+		"app-extra-1-1.fc25.noarch.rpm",	/* addons for a GUI app */
+		"composite-1-1.fc21.x86_64.rpm",	/* multiple GUI apps */
+		NULL};
+
+	output_dir = g_build_filename (tmpdir, "output", NULL);
+	temp_dir = g_build_filename (tmpdir, "temp", NULL);
+	icons_dir = g_build_filename (tmpdir, "temp", "icons", NULL);
+	ret = asb_utils_ensure_exists_and_empty (tmpdir, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* all runs share the same cache */
+	ctx = asb_context_new ();
+	asb_context_set_max_threads (ctx, 2);
+	asb_context_set_api_version (ctx, 0.9);
+	asb_context_set_flags (ctx, flags |
+				    ASB_CONTEXT_FLAG_NO_NETWORK |
+				    ASB_CONTEXT_FLAG_INCLUDE_FAILED |
+				    ASB_CONTEXT_FLAG_ADD_DEFAULT_ICONS);
+	asb_context_set_old_metadata (ctx, old_metadata);
+	asb_context_set_basename (ctx, "appstream");
+	asb_context_set_origin (ctx, "asb-self-test");
+	asb_context_set_cache_dir (ctx, "/tmp/asbuilder-cache/cache");
+	asb_context_set_output_dir (ctx, output_dir);
+	asb_context_set_temp_dir (ctx, temp_dir);
+	asb_context_set_icons_dir (ctx, icons_dir);
+	asb_plugin_loader_set_dir (asb_context_get_plugin_loader (ctx), TESTPLUGINDIR);
+	ret = asb_context_setup (ctx, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	for (guint i = 0; filenames[i] != NULL; i++) {
+		g_autofree gchar *fn = asb_test_get_filename (filenames[i]);
+		g_assert (fn != NULL);
+		ret = asb_context_add_filename (ctx, fn, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+	}
+	ret = asb_context_process (ctx, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the icons are written for cached results too */
+	fn_icon = g_build_filename (icons_dir, "64x64", "app.png", NULL);
+	g_assert (g_file_test (fn_icon, G_FILE_TEST_EXISTS));
+
+	filename = g_build_filename (output_dir, "appstream.xml.gz", NULL);
+	file = g_file_new_for_path (filename);
+	store = as_store_new ();
+	ret = as_store_from_file (store, file, NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	xml = as_store_to_xml (store, AS_NODE_TO_XML_FLAG_FORMAT_MULTILINE);
+	return g_strdup (xml->str);
+}
+#endif
+
+static void
+asb_test_context_cache_func (void)
+{
+#ifdef HAVE_RPM
+	const gchar *fn;
+	gboolean ret;
+	g_autofree gchar *fn_checksum = NULL;
+	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autofree gchar *xml1 = NULL;
+	g_autofree gchar *xml2 = NULL;
+
+	ret = asb_utils_ensure_exists_and_empty ("/tmp/asbuilder-cache/cache", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the first run populates the cache */
+	xml1 = asb_test_context_process_subset ("/tmp/asbuilder-cache/run1",
+						ASB_CONTEXT_FLAG_PACKAGE_CACHE, NULL);
+	dir = g_dir_open ("/tmp/asbuilder-cache/cache/packages", 0, &error);
+	g_assert_no_error (error);
+	g_assert (dir != NULL);
+	fn = g_dir_read_name (dir);
+	g_assert (fn != NULL);
+
+	/* each entry records the package checksum */
+	fn_checksum = g_build_filename ("/tmp/asbuilder-cache/cache/packages",
+					fn, "checksum", NULL);
+	g_assert (g_file_test (fn_checksum, G_FILE_TEST_EXISTS));
+
+	/* an entry for a package that is no longer in the run */
+	ret = asb_utils_ensure_exists ("/tmp/asbuilder-cache/cache/packages/unused", &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the second run uses it, and produces the same output */
+	xml2 = asb_test_context_process_subset ("/tmp/asbuilder-cache/run2",
+						ASB_CONTEXT_FLAG_PACKAGE_CACHE, NULL);
+	ret = asb_test_compare_lines (xml2, xml1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the unused entry was removed, the used one was kept */
+	g_assert (!g_file_test ("/tmp/asbuilder-cache/cache/packages/unused", G_FILE_TEST_EXISTS));
+	g_assert (g_file_test (fn_checksum, G_FILE_TEST_EXISTS));
+#endif
+}
+
+static void
+asb_test_context_old_metadata_func (void)
+{
+#ifdef HAVE_RPM
+	gboolean ret;
+	g_autoptr(GError) error = NULL;
+	g_autofree gchar *xml1 = NULL;
+	g_autofree gchar *xml2 = NULL;
+
+	/* the first run adds the package NEVRA to each component */
+	xml1 = asb_test_context_process_subset ("/tmp/asbuilder-old/run1",
+						ASB_CONTEXT_FLAG_ADD_CACHE_ID,
+						NULL);
+	g_assert (g_strstr_len (xml1, -1, "X-CacheID") != NULL);
+
+	/* the second run copies the components, and produces the same output */
+	xml2 = asb_test_context_process_subset ("/tmp/asbuilder-old/run2",
+						ASB_CONTEXT_FLAG_ADD_CACHE_ID,
+						"/tmp/asbuilder-old/run1/output");
+	ret = asb_test_compare_lines (xml2, xml1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+#endif
+}
+
+static void
+asb_test_context_shared_extra_func (void)
+{
+#ifdef HAVE_RPM
+	const gchar *filenames[] = {
+		"app-1-1.fc25.x86_64.rpm",		/* a GUI app */
+		"app-extra-1-1.fc25.noarch.rpm",	/* requires app */
+		"app-console-1-1.fc25.noarch.rpm",	/* also requires app */
+		NULL};
+
+	/* the tasks for app-extra and app-console both walk the deps of the
+	 * app package while its own task is adding to and clearing them */
+	for (guint j = 0; j < 5; j++) {
+		AsApp *app;
+		gboolean ret;
+		g_autoptr(AsbContext) ctx = NULL;
+		g_autoptr(AsStore) store = NULL;
+		g_autoptr(GError) error = NULL;
+		g_autoptr(GFile) file = NULL;
+
+		ret = asb_utils_ensure_exists_and_empty ("/tmp/asbuilder-shared", &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		ctx = asb_context_new ();
+		asb_context_set_max_threads (ctx, 3);
+		asb_context_set_api_version (ctx, 0.9);
+		asb_context_set_flags (ctx, ASB_CONTEXT_FLAG_NO_NETWORK |
+					    ASB_CONTEXT_FLAG_INCLUDE_FAILED);
+		asb_context_set_basename (ctx, "appstream");
+		asb_context_set_origin (ctx, "asb-self-test");
+		asb_context_set_cache_dir (ctx, "/tmp/asbuilder-shared/cache");
+		asb_context_set_output_dir (ctx, "/tmp/asbuilder-shared/output");
+		asb_context_set_temp_dir (ctx, "/tmp/asbuilder-shared/temp");
+		asb_context_set_icons_dir (ctx, "/tmp/asbuilder-shared/temp/icons");
+		asb_plugin_loader_set_dir (asb_context_get_plugin_loader (ctx), TESTPLUGINDIR);
+		ret = asb_context_setup (ctx, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		for (guint i = 0; filenames[i] != NULL; i++) {
+			g_autofree gchar *fn = asb_test_get_filename (filenames[i]);
+			g_assert (fn != NULL);
+			ret = asb_context_add_filename (ctx, fn, &error);
+			g_assert_no_error (error);
+			g_assert (ret);
+		}
+		ret = asb_context_process (ctx, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+
+		/* both the app and the addon that uses it are found */
+		file = g_file_new_for_path ("/tmp/asbuilder-shared/output/appstream.xml.gz");
+		store = as_store_new ();
+		ret = as_store_from_file (store, file, NULL, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		app = as_store_get_app_by_id (store, "app.desktop");
+		g_assert (app != NULL);
+		app = as_store_get_app_by_id (store, "app-extra");
+		g_assert (app != NULL);
+	}
 #endif
 }
 
@@ -644,9 +1228,19 @@ main (int argc, char **argv)
 	/* tests go here */
 	g_test_add_func ("/AppStreamBuilder/package", asb_test_package_func);
 	g_test_add_func ("/AppStreamBuilder/package{guess-fn}", asb_test_package_guess_from_fn_func);
+	g_test_add_func ("/AppStreamBuilder/package{hold}", asb_test_package_hold_func);
 	g_test_add_func ("/AppStreamBuilder/utils{glob}", asb_test_utils_glob_func);
+	g_test_add_func ("/AppStreamBuilder/utils{archive}", asb_test_utils_archive_func);
+	g_test_add_func ("/AppStreamBuilder/utils{add-files}", asb_test_utils_add_files_func);
+	g_test_add_func ("/AppStreamBuilder/utils{png}", asb_test_utils_png_func);
+	g_test_add_func ("/AppStreamBuilder/utils{png-lossy}", asb_test_utils_png_lossy_func);
+	g_test_add_func ("/AppStreamBuilder/utils{png-lossless}", asb_test_utils_png_lossless_func);
 	g_test_add_func ("/AppStreamBuilder/plugin-loader", asb_test_plugin_loader_func);
 	g_test_add_func ("/AppStreamBuilder/context", asb_test_context_func);
+	g_test_add_func ("/AppStreamBuilder/context{threads}", asb_test_context_threads_func);
+	g_test_add_func ("/AppStreamBuilder/context{cache}", asb_test_context_cache_func);
+	g_test_add_func ("/AppStreamBuilder/context{old-metadata}", asb_test_context_old_metadata_func);
+	g_test_add_func ("/AppStreamBuilder/context{shared-extra}", asb_test_context_shared_extra_func);
 #ifdef HAVE_RPM
 	g_test_add_func ("/AppStreamBuilder/package{rpm}", asb_test_package_rpm_func);
 #endif
@@ -28,8 +28,15 @@ typedef struct
 	AsbContext		*ctx;
 	AsbPackage		*pkg;
 	GPtrArray		*plugins_to_run;
+	GPtrArray		*extra_pkgs_used;	/* of AsbPackage */
+	GPtrArray		*extra_pkgs;		/* of AsbPackage */
+	gchar			*basename;
+	gchar			*cache_dir;
 	gchar			*filename;
 	gchar			*tmpdir;
+	gboolean		 held;
+	gboolean		 skip_plugins;		/* results already added */
+	gboolean		 finished;		/* nothing left to do */
 } AsbTaskPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (AsbTask, asb_task, G_TYPE_OBJECT)
@@ -68,10 +75,11 @@ asb_task_add_suitable_plugins (AsbTask *task)
 }
 
 static gboolean
-asb_task_explode_extra_package (AsbTask *task,
-				const gchar *pkg_name,
-				gboolean require_same_srpm,
-				GError **error)
+asb_task_add_extra_package (AsbTask *task,
+			    GPtrArray *extra_pkgs,
+			    const gchar *pkg_name,
+			    gboolean require_same_srpm,
+			    GError **error)
 {
 	AsbTaskPrivate *priv = GET_PRIVATE (task);
 	AsbPackage *pkg_extra;
@@ -90,32 +98,68 @@ asb_task_explode_extra_package (AsbTask *task,
 	    (g_strcmp0 (asb_package_get_source (pkg_extra),
 		        asb_package_get_source (priv->pkg)) != 0))
 		return TRUE;
-	g_debug ("decompressing extra pkg %s", asb_package_get_name (pkg_extra));
+	if (g_ptr_array_find (extra_pkgs, pkg_extra, NULL))
+		return TRUE;
+	g_ptr_array_add (extra_pkgs, g_object_ref (pkg_extra));
+	return TRUE;
+}
+
+static gboolean
+asb_task_explode_extra_package (AsbTask *task,
+				GHashTable **files,
+				AsbPackage *pkg_extra,
+				GError **error)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GHashTable) files_extra = NULL;
+
 	asb_package_log (priv->pkg,
 			 ASB_PACKAGE_LOG_LEVEL_DEBUG,
 			 "Adding extra package %s for %s",
 			 asb_package_get_name (pkg_extra),
 			 asb_package_get_name (priv->pkg));
-	if (!asb_package_ensure (pkg_extra,
-				 ASB_PACKAGE_ENSURE_FILES |
-				 ASB_PACKAGE_ENSURE_DEPS,
-				 error))
-		return FALSE;
-	if (!asb_package_explode (pkg_extra, priv->tmpdir,
-				  asb_context_get_file_globs (priv->ctx),
-				  error))
-		return FALSE;
 
-	/* free resources */
-	if (!asb_package_close (pkg_extra, error))
-		return FALSE;
-	asb_package_clear (pkg_extra,
-			   ASB_PACKAGE_ENSURE_DEPS |
-			   ASB_PACKAGE_ENSURE_FILES);
+	/* shared with every other package that needs it */
+	files_extra = asb_context_explode_extra_package (priv->ctx, pkg_extra, &error_local);
+	if (files_extra == NULL) {
+		asb_package_log (priv->pkg,
+				 ASB_PACKAGE_LOG_LEVEL_DEBUG,
+				 "Falling back to exploding %s on disk: %s",
+				 asb_package_get_name (pkg_extra),
+				 error_local->message);
+
+		/* the plugins now need the whole tree on disk */
+		if (*files != NULL) {
+			if (!asb_utils_write_files (*files, priv->tmpdir, error))
+				return FALSE;
+			g_clear_pointer (files, g_hash_table_unref);
+		}
+		return asb_context_explode_extra_package_dir (priv->ctx,
+							      pkg_extra,
+							      priv->tmpdir,
+							      error);
+	}
+	g_ptr_array_add (priv->extra_pkgs_used, g_object_ref (pkg_extra));
 
+	/* files from the package or an earlier extra package take priority */
+	if (*files == NULL)
+		return asb_utils_write_files (files_extra, priv->tmpdir, error);
+	asb_utils_add_files (*files, files_extra);
 	return TRUE;
 }
 
+static void
+asb_task_release_extra_packages (AsbTask *task)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+	for (guint i = 0; i < priv->extra_pkgs_used->len; i++) {
+		AsbPackage *pkg_extra = g_ptr_array_index (priv->extra_pkgs_used, i);
+		asb_context_release_extra_package (priv->ctx, pkg_extra);
+	}
+	g_ptr_array_set_size (priv->extra_pkgs_used, 0);
+}
+
 typedef struct {
 	GPtrArray	*results;
 	GHashTable	*results_hash;
@@ -139,7 +183,7 @@ asb_task_get_extra_deps_recursive (AsbTask *task,
 {
 	AsbTaskPrivate *priv = GET_PRIVATE (task);
 	AsbPackage *subpkg;
-	GPtrArray *subpkg_deps;
+	g_autoptr(GPtrArray) subpkg_deps = NULL;
 
 	subpkg = asb_context_find_by_pkgname (priv->ctx, dep);
 	if (subpkg == NULL)
@@ -156,7 +200,8 @@ asb_task_get_extra_deps_recursive (AsbTask *task,
 	               asb_package_get_source (priv->pkg)) != 0)
 		return TRUE;
 
-	subpkg_deps = asb_package_get_deps (subpkg);
+	/* the task for the subpackage may be changing its deps right now */
+	subpkg_deps = asb_package_dup_deps (subpkg);
 	for (guint i = 0; i < subpkg_deps->len; i++) {
 		const gchar *subpkg_dep = g_ptr_array_index (subpkg_deps, i);
 
@@ -182,15 +227,15 @@ static gboolean
 asb_task_add_extra_deps (AsbTask *task, GError **error)
 {
 	AsbTaskPrivate *priv = GET_PRIVATE (task);
-	GPtrArray *deps;
 	g_autoptr(AsbTaskExtraDeps) extra_deps = NULL;
+	g_autoptr(GPtrArray) deps = NULL;
 
 	extra_deps = g_slice_new0 (AsbTaskExtraDeps);
 	extra_deps->results = g_ptr_array_new_with_free_func (g_free);
 	extra_deps->results_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
 	/* recursively get extra package deps */
-	deps = asb_package_get_deps (priv->pkg);
+	deps = asb_package_dup_deps (priv->pkg);
 	for (guint i = 0; i < deps->len; i++) {
 		const gchar *dep = g_ptr_array_index (deps, i);
 		if (!asb_task_get_extra_deps_recursive (task, dep, extra_deps, error))
@@ -206,21 +251,23 @@ asb_task_add_extra_deps (AsbTask *task, GError **error)
 	return TRUE;
 }
 
-static gboolean
-asb_task_explode_extra_packages (AsbTask *task, GError **error)
+/* gets the packages that are exploded into the same tree as the package */
+static GPtrArray *
+asb_task_get_extra_packages (AsbTask *task, GError **error)
 {
 	AsbTaskPrivate *priv = GET_PRIVATE (task);
-	GPtrArray *deps;
 	const gchar *ignore[] = { "rtld", NULL };
 	const gchar *tmp;
 	guint i;
 	g_autoptr(GHashTable) hash = NULL;
 	g_autoptr(GPtrArray) array = NULL;
+	g_autoptr(GPtrArray) deps = NULL;
+	g_autoptr(GPtrArray) extra_pkgs = NULL;
 	g_autoptr(GPtrArray) icon_themes = NULL;
 
 	/* recursively copy all the extra package deps into the main package */
 	if (!asb_task_add_extra_deps (task, error))
-		return FALSE;
+		return NULL;
 
 	/* anything the package requires */
 	hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
@@ -231,7 +278,7 @@ asb_task_explode_extra_packages (AsbTask *task, GError **error)
 	}
 	array = g_ptr_array_new_with_free_func (g_free);
 	icon_themes = g_ptr_array_new_with_free_func (g_free);
-	deps = asb_package_get_deps (priv->pkg);
+	deps = asb_package_dup_deps (priv->pkg);
 	for (i = 0; i < deps->len; i++) {
 		tmp = g_ptr_array_index (deps, i);
 		if (g_strstr_len (tmp, -1, " ") != NULL)
@@ -268,46 +315,269 @@ asb_task_explode_extra_packages (AsbTask *task, GError **error)
 		g_hash_table_insert (hash, g_strdup (tmp), GINT_TO_POINTER (1));
 	}
 
-	/* explode any potential packages */
+	/* any potential packages, and then any icon themes */
+	extra_pkgs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	for (i = 0; i < array->len; i++) {
 		tmp = g_ptr_array_index (array, i);
-		if (!asb_task_explode_extra_package (task, tmp, TRUE, error))
-			return FALSE;
+		if (!asb_task_add_extra_package (task, extra_pkgs, tmp, TRUE, error))
+			return NULL;
 	}
-
-	/* explode any icon themes */
 	for (i = 0; i < icon_themes->len; i++) {
 		tmp = g_ptr_array_index (icon_themes, i);
-		if (!asb_task_explode_extra_package (task, tmp, FALSE, error))
+		if (!asb_task_add_extra_package (task, extra_pkgs, tmp, FALSE, error))
+			return NULL;
+	}
+	return g_steal_pointer (&extra_pkgs);
+}
+
+static gboolean
+asb_task_explode_extra_packages (AsbTask *task,
+				 GHashTable **files,
+				 GPtrArray *extra_pkgs,
+				 GError **error)
+{
+	for (guint i = 0; i < extra_pkgs->len; i++) {
+		AsbPackage *pkg_extra = g_ptr_array_index (extra_pkgs, i);
+		if (!asb_task_explode_extra_package (task, files, pkg_extra, error))
 			return FALSE;
 	}
 	return TRUE;
 }
 
-/**
- * asb_task_process:
- * @task: A #AsbTask
- * @error: A #GError or %NULL
- *
- * Processes the task.
- *
- * Returns: %TRUE for success, %FALSE otherwise
- *
- * Since: 0.1.0
- **/
-gboolean
-asb_task_process (AsbTask *task, GError **error)
+static gboolean
+asb_task_copy_file (const gchar *src, const gchar *dest, GError **error)
+{
+	g_autoptr(GFile) file_src = g_file_new_for_path (src);
+	g_autoptr(GFile) file_dest = g_file_new_for_path (dest);
+	return g_file_copy (file_src, file_dest,
+			    G_FILE_COPY_OVERWRITE,
+			    NULL, NULL, NULL, error);
+}
+
+/* screenshots generated by the plugins are written to TempDir/screenshots
+ * and referenced with a file:// URL */
+static gboolean
+asb_task_copy_local_screenshots (AsApp *app,
+				 const gchar *src_dir,
+				 const gchar *dest_dir,
+				 GError **error)
+{
+	GPtrArray *screenshots = as_app_get_screenshots (app);
+	for (guint i = 0; i < screenshots->len; i++) {
+		AsScreenshot *ss = g_ptr_array_index (screenshots, i);
+		GPtrArray *images = as_screenshot_get_images (ss);
+		for (guint j = 0; j < images->len; j++) {
+			AsImage *im = g_ptr_array_index (images, j);
+			const gchar *url = as_image_get_url (im);
+			g_autofree gchar *basename = NULL;
+			g_autofree gchar *fn_src = NULL;
+			g_autofree gchar *fn_dest = NULL;
+			if (url == NULL || !g_str_has_prefix (url, "file:"))
+				continue;
+			basename = g_path_get_basename (url);
+			fn_src = g_build_filename (src_dir, basename, NULL);
+			if (!g_file_test (fn_src, G_FILE_TEST_EXISTS))
+				continue;
+			if (!asb_utils_ensure_exists (dest_dir, error))
+				return FALSE;
+			fn_dest = g_build_filename (dest_dir, basename, NULL);
+			if (!asb_task_copy_file (fn_src, fn_dest, error))
+				return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static gboolean
+asb_task_add_cache_checksum (AsbTask *task,
+			     GString *str,
+			     AsbPackage *pkg,
+			     GError **error)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+	g_autofree gchar *checksum = NULL;
+
+	checksum = asb_context_get_package_checksum (priv->ctx, pkg, error);
+	if (checksum == NULL)
+		return FALSE;
+	g_string_append_printf (str, "%s  %s\n",
+				checksum, asb_package_get_basename (pkg));
+	return TRUE;
+}
+
+/* the results also depend on the contents of the extra packages */
+static gchar *
+asb_task_get_cache_checksum (AsbTask *task, GPtrArray *extra_pkgs, GError **error)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+	g_autoptr(GString) str = g_string_new (NULL);
+
+	if (!asb_task_add_cache_checksum (task, str, priv->pkg, error))
+		return NULL;
+	for (guint i = 0; i < extra_pkgs->len; i++) {
+		AsbPackage *pkg_extra = g_ptr_array_index (extra_pkgs, i);
+		if (!asb_task_add_cache_checksum (task, str, pkg_extra, error))
+			return NULL;
+	}
+	return g_string_free (g_steal_pointer (&str), FALSE);
+}
+
+static gboolean
+asb_task_check_cache_checksum (AsbTask *task,
+			       const gchar *cache_dir,
+			       GPtrArray *extra_pkgs,
+			       GError **error)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *checksum_old = NULL;
+	g_autofree gchar *filename = NULL;
+
+	filename = g_build_filename (cache_dir, "checksum", NULL);
+	if (!g_file_get_contents (filename, &checksum_old, NULL, error))
+		return FALSE;
+	checksum = asb_task_get_cache_checksum (task, extra_pkgs, error);
+	if (checksum == NULL)
+		return FALSE;
+	if (g_strcmp0 (checksum, checksum_old) != 0) {
+		g_set_error (error,
+			     ASB_PLUGIN_ERROR,
+			     ASB_PLUGIN_ERROR_FAILED,
+			     "%s or an extra package has changed",
+			     asb_package_get_basename (priv->pkg));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+asb_task_load_from_cache (AsbTask *task,
+			  const gchar *cache_dir,
+			  GPtrArray *extra_pkgs,
+			  GError **error)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+	GPtrArray *apps_tmp;
+	g_autofree gchar *filename = NULL;
+	g_autofree gchar *icons_dir = NULL;
+	g_autofree gchar *screenshots_dir = NULL;
+	g_autofree gchar *screenshots_dest = NULL;
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
+
+	/* the entry is only found by name, size and modification time, so
+	 * make sure the contents of all the packages are the same */
+	if (!asb_task_check_cache_checksum (task, cache_dir, extra_pkgs, error))
+		return FALSE;
+
+	filename = g_build_filename (cache_dir, "apps.xml", NULL);
+	file = g_file_new_for_path (filename);
+	if (!as_store_from_file (store, file, NULL, NULL, error))
+		return FALSE;
+
+	/* only add the apps to the context if the entire entry is valid */
+	icons_dir = g_build_filename (cache_dir, "icons", NULL);
+	screenshots_dir = g_build_filename (cache_dir, "screenshots", NULL);
+	screenshots_dest = g_build_filename (asb_context_get_temp_dir (priv->ctx),
+					     "screenshots", NULL);
+	apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	apps_tmp = as_store_get_apps (store);
+	for (guint i = 0; i < apps_tmp->len; i++) {
+		AsApp *app_tmp = g_ptr_array_index (apps_tmp, i);
+		GPtrArray *icons;
+		AsbApp *app;
+
+		app = asb_app_new (priv->pkg, as_app_get_id (app_tmp));
+		as_app_subsume (AS_APP (app), app_tmp);
+		g_ptr_array_add (apps, app);
+
+		/* the icons were saved in the cache entry when it was created */
+		icons = as_app_get_icons (AS_APP (app));
+		for (guint j = 0; j < icons->len; j++) {
+			AsIcon *icon = g_ptr_array_index (icons, j);
+			if (as_icon_get_kind (icon) == AS_ICON_KIND_CACHED)
+				as_icon_set_prefix (icon, icons_dir);
+		}
+		if (!asb_task_copy_local_screenshots (AS_APP (app),
+						      screenshots_dir,
+						      screenshots_dest,
+						      error))
+			return FALSE;
+	}
+	for (guint i = 0; i < apps->len; i++) {
+		AsbApp *app = g_ptr_array_index (apps, i);
+		asb_context_add_app (priv->ctx, app);
+	}
+	asb_package_log (priv->pkg,
+			 ASB_PACKAGE_LOG_LEVEL_DEBUG,
+			 "Using %u cached results from %s",
+			 apps->len, cache_dir);
+	return TRUE;
+}
+
+static gboolean
+asb_task_save_to_cache (AsbTask *task,
+			const gchar *cache_dir,
+			GPtrArray *extra_pkgs,
+			GPtrArray *apps,
+			GError **error)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+	g_autofree gchar *filename = NULL;
+	g_autofree gchar *icons_dir = NULL;
+	g_autofree gchar *screenshots_dir = NULL;
+	g_autofree gchar *screenshots_src = NULL;
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autofree gchar *checksum = NULL;
+	g_autofree gchar *fn_checksum = NULL;
+	g_autoptr(GFile) file = NULL;
+
+	/* the old entry has the same key but a different package */
+	if (!asb_utils_ensure_exists_and_empty (cache_dir, error))
+		return FALSE;
+	checksum = asb_task_get_cache_checksum (task, extra_pkgs, error);
+	if (checksum == NULL)
+		return FALSE;
+	fn_checksum = g_build_filename (cache_dir, "checksum", NULL);
+	if (!g_file_set_contents (fn_checksum, checksum, -1, error))
+		return FALSE;
+	icons_dir = g_build_filename (cache_dir, "icons", NULL);
+	screenshots_dir = g_build_filename (cache_dir, "screenshots", NULL);
+	screenshots_src = g_build_filename (asb_context_get_temp_dir (priv->ctx),
+					    "screenshots", NULL);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+
+		/* save the optimized icons so they can be copied next time */
+		if (!asb_app_save_icons_to_prefix (ASB_APP (app), icons_dir, error))
+			return FALSE;
+		if (!asb_task_copy_local_screenshots (app,
+						      screenshots_src,
+						      screenshots_dir,
+						      error))
+			return FALSE;
+		as_store_add_app (store, app);
+	}
+
+	/* written last, as the presence of this file marks the entry valid */
+	filename = g_build_filename (cache_dir, "apps.xml", NULL);
+	file = g_file_new_for_path (filename);
+	as_store_set_api_version (store, asb_context_get_api_version (priv->ctx));
+	return as_store_to_file (store, file,
+				 AS_NODE_TO_XML_FLAG_ADD_HEADER |
+				 AS_NODE_TO_XML_FLAG_FORMAT_INDENT |
+				 AS_NODE_TO_XML_FLAG_FORMAT_MULTILINE,
+				 NULL, error);
+}
+
+static gboolean
+asb_task_explode_pkg (AsbTask *task, GError **error)
 {
-	AsRelease *release;
-	AsbApp *app;
-	AsbPlugin *plugin = NULL;
 	AsbTaskPrivate *priv = GET_PRIVATE (task);
-	GList *apps = NULL;
-	GPtrArray *array;
-	gboolean ret;
 	guint i;
-	guint nr_added = 0;
-	g_autofree gchar *basename = NULL;
+	g_autoptr(GError) error_explode = NULL;
+	g_autoptr(GHashTable) files = NULL;
 
 	/* reset the profile timer */
 	asb_package_log_start (priv->pkg);
@@ -338,10 +608,10 @@ asb_task_process (AsbTask *task, GError **error)
 			app2 = asb_app_new (priv->pkg, as_app_get_id (app_tmp));
 			as_app_subsume (AS_APP (app2), app_tmp);
 			asb_context_add_app (priv->ctx, app2);
-			nr_added++;
 		}
 		g_debug ("added %u apps from archive", apps_tmp->len);
-		goto skip;
+		priv->skip_plugins = TRUE;
+		return TRUE;
 	}
 
 	/* ensure file list read */
@@ -351,52 +621,121 @@ asb_task_process (AsbTask *task, GError **error)
 		return FALSE;
 
 	/* did we get a file match on any plugin */
-	basename = g_path_get_basename (priv->filename);
+	priv->basename = g_path_get_basename (priv->filename);
 	asb_package_log (priv->pkg,
 			 ASB_PACKAGE_LOG_LEVEL_DEBUG,
 			 "Getting filename match for %s",
-			 basename);
+			 priv->basename);
 	asb_task_add_suitable_plugins (task);
 	if (priv->plugins_to_run->len == 0) {
 		asb_context_add_app_ignore (priv->ctx, priv->pkg);
-		asb_package_close (priv->pkg, NULL);
 		asb_package_clear (priv->pkg,
 				   ASB_PACKAGE_ENSURE_DEPS |
 				   ASB_PACKAGE_ENSURE_FILES);
+		priv->finished = TRUE;
 		return TRUE;
 	}
 
+	/* reuse the results from a previous run if nothing has changed */
+	if (!asb_package_ensure (priv->pkg,
+				 ASB_PACKAGE_ENSURE_DEPS |
+				 ASB_PACKAGE_ENSURE_SOURCE,
+				 error))
+		return FALSE;
+	priv->extra_pkgs = asb_task_get_extra_packages (task, error);
+	if (priv->extra_pkgs == NULL) {
+		g_prefix_error (error, "Failed to get extra packages: ");
+		return FALSE;
+	}
+	if ((asb_context_get_flags (priv->ctx) & ASB_CONTEXT_FLAG_PACKAGE_CACHE) > 0) {
+		g_autoptr(GError) error_local = NULL;
+		g_autofree gchar *fn_cache = NULL;
+		priv->cache_dir = asb_context_get_package_cache_dir (priv->ctx,
+								     priv->pkg,
+								     priv->extra_pkgs,
+								     &error_local);
+		if (priv->cache_dir == NULL) {
+			asb_package_log (priv->pkg,
+					 ASB_PACKAGE_LOG_LEVEL_WARNING,
+					 "Failed to get cache location: %s",
+					 error_local->message);
+		} else {
+			fn_cache = g_build_filename (priv->cache_dir, "apps.xml", NULL);
+		}
+		if (fn_cache != NULL && g_file_test (fn_cache, G_FILE_TEST_EXISTS)) {
+			if (asb_task_load_from_cache (task, priv->cache_dir,
+						      priv->extra_pkgs, &error_local)) {
+				priv->skip_plugins = TRUE;
+				return TRUE;
+			}
+			asb_package_log (priv->pkg,
+					 ASB_PACKAGE_LOG_LEVEL_WARNING,
+					 "Failed to use cached results: %s",
+					 error_local->message);
+		}
+	}
+
 	/* delete old tree if it exists */
 	if (!asb_utils_ensure_exists_and_empty (priv->tmpdir, error)) {
 		g_prefix_error (error, "Failed to clear: ");
 		return FALSE;
 	}
 
-	/* explode tree */
+	/* explode tree into memory; the files are only written to the
+	 * temporary directory if a plugin needs a real tree */
 	g_debug ("decompressing files: %s", asb_package_get_name (priv->pkg));
 	asb_package_log (priv->pkg,
 			 ASB_PACKAGE_LOG_LEVEL_DEBUG,
 			 "Exploding tree for %s",
 			 asb_package_get_name (priv->pkg));
-	if (!asb_package_explode (priv->pkg,
-				  priv->tmpdir,
-				  asb_context_get_file_globs (priv->ctx),
-				  error)) {
-		g_prefix_error (error, "Failed to explode %s: ",
-				asb_package_get_basename (priv->pkg));
-		return FALSE;
+	files = g_hash_table_new_full (g_str_hash, g_str_equal,
+				       g_free, (GDestroyNotify) g_bytes_unref);
+	if (!asb_package_explode_memory (priv->pkg,
+					 files,
+					 asb_context_get_file_globs (priv->ctx),
+					 &error_explode)) {
+		asb_package_log (priv->pkg,
+				 ASB_PACKAGE_LOG_LEVEL_DEBUG,
+				 "Falling back to exploding on disk: %s",
+				 error_explode->message);
+		g_clear_pointer (&files, g_hash_table_unref);
+		if (!asb_package_explode (priv->pkg,
+					  priv->tmpdir,
+					  asb_context_get_file_globs (priv->ctx),
+					  error)) {
+			g_prefix_error (error, "Failed to explode %s: ",
+					asb_package_get_basename (priv->pkg));
+			return FALSE;
+		}
 	}
 
 	/* add extra packages */
-	if (!asb_package_ensure (priv->pkg,
-				 ASB_PACKAGE_ENSURE_DEPS |
-				 ASB_PACKAGE_ENSURE_SOURCE,
-				 error))
-		return FALSE;
-	if (!asb_task_explode_extra_packages (task, error)) {
+	if (!asb_task_explode_extra_packages (task, &files, priv->extra_pkgs, error)) {
 		g_prefix_error (error, "Failed to explode extra files: ");
 		return FALSE;
 	}
+	asb_package_set_files (priv->pkg, files);
+	return TRUE;
+}
+
+static gboolean
+asb_task_run_plugins_pkg (AsbTask *task, GError **error)
+{
+	AsRelease *release;
+	AsbApp *app;
+	AsbPlugin *plugin = NULL;
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+	GList *apps = NULL;
+	GPtrArray *array;
+	gboolean ret;
+	guint i;
+	g_autoptr(GPtrArray) apps_ok = NULL;
+
+	/* ignored, or the results were added by asb_task_explode() */
+	if (priv->finished)
+		return TRUE;
+	if (priv->skip_plugins)
+		goto skip;
 
 	/* run plugins */
 	g_debug ("examining: %s", asb_package_get_name (priv->pkg));
@@ -407,7 +746,7 @@ asb_task_process (AsbTask *task, GError **error)
 		asb_package_log (priv->pkg,
 				 ASB_PACKAGE_LOG_LEVEL_DEBUG,
 				 "Processing %s with %s",
-				 basename,
+				 priv->basename,
 				 plugin->name);
 		apps_tmp = asb_plugin_process (plugin, priv->pkg, priv->tmpdir, &error_local);
 		if (apps_tmp == NULL) {
@@ -426,6 +765,7 @@ asb_task_process (AsbTask *task, GError **error)
 
 	/* print */
 	g_debug ("processing: %s", asb_package_get_name (priv->pkg));
+	apps_ok = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	for (GList *l = apps; l != NULL; l = l->next) {
 		g_autoptr(GError) error_local = NULL;
 		app = l->data;
@@ -506,8 +846,23 @@ asb_task_process (AsbTask *task, GError **error)
 		}
 
 		/* all okay */
+		g_ptr_array_add (apps_ok, g_object_ref (app));
+	}
+
+	/* save the results for the next run */
+	if (priv->cache_dir != NULL) {
+		g_autoptr(GError) error_local = NULL;
+		if (!asb_task_save_to_cache (task, priv->cache_dir, priv->extra_pkgs,
+					     apps_ok, &error_local)) {
+			asb_package_log (priv->pkg,
+					 ASB_PACKAGE_LOG_LEVEL_WARNING,
+					 "Failed to save cached results: %s",
+					 error_local->message);
+		}
+	}
+	for (i = 0; i < apps_ok->len; i++) {
+		app = g_ptr_array_index (apps_ok, i);
 		asb_context_add_app (priv->ctx, app);
-		nr_added++;
 	}
 skip:
 	/* delete tree */
@@ -524,8 +879,7 @@ skip:
 		return FALSE;
 	}
 
-	/* clear loaded resources */
-	asb_package_close (priv->pkg, NULL);
+	/* clear loaded resources; the package is closed in asb_task_release() */
 	asb_package_clear (priv->pkg,
 			   ASB_PACKAGE_ENSURE_DEPS |
 			   ASB_PACKAGE_ENSURE_FILES);
@@ -533,16 +887,113 @@ skip:
 	return TRUE;
 }
 
+static gboolean
+asb_task_release (AsbTask *task, GError **error)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+
+	/* drop the in-memory tree on every exit path, not just success */
+	asb_package_set_files (priv->pkg, NULL);
+
+	/* the decompressed extra packages can be freed by the last user */
+	asb_task_release_extra_packages (task);
+	if (!priv->held)
+		return TRUE;
+	priv->held = FALSE;
+	return asb_package_unhold (priv->pkg, ASB_PACKAGE_ENSURE_NONE, error);
+}
+
+/**
+ * asb_task_explode:
+ * @task: A #AsbTask
+ * @error: A #GError or %NULL
+ *
+ * Reads the package headers and decompresses the files the plugins need.
+ * This is the first half of asb_task_process(), and the package is kept
+ * open until asb_task_run_plugins() is called or the task is destroyed.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_task_explode (AsbTask *task, GError **error)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+
+	/* other tasks may be exploding this package as an extra package, so
+	 * only the last one to finish closes it */
+	if (!asb_package_hold (priv->pkg, ASB_PACKAGE_ENSURE_NONE, error))
+		return FALSE;
+	priv->held = TRUE;
+	if (!asb_task_explode_pkg (task, error)) {
+		asb_task_release (task, NULL);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * asb_task_run_plugins:
+ * @task: A #AsbTask
+ * @error: A #GError or %NULL
+ *
+ * Runs the plugins on the files decompressed by asb_task_explode() and
+ * adds the resulting applications to the context.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_task_run_plugins (AsbTask *task, GError **error)
+{
+	gboolean ret;
+
+	ret = asb_task_run_plugins_pkg (task, error);
+	if (!asb_task_release (task, ret ? error : NULL))
+		ret = FALSE;
+	return ret;
+}
+
+/**
+ * asb_task_process:
+ * @task: A #AsbTask
+ * @error: A #GError or %NULL
+ *
+ * Processes the task.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.1.0
+ **/
+gboolean
+asb_task_process (AsbTask *task, GError **error)
+{
+	if (!asb_task_explode (task, error))
+		return FALSE;
+	return asb_task_run_plugins (task, error);
+}
+
 static void
 asb_task_finalize (GObject *object)
 {
 	AsbTask *task = ASB_TASK (object);
 	AsbTaskPrivate *priv = GET_PRIVATE (task);
 
+	/* exploded but the plugins were never run */
+	if (priv->held)
+		asb_task_release (task, NULL);
+
 	g_object_unref (priv->ctx);
 	g_ptr_array_unref (priv->plugins_to_run);
+	g_ptr_array_unref (priv->extra_pkgs_used);
+	if (priv->extra_pkgs != NULL)
+		g_ptr_array_unref (priv->extra_pkgs);
 	if (priv->pkg != NULL)
 		g_object_unref (priv->pkg);
+	g_free (priv->basename);
+	g_free (priv->cache_dir);
 	g_free (priv->filename);
 	g_free (priv->tmpdir);
 
@@ -568,11 +1019,29 @@ asb_task_set_package (AsbTask *task, AsbPackage *pkg)
 	priv->pkg = g_object_ref (pkg);
 }
 
+/**
+ * asb_task_get_package:
+ * @task: A #AsbTask
+ *
+ * Gets the package used for the task.
+ *
+ * Returns: (transfer none): A #AsbPackage, or %NULL if unset
+ *
+ * Since: 0.8.5
+ **/
+AsbPackage *
+asb_task_get_package (AsbTask *task)
+{
+	AsbTaskPrivate *priv = GET_PRIVATE (task);
+	return priv->pkg;
+}
+
 static void
 asb_task_init (AsbTask *task)
 {
 	AsbTaskPrivate *priv = GET_PRIVATE (task);
 	priv->plugins_to_run = g_ptr_array_new ();
+	priv->extra_pkgs_used = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 }
 
 static void
@@ -34,7 +34,12 @@ struct _AsbTaskClass
 AsbTask		*asb_task_new			(AsbContext	*ctx);
 gboolean	 asb_task_process		(AsbTask	*task,
 						 GError		**error);
+gboolean	 asb_task_explode		(AsbTask	*task,
+						 GError		**error);
+gboolean	 asb_task_run_plugins		(AsbTask	*task,
+						 GError		**error);
 void		 asb_task_set_package		(AsbTask	*task,
 						 AsbPackage	*pkg);
+AsbPackage	*asb_task_get_package		(AsbTask	*task);
 
 G_END_DECLS
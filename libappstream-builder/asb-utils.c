@@ -227,35 +227,631 @@ asb_utils_explode_file (struct archive_entry *entry, const gchar *dir)
 	return TRUE;
 }
 
+/* PNG files are a signature followed by chunks, each with a CRC of the
+ * chunk type and data */
+static guint32
+asb_utils_png_crc (const guint8 *type, const guint8 *data, gsize len)
+{
+	static gsize table_init = 0;
+	static guint32 table[256];
+	guint32 crc = 0xffffffff;
+
+	if (g_once_init_enter (&table_init)) {
+		for (guint32 n = 0; n < 256; n++) {
+			guint32 c = n;
+			for (guint k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		g_once_init_leave (&table_init, 1);
+	}
+	for (guint i = 0; i < 4; i++)
+		crc = table[(crc ^ type[i]) & 0xff] ^ (crc >> 8);
+	for (gsize i = 0; i < len; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xffffffff;
+}
+
+static void
+asb_utils_png_add_chunk (GByteArray *png,
+			 const gchar *type,
+			 const guint8 *data,
+			 gsize len)
+{
+	guint32 tmp = GUINT32_TO_BE ((guint32) len);
+	g_byte_array_append (png, (const guint8 *) &tmp, 4);
+	g_byte_array_append (png, (const guint8 *) type, 4);
+	if (len > 0)
+		g_byte_array_append (png, data, (guint) len);
+	tmp = GUINT32_TO_BE (asb_utils_png_crc ((const guint8 *) type, data, len));
+	g_byte_array_append (png, (const guint8 *) &tmp, 4);
+}
+
+/* one color of the reduced histogram, or one palette entry */
+typedef struct {
+	guint32		 key;
+	guint32		 count;
+	guint64		 sum[4];	/* of full precision RGBA values */
+	guint8		 value[4];	/* reduced, or the final color */
+	guint		 idx;		/* of the palette entry */
+} AsbUtilsPngColor;
+
+typedef struct {
+	guint		 start;
+	guint		 end;
+	guint64		 count;
+	guint		 channel;
+	guint		 range;
+} AsbUtilsPngBox;
+
+static gint
+asb_utils_png_color_sort_cb (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+	const AsbUtilsPngColor *c1 = *((const AsbUtilsPngColor **) a);
+	const AsbUtilsPngColor *c2 = *((const AsbUtilsPngColor **) b);
+	guint channel = GPOINTER_TO_UINT (user_data);
+	if (c1->value[channel] != c2->value[channel])
+		return c1->value[channel] < c2->value[channel] ? -1 : 1;
+	if (c1->key != c2->key)
+		return c1->key < c2->key ? -1 : 1;
+	return 0;
+}
+
+static void
+asb_utils_png_box_update (AsbUtilsPngBox *box, GPtrArray *colors)
+{
+	guint8 min[4] = { 255, 255, 255, 255 };
+	guint8 max[4] = { 0, 0, 0, 0 };
+
+	box->count = 0;
+	for (guint i = box->start; i < box->end; i++) {
+		AsbUtilsPngColor *color = g_ptr_array_index (colors, i);
+		for (guint j = 0; j < 4; j++) {
+			min[j] = MIN (min[j], color->value[j]);
+			max[j] = MAX (max[j], color->value[j]);
+		}
+		box->count += color->count;
+	}
+	box->range = 0;
+	box->channel = 0;
+	for (guint j = 0; j < 4; j++) {
+		if ((guint) (max[j] - min[j]) > box->range) {
+			box->range = max[j] - min[j];
+			box->channel = j;
+		}
+	}
+}
+
+/* median cut: keep splitting the box with the most pixels and the widest
+ * range at the weighted median until there are enough boxes */
+static GArray *
+asb_utils_png_median_cut (GPtrArray *colors, guint max_colors)
+{
+	GArray *boxes = g_array_new (FALSE, FALSE, sizeof (AsbUtilsPngBox));
+	AsbUtilsPngBox box = { 0, colors->len, 0, 0, 0 };
+
+	asb_utils_png_box_update (&box, colors);
+	g_array_append_val (boxes, box);
+	while (boxes->len < max_colors) {
+		AsbUtilsPngBox *best = NULL;
+		AsbUtilsPngBox split;
+		guint64 acc = 0;
+		guint64 best_score = 0;
+		guint mid;
+
+		for (guint i = 0; i < boxes->len; i++) {
+			AsbUtilsPngBox *tmp = &g_array_index (boxes, AsbUtilsPngBox, i);
+			guint64 score = tmp->count * tmp->range;
+			if (tmp->end - tmp->start < 2 || tmp->range == 0)
+				continue;
+			if (score > best_score) {
+				best_score = score;
+				best = tmp;
+			}
+		}
+		if (best == NULL)
+			break;
+
+		/* sort just this box along the widest channel */
+		g_qsort_with_data (colors->pdata + best->start,
+				   (gint) (best->end - best->start),
+				   sizeof (gpointer),
+				   asb_utils_png_color_sort_cb,
+				   GUINT_TO_POINTER (best->channel));
+		for (mid = best->start; mid < best->end - 1; mid++) {
+			AsbUtilsPngColor *color = g_ptr_array_index (colors, mid);
+			acc += color->count;
+			if (acc * 2 >= best->count)
+				break;
+		}
+		split.start = mid + 1;
+		split.end = best->end;
+		best->end = mid + 1;
+		asb_utils_png_box_update (best, colors);
+		asb_utils_png_box_update (&split, colors);
+		g_array_append_val (boxes, split);
+	}
+	return boxes;
+}
+
+/* all fully transparent pixels are the same */
+static guint32
+asb_utils_png_get_key (const guint8 *p, gboolean has_alpha, guint shift)
+{
+	guint8 rgba[4] = { p[0], p[1], p[2], has_alpha ? p[3] : 255 };
+	if (rgba[3] == 0)
+		rgba[0] = rgba[1] = rgba[2] = 0;
+	return ((guint32) (rgba[0] >> shift) << 24) |
+	       ((guint32) (rgba[1] >> shift) << 16) |
+	       ((guint32) (rgba[2] >> shift) << 8) |
+	       (guint32) (rgba[3] >> shift);
+}
+
+/* reduce the image to at most 256 colors, exactly if possible */
+static GPtrArray *
+asb_utils_png_quantize (GdkPixbuf *pixbuf, GHashTable *lookup, guint *shift_out)
+{
+	AsbUtilsPngColor *color;
+	GPtrArray *palette;
+	gboolean has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+	gint height = gdk_pixbuf_get_height (pixbuf);
+	gint n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+	gint rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	gint width = gdk_pixbuf_get_width (pixbuf);
+	const guint8 *pixels = gdk_pixbuf_read_pixels (pixbuf);
+	guint shift = 0;
+	GList *values;
+	g_autoptr(GArray) boxes = NULL;
+	g_autoptr(GHashTable) hash = NULL;
+	g_autoptr(GPtrArray) colors = NULL;
+	g_autoptr(GPtrArray) entries = NULL;
+
+	/* try with full precision first, then 5 bits per channel */
+	for (;;) {
+		hash = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+					      NULL, g_free);
+		for (gint y = 0; y < height; y++) {
+			const guint8 *row = pixels + y * rowstride;
+			for (gint x = 0; x < width; x++) {
+				const guint8 *p = row + x * n_channels;
+				guint32 key = asb_utils_png_get_key (p, has_alpha, shift);
+
+				color = g_hash_table_lookup (hash, GUINT_TO_POINTER (key + 1));
+				if (color == NULL) {
+					color = g_new0 (AsbUtilsPngColor, 1);
+					color->key = key;
+					for (guint j = 0; j < 4; j++)
+						color->value[j] = (key >> (24 - j * 8)) & 0xff;
+					g_hash_table_insert (hash, GUINT_TO_POINTER (key + 1), color);
+				}
+				color->count++;
+				if (has_alpha && p[3] == 0)
+					continue;
+				for (guint j = 0; j < 3; j++)
+					color->sum[j] += p[j];
+				color->sum[3] += has_alpha ? p[3] : 255;
+			}
+			if (shift == 0 && g_hash_table_size (hash) > 256)
+				break;
+		}
+		if (shift > 0 || g_hash_table_size (hash) <= 256)
+			break;
+		g_clear_pointer (&hash, g_hash_table_unref);
+		shift = 3;
+	}
+	*shift_out = shift;
+
+	/* sort so the result does not depend on the hash table order */
+	colors = g_ptr_array_new ();
+	values = g_hash_table_get_values (hash);
+	for (GList *l = values; l != NULL; l = l->next)
+		g_ptr_array_add (colors, l->data);
+	g_list_free (values);
+	g_qsort_with_data (colors->pdata, (gint) colors->len, sizeof (gpointer),
+			   asb_utils_png_color_sort_cb, GUINT_TO_POINTER (3));
+
+	/* each box becomes one palette entry with the mean color */
+	boxes = asb_utils_png_median_cut (colors, 256);
+	entries = g_ptr_array_new ();
+	for (guint i = 0; i < boxes->len; i++) {
+		AsbUtilsPngBox *box = &g_array_index (boxes, AsbUtilsPngBox, i);
+		AsbUtilsPngColor *entry = g_new0 (AsbUtilsPngColor, 1);
+		for (guint k = box->start; k < box->end; k++) {
+			color = g_ptr_array_index (colors, k);
+			for (guint j = 0; j < 4; j++)
+				entry->sum[j] += color->sum[j];
+			color->idx = i;
+		}
+		for (guint j = 0; j < 4; j++)
+			entry->value[j] = (guint8) ((entry->sum[j] + box->count / 2) / box->count);
+		entry->count = (guint32) box->count;
+		g_ptr_array_add (entries, entry);
+	}
+
+	/* translucent entries go first so the tRNS chunk is short */
+	palette = g_ptr_array_new_with_free_func (g_free);
+	for (guint j = 0; j < 2; j++) {
+		for (guint k = 0; k < entries->len; k++) {
+			AsbUtilsPngColor *entry = g_ptr_array_index (entries, k);
+			if ((entry->value[3] == 255) == (j == 0))
+				continue;
+			entry->idx = palette->len;
+			g_ptr_array_add (palette, entry);
+		}
+	}
+	for (guint k = 0; k < colors->len; k++) {
+		AsbUtilsPngColor *entry;
+		color = g_ptr_array_index (colors, k);
+		entry = g_ptr_array_index (entries, color->idx);
+		g_hash_table_insert (lookup,
+				     GUINT_TO_POINTER (color->key + 1),
+				     GUINT_TO_POINTER (entry->idx));
+	}
+	return palette;
+}
+
+/* the largest mean error per channel before the original image is kept */
+#define ASB_UTILS_PNG_MAX_MEAN_ERROR	3.0
+
+static guint
+asb_utils_png_find_nearest (GPtrArray *palette, const gint *rgba)
+{
+	guint best = 0;
+	guint best_dist = G_MAXUINT;
+	for (guint i = 0; i < palette->len; i++) {
+		AsbUtilsPngColor *entry = g_ptr_array_index (palette, i);
+		guint dist = 0;
+		for (guint j = 0; j < 4; j++) {
+			gint tmp = rgba[j] - entry->value[j];
+			dist += (guint) (tmp * tmp);
+		}
+		if (dist < best_dist) {
+			best_dist = dist;
+			best = i;
+		}
+	}
+	return best;
+}
+
+/* colors that only differ in the lowest bits share the same palette entry */
+static guint
+asb_utils_png_get_nearest (GPtrArray *palette, GHashTable *cache, const gint *rgba)
+{
+	guint32 key = 0;
+	guint idx;
+	gpointer tmp;
+
+	for (guint j = 0; j < 4; j++)
+		key = (key << 8) | (guint32) (rgba[j] >> 3);
+	tmp = g_hash_table_lookup (cache, GUINT_TO_POINTER (key + 1));
+	if (tmp != NULL)
+		return GPOINTER_TO_UINT (tmp) - 1;
+	idx = asb_utils_png_find_nearest (palette, rgba);
+	g_hash_table_insert (cache,
+			     GUINT_TO_POINTER (key + 1),
+			     GUINT_TO_POINTER (idx + 1));
+	return idx;
+}
+
+/* Floyd-Steinberg dithering, returning the mean error per channel of the
+ * nearest palette colors so that a poor palette can be detected */
+static gdouble
+asb_utils_png_dither (GdkPixbuf *pixbuf, GPtrArray *palette, GByteArray *raw)
+{
+	gboolean has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+	gint height = gdk_pixbuf_get_height (pixbuf);
+	gint n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+	gint rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	gint width = gdk_pixbuf_get_width (pixbuf);
+	const guint8 *pixels = gdk_pixbuf_read_pixels (pixbuf);
+	guint64 error_total = 0;
+	g_autofree gint *error_cur = g_new0 (gint, (width + 2) * 4);
+	g_autofree gint *error_next = g_new0 (gint, (width + 2) * 4);
+	g_autoptr(GHashTable) cache = NULL;
+
+	cache = g_hash_table_new (g_direct_hash, g_direct_equal);
+	for (gint y = 0; y < height; y++) {
+		const guint8 *row = pixels + y * rowstride;
+		guint8 filter = 0;
+		gint *error_tmp;
+
+		g_byte_array_append (raw, &filter, 1);
+		for (gint x = 0; x < width; x++) {
+			const guint8 *p = row + x * n_channels;
+			AsbUtilsPngColor *entry;
+			gint orig[4] = { p[0], p[1], p[2], has_alpha ? p[3] : 255 };
+			gint rgba[4];
+			guint8 idx;
+
+			/* fully transparent pixels are never dithered */
+			if (orig[3] == 0) {
+				orig[0] = orig[1] = orig[2] = 0;
+				idx = (guint8) asb_utils_png_get_nearest (palette, cache, orig);
+				entry = g_ptr_array_index (palette, idx);
+				error_total += (guint64) entry->value[3];
+				g_byte_array_append (raw, &idx, 1);
+				continue;
+			}
+
+			/* the error without dithering */
+			entry = g_ptr_array_index (palette,
+						   asb_utils_png_get_nearest (palette, cache, orig));
+			for (guint j = 0; j < 4; j++)
+				error_total += (guint64) ABS (orig[j] - entry->value[j]);
+
+			/* spread the error to the pixels not yet written */
+			for (guint j = 0; j < 4; j++)
+				rgba[j] = CLAMP (orig[j] + error_cur[(x + 1) * 4 + j] / 16, 0, 255);
+			idx = (guint8) asb_utils_png_get_nearest (palette, cache, rgba);
+			entry = g_ptr_array_index (palette, idx);
+			for (guint j = 0; j < 4; j++) {
+				gint tmp = rgba[j] - entry->value[j];
+				error_cur[(x + 2) * 4 + j] += tmp * 7;
+				error_next[x * 4 + j] += tmp * 3;
+				error_next[(x + 1) * 4 + j] += tmp * 5;
+				error_next[(x + 2) * 4 + j] += tmp;
+			}
+			g_byte_array_append (raw, &idx, 1);
+		}
+		error_tmp = error_cur;
+		error_cur = error_next;
+		error_next = error_tmp;
+		memset (error_next, 0, sizeof (gint) * (gsize) (width + 2) * 4);
+	}
+	return (gdouble) error_total / ((gdouble) width * height * (has_alpha ? 4 : 3));
+}
+
+static GBytes *
+asb_utils_png_encode_paletted_full (GdkPixbuf *pixbuf,
+				    gboolean lossless,
+				    GError **error)
+{
+	gboolean has_alpha = gdk_pixbuf_get_has_alpha (pixbuf);
+	gint height = gdk_pixbuf_get_height (pixbuf);
+	gint n_channels = gdk_pixbuf_get_n_channels (pixbuf);
+	gint rowstride = gdk_pixbuf_get_rowstride (pixbuf);
+	gint width = gdk_pixbuf_get_width (pixbuf);
+	const guint8 *pixels = gdk_pixbuf_read_pixels (pixbuf);
+	const guint8 sig[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	guint8 ihdr[13];
+	guint ntrans = 0;
+	guint shift = 0;
+	guint32 tmp;
+	g_autoptr(GByteArray) plte = g_byte_array_new ();
+	g_autoptr(GByteArray) png = g_byte_array_new ();
+	g_autoptr(GByteArray) raw = g_byte_array_new ();
+	g_autoptr(GByteArray) trns = g_byte_array_new ();
+	g_autoptr(GBytes) idat = NULL;
+	g_autoptr(GHashTable) lookup = NULL;
+	g_autoptr(GOutputStream) ostream = NULL;
+	g_autoptr(GOutputStream) ostream_mem = NULL;
+	g_autoptr(GPtrArray) palette = NULL;
+	g_autoptr(GZlibCompressor) compressor = NULL;
+
+	if (gdk_pixbuf_get_colorspace (pixbuf) != GDK_COLORSPACE_RGB ||
+	    gdk_pixbuf_get_bits_per_sample (pixbuf) != 8 ||
+	    n_channels < 3) {
+		g_set_error_literal (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_NOT_SUPPORTED,
+				     "only 8 bit RGB images are supported");
+		return NULL;
+	}
+
+	/* build the palette */
+	lookup = g_hash_table_new (g_direct_hash, g_direct_equal);
+	palette = asb_utils_png_quantize (pixbuf, lookup, &shift);
+	if (shift > 0 && lossless) {
+		g_set_error_literal (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_NOT_SUPPORTED,
+				     "too many colors to encode losslessly");
+		return NULL;
+	}
+	for (guint i = 0; i < palette->len; i++) {
+		AsbUtilsPngColor *entry = g_ptr_array_index (palette, i);
+		g_byte_array_append (plte, entry->value, 3);
+		g_byte_array_append (trns, entry->value + 3, 1);
+		if (entry->value[3] != 255)
+			ntrans = i + 1;
+	}
+
+	/* one byte for the filter type, then one index per pixel, where the
+	 * palette is only an approximation if the colors had to be reduced */
+	if (shift > 0) {
+		gdouble mean_error = asb_utils_png_dither (pixbuf, palette, raw);
+		if (mean_error > ASB_UTILS_PNG_MAX_MEAN_ERROR) {
+			g_set_error (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_NOT_SUPPORTED,
+				     "too many colors, mean error %.1f",
+				     mean_error);
+			return NULL;
+		}
+	} else {
+		for (gint y = 0; y < height; y++) {
+			const guint8 *row = pixels + y * rowstride;
+			guint8 filter = 0;
+			g_byte_array_append (raw, &filter, 1);
+			for (gint x = 0; x < width; x++) {
+				guint32 key = asb_utils_png_get_key (row + x * n_channels,
+								     has_alpha, shift);
+				guint8 idx = (guint8) GPOINTER_TO_UINT (g_hash_table_lookup (lookup, GUINT_TO_POINTER (key + 1)));
+				g_byte_array_append (raw, &idx, 1);
+			}
+		}
+	}
+	compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_ZLIB, 9);
+	ostream_mem = g_memory_output_stream_new_resizable ();
+	ostream = g_converter_output_stream_new (ostream_mem,
+						 G_CONVERTER (compressor));
+	if (!g_output_stream_write_all (ostream, raw->data, raw->len, NULL, NULL, error))
+		return NULL;
+	if (!g_output_stream_close (ostream, NULL, error))
+		return NULL;
+	idat = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream_mem));
+
+	/* 8 bit indexed, default compression, filter and no interlace */
+	tmp = GUINT32_TO_BE ((guint32) width);
+	memcpy (ihdr, &tmp, 4);
+	tmp = GUINT32_TO_BE ((guint32) height);
+	memcpy (ihdr + 4, &tmp, 4);
+	ihdr[8] = 8;
+	ihdr[9] = 3;
+	ihdr[10] = 0;
+	ihdr[11] = 0;
+	ihdr[12] = 0;
+	g_byte_array_append (png, sig, sizeof(sig));
+	asb_utils_png_add_chunk (png, "IHDR", ihdr, sizeof(ihdr));
+	asb_utils_png_add_chunk (png, "PLTE", plte->data, plte->len);
+	if (ntrans > 0)
+		asb_utils_png_add_chunk (png, "tRNS", trns->data, ntrans);
+	asb_utils_png_add_chunk (png, "IDAT",
+				 g_bytes_get_data (idat, NULL),
+				 g_bytes_get_size (idat));
+	asb_utils_png_add_chunk (png, "IEND", NULL, 0);
+	return g_byte_array_free_to_bytes (g_steal_pointer (&png));
+}
+
+/**
+ * asb_utils_png_encode_paletted:
+ * @pixbuf: a #GdkPixbuf
+ * @error: A #GError or %NULL
+ *
+ * Encodes an image as a PNG with a palette of at most 256 colors, which is
+ * lossless if the image has few enough colors. Otherwise the palette is
+ * chosen using median cut and the image is dithered, and if the result
+ * would look too different to the original %ASB_PLUGIN_ERROR_NOT_SUPPORTED
+ * is returned. No metadata is written.
+ *
+ * Returns: (transfer full): PNG data, or %NULL for error
+ *
+ * Since: 0.8.5
+ **/
+GBytes *
+asb_utils_png_encode_paletted (GdkPixbuf *pixbuf, GError **error)
+{
+	return asb_utils_png_encode_paletted_full (pixbuf, FALSE, error);
+}
+
+static gboolean
+asb_utils_optimize_png_full (const gchar *filename,
+			     gboolean lossless,
+			     GError **error)
+{
+	GStatBuf st;
+	g_autoptr(GBytes) blob = NULL;
+	g_autoptr(GdkPixbuf) pixbuf = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	if (g_stat (filename, &st) != 0) {
+		g_set_error (error,
+			     ASB_PLUGIN_ERROR,
+			     ASB_PLUGIN_ERROR_FAILED,
+			     "Failed to stat: %s", filename);
+		return FALSE;
+	}
+	pixbuf = gdk_pixbuf_new_from_file (filename, error);
+	if (pixbuf == NULL)
+		return FALSE;
+	blob = asb_utils_png_encode_paletted_full (pixbuf, lossless, &error_local);
+	if (blob == NULL) {
+		/* keep the original */
+		if (g_error_matches (error_local,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_NOT_SUPPORTED)) {
+			g_debug ("not optimizing %s: %s",
+				 filename, error_local->message);
+			return TRUE;
+		}
+		g_propagate_error (error, g_steal_pointer (&error_local));
+		return FALSE;
+	}
+
+	/* skip if larger */
+	if (g_bytes_get_size (blob) >= (gsize) st.st_size)
+		return TRUE;
+	return g_file_set_contents (filename,
+				    g_bytes_get_data (blob, NULL),
+				    (gssize) g_bytes_get_size (blob),
+				    error);
+}
+
 /**
  * asb_utils_optimize_png:
  * @filename: package filename
  * @error: A #GError or %NULL
  *
- * Optimises a PNG if pngquant is installed on the system.
+ * Optimises a PNG by converting it to use a palette, keeping the original
+ * file if the result would be larger or would look too different.
  *
  * Returns: %TRUE for success, %FALSE otherwise
  **/
 gboolean
 asb_utils_optimize_png (const gchar *filename, GError **error)
 {
-	g_autofree gchar *standard_error = NULL;
-	gint exit_status = 0;
-	const gchar *argv[] = { "/usr/bin/pngquant", "--skip-if-larger",
-				"--strip", "--ext", ".png",
-				"--force", "--speed", "1", filename, NULL };
-	if (!g_file_test (argv[0], G_FILE_TEST_IS_EXECUTABLE))
-		return TRUE;
-	if (!g_spawn_sync (NULL, (gchar **) argv, NULL, G_SPAWN_DEFAULT,
-			   NULL, NULL, NULL, &standard_error, &exit_status, error))
+	return asb_utils_optimize_png_full (filename, FALSE, error);
+}
+
+typedef struct {
+	GMutex		 mutex;		/* for ->error */
+	GError		*error;
+} AsbUtilsOptimizeHelper;
+
+static void
+asb_utils_optimize_png_cb (gpointer data, gpointer user_data)
+{
+	AsbUtilsOptimizeHelper *helper = (AsbUtilsOptimizeHelper *) user_data;
+	const gchar *filename = (const gchar *) data;
+	g_autoptr(GError) error_local = NULL;
+
+	if (asb_utils_optimize_png_full (filename, TRUE, &error_local))
+		return;
+	g_mutex_lock (&helper->mutex);
+	if (helper->error == NULL)
+		helper->error = g_steal_pointer (&error_local);
+	g_mutex_unlock (&helper->mutex);
+}
+
+/**
+ * asb_utils_optimize_pngs:
+ * @filenames: (element-type utf8): PNG filenames
+ * @max_threads: the number of threads to use, or 0 for one per CPU
+ * @error: A #GError or %NULL
+ *
+ * Optimises several PNG files at once. Unlike
+ * asb_utils_optimize_png() this is lossless, so files with more than 256
+ * colors are kept as they are.
+ *
+ * Returns: %TRUE for success, %FALSE if any file failed
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_utils_optimize_pngs (GPtrArray *filenames, guint max_threads, GError **error)
+{
+	AsbUtilsOptimizeHelper helper;
+	GThreadPool *pool;
+
+	if (max_threads == 0)
+		max_threads = g_get_num_processors ();
+	helper.error = NULL;
+	g_mutex_init (&helper.mutex);
+	pool = g_thread_pool_new (asb_utils_optimize_png_cb,
+				  &helper,
+				  (gint) max_threads,
+				  TRUE,
+				  error);
+	if (pool == NULL) {
+		g_mutex_clear (&helper.mutex);
 		return FALSE;
-	if (exit_status != 0 && exit_status != 98) {
-		g_autofree gchar *argv_str = g_strjoinv (" ", (gchar **) argv);
-		g_set_error (error,
-			     AS_APP_ERROR,
-			     AS_APP_ERROR_FAILED,
-			     "failed to run %s: %s (%i)",
-			     argv_str, standard_error, exit_status);
+	}
+	for (guint i = 0; i < filenames->len; i++)
+		g_thread_pool_push (pool, g_ptr_array_index (filenames, i), NULL);
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_mutex_clear (&helper.mutex);
+	if (helper.error != NULL) {
+		g_propagate_error (error, helper.error);
 		return FALSE;
 	}
 	return TRUE;
@@ -425,6 +1021,336 @@ out:
 	return ret;
 }
 
+static gchar *
+asb_utils_get_link_target (struct archive_entry *entry, const gchar *path)
+{
+	const gchar *tmp;
+	g_autofree gchar *parent_dir = NULL;
+
+	/* hardlinks are always relative to the archive root */
+	tmp = archive_entry_hardlink (entry);
+	if (tmp != NULL)
+		return asb_utils_sanitise_path (tmp);
+
+	/* symlinks can be either */
+	tmp = archive_entry_symlink (entry);
+	if (tmp == NULL)
+		return NULL;
+	if (g_path_is_absolute (tmp))
+		return asb_utils_sanitise_path (tmp);
+	parent_dir = g_path_get_dirname (path);
+	return asb_utils_resolve_relative_symlink (parent_dir, tmp);
+}
+
+static struct archive *
+asb_utils_archive_open_bytes (GBytes *data, GError **error)
+{
+	struct archive *arch;
+	int r;
+
+	arch = archive_read_new ();
+	archive_read_support_format_all (arch);
+	archive_read_support_filter_all (arch);
+	r = archive_read_open_memory (arch,
+				      (void *) g_bytes_get_data (data, NULL),
+				      g_bytes_get_size (data));
+	if (r) {
+		g_set_error (error,
+			     ASB_PLUGIN_ERROR,
+			     ASB_PLUGIN_ERROR_FAILED,
+			     "Cannot open: %s",
+			     archive_error_string (arch));
+		archive_read_free (arch);
+		return NULL;
+	}
+	return arch;
+}
+
+static GBytes *
+asb_utils_archive_read_data (struct archive *arch,
+			     struct archive_entry *entry,
+			     GError **error)
+{
+	gchar buf[1024 * 32];
+	guint size = 0;
+	gssize len;
+	g_autoptr(GByteArray) data = NULL;
+
+	if (archive_entry_size_is_set (entry))
+		size = (guint) archive_entry_size (entry);
+	data = g_byte_array_sized_new (size);
+	for (;;) {
+		len = archive_read_data (arch, buf, sizeof(buf));
+		if (len == 0)
+			break;
+		if (len < 0) {
+			g_set_error (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_FAILED,
+				     "Cannot read %s: %s",
+				     archive_entry_pathname (entry),
+				     archive_error_string (arch));
+			return NULL;
+		}
+		g_byte_array_append (data, (const guint8 *) buf, (guint) len);
+	}
+	return g_byte_array_free_to_bytes (g_steal_pointer (&data));
+}
+
+static void
+asb_utils_archive_close (struct archive *arch)
+{
+	if (arch == NULL)
+		return;
+	archive_read_close (arch);
+	archive_read_free (arch);
+}
+
+/**
+ * asb_utils_explode_bytes:
+ * @data: archive data
+ * @files: (element-type utf8 GBytes): a hash table to add the files to
+ * @glob: (element-type utf8): filename globs, or %NULL
+ * @error: A #GError or %NULL
+ *
+ * Decompresses an archive into memory rather than into a directory.
+ *
+ * Each matching regular file is added to @files using the sanitised path
+ * as the key, e.g. `/usr/share/applications/foo.desktop`. Symlinks and
+ * hardlinks to files are added as extra references to the same data, but
+ * symlinks to directories are not followed. Files that already exist in
+ * @files are never replaced.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_utils_explode_bytes (GBytes *data,
+			 GHashTable *files,
+			 GPtrArray *glob,
+			 GError **error)
+{
+	const gchar *tmp;
+	struct archive *arch = NULL;
+	struct archive *arch_preview = NULL;
+	struct archive_entry *entry;
+	gboolean ret = TRUE;
+	GHashTableIter iter;
+	gpointer key, value;
+	int r;
+	g_autoptr(GHashTable) links = NULL;
+	g_autoptr(GHashTable) matches = NULL;
+
+	/* populate a hash with all the files, symlinks and hardlinks that
+	 * actually need decompressing */
+	arch_preview = asb_utils_archive_open_bytes (data, error);
+	if (arch_preview == NULL)
+		return FALSE;
+	matches = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (;;) {
+		g_autofree gchar *path = NULL;
+		g_autofree gchar *target = NULL;
+		r = archive_read_next_header (arch_preview, &entry);
+		if (r == ARCHIVE_EOF)
+			break;
+		if (r != ARCHIVE_OK) {
+			ret = FALSE;
+			g_set_error (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_FAILED,
+				     "Cannot read header: %s",
+				     archive_error_string (arch_preview));
+			goto out;
+		}
+		tmp = archive_entry_pathname (entry);
+		if (tmp == NULL)
+			continue;
+		path = asb_utils_sanitise_path (tmp);
+		if (glob != NULL) {
+			if (asb_glob_value_search (glob, path) == NULL)
+				continue;
+		}
+		target = asb_utils_get_link_target (entry, path);
+		if (target != NULL)
+			g_hash_table_add (matches, g_steal_pointer (&target));
+		g_hash_table_add (matches, g_steal_pointer (&path));
+	}
+
+	/* read the contents of anything matching, remembering the links */
+	arch = asb_utils_archive_open_bytes (data, error);
+	if (arch == NULL) {
+		ret = FALSE;
+		goto out;
+	}
+	links = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	for (;;) {
+		g_autofree gchar *path = NULL;
+		g_autofree gchar *target = NULL;
+		GBytes *blob;
+		r = archive_read_next_header (arch, &entry);
+		if (r == ARCHIVE_EOF)
+			break;
+		if (r != ARCHIVE_OK) {
+			ret = FALSE;
+			g_set_error (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_FAILED,
+				     "Cannot read header: %s",
+				     archive_error_string (arch));
+			goto out;
+		}
+		tmp = archive_entry_pathname (entry);
+		if (tmp == NULL)
+			continue;
+		path = asb_utils_sanitise_path (tmp);
+		if (!g_hash_table_contains (matches, path))
+			continue;
+		if (g_hash_table_contains (files, path)) {
+			g_debug ("skipping as %s already exists", path);
+			continue;
+		}
+		target = asb_utils_get_link_target (entry, path);
+		if (target != NULL) {
+			g_hash_table_insert (links,
+					     g_steal_pointer (&path),
+					     g_steal_pointer (&target));
+			continue;
+		}
+		if (archive_entry_filetype (entry) != AE_IFREG)
+			continue;
+		blob = asb_utils_archive_read_data (arch, entry, error);
+		if (blob == NULL) {
+			ret = FALSE;
+			goto out;
+		}
+		g_hash_table_insert (files, g_steal_pointer (&path), blob);
+	}
+
+	/* alias each link to the data of the file it eventually points to */
+	g_hash_table_iter_init (&iter, links);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		const gchar *target = value;
+		GBytes *blob = NULL;
+		for (guint i = 0; i < 10 && target != NULL; i++) {
+			blob = g_hash_table_lookup (files, target);
+			if (blob != NULL)
+				break;
+			target = g_hash_table_lookup (links, target);
+		}
+		if (blob == NULL) {
+			g_debug ("%s does not point to a file", (const gchar *) key);
+			continue;
+		}
+		g_hash_table_insert (files, g_strdup (key), g_bytes_ref (blob));
+	}
+out:
+	asb_utils_archive_close (arch_preview);
+	asb_utils_archive_close (arch);
+	return ret;
+}
+
+/**
+ * asb_utils_explode_memory:
+ * @filename: package filename
+ * @files: (element-type utf8 GBytes): a hash table to add the files to
+ * @glob: (element-type utf8): filename globs, or %NULL
+ * @error: A #GError or %NULL
+ *
+ * Decompresses the package into memory. See asb_utils_explode_bytes()
+ * for details.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_utils_explode_memory (const gchar *filename,
+			  GHashTable *files,
+			  GPtrArray *glob,
+			  GError **error)
+{
+	g_autoptr(GBytes) data = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+
+	mapped_file = g_mapped_file_new (filename, FALSE, error);
+	if (mapped_file == NULL)
+		return FALSE;
+	data = g_mapped_file_get_bytes (mapped_file);
+	return asb_utils_explode_bytes (data, files, glob, error);
+}
+
+/**
+ * asb_utils_write_files:
+ * @files: (element-type utf8 GBytes): files from asb_utils_explode_memory()
+ * @dir: directory to write into
+ * @error: A #GError or %NULL
+ *
+ * Writes files previously decompressed into memory to a directory, so
+ * that the tree looks the same as if asb_utils_explode() had been used.
+ * Links are written as copies of the file they point to.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+asb_utils_write_files (GHashTable *files, const gchar *dir, GError **error)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init (&iter, files);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		const gchar *path = key;
+		GBytes *blob = value;
+		g_autofree gchar *fn = NULL;
+		g_autofree gchar *parent_dir = NULL;
+
+		/* never write outside the tree */
+		if (path[0] != '/' || strstr (path, "/../") != NULL) {
+			g_debug ("not writing %s", path);
+			continue;
+		}
+		fn = g_build_filename (dir, path, NULL);
+		if (g_file_test (fn, G_FILE_TEST_EXISTS))
+			continue;
+		parent_dir = g_path_get_dirname (fn);
+		if (!asb_utils_ensure_exists (parent_dir, error))
+			return FALSE;
+		if (!g_file_set_contents (fn,
+					  g_bytes_get_data (blob, NULL),
+					  (gssize) g_bytes_get_size (blob),
+					  error))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * asb_utils_add_files:
+ * @files: (element-type utf8 GBytes): files from asb_utils_explode_memory()
+ * @files_extra: (element-type utf8 GBytes): files to add
+ *
+ * Adds the files from another package, where any file that already exists
+ * is kept, as asb_utils_write_files() does when writing to a directory.
+ *
+ * Since: 0.8.5
+ **/
+void
+asb_utils_add_files (GHashTable *files, GHashTable *files_extra)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_hash_table_iter_init (&iter, files_extra);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		if (g_hash_table_contains (files, key))
+			continue;
+		g_hash_table_insert (files, g_strdup (key), g_bytes_ref (value));
+	}
+}
+
 static gboolean
 asb_utils_write_archive (const gchar *filename,
 			 const gchar *path_orig,
@@ -477,6 +1403,294 @@ asb_utils_write_archive (const gchar *filename,
 	return ret;
 }
 
+/* the member boundaries must not depend on the number of CPUs, otherwise the
+ * compressed archive would differ between machines */
+#define ASB_UTILS_ARCHIVE_CHUNK_FILES	128
+
+typedef struct {
+	GMutex		 mutex;		/* for each chunk ->done */
+	GCond		 cond;
+	const gchar	*path_orig;
+	GPtrArray	*files;
+	gboolean	 compress;
+} AsbUtilsArchiveHelper;
+
+typedef struct {
+	AsbUtilsArchiveHelper	*helper;
+	guint			 start;
+	guint			 end;
+	GBytes			*blob;
+	gsize			 len_tar;
+	GError			*error;
+	gboolean		 done;
+} AsbUtilsArchiveChunk;
+
+static ssize_t
+asb_utils_archive_write_cb (struct archive *a,
+			    void *user_data,
+			    const void *buf,
+			    size_t len)
+{
+	GByteArray *data = (GByteArray *) user_data;
+	g_byte_array_append (data, buf, (guint) len);
+	return (ssize_t) len;
+}
+
+static GBytes *
+asb_utils_gzip_data (const guint8 *data, gsize len, GError **error)
+{
+	g_autoptr(GOutputStream) ostream = NULL;
+	g_autoptr(GOutputStream) ostream_mem = NULL;
+	g_autoptr(GZlibCompressor) compressor = NULL;
+
+	/* no filename or mtime is set, so the header is reproducible */
+	compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+	ostream_mem = g_memory_output_stream_new_resizable ();
+	ostream = g_converter_output_stream_new (ostream_mem,
+						 G_CONVERTER (compressor));
+	if (!g_output_stream_write_all (ostream, data, len, NULL, NULL, error))
+		return NULL;
+	if (!g_output_stream_close (ostream, NULL, error))
+		return NULL;
+	return g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream_mem));
+}
+
+/* writes the tar entries for some of the files, without the end-of-archive
+ * marker, so that the chunks can be simply concatenated */
+static GBytes *
+asb_utils_write_archive_chunk (AsbUtilsArchiveChunk *chunk, GError **error)
+{
+	AsbUtilsArchiveHelper *helper = chunk->helper;
+	gboolean ret = TRUE;
+	guint len_entries;
+	struct archive *a;
+	g_autoptr(GByteArray) data = g_byte_array_new ();
+
+	a = archive_write_new ();
+	archive_write_set_format_pax_restricted (a);
+	archive_write_set_bytes_per_block (a, 0);
+	if (archive_write_open (a, data, NULL, asb_utils_archive_write_cb, NULL) != ARCHIVE_OK) {
+		g_set_error (error,
+			     ASB_PLUGIN_ERROR,
+			     ASB_PLUGIN_ERROR_FAILED,
+			     "Cannot open: %s",
+			     archive_error_string (a));
+		archive_write_free (a);
+		return NULL;
+	}
+	for (guint i = chunk->start; i < chunk->end; i++) {
+		const gchar *tmp = g_ptr_array_index (helper->files, i);
+		gsize len;
+		struct archive_entry *entry;
+		struct stat st;
+		g_autofree gchar *buf = NULL;
+		g_autofree gchar *filename_full = NULL;
+
+		filename_full = g_build_filename (helper->path_orig, tmp, NULL);
+		if (stat (filename_full, &st) != 0)
+			continue;
+		ret = g_file_get_contents (filename_full, &buf, &len, error);
+		if (!ret)
+			break;
+		entry = archive_entry_new ();
+		archive_entry_set_pathname (entry, tmp);
+		archive_entry_set_size (entry, (gint64) len);
+		archive_entry_set_filetype (entry, AE_IFREG);
+		archive_entry_set_perm (entry, 0644);
+		if (archive_write_header (a, entry) != ARCHIVE_OK) {
+			g_set_error (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_FAILED,
+				     "Cannot write header for %s: %s",
+				     tmp, archive_error_string (a));
+			archive_entry_free (entry);
+			ret = FALSE;
+			break;
+		}
+		archive_entry_free (entry);
+		if (archive_write_data (a, buf, len) != (ssize_t) len ||
+		    archive_write_finish_entry (a) != ARCHIVE_OK) {
+			g_set_error (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_FAILED,
+				     "Cannot write %s: %s",
+				     tmp, archive_error_string (a));
+			ret = FALSE;
+			break;
+		}
+	}
+
+	/* nothing is buffered when unblocked, so drop the trailer */
+	len_entries = data->len;
+	if (ret && archive_write_close (a) != ARCHIVE_OK) {
+		g_set_error (error,
+			     ASB_PLUGIN_ERROR,
+			     ASB_PLUGIN_ERROR_FAILED,
+			     "Cannot close: %s",
+			     archive_error_string (a));
+		ret = FALSE;
+	}
+	archive_write_free (a);
+	if (!ret)
+		return NULL;
+	g_byte_array_set_size (data, len_entries);
+	chunk->len_tar = len_entries;
+	if (helper->compress)
+		return asb_utils_gzip_data (data->data, data->len, error);
+	return g_byte_array_free_to_bytes (g_steal_pointer (&data));
+}
+
+static void
+asb_utils_write_archive_chunk_cb (gpointer data, gpointer user_data)
+{
+	AsbUtilsArchiveChunk *chunk = (AsbUtilsArchiveChunk *) data;
+	AsbUtilsArchiveHelper *helper = chunk->helper;
+	GBytes *blob;
+	GError *error_local = NULL;
+
+	blob = asb_utils_write_archive_chunk (chunk, &error_local);
+	g_mutex_lock (&helper->mutex);
+	chunk->blob = blob;
+	chunk->error = error_local;
+	chunk->done = TRUE;
+	g_cond_broadcast (&helper->cond);
+	g_mutex_unlock (&helper->mutex);
+}
+
+static void
+asb_utils_archive_chunk_free (AsbUtilsArchiveChunk *chunk)
+{
+	if (chunk->blob != NULL)
+		g_bytes_unref (chunk->blob);
+	if (chunk->error != NULL)
+		g_error_free (chunk->error);
+	g_free (chunk);
+}
+
+/* closing with a cancelled GCancellable means the temporary file is deleted
+ * rather than replacing the existing archive */
+static void
+asb_utils_write_archive_abort (GFileOutputStream *ostream)
+{
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+	g_cancellable_cancel (cancellable);
+	g_output_stream_close (G_OUTPUT_STREAM (ostream), cancellable, NULL);
+}
+
+/* builds each chunk of the archive in parallel and writes them in order as
+ * soon as they are ready; a gzip file can have multiple members */
+static gboolean
+asb_utils_write_archive_parallel (const gchar *filename,
+				  const gchar *path_orig,
+				  GPtrArray *files,
+				  gboolean compress,
+				  guint max_threads,
+				  GError **error)
+{
+	AsbUtilsArchiveHelper helper;
+	GThreadPool *pool;
+	gboolean ret = TRUE;
+	guint max_inflight;
+	guint nr_pushed = 0;
+	gsize len_tar = 0;
+	gsize len_trailer;
+	g_autofree guint8 *trailer = NULL;
+	g_autoptr(GBytes) blob_trailer = NULL;
+	g_autoptr(GFile) file = g_file_new_for_path (filename);
+	g_autoptr(GFileOutputStream) ostream = NULL;
+	g_autoptr(GPtrArray) chunks = NULL;
+
+	/* split up the sorted file list */
+	chunks = g_ptr_array_new_with_free_func ((GDestroyNotify) asb_utils_archive_chunk_free);
+	helper.path_orig = path_orig;
+	helper.files = files;
+	helper.compress = compress;
+	for (guint i = 0; i < files->len; i += ASB_UTILS_ARCHIVE_CHUNK_FILES) {
+		AsbUtilsArchiveChunk *chunk = g_new0 (AsbUtilsArchiveChunk, 1);
+		chunk->helper = &helper;
+		chunk->start = i;
+		chunk->end = MIN (i + ASB_UTILS_ARCHIVE_CHUNK_FILES, files->len);
+		g_ptr_array_add (chunks, chunk);
+	}
+	ostream = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+	if (ostream == NULL)
+		return FALSE;
+	g_mutex_init (&helper.mutex);
+	g_cond_init (&helper.cond);
+	pool = g_thread_pool_new (asb_utils_write_archive_chunk_cb,
+				  &helper,
+				  (gint) max_threads,
+				  TRUE,
+				  error);
+	if (pool == NULL) {
+		g_mutex_clear (&helper.mutex);
+		g_cond_clear (&helper.cond);
+		asb_utils_write_archive_abort (ostream);
+		return FALSE;
+	}
+
+	/* only keep a few chunks in memory at any one time */
+	max_inflight = max_threads * 2;
+	for (guint i = 0; i < chunks->len; i++) {
+		AsbUtilsArchiveChunk *chunk = g_ptr_array_index (chunks, i);
+		while (nr_pushed < chunks->len && nr_pushed < i + max_inflight) {
+			g_thread_pool_push (pool, g_ptr_array_index (chunks, nr_pushed), NULL);
+			nr_pushed++;
+		}
+		g_mutex_lock (&helper.mutex);
+		while (!chunk->done)
+			g_cond_wait (&helper.cond, &helper.mutex);
+		g_mutex_unlock (&helper.mutex);
+		if (chunk->error != NULL) {
+			g_propagate_error (error, g_steal_pointer (&chunk->error));
+			ret = FALSE;
+			break;
+		}
+		if (!g_output_stream_write_all (G_OUTPUT_STREAM (ostream),
+						g_bytes_get_data (chunk->blob, NULL),
+						g_bytes_get_size (chunk->blob),
+						NULL, NULL, error)) {
+			ret = FALSE;
+			break;
+		}
+		g_clear_pointer (&chunk->blob, g_bytes_unref);
+	}
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_mutex_clear (&helper.mutex);
+	g_cond_clear (&helper.cond);
+	if (!ret) {
+		asb_utils_write_archive_abort (ostream);
+		return FALSE;
+	}
+
+	/* the end-of-archive marker, padded to the default tar block size */
+	for (guint i = 0; i < chunks->len; i++) {
+		AsbUtilsArchiveChunk *chunk = g_ptr_array_index (chunks, i);
+		len_tar += chunk->len_tar;
+	}
+	len_trailer = 1024;
+	if ((len_tar + len_trailer) % 10240 != 0)
+		len_trailer += 10240 - (len_tar + len_trailer) % 10240;
+	trailer = g_malloc0 (len_trailer);
+	if (compress) {
+		blob_trailer = asb_utils_gzip_data (trailer, len_trailer, error);
+		if (blob_trailer == NULL) {
+			asb_utils_write_archive_abort (ostream);
+			return FALSE;
+		}
+	} else {
+		blob_trailer = g_bytes_new_take (g_steal_pointer (&trailer), len_trailer);
+	}
+	if (!g_output_stream_write_all (G_OUTPUT_STREAM (ostream),
+					g_bytes_get_data (blob_trailer, NULL),
+					g_bytes_get_size (blob_trailer),
+					NULL, NULL, error)) {
+		asb_utils_write_archive_abort (ostream);
+		return FALSE;
+	}
+	return g_output_stream_close (G_OUTPUT_STREAM (ostream), NULL, error);
+}
+
 static gboolean
 asb_utils_add_files_recursive (GPtrArray *files,
 			       const gchar *path_orig,
@@ -513,24 +1727,33 @@ my_pstrcmp (const gchar **a, const gchar **b)
 }
 
 /**
- * asb_utils_write_archive_dir:
+ * asb_utils_write_archive_dir_full:
  * @filename: archive filename
  * @directory: source directory
+ * @max_threads: the number of threads to use, or 0 for one per CPU
  * @error: A #GError or %NULL
  *
  * Writes an archive from a directory.
  *
+ * Uncompressed and gzip archives are built on @max_threads threads, with one
+ * gzip member per chunk of files. The output does not depend on the number
+ * of threads and is byte-for-byte reproducible.
+ *
  * Returns: %TRUE for success, %FALSE otherwise
  *
- * Since: 0.1.0
+ * Since: 0.8.5
  **/
 gboolean
-asb_utils_write_archive_dir (const gchar *filename,
-			     const gchar *directory,
-			     GError **error)
+asb_utils_write_archive_dir_full (const gchar *filename,
+				  const gchar *directory,
+				  guint max_threads,
+				  GError **error)
 {
 	g_autoptr(GPtrArray) files = NULL;
 
+	if (max_threads == 0)
+		max_threads = g_get_num_processors ();
+
 	/* add all files in the directory to the archive */
 	files = g_ptr_array_new_with_free_func (g_free);
 	if (!asb_utils_add_files_recursive (files, directory, directory, error))
@@ -541,10 +1764,42 @@ asb_utils_write_archive_dir (const gchar *filename,
 	/* sort by filename for deterministic results */
 	g_ptr_array_sort (files, (GCompareFunc) my_pstrcmp);
 
+	/* gzip and plain tar files can be built in parallel */
+	if (g_str_has_suffix (filename, ".gz")) {
+		return asb_utils_write_archive_parallel (filename, directory,
+							 files, TRUE,
+							 max_threads, error);
+	}
+	if (g_str_has_suffix (filename, ".tar")) {
+		return asb_utils_write_archive_parallel (filename, directory,
+							 files, FALSE,
+							 max_threads, error);
+	}
+
 	/* write tar file */
 	return asb_utils_write_archive (filename, directory, files, error);
 }
 
+/**
+ * asb_utils_write_archive_dir:
+ * @filename: archive filename
+ * @directory: source directory
+ * @error: A #GError or %NULL
+ *
+ * Writes an archive from a directory using one thread per CPU.
+ *
+ * Returns: %TRUE for success, %FALSE otherwise
+ *
+ * Since: 0.1.0
+ **/
+gboolean
+asb_utils_write_archive_dir (const gchar *filename,
+			     const gchar *directory,
+			     GError **error)
+{
+	return asb_utils_write_archive_dir_full (filename, directory, 0, error);
+}
+
 /******************************************************************************/
 
 struct AsbGlobValue {
@@ -23,12 +23,34 @@ gboolean	 asb_utils_ensure_exists_and_empty	(const gchar	*directory,
 gboolean	 asb_utils_write_archive_dir		(const gchar	*filename,
 							 const gchar	*directory,
 							 GError		**error);
+gboolean	 asb_utils_write_archive_dir_full	(const gchar	*filename,
+							 const gchar	*directory,
+							 guint		 max_threads,
+							 GError		**error);
 gboolean	 asb_utils_explode			(const gchar	*filename,
 							 const gchar	*dir,
 							 GPtrArray	*glob,
 							 GError		**error);
+gboolean	 asb_utils_explode_memory		(const gchar	*filename,
+							 GHashTable	*files,
+							 GPtrArray	*glob,
+							 GError		**error);
+gboolean	 asb_utils_explode_bytes		(GBytes		*data,
+							 GHashTable	*files,
+							 GPtrArray	*glob,
+							 GError		**error);
+gboolean	 asb_utils_write_files			(GHashTable	*files,
+							 const gchar	*dir,
+							 GError		**error);
+void		 asb_utils_add_files			(GHashTable	*files,
+							 GHashTable	*files_extra);
 gboolean	 asb_utils_optimize_png			(const gchar	*filename,
 							 GError		**error);
+gboolean	 asb_utils_optimize_pngs		(GPtrArray	*filenames,
+							 guint		 max_threads,
+							 GError		**error);
+GBytes		*asb_utils_png_encode_paletted		(GdkPixbuf	*pixbuf,
+							 GError		**error);
 gchar		*asb_utils_get_cache_id_for_filename	(const gchar	*filename);
 
 gchar		*asb_utils_get_builder_id		(void);
@@ -16,6 +16,12 @@ asb_plugin_get_name (void)
 	return "appdata";
 }
 
+AsbPluginFlags
+asb_plugin_get_flags (void)
+{
+	return ASB_PLUGIN_FLAG_IN_MEMORY;
+}
+
 void
 asb_plugin_add_globs (AsbPlugin *plugin, GPtrArray *globs)
 {
@@ -45,22 +51,45 @@ asb_plugin_check_filename (AsbPlugin *plugin, const gchar *filename)
 static gboolean
 asb_plugin_process_filename (AsbPlugin *plugin,
 			     AsbPackage *pkg,
+			     const gchar *tmpdir,
 			     const gchar *filename,
 			     GList **apps,
 			     GError **error)
 {
 	AsProblemKind problem_kind;
 	AsProblem *problem;
+	GPtrArray *vetos;
 	const gchar *tmp;
 	guint i;
 	g_autoptr(AsbApp) app = NULL;
+	g_autoptr(AsFormat) format = as_format_new ();
+	g_autoptr(GBytes) data = NULL;
 	g_autoptr(GPtrArray) problems = NULL;
 
+	/* parse from memory, which is the same as as_app_parse_file() */
+	data = asb_package_get_file_data (pkg, tmpdir, filename, error);
+	if (data == NULL)
+		return FALSE;
 	app = asb_app_new (NULL, NULL);
-	if (!as_app_parse_file (AS_APP (app), filename,
+	as_format_set_filename (format, filename);
+	as_app_add_format (AS_APP (app), format);
+	as_app_set_trust_flags (AS_APP (app),
+				AS_APP_TRUST_FLAG_CHECK_DUPLICATES |
+				AS_APP_TRUST_FLAG_CHECK_VALID_UTF8);
+	if (!as_app_parse_data (AS_APP (app), data,
 				AS_APP_PARSE_FLAG_USE_HEURISTICS,
-				error))
+				error)) {
+		g_prefix_error (error, "failed to parse %s: ", filename);
 		return FALSE;
+	}
+	vetos = as_app_get_vetos (AS_APP (app));
+	if (vetos->len > 0) {
+		g_set_error_literal (error,
+				     ASB_PLUGIN_ERROR,
+				     ASB_PLUGIN_ERROR_FAILED,
+				     g_ptr_array_index (vetos, 0));
+		return FALSE;
+	}
 	if (as_app_get_kind (AS_APP (app)) == AS_APP_KIND_UNKNOWN) {
 		g_set_error (error,
 			     ASB_PLUGIN_ERROR,
@@ -141,13 +170,12 @@ asb_plugin_process (AsbPlugin *plugin,
 
 	filelist = asb_package_get_filelist (pkg);
 	for (i = 0; filelist[i] != NULL; i++) {
-		g_autofree gchar *filename_tmp = NULL;
 		if (!_asb_plugin_check_filename (filelist[i]))
 			continue;
-		filename_tmp = g_build_filename (tmpdir, filelist[i], NULL);
 		ret = asb_plugin_process_filename (plugin,
 						   pkg,
-						   filename_tmp,
+						   tmpdir,
+						   filelist[i],
 						   &apps,
 						   error);
 		if (!ret) {
@@ -21,6 +21,12 @@ asb_plugin_get_name (void)
 	return "desktop";
 }
 
+AsbPluginFlags
+asb_plugin_get_flags (void)
+{
+	return ASB_PLUGIN_FLAG_IN_MEMORY;
+}
+
 void
 asb_plugin_add_globs (AsbPlugin *plugin, GPtrArray *globs)
 {
@@ -87,10 +93,19 @@ asb_plugin_process_app (AsbPlugin *plugin,
 	/* use the .desktop file to refine the application */
 	for (i = 0; app_dirs[i] != NULL; i++) {
 		g_autofree gchar *fn = NULL;
-		fn = g_build_filename (tmpdir,
-				       app_dirs[i],
-				       desktop_basename->str,
-				       NULL);
+		g_autofree gchar *path = NULL;
+		g_autoptr(GBytes) data = NULL;
+
+		/* only write the tree if the file exists */
+		path = g_build_filename (app_dirs[i],
+					 desktop_basename->str,
+					 NULL);
+		data = asb_package_get_file_data (pkg, tmpdir, path, NULL);
+		if (data == NULL)
+			continue;
+		if (!asb_package_write_files (pkg, tmpdir, error))
+			return FALSE;
+		fn = g_build_filename (tmpdir, path, NULL);
 		if (g_file_test (fn, G_FILE_TEST_EXISTS)) {
 			if (!asb_plugin_desktop_refine (plugin, pkg, fn,
 							app, tmpdir, error))
@@ -24,12 +24,35 @@
 #define __APPSTREAM_GLIB_PRIVATE_H
 #include <as-app-private.h>
 
+struct AsbPluginPrivate {
+	GMutex			 mutex;
+};
+
 const gchar *
 asb_plugin_get_name (void)
 {
 	return "font";
 }
 
+void
+asb_plugin_initialize (AsbPlugin *plugin)
+{
+	plugin->priv = ASB_PLUGIN_GET_PRIVATE (AsbPluginPrivate);
+	g_mutex_init (&plugin->priv->mutex);
+}
+
+void
+asb_plugin_destroy (AsbPlugin *plugin)
+{
+	g_mutex_clear (&plugin->priv->mutex);
+}
+
+AsbPluginFlags
+asb_plugin_get_flags (void)
+{
+	return ASB_PLUGIN_FLAG_IN_MEMORY;
+}
+
 void
 asb_plugin_add_globs (AsbPlugin *plugin, GPtrArray *globs)
 {
@@ -692,6 +715,7 @@ asb_plugin_process_app (AsbPlugin *plugin,
 			const gchar *tmpdir,
 			GError **error)
 {
+	gboolean ret;
 	gchar **filelist;
 	guint i;
 
@@ -702,8 +726,15 @@ asb_plugin_process_app (AsbPlugin *plugin,
 
 		if (!_asb_plugin_check_filename (filelist[i]))
 			continue;
+		if (!asb_package_write_files (pkg, tmpdir, error))
+			return FALSE;
 		filename = g_build_filename (tmpdir, filelist[i], NULL);
-		if (!asb_plugin_font_app (plugin, app, filename, &error_local)) {
+
+		/* fontconfig uses a process-wide current config */
+		g_mutex_lock (&plugin->priv->mutex);
+		ret = asb_plugin_font_app (plugin, app, filename, &error_local);
+		g_mutex_unlock (&plugin->priv->mutex);
+		if (!ret) {
 			asb_package_log (pkg,
 					 ASB_PACKAGE_LOG_LEVEL_WARNING,
 					 "Failed to get font from %s: %s",
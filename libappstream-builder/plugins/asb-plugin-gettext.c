@@ -8,6 +8,7 @@
 #include <config.h>
 
 #include <asb-plugin.h>
+#include <as-app-builder-private.h>
 
 const gchar *
 asb_plugin_get_name (void)
@@ -15,6 +16,12 @@ asb_plugin_get_name (void)
 	return "gettext";
 }
 
+AsbPluginFlags
+asb_plugin_get_flags (void)
+{
+	return ASB_PLUGIN_FLAG_IN_MEMORY;
+}
+
 void
 asb_plugin_add_globs (AsbPlugin *plugin, GPtrArray *globs)
 {
@@ -32,6 +39,7 @@ asb_plugin_process_app (AsbPlugin *plugin,
 			GError **error)
 {
 	g_autofree gchar *prefix = NULL;
+	g_autoptr(GHashTable) files = NULL;
 	GPtrArray *translations;
 
 	/* skip for addons */
@@ -48,9 +56,15 @@ asb_plugin_process_app (AsbPlugin *plugin,
 		as_app_add_translation (AS_APP (app), translation);
 	}
 
-	/* search for .mo files in the prefix */
-	prefix = g_build_filename (tmpdir, "usr", NULL);
-	return as_app_builder_search_translations (AS_APP (app), prefix, 25,
-						   AS_APP_BUILDER_FLAG_USE_FALLBACKS,
-						   NULL, error);
+	/* search for .mo files in the prefix, which is only on disk if
+	 * another plugin needed a real tree */
+	files = asb_package_dup_files (pkg);
+	if (files != NULL)
+		prefix = g_strdup ("/usr");
+	else
+		prefix = g_build_filename (tmpdir, "usr", NULL);
+	return as_app_builder_search_translations_files (AS_APP (app), files,
+							 prefix, 25,
+							 AS_APP_BUILDER_FLAG_USE_FALLBACKS,
+							 error);
 }
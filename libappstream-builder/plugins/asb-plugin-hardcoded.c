@@ -8,6 +8,7 @@
 #include <config.h>
 
 #include <asb-plugin.h>
+#include <as-app-builder-private.h>
 
 const gchar *
 asb_plugin_get_name (void)
@@ -15,6 +16,12 @@ asb_plugin_get_name (void)
 	return "hardcoded";
 }
 
+AsbPluginFlags
+asb_plugin_get_flags (void)
+{
+	return ASB_PLUGIN_FLAG_IN_MEMORY;
+}
+
 void
 asb_plugin_add_globs (AsbPlugin *plugin, GPtrArray *globs)
 {
@@ -36,6 +43,7 @@ asb_plugin_process_app (AsbPlugin *plugin,
 	gchar **filelist;
 	guint i;
 	g_autofree gchar *prefix = NULL;
+	g_autoptr(GHashTable) files = NULL;
 
 	/* skip for addons */
 	if (as_app_get_kind (AS_APP (app)) == AS_APP_KIND_ADDON)
@@ -58,16 +66,22 @@ asb_plugin_process_app (AsbPlugin *plugin,
 	}
 
 	/* look for kudos and provides */
-	prefix = g_build_filename (tmpdir, "usr", NULL);
-	if (!as_app_builder_search_kudos (AS_APP (app),
-					  prefix,
-					  AS_APP_BUILDER_FLAG_USE_FALLBACKS,
-					  error))
+	files = asb_package_dup_files (pkg);
+	if (files != NULL)
+		prefix = g_strdup ("/usr");
+	else
+		prefix = g_build_filename (tmpdir, "usr", NULL);
+	if (!as_app_builder_search_kudos_files (AS_APP (app),
+						files,
+						prefix,
+						AS_APP_BUILDER_FLAG_USE_FALLBACKS,
+						error))
 		return FALSE;
-	if (!as_app_builder_search_provides (AS_APP (app),
-					     prefix,
-					     AS_APP_BUILDER_FLAG_USE_FALLBACKS,
-					     error))
+	if (!as_app_builder_search_provides_files (AS_APP (app),
+						   files,
+						   prefix,
+						   AS_APP_BUILDER_FLAG_USE_FALLBACKS,
+						   error))
 		return FALSE;
 
 	/* look for a high contrast icon */
@@ -22,6 +22,12 @@ asb_plugin_get_name (void)
 	return "icon";
 }
 
+AsbPluginFlags
+asb_plugin_get_flags (void)
+{
+	return ASB_PLUGIN_FLAG_IN_MEMORY;
+}
+
 void
 asb_plugin_add_globs (AsbPlugin *plugin, GPtrArray *globs)
 {
@@ -179,6 +185,8 @@ asb_plugin_process_app (AsbPlugin *plugin,
 		break;
 	}
 	g_ptr_array_set_size (as_app_get_icons (AS_APP (app)), 0);
+	if (!asb_package_write_files (pkg, tmpdir, error))
+		return FALSE;
 	if (!asb_plugin_icon_convert_cached (plugin, app, tmpdir, key, &error_local))
 		as_app_add_veto (AS_APP (app), "%s", error_local->message);
 
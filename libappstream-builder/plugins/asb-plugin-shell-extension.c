@@ -17,6 +17,12 @@ asb_plugin_get_name (void)
 	return "shell-extension";
 }
 
+AsbPluginFlags
+asb_plugin_get_flags (void)
+{
+	return ASB_PLUGIN_FLAG_IN_MEMORY;
+}
+
 void
 asb_plugin_add_globs (AsbPlugin *plugin, GPtrArray *globs)
 {
@@ -149,17 +155,21 @@ as_app_parse_shell_extension_data (AsbPlugin *plugin,
 static gboolean
 asb_plugin_process_filename (AsbPlugin *plugin,
 			     AsbPackage *pkg,
+			     const gchar *tmpdir,
 			     const gchar *filename,
 			     GList **apps,
 			     GError **error)
 {
 	gsize len;
+	const gchar *data;
 	g_autoptr(AsbApp) app = NULL;
-	g_autofree gchar *data = NULL;
+	g_autoptr(GBytes) blob = NULL;
 
 	app = asb_app_new (pkg, NULL);
-	if (!g_file_get_contents (filename, &data, &len, error))
+	blob = asb_package_get_file_data (pkg, tmpdir, filename, error);
+	if (blob == NULL)
 		return FALSE;
+	data = g_bytes_get_data (blob, &len);
 	if (!as_app_parse_shell_extension_data (plugin, AS_APP (app), data, len, error))
 		return FALSE;
 	asb_plugin_add_app (apps, AS_APP (app));
@@ -179,13 +189,12 @@ asb_plugin_process (AsbPlugin *plugin,
 
 	filelist = asb_package_get_filelist (pkg);
 	for (i = 0; filelist[i] != NULL; i++) {
-		g_autofree gchar *filename_tmp = NULL;
 		if (!_asb_plugin_check_filename (filelist[i]))
 			continue;
-		filename_tmp = g_build_filename (tmpdir, filelist[i], NULL);
 		ret = asb_plugin_process_filename (plugin,
 						   pkg,
-						   filename_tmp,
+						   tmpdir,
+						   filelist[i],
 						   &apps,
 						   error);
 		if (!ret) {
@@ -0,0 +1,35 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2015 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#if !defined (__APPSTREAM_GLIB_PRIVATE_H) && !defined (AS_COMPILATION)
+#error "Only <appstream-glib.h> can be included directly."
+#endif
+
+#include "as-app-builder.h"
+
+G_BEGIN_DECLS
+
+gboolean	 as_app_builder_search_translations_files (AsApp	*app,
+							 GHashTable	*files,
+							 const gchar	*prefix,
+							 guint		 min_percentage,
+							 AsAppBuilderFlags flags,
+							 GError		**error);
+gboolean	 as_app_builder_search_kudos_files	(AsApp		*app,
+							 GHashTable	*files,
+							 const gchar	*prefix,
+							 AsAppBuilderFlags flags,
+							 GError		**error);
+gboolean	 as_app_builder_search_provides_files	(AsApp		*app,
+							 GHashTable	*files,
+							 const gchar	*prefix,
+							 AsAppBuilderFlags flags,
+							 GError		**error);
+
+G_END_DECLS
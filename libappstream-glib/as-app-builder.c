@@ -22,7 +22,7 @@
 
 #include <string.h>
 
-#include "as-app-builder.h"
+#include "as-app-builder-private.h"
 
 typedef struct {
 	gchar		*locale;
@@ -34,6 +34,7 @@ typedef struct {
 	guint		 max_nstrings;
 	GList		*data;
 	GPtrArray	*translations;		/* no ref */
+	GHashTable	*files;			/* no ref, or %NULL */
 } AsAppBuilderContext;
 
 static AsAppBuilderEntry *
@@ -66,6 +67,107 @@ as_app_builder_ctx_free (AsAppBuilderContext *ctx)
 	g_free (ctx);
 }
 
+/* when @files is set the paths are looked up in the table of filename to
+ * #GBytes rather than in the filesystem */
+static gboolean
+as_app_builder_file_test (GHashTable *files, const gchar *path, GFileTest test)
+{
+	GHashTableIter iter;
+	gpointer key;
+	g_autofree gchar *path_dir = NULL;
+
+	if (files == NULL)
+		return g_file_test (path, test);
+
+	/* the symlinks have already been resolved */
+	if (test == G_FILE_TEST_IS_SYMLINK)
+		return FALSE;
+	if (test != G_FILE_TEST_IS_DIR &&
+	    g_hash_table_contains (files, path))
+		return TRUE;
+	if (test == G_FILE_TEST_IS_REGULAR)
+		return FALSE;
+
+	/* a directory exists if it contains anything */
+	path_dir = g_strconcat (path, "/", NULL);
+	g_hash_table_iter_init (&iter, files);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		if (g_str_has_prefix (key, path_dir))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static GBytes *
+as_app_builder_file_get_data (GHashTable *files, const gchar *path, GError **error)
+{
+	gchar *data = NULL;
+	gsize len = 0;
+
+	if (files != NULL) {
+		GBytes *blob = g_hash_table_lookup (files, path);
+		if (blob == NULL) {
+			g_set_error (error,
+				     AS_APP_ERROR,
+				     AS_APP_ERROR_FAILED,
+				     "%s was not found", path);
+			return NULL;
+		}
+		return g_bytes_ref (blob);
+	}
+	if (!g_file_get_contents (path, &data, &len, error))
+		return NULL;
+	return g_bytes_new_take (data, len);
+}
+
+static gint
+as_app_builder_dir_sort_cb (gconstpointer a, gconstpointer b)
+{
+	return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* lists the names in the directory, which has to exist */
+static GPtrArray *
+as_app_builder_dir_list (GHashTable *files, const gchar *path, GError **error)
+{
+	GHashTableIter iter;
+	gpointer key;
+	g_autofree gchar *path_dir = NULL;
+	g_autoptr(GHashTable) names = NULL;
+	g_autoptr(GPtrArray) array = g_ptr_array_new_with_free_func (g_free);
+
+	if (files == NULL) {
+		const gchar *tmp;
+		g_autoptr(GDir) dir = g_dir_open (path, 0, error);
+		if (dir == NULL)
+			return NULL;
+		while ((tmp = g_dir_read_name (dir)) != NULL)
+			g_ptr_array_add (array, g_strdup (tmp));
+		return g_steal_pointer (&array);
+	}
+
+	/* the first path component after the directory */
+	path_dir = g_strconcat (path, "/", NULL);
+	names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	g_hash_table_iter_init (&iter, files);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		const gchar *fn = key;
+		const gchar *tmp;
+		if (!g_str_has_prefix (fn, path_dir))
+			continue;
+		fn += strlen (path_dir);
+		tmp = strchr (fn, '/');
+		g_hash_table_add (names, tmp != NULL ? g_strndup (fn, (gsize) (tmp - fn)) : g_strdup (fn));
+	}
+	g_hash_table_iter_init (&iter, names);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		g_hash_table_iter_steal (&iter);
+		g_ptr_array_add (array, key);
+	}
+	g_ptr_array_sort (array, as_app_builder_dir_sort_cb);
+	return g_steal_pointer (&array);
+}
+
 typedef struct {
 	guint32		 magic;
 	guint32		 revision;
@@ -97,12 +199,23 @@ as_app_builder_parse_file_gettext (AsAppBuilderContext *ctx,
 {
 	AsAppBuilderEntry *entry;
 	AsAppBuilderGettextHeader h;
-	g_autofree gchar *data = NULL;
+	const guint8 *data;
+	gsize len = 0;
 	gboolean swapped;
+	g_autoptr(GBytes) blob = NULL;
 
 	/* read data */
-	if (!g_file_get_contents (filename, &data, NULL, error))
+	blob = as_app_builder_file_get_data (ctx->files, filename, error);
+	if (blob == NULL)
+		return FALSE;
+	data = g_bytes_get_data (blob, &len);
+	if (len < sizeof (AsAppBuilderGettextHeader)) {
+		g_set_error_literal (error,
+				     AS_APP_ERROR,
+				     AS_APP_ERROR_FAILED,
+				     "file is too small");
 		return FALSE;
+	}
 
 	/* we only strictly need the header */
 	memcpy (&h, data, sizeof (AsAppBuilderGettextHeader));
@@ -137,20 +250,21 @@ as_app_builder_search_locale_gettext (AsAppBuilderContext *ctx,
 	const gchar *filename;
 	gboolean found_anything = FALSE;
 	guint i;
-	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GPtrArray) names = NULL;
 	g_autoptr(GPtrArray) mo_paths = NULL;
 
 	/* list files */
-	dir = g_dir_open (messages_path, 0, error);
-	if (dir == NULL)
+	names = as_app_builder_dir_list (ctx->files, messages_path, error);
+	if (names == NULL)
 		return FALSE;
 
 	/* do a first pass at this, trying to find the preferred .mo */
 	mo_paths = g_ptr_array_new_with_free_func (g_free);
-	while ((filename = g_dir_read_name (dir)) != NULL) {
+	for (guint k = 0; k < names->len; k++) {
 		g_autofree gchar *path = NULL;
+		filename = g_ptr_array_index (names, k);
 		path = g_build_filename (messages_path, filename, NULL);
-		if (!g_file_test (path, G_FILE_TEST_EXISTS))
+		if (!as_app_builder_file_test (ctx->files, path, G_FILE_TEST_EXISTS))
 			continue;
 		for (i = 0; i < ctx->translations->len; i++) {
 			AsTranslation *t = g_ptr_array_index (ctx->translations, i);
@@ -280,17 +394,20 @@ as_app_builder_parse_file_qt (AsAppBuilderContext *ctx,
 			      const gchar *filename,
 			      GError **error)
 {
-	gsize len;
+	gsize len = 0;
 	guint32 m = 0;
-	g_autofree guint8 *data = NULL;
+	const guint8 *data;
+	g_autoptr(GBytes) blob = NULL;
 	const guint8 qm_magic[] = {
 		0x3c, 0xb8, 0x64, 0x18, 0xca, 0xef, 0x9c, 0x95,
 		0xcd, 0x21, 0x1c, 0xbf, 0x60, 0xa1, 0xbd, 0xdd
 	};
 
 	/* load file */
-	if (!g_file_get_contents (filename, (gchar **) &data, &len, error))
+	blob = as_app_builder_file_get_data (ctx->files, filename, error);
+	if (blob == NULL)
 		return FALSE;
+	data = g_bytes_get_data (blob, &len);
 
 	/* check header */
 	if (len < sizeof(qm_magic) ||
@@ -337,11 +454,9 @@ as_app_builder_search_translations_qt (AsAppBuilderContext *ctx,
 	/* search for each translation ID */
 	for (i = 0; i < ctx->translations->len; i++) {
 		AsTranslation *t;
-		const gchar *dirname;
-		const gchar *filename;
 		const gchar *install_dir;
 		g_autofree gchar *path = NULL;
-		g_autoptr(GDir) dir = NULL;
+		g_autoptr(GPtrArray) names = NULL;
 
 		/* FIXME: this path probably has to be specified as an attribute
 		 * in the <translations> tag from the AppData file */
@@ -357,14 +472,15 @@ as_app_builder_search_translations_qt (AsAppBuilderContext *ctx,
 					 install_dir,
 					 "translations",
 					 NULL);
-		if (!g_file_test (path, G_FILE_TEST_EXISTS))
+		if (!as_app_builder_file_test (ctx->files, path, G_FILE_TEST_EXISTS))
 			return TRUE;
-		dir = g_dir_open (path, 0, error);
-		if (dir == NULL)
+		names = as_app_builder_dir_list (ctx->files, path, error);
+		if (names == NULL)
 			return FALSE;
 
 		/* look for ${prefix}/share/${install_dir}/translations/${id}_${locale}.qm */
-		while ((filename = g_dir_read_name (dir)) != NULL) {
+		for (guint j = 0; j < names->len; j++) {
+			const gchar *filename = g_ptr_array_index (names, j);
 			g_autofree gchar *fn = NULL;
 			g_autofree gchar *locale = NULL;
 			if (!g_str_has_prefix (filename, as_translation_get_id (t)))
@@ -372,7 +488,7 @@ as_app_builder_search_translations_qt (AsAppBuilderContext *ctx,
 			if (!g_str_has_suffix (filename, ".qm"))
 				continue;
 			fn = g_build_filename (path, filename, NULL);
-			if (!g_file_test (fn, G_FILE_TEST_IS_REGULAR))
+			if (!as_app_builder_file_test (ctx->files, fn, G_FILE_TEST_IS_REGULAR))
 				continue;
 			locale = g_strdup (filename + strlen (as_translation_get_id (t)) + 1);
 			g_strdelimit (locale, ".", '\0');
@@ -380,29 +496,29 @@ as_app_builder_search_translations_qt (AsAppBuilderContext *ctx,
 				return FALSE;
 		}
 
-		g_dir_rewind (dir);
-
 		/* look for ${prefix}/share/${install_dir}/translations/${id}/${locale}.qm */
-		while ((dirname = g_dir_read_name (dir)) != NULL) {
+		for (guint j = 0; j < names->len; j++) {
+			const gchar *dirname = g_ptr_array_index (names, j);
 			g_autofree gchar *path_subdir = NULL;
-			g_autoptr(GDir) subdir = NULL;
+			g_autoptr(GPtrArray) subnames = NULL;
 
 			if (!g_str_equal (dirname, as_translation_get_id (t)))
 				continue;
 			path_subdir = g_build_filename (path, dirname, NULL);
-			if (!g_file_test (path_subdir, G_FILE_TEST_IS_DIR))
+			if (!as_app_builder_file_test (ctx->files, path_subdir, G_FILE_TEST_IS_DIR))
 				continue;
-			subdir = g_dir_open (path_subdir, 0, error);
-			if (subdir == NULL)
+			subnames = as_app_builder_dir_list (ctx->files, path_subdir, error);
+			if (subnames == NULL)
 				return FALSE;
 
-			while ((filename = g_dir_read_name (subdir)) != NULL) {
+			for (guint k = 0; k < subnames->len; k++) {
+				const gchar *filename = g_ptr_array_index (subnames, k);
 				g_autofree gchar *fn = NULL;
 				g_autofree gchar *locale = NULL;
 				if (!g_str_has_suffix (filename, ".qm"))
 					continue;
 				fn = g_build_filename (path_subdir, filename, NULL);
-				if (!g_file_test (fn, G_FILE_TEST_IS_REGULAR))
+				if (!as_app_builder_file_test (ctx->files, fn, G_FILE_TEST_IS_REGULAR))
 					continue;
 				locale = g_strdup (filename);
 				g_strdelimit (locale, ".", '\0');
@@ -421,20 +537,20 @@ as_app_builder_search_translations_gettext (AsAppBuilderContext *ctx,
 					    AsAppBuilderFlags flags,
 					    GError **error)
 {
-	const gchar *locale;
 	g_autofree gchar *path = NULL;
-	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GPtrArray) names = NULL;
 
 	path = g_build_filename (prefix, "share", "locale", NULL);
-	if (!g_file_test (path, G_FILE_TEST_EXISTS))
+	if (!as_app_builder_file_test (ctx->files, path, G_FILE_TEST_EXISTS))
 		return TRUE;
-	dir = g_dir_open (path, 0, error);
-	if (dir == NULL)
+	names = as_app_builder_dir_list (ctx->files, path, error);
+	if (names == NULL)
 		return FALSE;
-	while ((locale = g_dir_read_name (dir)) != NULL) {
+	for (guint i = 0; i < names->len; i++) {
+		const gchar *locale = g_ptr_array_index (names, i);
 		g_autofree gchar *fn = NULL;
 		fn = g_build_filename (path, locale, "LC_MESSAGES", NULL);
-		if (!g_file_test (fn, G_FILE_TEST_EXISTS))
+		if (!as_app_builder_file_test (ctx->files, fn, G_FILE_TEST_EXISTS))
 			continue;
 		if (!as_app_builder_search_locale_gettext (ctx, locale, fn, flags, error))
 			return FALSE;
@@ -468,10 +584,13 @@ as_app_builder_parse_file_pak (AsAppBuilderContext *ctx,
 	guint32 nr_resources;
 	guint32 version_number;
 	guint8 encoding;
-	g_autofree gchar *data = NULL;
+	const guint8 *data;
+	g_autoptr(GBytes) blob = NULL;
 
-	if (!g_file_get_contents (filename, &data, &len, error))
+	blob = as_app_builder_file_get_data (ctx->files, filename, error);
+	if (blob == NULL)
 		return FALSE;
+	data = g_bytes_get_data (blob, &len);
 	if (len < 9) {
 		g_set_error (error,
 			     AS_APP_ERROR,
@@ -504,7 +623,7 @@ as_app_builder_parse_file_pak (AsAppBuilderContext *ctx,
 	}
 
 	/* get single byte of encoding */
-	encoding = (guint8) data[8];
+	encoding = data[8];
 	if (encoding != 0 && encoding != 1) {
 		g_set_error (error,
 			     AS_APP_ERROR,
@@ -532,8 +651,6 @@ as_app_builder_search_translations_pak (AsAppBuilderContext *ctx,
 
 	/* search for each translation ID */
 	for (i = 0; i < ctx->translations->len; i++) {
-		const gchar *tmp;
-		g_autoptr(GDir) dir = NULL;
 		AsTranslation *t = g_ptr_array_index (ctx->translations, i);
 		const gchar *libdirs[] = { "lib64", "lib", NULL };
 
@@ -542,19 +659,21 @@ as_app_builder_search_translations_pak (AsAppBuilderContext *ctx,
 			continue;
 		for (guint j = 0; libdirs[j] != NULL; j++) {
 			g_autofree gchar *path = NULL;
+			g_autoptr(GPtrArray) names = NULL;
 			path = g_build_filename (prefix,
 						 libdirs[j],
 						 as_translation_get_id (t),
 						 "locales",
 						 NULL);
-			if (!g_file_test (path, G_FILE_TEST_EXISTS))
+			if (!as_app_builder_file_test (ctx->files, path, G_FILE_TEST_EXISTS))
 				continue;
-			dir = g_dir_open (path, 0, error);
-			if (dir == NULL)
+			names = as_app_builder_dir_list (ctx->files, path, error);
+			if (names == NULL)
 				return FALSE;
 
 			/* parse file for sanity */
-			while ((tmp = g_dir_read_name (dir)) != 0) {
+			for (guint k = 0; k < names->len; k++) {
+				const gchar *tmp = g_ptr_array_index (names, k);
 				g_autofree gchar *locale = NULL;
 				g_autofree gchar *fn = g_build_filename (path, tmp, NULL);
 				locale = as_app_builder_get_locale_from_pak_fn (tmp);
@@ -604,29 +723,29 @@ as_app_builder_search_translations_xpi (AsAppBuilderContext *ctx,
 					AsAppBuilderFlags flags,
 					GError **error)
 {
-	const gchar *tmp;
-	g_autoptr(GDir) dir = NULL;
 	const gchar *libdirs[] = { "lib64", "lib", NULL };
 
 	/* list files */
 	for (guint j = 0; libdirs[j] != NULL; j++) {
 		g_autofree gchar *path = NULL;
+		g_autoptr(GPtrArray) names = NULL;
 		path = g_build_filename (prefix,
 					 libdirs[j],
 					 "firefox",
 					 "langpacks",
 					 NULL);
-		if (!g_file_test (path, G_FILE_TEST_EXISTS))
+		if (!as_app_builder_file_test (ctx->files, path, G_FILE_TEST_EXISTS))
 			continue;
-		dir = g_dir_open (path, 0, error);
-		if (dir == NULL)
+		names = as_app_builder_dir_list (ctx->files, path, error);
+		if (names == NULL)
 			return FALSE;
 
 		/* parse file for sanity */
-		while ((tmp = g_dir_read_name (dir)) != 0) {
+		for (guint k = 0; k < names->len; k++) {
+			const gchar *tmp = g_ptr_array_index (names, k);
 			g_autofree gchar *locale = NULL;
 			g_autofree gchar *fn = g_build_filename (path, tmp, NULL);
-			if (g_file_test (fn, G_FILE_TEST_IS_SYMLINK))
+			if (as_app_builder_file_test (ctx->files, fn, G_FILE_TEST_IS_SYMLINK))
 				continue;
 			locale = as_app_builder_get_locale_from_xpi_fn (tmp);
 			if (!as_app_builder_parse_file_xpi (ctx, locale, fn, error))
@@ -647,39 +766,27 @@ as_app_builder_entry_sort_cb (gconstpointer a, gconstpointer b)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(AsAppBuilderContext, as_app_builder_ctx_free)
 
 /**
- * as_app_builder_search_translations:
+ * as_app_builder_search_translations_files: (skip)
  * @app: an #AsApp
+ * @files: (element-type utf8 GBytes) (nullable): a table of filename to data
  * @prefix: a prefix to search, e.g. "/usr"
  * @min_percentage: minimum percentage to add language
  * @flags: #AsAppBuilderFlags, e.g. %AS_APP_BUILDER_FLAG_USE_FALLBACKS
- * @cancellable: a #GCancellable or %NULL
  * @error: a #GError or %NULL
  *
- * Searches a prefix for languages, and using a heuristic adds <language>
- * tags to the specified application.
- *
- * If there are no #AsTranslation objects set on the #AsApp then all domains
- * are matched, which may include more languages than you intended to.
- *
- * @min_percentage sets the minimum percentage to add a language tag.
- * The usual value would be 25% and any language less complete than
- * this will not be added.
- *
- * The purpose of this functionality is to avoid blowing up the size
- * of the AppStream metadata with a lot of extra data detailing
- * languages with very few translated strings.
+ * Searches for languages like as_app_builder_search_translations(), but in
+ * files that have already been loaded into memory. If @files is %NULL then
+ * the filesystem is used.
  *
  * Returns: %TRUE for success
- *
- * Since: 0.5.8
  **/
 gboolean
-as_app_builder_search_translations (AsApp *app,
-				    const gchar *prefix,
-				    guint min_percentage,
-				    AsAppBuilderFlags flags,
-				    GCancellable *cancellable,
-				    GError **error)
+as_app_builder_search_translations_files (AsApp *app,
+					  GHashTable *files,
+					  const gchar *prefix,
+					  guint min_percentage,
+					  AsAppBuilderFlags flags,
+					  GError **error)
 {
 	AsAppBuilderEntry *e;
 	GList *l;
@@ -687,6 +794,7 @@ as_app_builder_search_translations (AsApp *app,
 
 	ctx = as_app_builder_ctx_new ();
 	ctx->translations = as_app_get_translations (app);
+	ctx->files = files;
 
 	/* search for QT .qm files */
 	if (!as_app_builder_search_translations_qt (ctx, prefix, flags, error))
@@ -723,26 +831,67 @@ as_app_builder_search_translations (AsApp *app,
 	return TRUE;
 }
 
+/**
+ * as_app_builder_search_translations:
+ * @app: an #AsApp
+ * @prefix: a prefix to search, e.g. "/usr"
+ * @min_percentage: minimum percentage to add language
+ * @flags: #AsAppBuilderFlags, e.g. %AS_APP_BUILDER_FLAG_USE_FALLBACKS
+ * @cancellable: a #GCancellable or %NULL
+ * @error: a #GError or %NULL
+ *
+ * Searches a prefix for languages, and using a heuristic adds <language>
+ * tags to the specified application.
+ *
+ * If there are no #AsTranslation objects set on the #AsApp then all domains
+ * are matched, which may include more languages than you intended to.
+ *
+ * @min_percentage sets the minimum percentage to add a language tag.
+ * The usual value would be 25% and any language less complete than
+ * this will not be added.
+ *
+ * The purpose of this functionality is to avoid blowing up the size
+ * of the AppStream metadata with a lot of extra data detailing
+ * languages with very few translated strings.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 0.5.8
+ **/
+gboolean
+as_app_builder_search_translations (AsApp *app,
+				    const gchar *prefix,
+				    guint min_percentage,
+				    AsAppBuilderFlags flags,
+				    GCancellable *cancellable,
+				    GError **error)
+{
+	return as_app_builder_search_translations_files (app, NULL, prefix,
+							 min_percentage,
+							 flags, error);
+}
+
 static gboolean
 as_app_builder_search_path (AsApp *app,
+			    GHashTable *files,
 			    const gchar *prefix,
 			    const gchar *path,
 			    AsAppBuilderFlags flags)
 {
-	const gchar *tmp;
 	g_autofree gchar *fn_prefix = NULL;
-	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GPtrArray) names = NULL;
 
 	/* find dir */
 	fn_prefix = g_build_filename (prefix, path, NULL);
-	if (!g_file_test (fn_prefix, G_FILE_TEST_IS_DIR))
+	if (!as_app_builder_file_test (files, fn_prefix, G_FILE_TEST_IS_DIR))
 		return FALSE;
-	dir = g_dir_open (fn_prefix, 0, NULL);
-	if (dir == NULL)
+	names = as_app_builder_dir_list (files, fn_prefix, NULL);
+	if (names == NULL)
 		return FALSE;
 
 	/* find any file with the app-id prefix */
-	while ((tmp = g_dir_read_name (dir)) != NULL) {
+	for (guint i = 0; i < names->len; i++) {
+		const gchar *tmp = g_ptr_array_index (names, i);
 		if (g_str_has_prefix (tmp, as_app_get_id (app)))
 			return TRUE;
 	}
@@ -755,27 +904,28 @@ as_app_builder_search_path (AsApp *app,
 }
 
 /**
- * as_app_builder_search_kudos:
+ * as_app_builder_search_kudos_files: (skip)
  * @app: an #AsApp
+ * @files: (element-type utf8 GBytes) (nullable): a table of filename to data
  * @prefix: a prefix to search, e.g. "/usr"
  * @flags: #AsAppBuilderFlags, e.g. %AS_APP_BUILDER_FLAG_USE_FALLBACKS
  * @error: a #GError or %NULL
  *
- * Searches a prefix for auto-detected kudos.
+ * Searches for auto-detected kudos like as_app_builder_search_kudos(), but
+ * in files that have already been loaded into memory.
  *
  * Returns: %TRUE for success
- *
- * Since: 0.5.8
  **/
 gboolean
-as_app_builder_search_kudos (AsApp *app,
-			     const gchar *prefix,
-			     AsAppBuilderFlags flags,
-			     GError **error)
+as_app_builder_search_kudos_files (AsApp *app,
+				   GHashTable *files,
+				   const gchar *prefix,
+				   AsAppBuilderFlags flags,
+				   GError **error)
 {
 	/* gnome-shell search provider */
 	if (!as_app_has_kudo_kind (app, AS_KUDO_KIND_SEARCH_PROVIDER) &&
-	    as_app_builder_search_path (app, prefix,
+	    as_app_builder_search_path (app, files, prefix,
 					"share/gnome-shell/search-providers",
 					flags)) {
 		g_debug ("auto-adding SearchProvider kudo");
@@ -784,7 +934,7 @@ as_app_builder_search_kudos (AsApp *app,
 
 	/* hicolor icon */
 	if (!as_app_has_kudo_kind (app, AS_KUDO_KIND_HIGH_CONTRAST) &&
-	    as_app_builder_search_path (app, prefix,
+	    as_app_builder_search_path (app, files, prefix,
 					"share/icons/hicolor/symbolic/apps",
 					flags)) {
 		g_debug ("auto-adding HighContrast kudo");
@@ -793,19 +943,49 @@ as_app_builder_search_kudos (AsApp *app,
 	return TRUE;
 }
 
+/**
+ * as_app_builder_search_kudos:
+ * @app: an #AsApp
+ * @prefix: a prefix to search, e.g. "/usr"
+ * @flags: #AsAppBuilderFlags, e.g. %AS_APP_BUILDER_FLAG_USE_FALLBACKS
+ * @error: a #GError or %NULL
+ *
+ * Searches a prefix for auto-detected kudos.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 0.5.8
+ **/
+gboolean
+as_app_builder_search_kudos (AsApp *app,
+			     const gchar *prefix,
+			     AsAppBuilderFlags flags,
+			     GError **error)
+{
+	return as_app_builder_search_kudos_files (app, NULL, prefix, flags, error);
+}
+
 static gboolean
 as_app_builder_search_dbus_file (AsApp *app,
+				 GHashTable *files,
 				 const gchar *filename,
 				 AsProvideKind provide_kind,
 				 GError **error)
 {
+	const gchar *data;
+	gsize len = 0;
 	g_autofree gchar *name = NULL;
 	g_autoptr(AsProvide) provide = NULL;
+	g_autoptr(GBytes) blob = NULL;
 	g_autoptr(GKeyFile) kf = NULL;
 
 	/* load file */
+	blob = as_app_builder_file_get_data (files, filename, error);
+	if (blob == NULL)
+		return FALSE;
+	data = g_bytes_get_data (blob, &len);
 	kf = g_key_file_new ();
-	if (!g_key_file_load_from_file (kf, filename, G_KEY_FILE_NONE, error))
+	if (!g_key_file_load_from_data (kf, data, len, G_KEY_FILE_NONE, error))
 		return FALSE;
 	name = g_key_file_get_string (kf, "D-BUS Service", "Name", error);
 	if (name == NULL)
@@ -821,70 +1001,94 @@ as_app_builder_search_dbus_file (AsApp *app,
 
 static gboolean
 as_app_builder_search_dbus (AsApp *app,
+			    GHashTable *files,
 			    const gchar *prefix,
 			    const gchar *path,
 			    AsProvideKind provide_kind,
 			    AsAppBuilderFlags flags,
 			    GError **error)
 {
-	const gchar *tmp;
 	g_autofree gchar *fn_prefix = NULL;
-	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GPtrArray) names = NULL;
 
 	/* find dir */
 	fn_prefix = g_build_filename (prefix, path, NULL);
-	if (!g_file_test (fn_prefix, G_FILE_TEST_IS_DIR))
+	if (!as_app_builder_file_test (files, fn_prefix, G_FILE_TEST_IS_DIR))
 		return TRUE;
-	dir = g_dir_open (fn_prefix, 0, error);
-	if (dir == NULL)
+	names = as_app_builder_dir_list (files, fn_prefix, error);
+	if (names == NULL)
 		return FALSE;
 
 	/* find any file with the app-id prefix */
-	while ((tmp = g_dir_read_name (dir)) != NULL) {
+	for (guint i = 0; i < names->len; i++) {
+		const gchar *tmp = g_ptr_array_index (names, i);
 		g_autofree gchar *fn = NULL;
 		if ((flags & AS_APP_BUILDER_FLAG_USE_FALLBACKS) == 0) {
 			if (!g_str_has_prefix (tmp, as_app_get_id (app)))
 				continue;
 		}
 		fn = g_build_filename (fn_prefix, tmp, NULL);
-		if (!as_app_builder_search_dbus_file (app, fn, provide_kind, error))
+		if (!as_app_builder_search_dbus_file (app, files, fn, provide_kind, error))
 			return FALSE;
 	}
 	return TRUE;
 }
 
 /**
- * as_app_builder_search_provides:
+ * as_app_builder_search_provides_files: (skip)
  * @app: an #AsApp
+ * @files: (element-type utf8 GBytes) (nullable): a table of filename to data
  * @prefix: a prefix to search, e.g. "/usr"
  * @flags: #AsAppBuilderFlags, e.g. %AS_APP_BUILDER_FLAG_USE_FALLBACKS
  * @error: a #GError or %NULL
  *
- * Searches a prefix for auto-detected provides.
+ * Searches for auto-detected provides like as_app_builder_search_provides(),
+ * but in files that have already been loaded into memory.
  *
  * Returns: %TRUE for success
- *
- * Since: 0.5.8
  **/
 gboolean
-as_app_builder_search_provides (AsApp *app,
-				const gchar *prefix,
-				AsAppBuilderFlags flags,
-				GError **error)
+as_app_builder_search_provides_files (AsApp *app,
+				      GHashTable *files,
+				      const gchar *prefix,
+				      AsAppBuilderFlags flags,
+				      GError **error)
 {
 	/* skip for addons */
 	if (as_app_get_kind (AS_APP (app)) == AS_APP_KIND_ADDON)
 		return TRUE;
 
-	if (!as_app_builder_search_dbus (app, prefix,
+	if (!as_app_builder_search_dbus (app, files, prefix,
 					 "share/dbus-1/system-services",
 					 AS_PROVIDE_KIND_DBUS_SYSTEM,
 					 flags, error))
 		return FALSE;
-	if (!as_app_builder_search_dbus (app, prefix,
+	if (!as_app_builder_search_dbus (app, files, prefix,
 					 "share/dbus-1/services",
 					 AS_PROVIDE_KIND_DBUS_SESSION,
 					 flags, error))
 		return FALSE;
 	return TRUE;
 }
+
+/**
+ * as_app_builder_search_provides:
+ * @app: an #AsApp
+ * @prefix: a prefix to search, e.g. "/usr"
+ * @flags: #AsAppBuilderFlags, e.g. %AS_APP_BUILDER_FLAG_USE_FALLBACKS
+ * @error: a #GError or %NULL
+ *
+ * Searches a prefix for auto-detected provides.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 0.5.8
+ **/
+gboolean
+as_app_builder_search_provides (AsApp *app,
+				const gchar *prefix,
+				AsAppBuilderFlags flags,
+				GError **error)
+{
+	return as_app_builder_search_provides_files (app, NULL, prefix, flags, error);
+}
@@ -16,6 +16,7 @@
 #include "as-app.h"
 #include "as-node-private.h"
 #include "as-stemmer.h"
+#include "as-token-dict-private.h"
 
 G_BEGIN_DECLS
 
@@ -43,6 +44,7 @@ G_BEGIN_DECLS
  * @AS_APP_PROBLEM_DUPLICATE_SCREENSHOT:	More than one screenshot with the same URL
  * @AS_APP_PROBLEM_DUPLICATE_CONTENT_RATING:	More than one content rating with the same kind
  * @AS_APP_PROBLEM_DUPLICATE_AGREEMENT:		More than one agreement with the same kind
+ * @AS_APP_PROBLEM_INVALID_DEFERRED_DATA:	Data deferred when parsing could not be loaded
  *
  * The application problems detected when loading.
  **/
@@ -71,10 +73,20 @@ typedef enum {
 	AS_APP_PROBLEM_DUPLICATE_AGREEMENT	= 1 << 20,
 	AS_APP_PROBLEM_DUPLICATE_PROJECT_LICENSE = 1 << 21,
 	AS_APP_PROBLEM_DUPLICATE_METADATA_LICENSE = 1 << 22,
+	AS_APP_PROBLEM_INVALID_DEFERRED_DATA	= 1 << 23,
 	/*< private >*/
 	AS_APP_PROBLEM_LAST
 } AsAppProblems;
 
+/* the data needed to list and search for an application as typed values,
+ * followed by the children that are only parsed when first used */
+#define AS_APP_VARIANT_TYPE	"(uuiuuuuumsmsmsmsmsmsmsmsmsms"		\
+				 "a{ss}a{ss}a{ss}a{ss}a{ss}a{ss}a{si}a{sas}"	\
+				 "asasasasasasasasas"				\
+				 "a(us)a(umsmsms)a(ums)a(uas)a(uumsms)"		\
+				 "a(ums)a(ums)a(umsmsmsmsuuuay)"		\
+				 "a(qsmsa(ss)))"
+
 /* some useful constants */
 #define AS_APP_ICON_MIN_HEIGHT			32
 #define AS_APP_ICON_MIN_WIDTH			32
@@ -82,11 +94,33 @@ typedef enum {
 /* unique */
 #define AS_APP_UNIQUE_WILDCARD			"*"
 
+typedef guint16	AsAppTokenType;	/* big enough for both bitshifts */
+
+typedef void	(*AsAppProvidesFunc)		(AsApp		*app,
+						 gpointer	 user_data);
+
+typedef struct {
+	guint32		 id;		/* in the AsTokenDict */
+	AsAppTokenType	 match;
+} AsAppToken;
+
 AsAppProblems	 as_app_get_problems		(AsApp		*app);
 guint		 as_app_get_name_size		(AsApp		*app);
 guint		 as_app_get_comment_size	(AsApp		*app);
 guint		 as_app_get_description_size	(AsApp		*app);
 GPtrArray	*as_app_get_search_tokens	(AsApp		*app);
+GArray		*as_app_get_token_cache		(AsApp		*app);
+void		 as_app_invalidate_token_cache	(AsApp		*app);
+guint		 as_app_get_token_cache_generation (AsApp	*app);
+void		 as_app_add_provides_watcher	(AsApp		*app,
+						 AsAppProvidesFunc func,
+						 gpointer	 user_data);
+void		 as_app_remove_provides_watcher	(AsApp		*app,
+						 AsAppProvidesFunc func,
+						 gpointer	 user_data);
+AsTokenDict	*as_app_get_token_dict		(AsApp		*app);
+gboolean	 as_app_set_token_cache		(AsApp		*app,
+						 GArray		*token_cache);
 AsBundleKind	 as_app_get_bundle_kind		(AsApp		*app);
 
 GNode		*as_app_node_insert		(AsApp		*app,
@@ -96,6 +130,18 @@ gboolean	 as_app_node_parse		(AsApp		*app,
 						 GNode		*node,
 						 AsNodeContext	*ctx,
 						 GError		**error);
+gboolean	 as_app_node_parse_full		(AsApp		*app,
+						 GNode		*node,
+						 guint32	 flags,
+						 AsNodeContext	*ctx,
+						 GError		**error);
+GVariant	*as_app_to_variant		(AsApp		*app,
+						 AsNodeContext	*ctx);
+gboolean	 as_app_from_variant		(AsApp		*app,
+						 GVariant	*value,
+						 guint32	 flags,
+						 AsNodeContext	*ctx,
+						 GError		**error);
 gboolean	 as_app_node_parse_dep11	(AsApp		*app,
 						 GNode		*node,
 						 AsNodeContext	*ctx,
@@ -114,6 +160,8 @@ gboolean	 as_app_parse_inf_file		(AsApp		*app,
 						 GError		**error);
 void		 as_app_set_stemmer		(AsApp		*app,
 						 AsStemmer	*stemmer);
+void		 as_app_set_token_dict		(AsApp		*app,
+						 AsTokenDict	*token_dict);
 void		 as_app_set_search_blacklist	(AsApp		*app,
 						 GHashTable	*search_blacklist);
 void		 as_app_set_icon_path_rstr	(AsApp		*app,
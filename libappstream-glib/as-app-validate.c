@@ -1585,6 +1585,11 @@ as_app_validate (AsApp *app, guint32 flags, GError **error)
 				     AS_PROBLEM_KIND_TAG_INVALID,
 				     "<content_rating> was duplicated");
 	}
+	if (problems & AS_APP_PROBLEM_INVALID_DEFERRED_DATA) {
+		ai_app_validate_add (helper,
+				     AS_PROBLEM_KIND_MARKUP_INVALID,
+				     "deferred data could not be parsed");
+	}
 
 	/* check for things that have to exist */
 	if (as_app_get_id (app) == NULL) {
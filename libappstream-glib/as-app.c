@@ -38,6 +38,7 @@
 #include "as-screenshot-private.h"
 #include "as-stemmer.h"
 #include "as-tag.h"
+#include "as-token-dict-private.h"
 #include "as-translation-private.h"
 #include "as-suggest-private.h"
 #include "as-utils-private.h"
@@ -105,15 +106,33 @@ typedef struct
 	AsRefString	*branch;
 	gint		 priority;
 	gsize		 token_cache_valid;
-	GHashTable	*token_cache;			/* of AsRefString:AsAppTokenType* */
+	guint		 token_cache_generation;	/* atomic */
+	GArray		*provides_watchers;		/* of AsAppProvidesWatcher */
+	AsTokenDict	*token_dict;
+	GArray		*token_cache;			/* of AsAppToken, sorted by id */
 	GHashTable	*search_blacklist;		/* of AsRefString:1 */
+	gint		 lazy_pending;			/* atomic */
+	GRecMutex	 lazy_mutex;			/* held when parsing lazy data */
+	GVariant	*lazy_nodes;			/* of children from the cache */
+	GPtrArray	*lazy_raw;			/* of GBytes, children not yet parsed */
+	AsNodeContext	*lazy_ctx;
+	guint32		 lazy_flags;
+	guint32		 lazy_xml_flags;
 } AsAppPrivate;
 
+typedef struct {
+	AsAppProvidesFunc	 func;
+	gpointer		 user_data;
+} AsAppProvidesWatcher;
+
+/* shared by all apps as watchers are only added and removed by the store */
+static GMutex as_app_provides_watchers_mutex;
+
 G_DEFINE_TYPE_WITH_PRIVATE (AsApp, as_app, G_TYPE_OBJECT)
 
-#define GET_PRIVATE(o) (as_app_get_instance_private (o))
+static void as_app_ensure_lazy (AsApp *app);
 
-typedef guint16	AsAppTokenType;	/* big enough for both bitshifts */
+#define GET_PRIVATE(o) (as_app_get_instance_private (o))
 
 /**
  * as_app_error_quark:
@@ -413,6 +432,17 @@ as_app_finalize (GObject *object)
 		g_object_unref (priv->stemmer);
 	if (priv->search_blacklist != NULL)
 		g_hash_table_unref (priv->search_blacklist);
+	if (priv->token_dict != NULL)
+		g_object_unref (priv->token_dict);
+	if (priv->lazy_nodes != NULL)
+		g_variant_unref (priv->lazy_nodes);
+	if (priv->lazy_raw != NULL)
+		g_ptr_array_unref (priv->lazy_raw);
+	if (priv->lazy_ctx != NULL)
+		as_node_context_free (priv->lazy_ctx);
+	g_rec_mutex_clear (&priv->lazy_mutex);
+	if (priv->provides_watchers != NULL)
+		g_array_unref (priv->provides_watchers);
 
 	if (priv->icon_path != NULL)
 		as_ref_string_unref (priv->icon_path);
@@ -444,7 +474,7 @@ as_app_finalize (GObject *object)
 	g_hash_table_unref (priv->metadata);
 	g_hash_table_unref (priv->names);
 	g_hash_table_unref (priv->urls);
-	g_hash_table_unref (priv->token_cache);
+	g_array_unref (priv->token_cache);
 	g_ptr_array_unref (priv->addons);
 	g_ptr_array_unref (priv->categories);
 	g_ptr_array_unref (priv->compulsory_for_desktops);
@@ -477,6 +507,7 @@ as_app_init (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
 	g_mutex_init (&priv->unique_id_mutex);
+	g_rec_mutex_init (&priv->lazy_mutex);
 	priv->categories = g_ptr_array_new_with_free_func ((GDestroyNotify) as_ref_string_unref);
 	priv->compulsory_for_desktops = g_ptr_array_new_with_free_func ((GDestroyNotify) as_ref_string_unref);
 	priv->content_ratings = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
@@ -525,9 +556,7 @@ as_app_init (AsApp *app)
 	priv->urls = g_hash_table_new_full (g_str_hash, g_str_equal,
 					    (GDestroyNotify) as_ref_string_unref,
 					    (GDestroyNotify) as_ref_string_unref);
-	priv->token_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
-						   (GDestroyNotify) as_ref_string_unref,
-						   g_free);
+	priv->token_cache = g_array_new (FALSE, FALSE, sizeof (AsAppToken));
 	priv->search_match = AS_APP_SEARCH_MATCH_LAST;
 }
 
@@ -1066,6 +1095,7 @@ GPtrArray *
 as_app_get_releases (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
+	as_app_ensure_lazy (app);
 	return priv->releases;
 }
 
@@ -1087,6 +1117,8 @@ as_app_get_release (AsApp *app, const gchar *version)
 	AsRelease *release;
 	guint i;
 
+	as_app_ensure_lazy (app);
+
 	for (i = 0; i < priv->releases->len; i++) {
 		release = g_ptr_array_index (priv->releases, i);
 		if (g_strcmp0 (as_release_get_version (release), version) == 0)
@@ -1113,6 +1145,8 @@ as_app_get_release_default (AsApp *app)
 	AsRelease *release_tmp = NULL;
 	guint i;
 
+	as_app_ensure_lazy (app);
+
 	for (i = 0; i < priv->releases->len; i++) {
 		release_tmp = g_ptr_array_index (priv->releases, i);
 		if (release_newest == NULL ||
@@ -1137,6 +1171,7 @@ AsRelease *
 as_app_get_release_by_version (AsApp *app, const gchar *version)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
+	as_app_ensure_lazy (app);
 	for (guint i = 0; i < priv->releases->len; i++) {
 		AsRelease *release_tmp = g_ptr_array_index (priv->releases, i);
 		if (g_strcmp0 (version, as_release_get_version (release_tmp)) == 0)
@@ -1237,6 +1272,7 @@ GPtrArray *
 as_app_get_screenshots (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
+	as_app_ensure_lazy (app);
 	return priv->screenshots;
 }
 
@@ -1254,6 +1290,7 @@ AsScreenshot *
 as_app_get_screenshot_default (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
+	as_app_ensure_lazy (app);
 	if (priv->screenshots->len == 0)
 		return NULL;
 	return AS_SCREENSHOT (g_ptr_array_index (priv->screenshots, 0));
@@ -1273,6 +1310,7 @@ GPtrArray *
 as_app_get_reviews (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
+	as_app_ensure_lazy (app);
 	return priv->reviews;
 }
 
@@ -1290,6 +1328,7 @@ GPtrArray *
 as_app_get_content_ratings (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
+	as_app_ensure_lazy (app);
 	return priv->content_ratings;
 }
 
@@ -1310,6 +1349,8 @@ as_app_get_content_rating (AsApp *app, const gchar *kind)
 	AsAppPrivate *priv = GET_PRIVATE (app);
 	guint i;
 
+	as_app_ensure_lazy (app);
+
 	for (i = 0; i < priv->content_ratings->len; i++) {
 		AsContentRating *content_rating;
 		content_rating = g_ptr_array_index (priv->content_ratings, i);
@@ -1333,6 +1374,7 @@ GPtrArray *
 as_app_get_agreements (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
+	as_app_ensure_lazy (app);
 	return priv->agreements;
 }
 
@@ -1353,6 +1395,8 @@ as_app_get_agreement_by_kind (AsApp *app, AsAgreementKind kind)
 	AsAppPrivate *priv = GET_PRIVATE (app);
 	guint i;
 
+	as_app_ensure_lazy (app);
+
 	for (i = 0; i < priv->agreements->len; i++) {
 		AsAgreement *agreement;
 		agreement = g_ptr_array_index (priv->agreements, i);
@@ -1376,6 +1420,7 @@ AsAgreement *
 as_app_get_agreement_default (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
+	as_app_ensure_lazy (app);
 	if (priv->agreements->len < 1)
 		return NULL;
 	return g_ptr_array_index (priv->agreements, 0);
@@ -1854,6 +1899,7 @@ AsAppProblems
 as_app_get_problems (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
+	as_app_ensure_lazy (app);
 	return priv->problems;
 }
 
@@ -2988,11 +3034,10 @@ as_app_add_keyword_rstr (AsApp *app, AsRefString *locale, AsRefString *keyword)
 	g_ptr_array_add (tmp, as_ref_string_ref (keyword));
 
 	/* cache already populated */
-	if (priv->token_cache_valid) {
+	if (g_atomic_pointer_get (&priv->token_cache_valid)) {
 		g_warning ("%s has token cache, invaliding as %s was added",
 			   as_app_get_unique_id (app), keyword);
-		g_hash_table_remove_all (priv->token_cache);
-		priv->token_cache_valid = FALSE;
+		as_app_invalidate_token_cache (app);
 	}
 }
 
@@ -3299,6 +3344,8 @@ as_app_add_release (AsApp *app, AsRelease *release)
 	AsAppPrivate *priv = GET_PRIVATE (app);
 	AsRelease *release_old;
 
+	as_app_ensure_lazy (app);
+
 	/* if already exists them update */
 	release_old = as_app_get_release (app, as_release_get_version (release));
 	if (release_old == NULL)
@@ -3314,6 +3361,23 @@ as_app_add_release (AsApp *app, AsRelease *release)
 	g_ptr_array_add (priv->releases, g_object_ref (release));
 }
 
+static void
+as_app_provides_changed (AsApp *app)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	/* not in any store, e.g. still being parsed */
+	if (g_atomic_pointer_get (&priv->provides_watchers) == NULL)
+		return;
+	locker = g_mutex_locker_new (&as_app_provides_watchers_mutex);
+	for (guint i = 0; i < priv->provides_watchers->len; i++) {
+		AsAppProvidesWatcher *watcher;
+		watcher = &g_array_index (priv->provides_watchers, AsAppProvidesWatcher, i);
+		watcher->func (app, watcher->user_data);
+	}
+}
+
 /**
  * as_app_add_provide:
  * @app: a #AsApp instance.
@@ -3342,6 +3406,7 @@ as_app_add_provide (AsApp *app, AsProvide *provide)
 	}
 
 	g_ptr_array_add (priv->provides, g_object_ref (provide));
+	as_app_provides_changed (app);
 }
 
 /**
@@ -3370,6 +3435,7 @@ as_app_add_launchable (AsApp *app, AsLaunchable *launchable)
 	}
 
 	g_ptr_array_add (priv->launchables, g_object_ref (launchable));
+	as_app_provides_changed (app);
 }
 
 static gint
@@ -3405,6 +3471,8 @@ as_app_add_screenshot (AsApp *app, AsScreenshot *screenshot)
 	AsScreenshot *ss;
 	guint i;
 
+	as_app_ensure_lazy (app);
+
 	/* handle untrusted */
 	if ((priv->trust_flags & AS_APP_TRUST_FLAG_CHECK_DUPLICATES) > 0) {
 		for (i = 0; i < priv->screenshots->len; i++) {
@@ -3444,6 +3512,8 @@ as_app_add_review (AsApp *app, AsReview *review)
 	AsReview *review_tmp;
 	guint i;
 
+	as_app_ensure_lazy (app);
+
 	/* handle untrusted */
 	if ((priv->trust_flags & AS_APP_TRUST_FLAG_CHECK_DUPLICATES) > 0) {
 		for (i = 0; i < priv->reviews->len; i++) {
@@ -3469,6 +3539,8 @@ as_app_add_content_rating (AsApp *app, AsContentRating *content_rating)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
 
+	as_app_ensure_lazy (app);
+
 	/* handle untrusted */
 	if ((priv->trust_flags & AS_APP_TRUST_FLAG_CHECK_DUPLICATES) > 0) {
 		for (guint i = 0; i < priv->content_ratings->len; i++) {
@@ -3497,6 +3569,8 @@ as_app_add_agreement (AsApp *app, AsAgreement *agreement)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
 
+	as_app_ensure_lazy (app);
+
 	/* handle untrusted */
 	if ((priv->trust_flags & AS_APP_TRUST_FLAG_CHECK_DUPLICATES) > 0) {
 		for (guint i = 0; i < priv->agreements->len; i++) {
@@ -4016,6 +4090,9 @@ as_app_subsume_private (AsApp *app, AsApp *donor, guint64 flags)
 	const gchar *key;
 	guint i;
 
+	as_app_ensure_lazy (app);
+	as_app_ensure_lazy (donor);
+
 	/* stop us shooting ourselves in the foot */
 	papp->trust_flags |= AS_APP_TRUST_FLAG_CHECK_DUPLICATES;
 
@@ -4523,6 +4600,64 @@ as_app_node_insert_keywords (AsApp *app, GNode *parent, AsNodeContext *ctx)
 	g_list_free (keys);
 }
 
+/* the children that AS_APP_PARSE_FLAG_LAZY does not parse up front */
+static void
+as_app_node_insert_deferred (AsApp *app, GNode *parent, AsNodeContext *ctx)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	AsRelease *rel;
+	AsScreenshot *ss;
+	GNode *node_tmp;
+	guint i;
+
+	/* <screenshots> */
+	if (priv->screenshots->len > 0) {
+		node_tmp = as_node_insert (parent, "screenshots", NULL, 0, NULL);
+		for (i = 0; i < priv->screenshots->len; i++) {
+			ss = g_ptr_array_index (priv->screenshots, i);
+			as_screenshot_node_insert (ss, node_tmp, ctx);
+		}
+	}
+
+	/* <reviews> */
+	if (priv->reviews->len > 0) {
+		AsReview *review;
+		node_tmp = as_node_insert (parent, "reviews", NULL, 0, NULL);
+		for (i = 0; i < priv->reviews->len; i++) {
+			review = g_ptr_array_index (priv->reviews, i);
+			as_review_node_insert (review, node_tmp, ctx);
+		}
+	}
+
+	/* <content_ratings> */
+	if (priv->content_ratings->len > 0) {
+		for (i = 0; i < priv->content_ratings->len; i++) {
+			AsContentRating *content_rating;
+			content_rating = g_ptr_array_index (priv->content_ratings, i);
+			as_content_rating_node_insert (content_rating, parent, ctx);
+		}
+	}
+
+	/* <agreements> */
+	if (priv->agreements->len > 0) {
+		for (i = 0; i < priv->agreements->len; i++) {
+			AsAgreement *agreement;
+			agreement = g_ptr_array_index (priv->agreements, i);
+			as_agreement_node_insert (agreement, parent, ctx);
+		}
+	}
+
+	/* <releases> */
+	if (priv->releases->len > 0) {
+		g_ptr_array_sort (priv->releases, as_app_releases_sort_cb);
+		node_tmp = as_node_insert (parent, "releases", NULL, 0, NULL);
+		for (i = 0; i < priv->releases->len; i++) {
+			rel = g_ptr_array_index (priv->releases, i);
+			as_release_node_insert (rel, node_tmp, ctx);
+		}
+	}
+}
+
 /**
  * as_app_node_insert: (skip)
  * @app: a #AsApp instance.
@@ -4539,13 +4674,13 @@ GNode *
 as_app_node_insert (AsApp *app, GNode *parent, AsNodeContext *ctx)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
-	AsRelease *rel;
-	AsScreenshot *ss;
 	GNode *node_app;
 	GNode *node_tmp;
 	const gchar *tmp;
 	guint i;
 
+	as_app_ensure_lazy (app);
+
 	/* <component> or <application> */
 	node_app = as_node_insert (parent, "component", NULL, 0, NULL);
 	if (priv->kind != AS_APP_KIND_UNKNOWN) {
@@ -4748,52 +4883,8 @@ as_app_node_insert (AsApp *app, GNode *parent, AsNodeContext *ctx)
 		}
 	}
 
-	/* <screenshots> */
-	if (priv->screenshots->len > 0) {
-		node_tmp = as_node_insert (node_app, "screenshots", NULL, 0, NULL);
-		for (i = 0; i < priv->screenshots->len; i++) {
-			ss = g_ptr_array_index (priv->screenshots, i);
-			as_screenshot_node_insert (ss, node_tmp, ctx);
-		}
-	}
-
-	/* <reviews> */
-	if (priv->reviews->len > 0) {
-		AsReview *review;
-		node_tmp = as_node_insert (node_app, "reviews", NULL, 0, NULL);
-		for (i = 0; i < priv->reviews->len; i++) {
-			review = g_ptr_array_index (priv->reviews, i);
-			as_review_node_insert (review, node_tmp, ctx);
-		}
-	}
-
-	/* <content_ratings> */
-	if (priv->content_ratings->len > 0) {
-		for (i = 0; i < priv->content_ratings->len; i++) {
-			AsContentRating *content_rating;
-			content_rating = g_ptr_array_index (priv->content_ratings, i);
-			as_content_rating_node_insert (content_rating, node_app, ctx);
-		}
-	}
-
-	/* <agreements> */
-	if (priv->agreements->len > 0) {
-		for (i = 0; i < priv->agreements->len; i++) {
-			AsAgreement *agreement;
-			agreement = g_ptr_array_index (priv->agreements, i);
-			as_agreement_node_insert (agreement, node_app, ctx);
-		}
-	}
-
-	/* <releases> */
-	if (priv->releases->len > 0) {
-		g_ptr_array_sort (priv->releases, as_app_releases_sort_cb);
-		node_tmp = as_node_insert (node_app, "releases", NULL, 0, NULL);
-		for (i = 0; i < priv->releases->len; i++) {
-			rel = g_ptr_array_index (priv->releases, i);
-			as_release_node_insert (rel, node_tmp, ctx);
-		}
-	}
+	/* <screenshots>, <reviews>, <content_rating>, <agreement>, <releases> */
+	as_app_node_insert_deferred (app, node_app, ctx);
 
 	/* <provides> */
 	if (priv->provides->len > 0) {
@@ -5398,7 +5489,120 @@ as_app_check_for_hidpi_icons (AsApp *app)
 	as_app_add_icon (app, icon_hidpi);
 }
 
+/* a child kept as XML by AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA */
 static gboolean
+as_app_node_parse_raw (AsApp *app, GBytes *raw, guint32 xml_flags,
+		       guint32 flags, AsNodeContext *ctx, GError **error)
+{
+	GNode *n;
+	g_autoptr(AsNode) root = NULL;
+
+	xml_flags &= ~AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA;
+	root = as_node_from_bytes (raw, xml_flags, error);
+	if (root == NULL)
+		return FALSE;
+	for (n = root->children; n != NULL; n = n->next) {
+		if (!as_app_node_parse_child (app, n, flags, ctx, error))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static void
+as_app_ensure_lazy (AsApp *app)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	GNode *n;
+	g_autoptr(AsNode) root = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GPtrArray) raw = NULL;
+	g_autoptr(GVariant) nodes = NULL;
+
+	if (!g_atomic_int_get (&priv->lazy_pending))
+		return;
+
+	/* the recursive mutex lets as_app_add_release() and friends call
+	 * back in here while the children are being parsed */
+	g_rec_mutex_lock (&priv->lazy_mutex);
+	nodes = g_steal_pointer (&priv->lazy_nodes);
+	raw = g_steal_pointer (&priv->lazy_raw);
+	if (nodes == NULL && raw == NULL) {
+		g_rec_mutex_unlock (&priv->lazy_mutex);
+		return;
+	}
+
+	/* restored from the cache */
+	if (nodes != NULL) {
+		root = as_node_from_variant (nodes, &error_local);
+		if (root == NULL) {
+			g_debug ("failed to load deferred data for %s: %s",
+				 priv->id, error_local->message);
+			priv->problems |= AS_APP_PROBLEM_INVALID_DEFERRED_DATA;
+		} else {
+			for (n = root->children; n != NULL; n = n->next) {
+				if (!as_app_node_parse_child (app, n, priv->lazy_flags,
+							      priv->lazy_ctx, &error_local)) {
+					g_debug ("failed to parse deferred data for %s: %s",
+						 priv->id, error_local->message);
+					priv->problems |= AS_APP_PROBLEM_INVALID_DEFERRED_DATA;
+					break;
+				}
+			}
+		}
+	}
+
+	/* kept as slices of the XML source */
+	for (guint i = 0; raw != NULL && i < raw->len; i++) {
+		g_autoptr(GError) error_raw = NULL;
+		if (!as_app_node_parse_raw (app, g_ptr_array_index (raw, i),
+					    priv->lazy_xml_flags,
+					    priv->lazy_flags,
+					    priv->lazy_ctx,
+					    &error_raw)) {
+			g_debug ("failed to parse deferred data for %s: %s",
+				 priv->id, error_raw->message);
+			priv->problems |= AS_APP_PROBLEM_INVALID_DEFERRED_DATA;
+			break;
+		}
+	}
+	g_clear_pointer (&priv->lazy_ctx, as_node_context_free);
+	g_atomic_int_set (&priv->lazy_pending, 0);
+	g_rec_mutex_unlock (&priv->lazy_mutex);
+}
+
+static AsNodeContext *
+as_app_node_context_copy (AsNodeContext *ctx)
+{
+	AsNodeContext *copy = as_node_context_new ();
+	as_node_context_set_version (copy, as_node_context_get_version (ctx));
+	as_node_context_set_format_kind (copy, as_node_context_get_format_kind (ctx));
+	as_node_context_set_output (copy, as_node_context_get_output (ctx));
+	as_node_context_set_output_trusted (copy, as_node_context_get_output_trusted (ctx));
+	as_node_context_set_media_base_url (copy, as_node_context_get_media_base_url (ctx));
+	return copy;
+}
+
+/**
+ * as_app_node_parse_full:
+ * @app: a #AsApp instance.
+ * @node: a #GNode.
+ * @flags: #AsAppParseFlags, e.g. %AS_APP_PARSE_FLAG_LAZY
+ * @ctx: a #AsNodeContext.
+ * @error: A #GError or %NULL.
+ *
+ * Populates the object from a DOM node.
+ *
+ * If the tree was loaded with %AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA and
+ * @flags contains %AS_APP_PARSE_FLAG_LAZY then the screenshots, reviews,
+ * content ratings, agreements and releases are kept as XML and only parsed
+ * when they are first used. If this fails later then as_app_get_problems()
+ * includes %AS_APP_PROBLEM_INVALID_DEFERRED_DATA.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 0.8.5
+ **/
+gboolean
 as_app_node_parse_full (AsApp *app, GNode *node, guint32 flags,
 			AsNodeContext *ctx, GError **error)
 {
@@ -5406,6 +5610,11 @@ as_app_node_parse_full (AsApp *app, GNode *node, guint32 flags,
 	GNode *n;
 	const gchar *tmp;
 	gint prio;
+	guint32 lazy_xml_flags = AS_NODE_FROM_XML_FLAG_NONE;
+	g_autoptr(GPtrArray) lazy = NULL;
+
+	/* anything deferred from before has to be applied first */
+	as_app_ensure_lazy (app);
 
 	/* new style */
 	if (g_strcmp0 (as_node_get_name (node), "component") == 0) {
@@ -5439,10 +5648,47 @@ as_app_node_parse_full (AsApp *app, GNode *node, guint32 flags,
 		g_hash_table_remove_all (priv->keywords);
 	}
 	for (n = node->children; n != NULL; n = n->next) {
+		AsNodeFromXmlFlags xml_flags = AS_NODE_FROM_XML_FLAG_NONE;
+		GBytes *raw = as_node_get_raw (n, &xml_flags);
+
+		/* not parsed yet, so either do it now or when first used */
+		if (raw != NULL) {
+			if ((flags & AS_APP_PARSE_FLAG_LAZY) == 0) {
+				if (!as_app_node_parse_raw (app, raw, xml_flags,
+							    flags, ctx, error))
+					return FALSE;
+				continue;
+			}
+			if (lazy == NULL)
+				lazy = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+			g_ptr_array_add (lazy, g_bytes_ref (raw));
+			lazy_xml_flags = xml_flags;
+			continue;
+		}
 		if (!as_app_node_parse_child (app, n, flags, ctx, error))
 			return FALSE;
 	}
 
+	/* keep the skipped children until they are needed */
+	if (lazy != NULL) {
+		if (!(flags & AS_APP_PARSE_FLAG_APPEND_DATA)) {
+			g_ptr_array_set_size (priv->releases, 0);
+			g_ptr_array_set_size (priv->screenshots, 0);
+			g_ptr_array_set_size (priv->reviews, 0);
+		}
+		g_rec_mutex_lock (&priv->lazy_mutex);
+		g_clear_pointer (&priv->lazy_nodes, g_variant_unref);
+		g_clear_pointer (&priv->lazy_raw, g_ptr_array_unref);
+		g_clear_pointer (&priv->lazy_ctx, as_node_context_free);
+		priv->lazy_raw = g_steal_pointer (&lazy);
+		priv->lazy_ctx = as_app_node_context_copy (ctx);
+		priv->lazy_flags = (flags & ~AS_APP_PARSE_FLAG_LAZY) |
+				   AS_APP_PARSE_FLAG_APPEND_DATA;
+		priv->lazy_xml_flags = lazy_xml_flags;
+		g_atomic_int_set (&priv->lazy_pending, 1);
+		g_rec_mutex_unlock (&priv->lazy_mutex);
+	}
+
 	/* if only one icon is listed, look for HiDPI versions too */
 	if (as_app_get_icons(app)->len == 1)
 		as_app_check_for_hidpi_icons (app);
@@ -5485,6 +5731,478 @@ as_app_node_parse (AsApp *app, GNode *node, AsNodeContext *ctx, GError **error)
 	return as_app_node_parse_full (app, node, AS_APP_PARSE_FLAG_NONE, ctx, error);
 }
 
+static void
+as_app_variant_builder_add_hash (GVariantBuilder *builder, GHashTable *hash)
+{
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+
+	g_variant_builder_open (builder, G_VARIANT_TYPE ("a{ss}"));
+	g_hash_table_iter_init (&iter, hash);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		g_variant_builder_add (builder, "{ss}", key, value);
+	g_variant_builder_close (builder);
+}
+
+static void
+as_app_variant_builder_add_array (GVariantBuilder *builder, GPtrArray *array)
+{
+	g_variant_builder_open (builder, G_VARIANT_TYPE_STRING_ARRAY);
+	for (guint i = 0; i < array->len; i++)
+		g_variant_builder_add (builder, "s", g_ptr_array_index (array, i));
+	g_variant_builder_close (builder);
+}
+
+/**
+ * as_app_to_variant: (skip)
+ * @app: a #AsApp instance.
+ * @ctx: the #AsNodeContext
+ *
+ * Serializes the application so that it can be restored using
+ * as_app_from_variant() without parsing any XML.
+ *
+ * Returns: (transfer floating): a #GVariant
+ *
+ * Since: 0.8.5
+ **/
+GVariant *
+as_app_to_variant (AsApp *app, AsNodeContext *ctx)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	GHashTableIter iter;
+	GVariantBuilder builder;
+	gpointer key;
+	gpointer value;
+	g_autoptr(AsNode) root = as_node_new ();
+	g_autoptr(GPtrArray) deferred = g_ptr_array_new ();
+
+	as_app_ensure_lazy (app);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE (AS_APP_VARIANT_TYPE));
+	g_variant_builder_add (&builder, "u", (guint32) priv->kind);
+	g_variant_builder_add (&builder, "u", (guint32) priv->merge_kind);
+	g_variant_builder_add (&builder, "i", (gint32) priv->priority);
+	g_variant_builder_add (&builder, "u", (guint32) priv->scope);
+	g_variant_builder_add (&builder, "u", priv->trust_flags);
+	g_variant_builder_add (&builder, "u", (guint32) priv->problems);
+	g_variant_builder_add (&builder, "u", (guint32) priv->state);
+	g_variant_builder_add (&builder, "u", (guint32) priv->quirk);
+	g_variant_builder_add (&builder, "ms", priv->id);
+	g_variant_builder_add (&builder, "ms", priv->id_filename);
+	g_variant_builder_add (&builder, "ms", priv->origin);
+	g_variant_builder_add (&builder, "ms", priv->icon_path);
+	g_variant_builder_add (&builder, "ms", priv->source_pkgname);
+	g_variant_builder_add (&builder, "ms", priv->project_group);
+	g_variant_builder_add (&builder, "ms", priv->project_license);
+	g_variant_builder_add (&builder, "ms", priv->metadata_license);
+	g_variant_builder_add (&builder, "ms", priv->update_contact);
+	g_variant_builder_add (&builder, "ms", priv->branch);
+
+	/* localized text and other string tables */
+	as_app_variant_builder_add_hash (&builder, priv->names);
+	as_app_variant_builder_add_hash (&builder, priv->comments);
+	as_app_variant_builder_add_hash (&builder, priv->developer_names);
+	as_app_variant_builder_add_hash (&builder, priv->descriptions);
+	as_app_variant_builder_add_hash (&builder, priv->urls);
+	as_app_variant_builder_add_hash (&builder, priv->metadata);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{si}"));
+	g_hash_table_iter_init (&iter, priv->languages);
+	while (g_hash_table_iter_next (&iter, &key, &value))
+		g_variant_builder_add (&builder, "{si}", key, GPOINTER_TO_INT (value));
+	g_variant_builder_close (&builder);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a{sas}"));
+	g_hash_table_iter_init (&iter, priv->keywords);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		g_variant_builder_open (&builder, G_VARIANT_TYPE ("{sas}"));
+		g_variant_builder_add (&builder, "s", key);
+		as_app_variant_builder_add_array (&builder, value);
+		g_variant_builder_close (&builder);
+	}
+	g_variant_builder_close (&builder);
+
+	/* string lists */
+	as_app_variant_builder_add_array (&builder, priv->pkgnames);
+	as_app_variant_builder_add_array (&builder, priv->categories);
+	as_app_variant_builder_add_array (&builder, priv->architectures);
+	as_app_variant_builder_add_array (&builder, priv->kudos);
+	as_app_variant_builder_add_array (&builder, priv->permissions);
+	as_app_variant_builder_add_array (&builder, priv->vetos);
+	as_app_variant_builder_add_array (&builder, priv->mimetypes);
+	as_app_variant_builder_add_array (&builder, priv->compulsory_for_desktops);
+	as_app_variant_builder_add_array (&builder, priv->extends);
+
+	/* small objects */
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(us)"));
+	for (guint i = 0; i < priv->formats->len; i++) {
+		AsFormat *format = g_ptr_array_index (priv->formats, i);
+		if (as_format_get_filename (format) == NULL)
+			continue;
+		g_variant_builder_add (&builder, "(us)",
+				       (guint32) as_format_get_kind (format),
+				       as_format_get_filename (format));
+	}
+	g_variant_builder_close (&builder);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(umsmsms)"));
+	for (guint i = 0; i < priv->bundles->len; i++) {
+		AsBundle *bundle = g_ptr_array_index (priv->bundles, i);
+		g_variant_builder_add (&builder, "(umsmsms)",
+				       (guint32) as_bundle_get_kind (bundle),
+				       as_bundle_get_id (bundle),
+				       as_bundle_get_runtime (bundle),
+				       as_bundle_get_sdk (bundle));
+	}
+	g_variant_builder_close (&builder);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(ums)"));
+	for (guint i = 0; i < priv->translations->len; i++) {
+		AsTranslation *translation = g_ptr_array_index (priv->translations, i);
+		g_variant_builder_add (&builder, "(ums)",
+				       (guint32) as_translation_get_kind (translation),
+				       as_translation_get_id (translation));
+	}
+	g_variant_builder_close (&builder);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(uas)"));
+	for (guint i = 0; i < priv->suggests->len; i++) {
+		AsSuggest *suggest = g_ptr_array_index (priv->suggests, i);
+		g_variant_builder_open (&builder, G_VARIANT_TYPE ("(uas)"));
+		g_variant_builder_add (&builder, "u", (guint32) as_suggest_get_kind (suggest));
+		as_app_variant_builder_add_array (&builder, as_suggest_get_ids (suggest));
+		g_variant_builder_close (&builder);
+	}
+	g_variant_builder_close (&builder);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(uumsms)"));
+	for (guint i = 0; i < priv->requires->len; i++) {
+		AsRequire *require = g_ptr_array_index (priv->requires, i);
+		g_variant_builder_add (&builder, "(uumsms)",
+				       (guint32) as_require_get_kind (require),
+				       (guint32) as_require_get_compare (require),
+				       as_require_get_version (require),
+				       as_require_get_value (require));
+	}
+	g_variant_builder_close (&builder);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(ums)"));
+	for (guint i = 0; i < priv->provides->len; i++) {
+		AsProvide *provide = g_ptr_array_index (priv->provides, i);
+		g_variant_builder_add (&builder, "(ums)",
+				       (guint32) as_provide_get_kind (provide),
+				       as_provide_get_value (provide));
+	}
+	g_variant_builder_close (&builder);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(ums)"));
+	for (guint i = 0; i < priv->launchables->len; i++) {
+		AsLaunchable *launchable = g_ptr_array_index (priv->launchables, i);
+		g_variant_builder_add (&builder, "(ums)",
+				       (guint32) as_launchable_get_kind (launchable),
+				       as_launchable_get_value (launchable));
+	}
+	g_variant_builder_close (&builder);
+	g_variant_builder_open (&builder, G_VARIANT_TYPE ("a(umsmsmsmsuuuay)"));
+	for (guint i = 0; i < priv->icons->len; i++) {
+		AsIcon *icon = g_ptr_array_index (priv->icons, i);
+		GBytes *data = as_icon_get_data (icon);
+		GVariant *data_value;
+		if (data != NULL)
+			data_value = g_variant_new_from_bytes (G_VARIANT_TYPE_BYTESTRING, data, TRUE);
+		else
+			data_value = g_variant_new_array (G_VARIANT_TYPE_BYTE, NULL, 0);
+		g_variant_builder_add (&builder, "(umsmsmsmsuuu@ay)",
+				       (guint32) as_icon_get_kind (icon),
+				       as_icon_get_name (icon),
+				       as_icon_get_url (icon),
+				       as_icon_get_filename (icon),
+				       as_icon_get_prefix (icon),
+				       as_icon_get_width (icon),
+				       as_icon_get_height (icon),
+				       as_icon_get_scale (icon),
+				       data_value);
+	}
+	g_variant_builder_close (&builder);
+
+	/* everything else is kept as nodes */
+	as_app_node_insert_deferred (app, root, ctx);
+	for (AsNode *n = root->children; n != NULL; n = n->next)
+		g_ptr_array_add (deferred, n);
+	g_variant_builder_add_value (&builder, as_node_array_to_variant (deferred));
+	return g_variant_builder_end (&builder);
+}
+
+static void
+as_app_variant_iter_get_hash (GVariantIter *iter, GHashTable *hash)
+{
+	const gchar *key;
+	const gchar *value;
+	g_autoptr(GVariantIter) iter_hash = NULL;
+
+	g_variant_iter_next (iter, "a{ss}", &iter_hash);
+	while (g_variant_iter_next (iter_hash, "{&s&s}", &key, &value)) {
+		g_hash_table_insert (hash,
+				     as_ref_string_new (key),
+				     as_ref_string_new (value));
+	}
+}
+
+static void
+as_app_variant_iter_get_array (GVariantIter *iter, GPtrArray *array)
+{
+	const gchar *value;
+	g_autoptr(GVariantIter) iter_array = NULL;
+
+	g_variant_iter_next (iter, "as", &iter_array);
+	while (g_variant_iter_next (iter_array, "&s", &value))
+		g_ptr_array_add (array, as_ref_string_new (value));
+}
+
+/**
+ * as_app_from_variant: (skip)
+ * @app: a new #AsApp instance.
+ * @value: a #GVariant created by as_app_to_variant()
+ * @flags: #AsAppParseFlags, e.g. %AS_APP_PARSE_FLAG_NONE
+ * @ctx: the #AsNodeContext used to create @value
+ * @error: A #GError or %NULL.
+ *
+ * Populates the object from a serialized application without parsing any
+ * XML. The screenshots, reviews, content ratings, agreements and releases are
+ * kept in @value and only parsed when they are first used.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+as_app_from_variant (AsApp *app, GVariant *value, guint32 flags,
+		     AsNodeContext *ctx, GError **error)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	GVariantIter iter;
+	const gchar *key;
+	const gchar *tmp;
+	gint32 priority;
+	gint32 percentage;
+	guint32 kind;
+	guint32 kind2;
+	guint32 problems;
+	guint32 trust_flags;
+	g_autoptr(GVariant) deferred = NULL;
+	g_autoptr(GVariantIter) iter_tmp = NULL;
+
+	if (!g_variant_is_of_type (value, G_VARIANT_TYPE (AS_APP_VARIANT_TYPE))) {
+		g_set_error (error,
+			     AS_APP_ERROR,
+			     AS_APP_ERROR_INVALID_TYPE,
+			     "invalid serialized type %s",
+			     g_variant_get_type_string (value));
+		return FALSE;
+	}
+	g_variant_iter_init (&iter, value);
+	g_variant_iter_next (&iter, "u", &kind);
+	as_app_set_kind (app, kind);
+	g_variant_iter_next (&iter, "u", &kind);
+	priv->merge_kind = kind;
+	g_variant_iter_next (&iter, "i", &priority);
+	priv->priority = priority;
+	g_variant_iter_next (&iter, "u", &kind);
+	priv->scope = kind;
+	g_variant_iter_next (&iter, "u", &trust_flags);
+	g_variant_iter_next (&iter, "u", &problems);
+	g_variant_iter_next (&iter, "u", &kind);
+	priv->state = kind;
+	g_variant_iter_next (&iter, "u", &kind);
+	priv->quirk |= kind;
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	if (tmp != NULL)
+		as_app_set_id (app, tmp);
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	as_ref_string_assign_safe (&priv->id_filename, tmp);
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	as_app_set_origin (app, tmp);
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	as_ref_string_assign_safe (&priv->icon_path, tmp);
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	as_ref_string_assign_safe (&priv->source_pkgname, tmp);
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	as_ref_string_assign_safe (&priv->project_group, tmp);
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	as_ref_string_assign_safe (&priv->project_license, tmp);
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	as_ref_string_assign_safe (&priv->metadata_license, tmp);
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	as_ref_string_assign_safe (&priv->update_contact, tmp);
+	g_variant_iter_next (&iter, "m&s", &tmp);
+	as_app_set_branch (app, tmp);
+
+	/* localized text and other string tables */
+	as_app_variant_iter_get_hash (&iter, priv->names);
+	as_app_variant_iter_get_hash (&iter, priv->comments);
+	as_app_variant_iter_get_hash (&iter, priv->developer_names);
+	as_app_variant_iter_get_hash (&iter, priv->descriptions);
+	g_variant_iter_next (&iter, "a{ss}", &iter_tmp);
+	while (g_variant_iter_next (iter_tmp, "{&s&s}", &key, &tmp))
+		as_app_add_url (app, as_url_kind_from_string (key), tmp);
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+	as_app_variant_iter_get_hash (&iter, priv->metadata);
+	g_variant_iter_next (&iter, "a{si}", &iter_tmp);
+	while (g_variant_iter_next (iter_tmp, "{&si}", &key, &percentage)) {
+		g_hash_table_insert (priv->languages,
+				     as_ref_string_new (key),
+				     GINT_TO_POINTER (percentage));
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+	g_variant_iter_next (&iter, "a{sas}", &iter_tmp);
+	while (TRUE) {
+		GVariantIter *iter_keywords = NULL;
+		g_autoptr(AsRefString) locale = NULL;
+		if (!g_variant_iter_next (iter_tmp, "{&sas}", &key, &iter_keywords))
+			break;
+		locale = as_ref_string_new (key);
+		while (g_variant_iter_next (iter_keywords, "&s", &tmp)) {
+			g_autoptr(AsRefString) keyword = as_ref_string_new (tmp);
+			as_app_add_keyword_rstr (app, locale, keyword);
+		}
+		g_variant_iter_free (iter_keywords);
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+
+	/* string lists */
+	as_app_variant_iter_get_array (&iter, priv->pkgnames);
+	as_app_variant_iter_get_array (&iter, priv->categories);
+	as_app_variant_iter_get_array (&iter, priv->architectures);
+	as_app_variant_iter_get_array (&iter, priv->kudos);
+	as_app_variant_iter_get_array (&iter, priv->permissions);
+	as_app_variant_iter_get_array (&iter, priv->vetos);
+	as_app_variant_iter_get_array (&iter, priv->mimetypes);
+	as_app_variant_iter_get_array (&iter, priv->compulsory_for_desktops);
+	as_app_variant_iter_get_array (&iter, priv->extends);
+
+	/* small objects */
+	g_variant_iter_next (&iter, "a(us)", &iter_tmp);
+	while (g_variant_iter_next (iter_tmp, "(u&s)", &kind, &tmp)) {
+		g_autoptr(AsFormat) format = as_format_new ();
+		as_format_set_kind (format, kind);
+		as_format_set_filename (format, tmp);
+		as_app_add_format (app, format);
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+	g_variant_iter_next (&iter, "a(umsmsms)", &iter_tmp);
+	while (TRUE) {
+		const gchar *runtime;
+		const gchar *sdk;
+		g_autoptr(AsBundle) bundle = NULL;
+		if (!g_variant_iter_next (iter_tmp, "(um&sm&sm&s)",
+					  &kind, &tmp, &runtime, &sdk))
+			break;
+		bundle = as_bundle_new ();
+		as_bundle_set_kind (bundle, kind);
+		as_bundle_set_id (bundle, tmp);
+		as_bundle_set_runtime (bundle, runtime);
+		as_bundle_set_sdk (bundle, sdk);
+		g_ptr_array_add (priv->bundles, g_steal_pointer (&bundle));
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+	g_variant_iter_next (&iter, "a(ums)", &iter_tmp);
+	while (g_variant_iter_next (iter_tmp, "(um&s)", &kind, &tmp)) {
+		AsTranslation *translation = as_translation_new ();
+		as_translation_set_kind (translation, kind);
+		as_translation_set_id (translation, tmp);
+		g_ptr_array_add (priv->translations, translation);
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+	g_variant_iter_next (&iter, "a(uas)", &iter_tmp);
+	while (TRUE) {
+		GVariantIter *iter_ids = NULL;
+		AsSuggest *suggest;
+		if (!g_variant_iter_next (iter_tmp, "(uas)", &kind, &iter_ids))
+			break;
+		suggest = as_suggest_new ();
+		as_suggest_set_kind (suggest, kind);
+		while (g_variant_iter_next (iter_ids, "&s", &tmp))
+			as_suggest_add_id (suggest, tmp);
+		g_variant_iter_free (iter_ids);
+		g_ptr_array_add (priv->suggests, suggest);
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+	g_variant_iter_next (&iter, "a(uumsms)", &iter_tmp);
+	while (TRUE) {
+		const gchar *version;
+		AsRequire *require;
+		if (!g_variant_iter_next (iter_tmp, "(uum&sm&s)",
+					  &kind, &kind2, &version, &tmp))
+			break;
+		require = as_require_new ();
+		as_require_set_kind (require, kind);
+		as_require_set_compare (require, kind2);
+		as_require_set_version (require, version);
+		as_require_set_value (require, tmp);
+		g_ptr_array_add (priv->requires, require);
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+	g_variant_iter_next (&iter, "a(ums)", &iter_tmp);
+	while (g_variant_iter_next (iter_tmp, "(um&s)", &kind, &tmp)) {
+		AsProvide *provide = as_provide_new ();
+		as_provide_set_kind (provide, kind);
+		as_provide_set_value (provide, tmp);
+		g_ptr_array_add (priv->provides, provide);
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+	g_variant_iter_next (&iter, "a(ums)", &iter_tmp);
+	while (g_variant_iter_next (iter_tmp, "(um&s)", &kind, &tmp)) {
+		AsLaunchable *launchable = as_launchable_new ();
+		as_launchable_set_kind (launchable, kind);
+		as_launchable_set_value (launchable, tmp);
+		g_ptr_array_add (priv->launchables, launchable);
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+	g_variant_iter_next (&iter, "a(umsmsmsmsuuuay)", &iter_tmp);
+	while (TRUE) {
+		const gchar *url;
+		const gchar *filename;
+		const gchar *prefix;
+		guint32 width;
+		guint32 height;
+		guint32 scale;
+		AsIcon *icon;
+		g_autoptr(GVariant) data = NULL;
+		if (!g_variant_iter_next (iter_tmp, "(um&sm&sm&sm&suuu@ay)",
+					  &kind, &tmp, &url, &filename, &prefix,
+					  &width, &height, &scale, &data))
+			break;
+		icon = as_icon_new ();
+		as_icon_set_kind (icon, kind);
+		as_icon_set_name (icon, tmp);
+		as_icon_set_url (icon, url);
+		as_icon_set_filename (icon, filename);
+		as_icon_set_prefix (icon, prefix);
+		as_icon_set_width (icon, width);
+		as_icon_set_height (icon, height);
+		as_icon_set_scale (icon, scale);
+		if (g_variant_get_size (data) > 0) {
+			g_autoptr(GBytes) bytes = g_variant_get_data_as_bytes (data);
+			as_icon_set_data (icon, bytes);
+		}
+		g_ptr_array_add (priv->icons, icon);
+	}
+	g_clear_pointer (&iter_tmp, g_variant_iter_free);
+
+	/* set last so the cached values are not validated again */
+	priv->trust_flags = trust_flags;
+	priv->problems = problems;
+
+	/* parsed when first required, referring to the data in @value */
+	deferred = g_variant_iter_next_value (&iter);
+	if (g_variant_n_children (deferred) > 0) {
+		g_rec_mutex_lock (&priv->lazy_mutex);
+		g_clear_pointer (&priv->lazy_nodes, g_variant_unref);
+		g_clear_pointer (&priv->lazy_raw, g_ptr_array_unref);
+		g_clear_pointer (&priv->lazy_ctx, as_node_context_free);
+		priv->lazy_nodes = g_steal_pointer (&deferred);
+		priv->lazy_ctx = as_app_node_context_copy (ctx);
+		priv->lazy_flags = (flags & ~AS_APP_PARSE_FLAG_LAZY) |
+				   AS_APP_PARSE_FLAG_APPEND_DATA;
+		g_atomic_int_set (&priv->lazy_pending, 1);
+		g_rec_mutex_unlock (&priv->lazy_mutex);
+	}
+	return TRUE;
+}
+
 static gboolean
 as_app_node_parse_dep11_icons (AsApp *app, GNode *node,
 			       AsNodeContext *ctx, GError **error)
@@ -5843,7 +6561,7 @@ as_app_add_token_internal (AsApp *app,
 			   guint16 match_flag)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
-	AsAppTokenType *match_pval;
+	AsAppToken token;
 	g_autoptr(AsRefString) value_stem = NULL;
 
 	/* invalid */
@@ -5861,19 +6579,10 @@ as_app_add_token_internal (AsApp *app,
 	    g_hash_table_lookup (priv->search_blacklist, value_stem) != NULL)
 		return;
 
-	/* does the token already exist */
-	match_pval = g_hash_table_lookup (priv->token_cache, value_stem);
-	if (match_pval != NULL) {
-		*match_pval |= match_flag;
-		return;
-	}
-
-	/* create and add */
-	match_pval = g_new0 (AsAppTokenType, 1);
-	*match_pval = match_flag;
-	g_hash_table_insert (priv->token_cache,
-			     as_ref_string_ref (value_stem),
-			     match_pval);
+	/* duplicates are merged when the cache is complete */
+	token.id = as_token_dict_insert (priv->token_dict, value_stem);
+	token.match = match_flag;
+	g_array_append_val (priv->token_cache, token);
 }
 
 static void
@@ -6019,6 +6728,39 @@ as_app_create_token_cache_target (AsApp *app, AsApp *donor)
 	}
 }
 
+static gint
+as_app_token_sort_cb (gconstpointer a, gconstpointer b)
+{
+	const AsAppToken *t1 = a;
+	const AsAppToken *t2 = b;
+	if (t1->id < t2->id)
+		return -1;
+	if (t1->id > t2->id)
+		return 1;
+	return 0;
+}
+
+/* sort by ID and merge the match flags of duplicate tokens */
+static void
+as_app_token_cache_compact (GArray *token_cache)
+{
+	guint j = 0;
+
+	if (token_cache->len == 0)
+		return;
+	g_array_sort (token_cache, as_app_token_sort_cb);
+	for (guint i = 1; i < token_cache->len; i++) {
+		AsAppToken *token = &g_array_index (token_cache, AsAppToken, i);
+		AsAppToken *last = &g_array_index (token_cache, AsAppToken, j);
+		if (token->id == last->id) {
+			last->match |= token->match;
+			continue;
+		}
+		g_array_index (token_cache, AsAppToken, ++j) = *token;
+	}
+	g_array_set_size (token_cache, j + 1);
+}
+
 static void
 as_app_create_token_cache (AsApp *app)
 {
@@ -6026,11 +6768,62 @@ as_app_create_token_cache (AsApp *app)
 	AsAppPrivate *priv = GET_PRIVATE (app);
 	guint i;
 
+	/* not added to a store */
+	if (priv->token_dict == NULL)
+		priv->token_dict = as_token_dict_new ();
+
 	as_app_create_token_cache_target (app, app);
 	for (i = 0; i < priv->addons->len; i++) {
 		donor = g_ptr_array_index (priv->addons, i);
 		as_app_create_token_cache_target (app, donor);
 	}
+	as_app_token_cache_compact (priv->token_cache);
+}
+
+/**
+ * as_app_set_token_cache: (skip)
+ * @app: a #AsApp instance.
+ * @token_cache: an array of AsAppToken using IDs from as_app_get_token_dict()
+ *
+ * Sets a token cache that was saved earlier, unless it has already been
+ * created.
+ *
+ * Returns: %TRUE if the token cache was used
+ **/
+gboolean
+as_app_set_token_cache (AsApp *app, GArray *token_cache)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+
+	if (priv->token_dict == NULL)
+		return FALSE;
+	if (!g_once_init_enter (&priv->token_cache_valid))
+		return FALSE;
+	g_array_set_size (priv->token_cache, 0);
+	g_array_append_vals (priv->token_cache, token_cache->data, token_cache->len);
+	as_app_token_cache_compact (priv->token_cache);
+	g_once_init_leave (&priv->token_cache_valid, TRUE);
+	return TRUE;
+}
+
+/* returns the token with @id, or %NULL */
+static AsAppToken *
+as_app_token_cache_find (GArray *token_cache, guint32 id)
+{
+	guint lo = 0;
+	guint hi = token_cache->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		AsAppToken *token = &g_array_index (token_cache, AsAppToken, mid);
+		if (token->id == id)
+			return token;
+		if (token->id < id)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return NULL;
 }
 
 /**
@@ -6048,10 +6841,9 @@ guint
 as_app_search_matches (AsApp *app, const gchar *search)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
-	AsAppTokenType *match_pval;
-	GList *l;
+	AsAppToken *token;
+	guint32 id;
 	guint16 result = 0;
-	g_autoptr(GList) keys = NULL;
 	g_autoptr(AsRefString) search_stem = NULL;
 
 	/* ensure the token cache is created */
@@ -6069,20 +6861,131 @@ as_app_search_matches (AsApp *app, const gchar *search)
 		search_stem = as_stemmer_process (priv->stemmer, search);
 	if (search_stem == NULL)
 		return 0;
-	match_pval = g_hash_table_lookup (priv->token_cache, search_stem);
-	if (match_pval != NULL)
-		return (guint) *match_pval << 2;
+	if (as_token_dict_lookup (priv->token_dict, search_stem, &id)) {
+		token = as_app_token_cache_find (priv->token_cache, id);
+		if (token != NULL)
+			return (guint) token->match << 2;
+	}
+
+	/* need to do partial match, so only take the lock once */
+	as_token_dict_reader_lock (priv->token_dict);
+	for (guint i = 0; i < priv->token_cache->len; i++) {
+		AsRefString *key;
+		token = &g_array_index (priv->token_cache, AsAppToken, i);
+		key = as_token_dict_get_unlocked (priv->token_dict, token->id);
+		if (key != NULL && g_str_has_prefix (key, search_stem))
+			result |= token->match;
+	}
+	as_token_dict_reader_unlock (priv->token_dict);
+	return result;
+}
 
-	/* need to do partial match */
-	keys = g_hash_table_get_keys (priv->token_cache);
-	for (l = keys; l != NULL; l = l->next) {
-		const gchar *key = l->data;
-		if (g_str_has_prefix (key, search_stem)) {
-			match_pval = g_hash_table_lookup (priv->token_cache, key);
-			result |= *match_pval;
+/**
+ * as_app_get_token_cache: (skip)
+ * @app: a #AsApp instance.
+ *
+ * Gets the token cache, creating it if required. The IDs refer to the
+ * tokens in as_app_get_token_dict().
+ *
+ * Returns: (transfer none): an array of AsAppToken, sorted by ID
+ **/
+GArray *
+as_app_get_token_cache (AsApp *app)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+
+	/* ensure the token cache is created */
+	if (g_once_init_enter (&priv->token_cache_valid)) {
+		as_app_create_token_cache (app);
+		g_once_init_leave (&priv->token_cache_valid, TRUE);
+	}
+	return priv->token_cache;
+}
+
+/**
+ * as_app_invalidate_token_cache: (skip)
+ * @app: a #AsApp instance.
+ *
+ * Clears the token cache so that it is created again on next use, for
+ * instance when the stemmer or the search match fields have changed.
+ **/
+void
+as_app_invalidate_token_cache (AsApp *app)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	g_array_set_size (priv->token_cache, 0);
+	g_atomic_pointer_set (&priv->token_cache_valid, 0);
+	g_atomic_int_inc (&priv->token_cache_generation);
+}
+
+/**
+ * as_app_get_token_cache_generation: (skip)
+ * @app: a #AsApp instance.
+ *
+ * Gets a number that changes each time the token cache is invalidated, so
+ * that anything built from the token cache can tell when it is out of date.
+ *
+ * Returns: a generation number
+ **/
+guint
+as_app_get_token_cache_generation (AsApp *app)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	return (guint) g_atomic_int_get (&priv->token_cache_generation);
+}
+
+/**
+ * as_app_add_provides_watcher: (skip)
+ * @app: a #AsApp instance.
+ * @func: a #AsAppProvidesFunc
+ * @user_data: data for @func
+ *
+ * Calls @func each time a provide or launchable is added to the application,
+ * so that an index of them can be kept up to date.
+ *
+ * @func is called with a lock held that is shared by all applications, and
+ * must not add or remove watchers itself.
+ **/
+void
+as_app_add_provides_watcher (AsApp *app, AsAppProvidesFunc func, gpointer user_data)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	AsAppProvidesWatcher watcher = { func, user_data };
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	locker = g_mutex_locker_new (&as_app_provides_watchers_mutex);
+	if (priv->provides_watchers == NULL) {
+		GArray *watchers = g_array_new (FALSE, FALSE, sizeof (AsAppProvidesWatcher));
+		g_atomic_pointer_set (&priv->provides_watchers, watchers);
+	}
+	g_array_append_val (priv->provides_watchers, watcher);
+}
+
+/**
+ * as_app_remove_provides_watcher: (skip)
+ * @app: a #AsApp instance.
+ * @func: a #AsAppProvidesFunc
+ * @user_data: data for @func
+ *
+ * Removes a watcher added with as_app_add_provides_watcher().
+ **/
+void
+as_app_remove_provides_watcher (AsApp *app, AsAppProvidesFunc func, gpointer user_data)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	g_autoptr(GMutexLocker) locker = NULL;
+
+	locker = g_mutex_locker_new (&as_app_provides_watchers_mutex);
+	if (priv->provides_watchers == NULL)
+		return;
+	for (guint i = 0; i < priv->provides_watchers->len; i++) {
+		AsAppProvidesWatcher *watcher;
+		watcher = &g_array_index (priv->provides_watchers, AsAppProvidesWatcher, i);
+		if (watcher->func == func && watcher->user_data == user_data) {
+			g_array_remove_index_fast (priv->provides_watchers, i);
+			return;
 		}
 	}
-	return result;
 }
 
 /**
@@ -6099,9 +7002,7 @@ GPtrArray *
 as_app_get_search_tokens (AsApp *app)
 {
 	AsAppPrivate *priv = GET_PRIVATE (app);
-	GList *l;
 	GPtrArray *array;
-	g_autoptr(GList) keys = NULL;
 
 	/* ensure the token cache is created */
 	if (g_once_init_enter (&priv->token_cache_valid)) {
@@ -6110,10 +7011,11 @@ as_app_get_search_tokens (AsApp *app)
 	}
 
 	/* return all the token cache */
-	keys = g_hash_table_get_keys (priv->token_cache);
 	array = g_ptr_array_new_with_free_func ((GDestroyNotify) as_ref_string_unref);
-	for (l = keys; l != NULL; l = l->next)
-		g_ptr_array_add (array, as_ref_string_ref (l->data));
+	for (guint i = 0; i < priv->token_cache->len; i++) {
+		AsAppToken *token = &g_array_index (priv->token_cache, AsAppToken, i);
+		g_ptr_array_add (array, as_ref_string_ref (as_token_dict_get (priv->token_dict, token->id)));
+	}
 	return array;
 }
 
@@ -6708,6 +7610,45 @@ as_app_set_stemmer (AsApp *app, AsStemmer *stemmer)
 	g_set_object (&priv->stemmer, stemmer);
 }
 
+/**
+ * as_app_get_token_dict: (skip)
+ *
+ * Gets the dictionary for the IDs in as_app_get_token_cache(), which is
+ * only valid once the token cache has been created.
+ **/
+AsTokenDict *
+as_app_get_token_dict (AsApp *app)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+	return priv->token_dict;
+}
+
+/**
+ * as_app_set_token_dict: (skip)
+ *
+ * Sets the dictionary shared by all the applications in a store. Any
+ * existing token cache is converted to use the new IDs in place, so this
+ * must not be called while the application can be searched from another
+ * thread, for instance when it has already been added to a different store.
+ **/
+void
+as_app_set_token_dict (AsApp *app, AsTokenDict *token_dict)
+{
+	AsAppPrivate *priv = GET_PRIVATE (app);
+
+	if (priv->token_dict == token_dict)
+		return;
+	if (priv->token_dict != NULL) {
+		for (guint i = 0; i < priv->token_cache->len; i++) {
+			AsAppToken *token = &g_array_index (priv->token_cache, AsAppToken, i);
+			AsRefString *tmp = as_token_dict_get (priv->token_dict, token->id);
+			token->id = as_token_dict_insert (token_dict, tmp);
+		}
+		g_array_sort (priv->token_cache, as_app_token_sort_cb);
+	}
+	g_set_object (&priv->token_dict, token_dict);
+}
+
 /**
  * as_app_set_search_blacklist: (skip)
  **/
@@ -58,6 +58,7 @@ struct _AsAppClass
  * @AS_APP_PARSE_FLAG_USE_FALLBACKS:	Fall back to suboptimal data where required
  * @AS_APP_PARSE_FLAG_ADD_ALL_METADATA:	Add all extra metadata from the source file
  * @AS_APP_PARSE_FLAG_ONLY_NATIVE_LANGS:	Only load native languages
+ * @AS_APP_PARSE_FLAG_LAZY:		Defer parsing releases, screenshots and other large data
  *
  * The flags to use when parsing resources.
  **/
@@ -71,6 +72,7 @@ typedef enum {
 	AS_APP_PARSE_FLAG_USE_FALLBACKS		= 1 << 5,	/* Since: 0.4.1 */
 	AS_APP_PARSE_FLAG_ADD_ALL_METADATA	= 1 << 6,	/* Since: 0.6.1 */
 	AS_APP_PARSE_FLAG_ONLY_NATIVE_LANGS	= 1 << 7,	/* Since: 0.6.3 */
+	AS_APP_PARSE_FLAG_LAZY			= 1 << 8,	/* Since: 0.8.5 */
 	/*< private >*/
 	AS_APP_PARSE_FLAG_LAST,
 } AsAppParseFlags;
@@ -0,0 +1,506 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014-2016 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include "as-store.h"
+
+/* the components in the synthetic catalogue are made from these words */
+static const gchar *as_benchmark_words[] = {
+	"audio", "browser", "calendar", "chess", "clock", "compiler",
+	"database", "debugger", "document", "editor", "email", "font",
+	"game", "graphics", "image", "internet", "library", "mail",
+	"manager", "maps", "music", "network", "office", "painting",
+	"photo", "player", "presentation", "printer", "puzzle", "radio",
+	"recorder", "scanner", "science", "security", "spreadsheet",
+	"terminal", "text", "translator", "video", "viewer", "weather",
+	"word", NULL };
+
+typedef struct {
+	guint		 size;
+	gchar		*destdir;
+	GString		*json;
+	GTimer		*timer;
+	gboolean	 first;
+	gboolean	 rss_reset;	/* peak RSS is only for this stage */
+} AsBenchmark;
+
+static const gchar *
+as_benchmark_word (guint idx)
+{
+	return as_benchmark_words[idx % (G_N_ELEMENTS (as_benchmark_words) - 1)];
+}
+
+static gchar *
+as_benchmark_app_id (guint idx)
+{
+	return g_strdup_printf ("org.example.%s%u.desktop",
+				as_benchmark_word (idx), idx);
+}
+
+static gboolean
+as_benchmark_write_xml (AsBenchmark *self, const gchar *filename, GError **error)
+{
+	g_autoptr(GString) str = g_string_new (NULL);
+
+	g_string_append (str, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			 "<components origin=\"benchmark\" version=\"0.9\">\n");
+	for (guint i = 0; i < self->size; i++) {
+		g_autofree gchar *id = as_benchmark_app_id (i);
+		const gchar *word1 = as_benchmark_word (i);
+		const gchar *word2 = as_benchmark_word (i / 7);
+		g_string_append_printf (str,
+			"<component type=\"desktop\">\n"
+			"<id>%s</id>\n"
+			"<pkgname>%s%u</pkgname>\n"
+			"<name>%s %s %u</name>\n"
+			"<name xml:lang=\"de\">%s %s %u</name>\n"
+			"<summary>A %s for %s</summary>\n"
+			"<description><p>This %s is used to manage %s and %s.</p>"
+			"<ul><li>Fast %s</li><li>Simple %s</li></ul></description>\n"
+			"<categories><category>Utility</category></categories>\n"
+			"<keywords><keyword>%s</keyword><keyword>%s</keyword></keywords>\n"
+			"<url type=\"homepage\">https://www.example.org/%s%u</url>\n"
+			"<project_license>GPL-2.0+</project_license>\n"
+			"<icon type=\"cached\" height=\"64\" width=\"64\">%s%u.png</icon>\n"
+			"<provides><binary>%s%u</binary></provides>\n"
+			"<launchable type=\"desktop-id\">%s</launchable>\n"
+			"<screenshots><screenshot type=\"default\">"
+			"<caption>The main %s window</caption>"
+			"<image type=\"source\" width=\"1024\" height=\"768\">"
+			"https://www.example.org/%s%u.png</image>"
+			"</screenshot></screenshots>\n"
+			"<content_rating type=\"oars-1.0\">"
+			"<content_attribute id=\"violence-cartoon\">mild</content_attribute>"
+			"<content_attribute id=\"social-chat\">intense</content_attribute>"
+			"</content_rating>\n"
+			"<releases>"
+			"<release version=\"%u.2\" timestamp=\"%u\">"
+			"<description><p>Faster %s.</p></description></release>"
+			"<release version=\"%u.1\" timestamp=\"%u\">"
+			"<description><p>Fixed %s.</p></description></release>"
+			"<release version=\"%u.0\" timestamp=\"%u\"/>"
+			"</releases>\n"
+			"</component>\n",
+			id, word1, i,
+			word1, word2, i,
+			word2, word1, i,
+			word1, word2,
+			word1, word2, word1,
+			word1, word2,
+			word1, word2,
+			word1, i,
+			word1, i,
+			word1, i,
+			id,
+			word1,
+			word1, i,
+			i % 10, 1400200000 + i, word2,
+			i % 10, 1400100000 + i, word1,
+			i % 10, 1400000000 + i);
+	}
+	g_string_append (str, "</components>\n");
+	return g_file_set_contents (filename, str->str, (gssize) str->len, error);
+}
+
+#ifdef AS_BUILD_DEP11
+static gboolean
+as_benchmark_write_yaml (AsBenchmark *self, const gchar *filename, GError **error)
+{
+	g_autoptr(GString) str = g_string_new (NULL);
+
+	g_string_append (str, "---\nFile: DEP-11\nOrigin: benchmark\nVersion: '0.6'\n");
+	for (guint i = 0; i < self->size; i++) {
+		g_autofree gchar *id = as_benchmark_app_id (i);
+		const gchar *word1 = as_benchmark_word (i);
+		const gchar *word2 = as_benchmark_word (i / 7);
+		g_string_append_printf (str,
+			"---\n"
+			"Type: desktop-app\n"
+			"ID: %s\n"
+			"Package: %s%u\n"
+			"Name:\n  C: %s %s %u\n  de: %s %s %u\n"
+			"Summary:\n  C: A %s for %s\n"
+			"Description:\n  C: <p>This %s is used to manage %s.</p>\n"
+			"Categories:\n  - Utility\n"
+			"Keywords:\n  C:\n    - %s\n    - %s\n"
+			"Url:\n  homepage: https://www.example.org/%s%u\n"
+			"Icon:\n  cached: %s%u.png\n",
+			id, word1, i,
+			word1, word2, i, word2, word1, i,
+			word1, word2,
+			word1, word2,
+			word1, word2,
+			word1, i,
+			word1, i);
+	}
+	return g_file_set_contents (filename, str->str, (gssize) str->len, error);
+}
+#endif
+
+static gboolean
+as_benchmark_write_desktop (AsBenchmark *self, const gchar *path, GError **error)
+{
+	for (guint i = 0; i < self->size; i++) {
+		const gchar *word1 = as_benchmark_word (i);
+		const gchar *word2 = as_benchmark_word (i / 7);
+		g_autofree gchar *id = as_benchmark_app_id (i);
+		g_autofree gchar *filename = g_build_filename (path, id, NULL);
+		g_autofree gchar *data = NULL;
+		data = g_strdup_printf ("[Desktop Entry]\n"
+					"Type=Application\n"
+					"Name=%s %s %u\n"
+					"Name[de]=%s %s %u\n"
+					"Comment=A %s for %s\n"
+					"Keywords=%s;%s;\n"
+					"Categories=Utility;\n"
+					"Icon=%s%u\n"
+					"Exec=%s%u\n",
+					word1, word2, i,
+					word2, word1, i,
+					word1, word2,
+					word1, word2,
+					word1, i,
+					word1, i);
+		if (!g_file_set_contents (filename, data, -1, error))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static gchar *
+as_benchmark_build_path (AsBenchmark *self, const gchar *subdir, GError **error)
+{
+	g_autofree gchar *path = g_build_filename (self->destdir, subdir, NULL);
+	if (g_mkdir_with_parents (path, 0700) != 0) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+			     "Failed to create %s", path);
+		return NULL;
+	}
+	return g_steal_pointer (&path);
+}
+
+/* resets the peak RSS of the process to the current RSS, which is only
+ * possible on Linux 4.0 and newer */
+static gboolean
+as_benchmark_reset_peak_rss (void)
+{
+#ifdef __linux__
+	gboolean ret;
+	FILE *fp = fopen ("/proc/self/clear_refs", "w");
+	if (fp == NULL)
+		return FALSE;
+	ret = fputs ("5", fp) >= 0;
+	if (fclose (fp) != 0)
+		return FALSE;
+	return ret;
+#else
+	return FALSE;
+#endif
+}
+
+/* the peak RSS since as_benchmark_reset_peak_rss() in kB */
+static gint64
+as_benchmark_get_peak_rss (void)
+{
+	g_autofree gchar *data = NULL;
+	const gchar *tmp;
+
+	if (!g_file_get_contents ("/proc/self/status", &data, NULL, NULL))
+		return -1;
+	tmp = g_strstr_len (data, -1, "\nVmHWM:");
+	if (tmp == NULL)
+		return -1;
+	return g_ascii_strtoll (tmp + 7, NULL, 10);
+}
+
+/* the peak RSS over the whole lifetime of the process in kB */
+static gint64
+as_benchmark_get_process_peak_rss (void)
+{
+#ifndef _WIN32
+	struct rusage usage;
+	if (getrusage (RUSAGE_SELF, &usage) == 0)
+		return usage.ru_maxrss;
+#endif
+	return -1;
+}
+
+static void
+as_benchmark_start (AsBenchmark *self)
+{
+	self->rss_reset = as_benchmark_reset_peak_rss ();
+	g_timer_start (self->timer);
+}
+
+/* outputs one result, where @items is the number of things processed */
+static void
+as_benchmark_stop (AsBenchmark *self, const gchar *name, guint items)
+{
+	gdouble elapsed = g_timer_elapsed (self->timer, NULL);
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	if (!self->first)
+		g_string_append (self->json, ",\n");
+	self->first = FALSE;
+	g_string_append_printf (self->json, "    { \"name\": \"%s\", ", name);
+	g_string_append_printf (self->json, "\"items\": %u, ", items);
+	g_string_append_printf (self->json, "\"seconds\": %s, ",
+				g_ascii_dtostr (buf, sizeof (buf), elapsed));
+	g_string_append_printf (self->json, "\"items_per_second\": %s, ",
+				g_ascii_dtostr (buf, sizeof (buf),
+						elapsed > 0.f ? items / elapsed : 0.f));
+
+	/* without a reset the peak includes all the earlier stages */
+	if (self->rss_reset) {
+		g_string_append_printf (self->json, "\"peak_rss_kb\": %" G_GINT64_FORMAT " }",
+					as_benchmark_get_peak_rss ());
+	} else {
+		g_string_append_printf (self->json, "\"process_peak_rss_kb\": %" G_GINT64_FORMAT " }",
+					as_benchmark_get_process_peak_rss ());
+	}
+	g_debug ("%s: %.3fs", name, elapsed);
+}
+
+static gboolean
+as_benchmark_store_from_file (AsBenchmark *self,
+			      AsStore *store,
+			      const gchar *name,
+			      const gchar *filename,
+			      GError **error)
+{
+	g_autoptr(GFile) file = g_file_new_for_path (filename);
+
+	as_benchmark_start (self);
+	if (!as_store_from_file (store, file, NULL, NULL, error))
+		return FALSE;
+	as_benchmark_stop (self, name, as_store_get_size (store));
+	return TRUE;
+}
+
+static gboolean
+as_benchmark_run (AsBenchmark *self, GError **error)
+{
+	guint cnt = 0;
+	g_autofree gchar *fn_xml = NULL;
+	g_autofree gchar *path_desktop = NULL;
+	g_autofree gchar *path_xmls = NULL;
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autoptr(GPtrArray) apps = NULL;
+	g_autoptr(GString) xml = NULL;
+
+	/* generate the corpora */
+	path_xmls = as_benchmark_build_path (self, "usr/share/app-info/xmls", error);
+	if (path_xmls == NULL)
+		return FALSE;
+	fn_xml = g_build_filename (path_xmls, "benchmark.xml", NULL);
+	as_benchmark_start (self);
+	if (!as_benchmark_write_xml (self, fn_xml, error))
+		return FALSE;
+	as_benchmark_stop (self, "generate-xml", self->size);
+#ifdef AS_BUILD_DEP11
+	{
+		g_autofree gchar *fn_yaml = NULL;
+		g_autofree gchar *path_yaml = NULL;
+		g_autoptr(AsStore) store_yaml = as_store_new ();
+		path_yaml = as_benchmark_build_path (self, "usr/share/app-info/yaml", error);
+		if (path_yaml == NULL)
+			return FALSE;
+		fn_yaml = g_build_filename (path_yaml, "benchmark.yml", NULL);
+		as_benchmark_start (self);
+		if (!as_benchmark_write_yaml (self, fn_yaml, error))
+			return FALSE;
+		as_benchmark_stop (self, "generate-yaml", self->size);
+		if (!as_benchmark_store_from_file (self, store_yaml, "load-yaml",
+						   fn_yaml, error))
+			return FALSE;
+	}
+#endif
+	path_desktop = as_benchmark_build_path (self, "usr/share/applications", error);
+	if (path_desktop == NULL)
+		return FALSE;
+	as_benchmark_start (self);
+	if (!as_benchmark_write_desktop (self, path_desktop, error))
+		return FALSE;
+	as_benchmark_stop (self, "generate-desktop", self->size);
+
+	/* load */
+	{
+		g_autoptr(AsStore) store_desktop = as_store_new ();
+		as_benchmark_start (self);
+		if (!as_store_load_path_full (store_desktop, path_desktop,
+					      AS_STORE_LOAD_FLAG_PARALLEL,
+					      NULL, error))
+			return FALSE;
+		as_benchmark_stop (self, "load-desktop", as_store_get_size (store_desktop));
+	}
+	if (!as_benchmark_store_from_file (self, store, "load-xml", fn_xml, error))
+		return FALSE;
+
+	/* only what is needed to list and search is parsed up front, and the
+	 * releases, screenshots and content ratings when first used */
+	{
+		g_autoptr(AsStore) store_lazy = as_store_new ();
+		g_autoptr(GPtrArray) apps_lazy = NULL;
+		as_store_set_add_flags (store_lazy, AS_STORE_ADD_FLAG_LAZY_PARSE);
+		if (!as_benchmark_store_from_file (self, store_lazy, "load-xml-lazy",
+						   fn_xml, error))
+			return FALSE;
+		apps_lazy = as_store_dup_apps (store_lazy);
+		as_benchmark_start (self);
+		for (guint i = 0; i < apps_lazy->len; i++) {
+			AsApp *app = g_ptr_array_index (apps_lazy, i);
+			if (as_app_get_releases (app)->len == 0) {
+				g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+					     "No releases for %s", as_app_get_id (app));
+				return FALSE;
+			}
+		}
+		as_benchmark_stop (self, "load-xml-lazy-releases", apps_lazy->len);
+	}
+
+	/* search */
+	as_benchmark_start (self);
+	as_store_load_search_cache (store);
+	as_benchmark_stop (self, "search-cache", as_store_get_size (store));
+	as_benchmark_start (self);
+	for (guint i = 0; as_benchmark_words[i] != NULL; i++) {
+		g_autofree gchar *search = NULL;
+		g_autoptr(GPtrArray) results1 = NULL;
+		g_autoptr(GPtrArray) results2 = NULL;
+		search = g_strdup_printf ("%s %s", as_benchmark_words[i],
+					  as_benchmark_word (i + 1));
+		results1 = as_store_search (store, as_benchmark_words[i]);
+		results2 = as_store_search (store, search);
+		cnt += 2;
+	}
+	as_benchmark_stop (self, "search", cnt);
+
+	/* to_xml */
+	as_benchmark_start (self);
+	xml = as_store_to_xml (store, AS_NODE_TO_XML_FLAG_FORMAT_MULTILINE |
+				      AS_NODE_TO_XML_FLAG_FORMAT_INDENT);
+	as_benchmark_stop (self, "to-xml", as_store_get_size (store));
+
+	/* validate */
+	apps = as_store_dup_apps (store);
+	as_benchmark_start (self);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		g_autoptr(GPtrArray) probs = NULL;
+		probs = as_app_validate (app, AS_APP_VALIDATE_FLAG_NO_NETWORK, error);
+		if (probs == NULL)
+			return FALSE;
+	}
+	as_benchmark_stop (self, "validate", apps->len);
+
+	/* subsume */
+	as_benchmark_start (self);
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		g_autoptr(AsApp) app_tmp = as_app_new ();
+		as_app_subsume_full (app_tmp, app, AS_APP_SUBSUME_FLAG_NO_OVERWRITE);
+	}
+	as_benchmark_stop (self, "subsume", apps->len);
+	return TRUE;
+}
+
+static gboolean
+as_benchmark_rm_rf (const gchar *path, GError **error)
+{
+	const gchar *fn;
+	g_autoptr(GDir) dir = NULL;
+
+	dir = g_dir_open (path, 0, error);
+	if (dir == NULL)
+		return FALSE;
+	while ((fn = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *tmp = g_build_filename (path, fn, NULL);
+		if (g_file_test (tmp, G_FILE_TEST_IS_DIR)) {
+			if (!as_benchmark_rm_rf (tmp, error))
+				return FALSE;
+		} else {
+			(void)g_unlink (tmp);
+		}
+	}
+	(void)g_rmdir (path);
+	return TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+	AsBenchmark self = { .first = TRUE };
+	gboolean keep = FALSE;
+	gboolean ret;
+	gboolean destdir_is_tmp = FALSE;
+	gint size = 1000;
+	g_autofree gchar *destdir = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GOptionContext) option_context = NULL;
+	const GOptionEntry options[] = {
+		{ "size", 's', 0, G_OPTION_ARG_INT, &size,
+			"Number of components in each catalogue", "NUMBER" },
+		{ "destdir", 'd', 0, G_OPTION_ARG_FILENAME, &destdir,
+			"Directory to write the catalogues to", "DIR" },
+		{ "keep", 'k', 0, G_OPTION_ARG_NONE, &keep,
+			"Do not delete the temporary directory when finished", NULL },
+		{ NULL}
+	};
+
+	option_context = g_option_context_new (NULL);
+	g_option_context_add_main_entries (option_context, options, NULL);
+	if (!g_option_context_parse (option_context, &argc, &argv, &error)) {
+		g_printerr ("Failed to parse arguments: %s\n", error->message);
+		return EXIT_FAILURE;
+	}
+	if (size <= 0) {
+		g_printerr ("Invalid size %i\n", size);
+		return EXIT_FAILURE;
+	}
+
+	/* use a temporary directory by default */
+	if (destdir == NULL) {
+		destdir = g_dir_make_tmp ("as-benchmark-XXXXXX", &error);
+		if (destdir == NULL) {
+			g_printerr ("Failed to create directory: %s\n", error->message);
+			return EXIT_FAILURE;
+		}
+		destdir_is_tmp = TRUE;
+	}
+
+	self.size = (guint) size;
+	self.destdir = destdir;
+	self.timer = g_timer_new ();
+	self.json = g_string_new (NULL);
+	g_string_append_printf (self.json, "{\n  \"components\": %u,\n"
+				"  \"results\": [\n", self.size);
+	ret = as_benchmark_run (&self, &error);
+	g_string_append (self.json, "\n  ]\n}\n");
+	g_timer_destroy (self.timer);
+
+	/* clean up, but never delete a directory the user specified */
+	if (destdir_is_tmp && !keep)
+		as_benchmark_rm_rf (destdir, NULL);
+	if (!ret) {
+		g_printerr ("Failed to run benchmark: %s\n", error->message);
+		g_string_free (self.json, TRUE);
+		return EXIT_FAILURE;
+	}
+	g_print ("%s", self.json->str);
+	g_string_free (self.json, TRUE);
+	return EXIT_SUCCESS;
+}
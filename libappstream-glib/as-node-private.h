@@ -18,6 +18,10 @@
 G_BEGIN_DECLS
 
 typedef struct _AsNodeContext	AsNodeContext;
+
+typedef gboolean (*AsNodeStreamFunc)		(AsNode		*node,
+						 gpointer	 user_data,
+						 GError		**error);
 AsNodeContext	*as_node_context_new		(void);
 void		 as_node_context_free		(AsNodeContext	*ctx);
 const gchar	*as_node_context_get_version	(AsNodeContext	*ctx);
@@ -52,6 +56,29 @@ AsRefString	*as_node_fix_locale_full	(const GNode	*node,
 AsRefString	*as_node_get_data_as_refstr	(const AsNode	*node);
 AsRefString	*as_node_get_attribute_as_refstr (const AsNode	*node,
 						const gchar	*key);
+GBytes		*as_node_get_raw		(const AsNode	*node,
+						 AsNodeFromXmlFlags *flags);
+AsNode		*as_node_from_file_stream	(GFile		*file,
+						 AsNodeFromXmlFlags flags,
+						 guint		 depth,
+						 AsNodeStreamFunc func,
+						 gpointer	 user_data,
+						 GCancellable	*cancellable,
+						 GError		**error)
+						 G_GNUC_WARN_UNUSED_RESULT;
+void		 as_node_to_xml_start		(GString	*xml,
+						 const AsNode	*node,
+						 AsNodeToXmlFlags flags);
+void		 as_node_to_xml_append		(GString	*xml,
+						 const AsNode	*node,
+						 AsNodeToXmlFlags flags);
+void		 as_node_to_xml_end		(GString	*xml,
+						 const AsNode	*node,
+						 AsNodeToXmlFlags flags);
+GVariant	*as_node_to_variant		(const AsNode	*node);
+GVariant	*as_node_array_to_variant	(GPtrArray	*nodes);
+AsNode		*as_node_from_variant		(GVariant	*value,
+						 GError		**error);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(AsNodeContext, as_node_context_free)
 
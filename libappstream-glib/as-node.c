@@ -28,14 +28,28 @@
 #include "as-ref-string.h"
 #include "as-utils-private.h"
 
+/* the first chunk is small so that tiny fragments stay cheap */
+#define AS_NODE_ARENA_CHUNK_MIN		(4 * 1024)
+#define AS_NODE_ARENA_CHUNK_MAX		(64 * 1024)
+
 typedef struct {
 	GHashTable		*intern_attr;	/* key=value of AsRefString */
 	GHashTable		*intern_name;	/* key=value of AsRefString */
 	GHashTable		*intern_lang;	/* key=value of AsRefString */
+	GPtrArray		*chunks;	/* of arena memory for the tree */
+	gsize			 chunk_size;
+	gsize			 chunk_used;
+	gpointer		 free_nodes;	/* of AsNodeBlock, from subtrees */
+	gpointer		 free_attrs;	/* of AsNodeAttrBlock, from subtrees */
+	GBytes			*source;	/* the parsed XML, for cdata slices */
+	GHashTable		*raw;		/* of AsNode:GBytes, deferred children */
+	AsNodeFromXmlFlags	 flags;
+	gboolean		 has_heap_strings;
 } AsNodeRoot;
 
 typedef struct
 {
+	AsNodeRoot		*root;		/* the arena this node lives in */
 	GList			*attrs;
 	union {
 		AsTag		 tag;
@@ -43,7 +57,6 @@ typedef struct
 		AsRefString	*name;		/* only if is_tag_valid = FALSE */
 	};
 	union {
-		AsNodeRoot	*root;		/* only if is_root_node = TRUE */
 		const gchar	*cdata_const;	/* only if is_cdata_const = TRUE */
 		AsRefString	*cdata;
 	};
@@ -53,6 +66,8 @@ typedef struct
 	guint8			 is_cdata_escaped:1;
 	guint8			 is_cdata_ignore:1;
 	guint8			 is_tag_valid:1;
+	guint8			 is_cdata_slice:1;
+	guint32			 cdata_len;	/* only if is_cdata_slice = TRUE */
 } AsNodeData;
 
 typedef struct {
@@ -60,6 +75,67 @@ typedef struct {
 	AsRefString		*value;
 } AsNodeAttr;
 
+/* nodes and attributes are allocated together with their list links */
+typedef struct {
+	GNode			 node;
+	AsNodeData		 data;
+} AsNodeBlock;
+
+typedef struct {
+	GList			 link;
+	AsNodeAttr		 attr;
+} AsNodeAttrBlock;
+
+static gpointer
+as_node_root_alloc (AsNodeRoot *root, gpointer *free_list, gsize size)
+{
+	gpointer mem;
+
+	/* reuse anything released by as_node_unref() on a subtree */
+	if (*free_list != NULL) {
+		mem = *free_list;
+		*free_list = *((gpointer *) mem);
+		memset (mem, 0, size);
+		return mem;
+	}
+
+	/* bump allocate from the current chunk, keeping pointer alignment */
+	size = (size + 2 * sizeof(gpointer) - 1) & ~(2 * sizeof(gpointer) - 1);
+	if (root->chunks->len == 0 ||
+	    root->chunk_used + size > root->chunk_size) {
+		if (root->chunks->len > 0)
+			root->chunk_size = MIN (root->chunk_size * 2,
+						AS_NODE_ARENA_CHUNK_MAX);
+		g_ptr_array_add (root->chunks, g_malloc (root->chunk_size));
+		root->chunk_used = 0;
+	}
+	mem = (gchar *) g_ptr_array_index (root->chunks, root->chunks->len - 1) +
+		root->chunk_used;
+	root->chunk_used += size;
+	memset (mem, 0, size);
+	return mem;
+}
+
+static void
+as_node_root_free (gpointer *free_list, gpointer mem)
+{
+	*((gpointer *) mem) = *free_list;
+	*free_list = mem;
+}
+
+/* the returned node is not linked into the tree yet */
+static AsNode *
+as_node_alloc (AsNode *root)
+{
+	AsNodeRoot *root_data = ((AsNodeData *) root->data)->root;
+	AsNodeBlock *block = as_node_root_alloc (root_data,
+						 &root_data->free_nodes,
+						 sizeof(AsNodeBlock));
+	block->node.data = &block->data;
+	block->data.root = root_data;
+	return &block->node;
+}
+
 /**
  * as_node_new: (skip)
  *
@@ -72,31 +148,32 @@ typedef struct {
 AsNode *
 as_node_new (void)
 {
-	AsNodeData *data;
-	data = g_slice_new0 (AsNodeData);
-	data->tag = AS_TAG_LAST;
-	data->is_tag_valid = TRUE;
-	data->is_root_node = TRUE;
-	data->root = g_new0 (AsNodeRoot, 1);
-	data->root->intern_attr = g_hash_table_new_full (g_str_hash,
-							 g_str_equal,
-							 (GDestroyNotify) as_ref_string_unref,
-							 NULL);
-	data->root->intern_name = g_hash_table_new_full (g_str_hash,
-							 g_str_equal,
-							 (GDestroyNotify) as_ref_string_unref,
-							 NULL);
-	data->root->intern_lang = g_hash_table_new_full (g_str_hash,
-							 g_str_equal,
-							 (GDestroyNotify) as_ref_string_unref,
-							 NULL);
-	return g_node_new (data);
-}
-
-static void
-as_node_attr_free (AsNodeAttr *attr)
-{
-	g_slice_free (AsNodeAttr, attr);
+	AsNodeBlock *block;
+	AsNodeRoot *root = g_new0 (AsNodeRoot, 1);
+
+	root->intern_attr = g_hash_table_new_full (g_str_hash,
+						   g_str_equal,
+						   (GDestroyNotify) as_ref_string_unref,
+						   NULL);
+	root->intern_name = g_hash_table_new_full (g_str_hash,
+						   g_str_equal,
+						   (GDestroyNotify) as_ref_string_unref,
+						   NULL);
+	root->intern_lang = g_hash_table_new_full (g_str_hash,
+						   g_str_equal,
+						   (GDestroyNotify) as_ref_string_unref,
+						   NULL);
+	root->chunks = g_ptr_array_new_with_free_func (g_free);
+	root->chunk_size = AS_NODE_ARENA_CHUNK_MIN;
+
+	/* the root node lives in its own arena too */
+	block = as_node_root_alloc (root, &root->free_nodes, sizeof(AsNodeBlock));
+	block->node.data = &block->data;
+	block->data.tag = AS_TAG_LAST;
+	block->data.is_tag_valid = TRUE;
+	block->data.is_root_node = TRUE;
+	block->data.root = root;
+	return &block->node;
 }
 
 /* transfer: none */
@@ -117,14 +194,22 @@ as_node_attr_insert (AsNode *root,
 		     const gchar *key,
 		     const gchar *value)
 {
-	AsNodeAttr *attr;
+	AsNodeAttrBlock *block;
 	AsNodeRoot *root_data = ((AsNodeData *)root->data)->root;
 
-	attr = g_slice_new0 (AsNodeAttr);
-	attr->key = as_node_intern (root_data->intern_attr, key);
-	attr->value = as_node_intern (root_data->intern_attr, value);
-	data->attrs = g_list_prepend (data->attrs, attr);
-	return attr;
+	block = as_node_root_alloc (root_data,
+				    &root_data->free_attrs,
+				    sizeof(AsNodeAttrBlock));
+	block->attr.key = as_node_intern (root_data->intern_attr, key);
+	block->attr.value = as_node_intern (root_data->intern_attr, value);
+
+	/* prepend the preallocated link */
+	block->link.data = &block->attr;
+	block->link.next = data->attrs;
+	if (data->attrs != NULL)
+		data->attrs->prev = &block->link;
+	data->attrs = &block->link;
+	return &block->attr;
 }
 
 static AsNodeAttr *
@@ -159,38 +244,77 @@ as_node_destroy_node_cb (AsNode *node, gpointer user_data)
 		return FALSE;
 	if (!data->is_tag_valid && !data->is_name_const && data->name != NULL)
 		as_ref_string_unref (data->name);
-	if (data->is_root_node) {
-		g_hash_table_unref (data->root->intern_attr);
-		g_hash_table_unref (data->root->intern_name);
-		g_hash_table_unref (data->root->intern_lang);
-		g_free (data->root);
-	} else {
-		if (!data->is_cdata_const && data->cdata != NULL)
-			as_ref_string_unref (data->cdata);
-	}
-	g_list_free_full (data->attrs, (GDestroyNotify) as_node_attr_free);
-	g_slice_free (AsNodeData, data);
+	if (!data->is_cdata_const && data->cdata != NULL)
+		as_ref_string_unref (data->cdata);
 	return FALSE;
 }
 
+static void
+as_node_recycle (AsNodeRoot *root, AsNode *node)
+{
+	AsNode *child = node->children;
+	AsNodeData *data = node->data;
+	GList *l = data->attrs;
+
+	while (child != NULL) {
+		AsNode *next = child->next;
+		as_node_recycle (root, child);
+		child = next;
+	}
+	if (root->raw != NULL)
+		g_hash_table_remove (root->raw, node);
+	while (l != NULL) {
+		GList *next = l->next;
+		as_node_root_free (&root->free_attrs, l);
+		l = next;
+	}
+	as_node_root_free (&root->free_nodes, node);
+}
+
 /**
  * as_node_unref:
  * @node: a #AsNode.
  *
  * Deallocates all notes in the tree.
  *
+ * A subtree may be unlinked with g_node_unlink() and then freed with this
+ * function, but it must be freed before the tree it was taken from.
+ *
  * Since: 0.1.0
  **/
 void
 as_node_unref (AsNode *node)
 {
-	g_node_traverse (node,
-			 G_PRE_ORDER,
-			 G_TRAVERSE_ALL,
-			 -1,
-			 as_node_destroy_node_cb,
-			 NULL);
-	g_node_destroy (node);
+	AsNodeData *data = node->data;
+	AsNodeRoot *root = data->root;
+
+	/* only the refcounted strings need releasing one by one */
+	if (root->has_heap_strings) {
+		g_node_traverse (node,
+				 G_PRE_ORDER,
+				 G_TRAVERSE_ALL,
+				 -1,
+				 as_node_destroy_node_cb,
+				 NULL);
+	}
+
+	/* the whole tree, including this node, is freed with the arena */
+	if (data->is_root_node) {
+		g_hash_table_unref (root->intern_attr);
+		g_hash_table_unref (root->intern_name);
+		g_hash_table_unref (root->intern_lang);
+		g_ptr_array_unref (root->chunks);
+		if (root->source != NULL)
+			g_bytes_unref (root->source);
+		if (root->raw != NULL)
+			g_hash_table_unref (root->raw);
+		g_free (root);
+		return;
+	}
+
+	/* a subtree is kept for reuse until the tree is freed */
+	g_node_unlink (node);
+	as_node_recycle (root, node);
 }
 
 /**
@@ -224,12 +348,31 @@ as_node_string_replace_inplace (gchar *text,
 	}
 }
 
+/* text parsed by as_node_from_bytes() is only copied out of the source
+ * buffer when it is needed as a NUL-terminated string */
+static void
+as_node_cdata_from_slice (AsNodeData *data)
+{
+	if (!data->is_cdata_slice)
+		return;
+	data->cdata = as_ref_string_new_with_length (data->cdata_const,
+						     data->cdata_len);
+	data->root->has_heap_strings = TRUE;
+	data->is_cdata_slice = FALSE;
+	data->is_cdata_const = FALSE;
+}
+
 static void
 as_node_cdata_to_heap (AsNodeData *data)
 {
+	if (data->is_cdata_slice) {
+		as_node_cdata_from_slice (data);
+		return;
+	}
 	if (!data->is_cdata_const)
 		return;
 	data->cdata = as_ref_string_new (data->cdata);
+	data->root->has_heap_strings = TRUE;
 	data->is_cdata_const = FALSE;
 }
 
@@ -238,6 +381,7 @@ as_node_cdata_to_intern (AsNode *root, AsNodeData *data)
 {
 	AsNodeRoot *root_data = ((AsNodeData *)root->data)->root;
 	AsRefString *tmp;
+	as_node_cdata_from_slice (data);
 	if (data->is_cdata_const)
 		return;
 	tmp = as_node_intern (root_data->intern_attr, data->cdata);
@@ -272,6 +416,7 @@ as_node_cdata_to_escaped (AsNodeData *data)
 		return;
 	if (data->cdata == NULL)
 		return;
+	as_node_cdata_from_slice (data);
 	if (g_strstr_len (data->cdata, -1, "&") != NULL ||
 	    g_strstr_len (data->cdata, -1, "<") != NULL ||
 	    g_strstr_len (data->cdata, -1, ">") != NULL) {
@@ -281,6 +426,7 @@ as_node_cdata_to_escaped (AsNodeData *data)
 		as_utils_string_replace (str, "<", "&lt;");
 		as_utils_string_replace (str, ">", "&gt;");
 		data->cdata = as_ref_string_new_with_length (str->str, str->len);
+		data->root->has_heap_strings = TRUE;
 	}
 	data->is_cdata_escaped = TRUE;
 }
@@ -368,6 +514,7 @@ as_node_data_set_name (AsNode *root,
 		/* always store the translated tag */
 		g_autofree gchar *name_tmp = g_strdup_printf ("_%s", name);
 		data->name = as_ref_string_new (name_tmp);
+		data->root->has_heap_strings = TRUE;
 		data->is_tag_valid = FALSE;
 	}
 }
@@ -399,17 +546,13 @@ as_node_sort_children (AsNode *first)
 }
 
 static void
-as_node_to_xml_string (GString *xml,
-		       guint depth_offset,
-		       const AsNode *n,
-		       AsNodeToXmlFlags flags)
+as_node_to_xml_string_comment (GString *xml,
+			       guint depth_offset,
+			       const AsNode *n,
+			       AsNodeToXmlFlags flags)
 {
-	AsNodeData *data = n->data;
-	AsNode *c;
-	const gchar *tag_str;
 	const gchar *comment;
 	guint depth = g_node_depth ((GNode *) n);
-	gchar *attrs;
 
 	/* comment */
 	comment = as_node_get_comment (n);
@@ -432,6 +575,51 @@ as_node_to_xml_string (GString *xml,
 				g_string_append (xml, "\n");
 		}
 	}
+}
+
+static void
+as_node_to_xml_string_open (GString *xml,
+			    guint depth_offset,
+			    const AsNode *n,
+			    AsNodeToXmlFlags flags)
+{
+	AsNodeData *data = n->data;
+	g_autofree gchar *attrs = NULL;
+
+	if ((flags & AS_NODE_TO_XML_FLAG_FORMAT_INDENT) > 0)
+		as_node_add_padding (xml, g_node_depth ((GNode *) n) - depth_offset);
+	attrs = as_node_get_attr_string (data);
+	g_string_append_printf (xml, "<%s%s>", as_tag_data_get_name (data), attrs);
+	if ((flags & AS_NODE_TO_XML_FLAG_FORMAT_MULTILINE) > 0)
+		g_string_append (xml, "\n");
+}
+
+static void
+as_node_to_xml_string_close (GString *xml,
+			     guint depth_offset,
+			     const AsNode *n,
+			     AsNodeToXmlFlags flags)
+{
+	if ((flags & AS_NODE_TO_XML_FLAG_FORMAT_INDENT) > 0)
+		as_node_add_padding (xml, g_node_depth ((GNode *) n) - depth_offset);
+	g_string_append_printf (xml, "</%s>", as_tag_data_get_name (n->data));
+	if ((flags & AS_NODE_TO_XML_FLAG_FORMAT_MULTILINE) > 0)
+		g_string_append (xml, "\n");
+}
+
+static void
+as_node_to_xml_string (GString *xml,
+		       guint depth_offset,
+		       const AsNode *n,
+		       AsNodeToXmlFlags flags)
+{
+	AsNodeData *data = n->data;
+	AsNode *c;
+	const gchar *tag_str;
+	guint depth = g_node_depth ((GNode *) n);
+	gchar *attrs;
+
+	as_node_to_xml_string_comment (xml, depth_offset, n, flags);
 
 	/* root node */
 	if (data == NULL || as_node_get_tag (n) == AS_TAG_LAST) {
@@ -465,27 +653,77 @@ as_node_to_xml_string (GString *xml,
 
 	/* node with children */
 	} else {
-		if ((flags & AS_NODE_TO_XML_FLAG_FORMAT_INDENT) > 0)
-			as_node_add_padding (xml, depth - depth_offset);
-		attrs = as_node_get_attr_string (data);
-		tag_str = as_tag_data_get_name (data);
-		g_string_append_printf (xml, "<%s%s>", tag_str, attrs);
-		if ((flags & AS_NODE_TO_XML_FLAG_FORMAT_MULTILINE) > 0)
-			g_string_append (xml, "\n");
-		g_free (attrs);
+		as_node_to_xml_string_open (xml, depth_offset, n, flags);
 		if ((flags & AS_NODE_TO_XML_FLAG_SORT_CHILDREN) > 0)
 			as_node_sort_children (n->children);
 		for (c = n->children; c != NULL; c = c->next)
 			as_node_to_xml_string (xml, depth_offset, c, flags);
-
-		if ((flags & AS_NODE_TO_XML_FLAG_FORMAT_INDENT) > 0)
-			as_node_add_padding (xml, depth - depth_offset);
-		g_string_append_printf (xml, "</%s>", tag_str);
-		if ((flags & AS_NODE_TO_XML_FLAG_FORMAT_MULTILINE) > 0)
-			g_string_append (xml, "\n");
+		as_node_to_xml_string_close (xml, depth_offset, n, flags);
 	}
 }
 
+/* the offset used when converting the whole tree from the root node */
+static guint
+as_node_to_xml_root_depth_offset (const AsNode *node)
+{
+	return g_node_depth (g_node_get_root ((GNode *) node)) + 1;
+}
+
+/**
+ * as_node_to_xml_start: (skip)
+ * @xml: a #GString
+ * @node: a #AsNode with children
+ * @flags: the AsNodeToXmlFlags, e.g. %AS_NODE_TO_XML_FLAG_NONE.
+ *
+ * Appends the comment and opening tag of a node, formatted exactly as it would
+ * be by as_node_to_xml() on the root node. The children can then be added one
+ * at a time using as_node_to_xml_append() before as_node_to_xml_end().
+ *
+ * Since: 0.8.5
+ **/
+void
+as_node_to_xml_start (GString *xml, const AsNode *node, AsNodeToXmlFlags flags)
+{
+	guint depth_offset = as_node_to_xml_root_depth_offset (node);
+	as_node_to_xml_string_comment (xml, depth_offset, node, flags);
+	as_node_to_xml_string_open (xml, depth_offset, node, flags);
+}
+
+/**
+ * as_node_to_xml_append: (skip)
+ * @xml: a #GString
+ * @node: a #AsNode
+ * @flags: the AsNodeToXmlFlags, e.g. %AS_NODE_TO_XML_FLAG_NONE.
+ *
+ * Appends a node and all of its children, formatted exactly as it would be by
+ * as_node_to_xml() on the root node.
+ *
+ * Since: 0.8.5
+ **/
+void
+as_node_to_xml_append (GString *xml, const AsNode *node, AsNodeToXmlFlags flags)
+{
+	as_node_to_xml_string (xml, as_node_to_xml_root_depth_offset (node),
+			       node, flags);
+}
+
+/**
+ * as_node_to_xml_end: (skip)
+ * @xml: a #GString
+ * @node: a #AsNode
+ * @flags: the AsNodeToXmlFlags, e.g. %AS_NODE_TO_XML_FLAG_NONE.
+ *
+ * Appends the closing tag of a node started with as_node_to_xml_start().
+ *
+ * Since: 0.8.5
+ **/
+void
+as_node_to_xml_end (GString *xml, const AsNode *node, AsNodeToXmlFlags flags)
+{
+	as_node_to_xml_string_close (xml, as_node_to_xml_root_depth_offset (node),
+				     node, flags);
+}
+
 /**
  * as_node_reflow_text:
  * @text: XML text data
@@ -557,6 +795,11 @@ typedef struct {
 	const gchar * const	*locales;
 	guint8			 is_em_text:1;
 	guint8			 is_code_text:1;
+	guint			 stream_depth;
+	AsNodeStreamFunc	 stream_func;
+	gpointer		 stream_user_data;
+	gboolean		 stream_failed;
+	gboolean		 use_slices;	/* the root keeps the source */
 } AsNodeToXmlHelper;
 
 /**
@@ -604,6 +847,7 @@ as_node_start_element_cb (GMarkupParseContext *context,
 	AsNodeData *data;
 	AsNodeData *data_parent;
 	AsNode *current;
+	AsNode *root;
 	guint i;
 
 	/* do not create a child node for em and code tags */
@@ -617,7 +861,9 @@ as_node_start_element_cb (GMarkupParseContext *context,
 	}
 
 	/* check if we should ignore the locale */
-	data = g_slice_new0 (AsNodeData);
+	root = g_node_get_root (helper->current);
+	current = as_node_alloc (root);
+	data = current->data;
 
 	/* parent node is being ignored */
 	data_parent = helper->current->data;
@@ -638,7 +884,6 @@ as_node_start_element_cb (GMarkupParseContext *context,
 
 	/* create the new node data */
 	if (!data->is_cdata_ignore) {
-		AsNode *root = g_node_get_root (helper->current);
 		as_node_data_set_name (root,
 				       data,
 				       element_name,
@@ -651,7 +896,7 @@ as_node_start_element_cb (GMarkupParseContext *context,
 	}
 
 	/* add the node to the DOM */
-	current = g_node_append_data (helper->current, data);
+	g_node_append (helper->current, current);
 
 	/* transfer the ownership of the comment to the new child */
 	if (helper->flags & AS_NODE_FROM_XML_FLAG_KEEP_COMMENTS) {
@@ -675,6 +920,7 @@ as_node_end_element_cb (GMarkupParseContext *context,
 {
 	AsNodeToXmlHelper *helper = (AsNodeToXmlHelper *) user_data;
 	AsNodeData *data = helper->current->data;
+	AsNode *current = helper->current;
 
 	/* do not create a child node for em and code tags */
 	if (g_strcmp0 (element_name, "em") == 0) {
@@ -686,16 +932,27 @@ as_node_end_element_cb (GMarkupParseContext *context,
 		return;
 	}
 
+	/* a slice can stay in place if reflowing would not change it */
+	if (data->is_cdata_slice &&
+	    (helper->flags & AS_NODE_FROM_XML_FLAG_LITERAL_TEXT) == 0) {
+		if (memchr (data->cdata_const, '\n', data->cdata_len) != NULL ||
+		    data->cdata_const[0] == ' ' ||
+		    data->cdata_const[data->cdata_len - 1] == ' ')
+			as_node_cdata_from_slice (data);
+	}
+
 	if (data->cdata != NULL) {
 		/* split up into lines and add each with spaces stripped */
-		if ((helper->flags & AS_NODE_FROM_XML_FLAG_LITERAL_TEXT) == 0) {
+		if ((helper->flags & AS_NODE_FROM_XML_FLAG_LITERAL_TEXT) == 0 &&
+		    !data->is_cdata_slice) {
 			AsRefString *cdata = data->cdata;
 			data->cdata = as_node_reflow_text (cdata, strlen (cdata));
 			as_ref_string_unref (cdata);
 		}
 
-		/* intern commonly duplicated tag values and save a bit of memory */
-		if (data->is_tag_valid) {
+		/* intern commonly duplicated tag values and save a bit of memory,
+		 * unless the node is going to be freed as soon as it is parsed */
+		if (data->is_tag_valid && helper->stream_func == NULL) {
 			AsNode *root = g_node_get_root (helper->current);
 			switch (data->tag) {
 			case AS_TAG_CATEGORY:
@@ -722,6 +979,25 @@ as_node_end_element_cb (GMarkupParseContext *context,
 	}
 
 	helper->current = helper->current->parent;
+
+	/* hand the completed subtree to the caller and then free it, stopping
+	 * the parser if the caller failed */
+	if (helper->stream_func != NULL &&
+	    g_node_depth (current) == helper->stream_depth) {
+		g_autoptr(GError) error_local = NULL;
+		if (!helper->stream_func (current, helper->stream_user_data,
+					  &error_local)) {
+			helper->stream_failed = TRUE;
+			if (error_local == NULL) {
+				g_set_error_literal (&error_local,
+						     AS_NODE_ERROR,
+						     AS_NODE_ERROR_FAILED,
+						     "Stream function failed");
+			}
+			g_propagate_error (error, g_steal_pointer (&error_local));
+		}
+		as_node_unref (current);
+	}
 }
 
 static void
@@ -752,15 +1028,18 @@ as_node_text_cb (GMarkupParseContext *context,
 	if (i >= text_len)
 		return;
 
+	/* joining text to the slice from an earlier run */
+	as_node_cdata_from_slice (data);
+
 	if (data->cdata != NULL &&
 	    g_strcmp0 (as_tag_data_get_name (data), "p") != 0 &&
 	    g_strcmp0 (as_tag_data_get_name (data), "li") != 0) {
 		g_set_error (error,
 			     AS_NODE_ERROR,
 			     AS_NODE_ERROR_INVALID_MARKUP,
-			     "<%s> already set '%s' and tried to replace with '%s'",
+			     "<%s> already set '%s' and tried to replace with '%.*s'",
 			     as_tag_data_get_name (data),
-			     data->cdata, text);
+			     data->cdata, (gint) text_len, text);
 		return;
 	}
 
@@ -786,10 +1065,12 @@ as_node_text_cb (GMarkupParseContext *context,
 			g_string_append (str, "</em>");
 
 		data->cdata = as_ref_string_new_with_length (str->str, str->len);
+		data->root->has_heap_strings = TRUE;
 		return;
 	}
 
 	data->cdata = as_ref_string_new_with_length (text, text_len);
+	data->root->has_heap_strings = TRUE;
 }
 
 static void
@@ -841,39 +1122,666 @@ as_node_passthrough_cb (GMarkupParseContext *context,
 	}
 }
 
+/* a minimal XML tokenizer that hands the GMarkup callbacks above slices of
+ * the input buffer where possible rather than copying every token */
+typedef struct {
+	const gchar		*str;
+	gsize			 len;
+} AsNodeMarkupSlice;
+
+typedef struct {
+	const gchar		*data;
+	const gchar		*end;
+	GString			*scratch;	/* reused for names and unescaped values */
+	GArray			*offsets;	/* of gsize into @scratch */
+	GPtrArray		*attr_names;
+	GPtrArray		*attr_values;
+	GArray			*stack;		/* of AsNodeMarkupSlice */
+} AsNodeMarkupParser;
+
+static void as_node_markup_set_error (AsNodeMarkupParser *parser,
+				      const gchar *pos,
+				      GError **error,
+				      const gchar *fmt, ...) G_GNUC_PRINTF (4, 5);
+
+static void
+as_node_markup_set_error (AsNodeMarkupParser *parser,
+			  const gchar *pos,
+			  GError **error,
+			  const gchar *fmt, ...)
+{
+	const gchar *line_start = parser->data;
+	guint line = 1;
+	va_list args;
+	g_autofree gchar *msg = NULL;
+
+	/* only work out the position when actually required */
+	for (const gchar *tmp = parser->data; tmp < pos; tmp++) {
+		if (*tmp == '\n') {
+			line++;
+			line_start = tmp + 1;
+		}
+	}
+	va_start (args, fmt);
+	msg = g_strdup_vprintf (fmt, args);
+	va_end (args);
+	g_set_error (error,
+		     AS_NODE_ERROR,
+		     AS_NODE_ERROR_FAILED,
+		     "Error on line %u char %li: %s",
+		     line,
+		     (glong) g_utf8_strlen (line_start, pos - line_start) + 1,
+		     msg);
+}
+
+static const gchar *
+as_node_markup_skip_whitespace (const gchar *p, const gchar *end)
+{
+	while (p < end && g_ascii_isspace (*p))
+		p++;
+	return p;
+}
+
+static const gchar *
+as_node_markup_scan_name (const gchar *p, const gchar *end)
+{
+	while (p < end && !g_ascii_isspace (*p) &&
+	       strchr ("/<>=\"'", *p) == NULL)
+		p++;
+	return p;
+}
+
+static gboolean
+as_node_markup_unescape (AsNodeMarkupParser *parser,
+			 GString *str,
+			 const gchar *text,
+			 gsize text_len,
+			 gboolean is_attribute,
+			 GError **error)
+{
+	for (gsize i = 0; i < text_len; i++) {
+		const gchar *ent;
+		const gchar *ent_end;
+		gsize ent_len;
+
+		/* line endings are normalized, and attribute values use spaces */
+		if (text[i] == '\r') {
+			g_string_append_c (str, is_attribute ? ' ' : '\n');
+			if (i + 1 < text_len && text[i + 1] == '\n')
+				i++;
+			continue;
+		}
+		if (is_attribute && (text[i] == '\n' || text[i] == '\t')) {
+			g_string_append_c (str, ' ');
+			continue;
+		}
+		if (text[i] != '&') {
+			g_string_append_c (str, text[i]);
+			continue;
+		}
+
+		/* entity */
+		ent = text + i + 1;
+		ent_end = memchr (ent, ';', text_len - i - 1);
+		if (ent_end == NULL) {
+			as_node_markup_set_error (parser, text + i, error,
+						  "Entity did not end with ';'");
+			return FALSE;
+		}
+		ent_len = (gsize) (ent_end - ent);
+		if (ent_len == 3 && memcmp (ent, "amp", 3) == 0) {
+			g_string_append_c (str, '&');
+		} else if (ent_len == 2 && memcmp (ent, "lt", 2) == 0) {
+			g_string_append_c (str, '<');
+		} else if (ent_len == 2 && memcmp (ent, "gt", 2) == 0) {
+			g_string_append_c (str, '>');
+		} else if (ent_len == 4 && memcmp (ent, "quot", 4) == 0) {
+			g_string_append_c (str, '"');
+		} else if (ent_len == 4 && memcmp (ent, "apos", 4) == 0) {
+			g_string_append_c (str, '\'');
+		} else if (ent_len > 1 && ent[0] == '#') {
+			gboolean is_hex = ent[1] == 'x';
+			gsize j = is_hex ? 2 : 1;
+			gunichar ch = 0;
+
+			if (j >= ent_len) {
+				as_node_markup_set_error (parser, text + i, error,
+							  "Empty character reference");
+				return FALSE;
+			}
+			for (; j < ent_len; j++) {
+				gint val = is_hex ? g_ascii_xdigit_value (ent[j]) :
+						    g_ascii_digit_value (ent[j]);
+				if (val < 0 || ch > 0x10ffff) {
+					ch = 0;
+					break;
+				}
+				ch = ch * (is_hex ? 16 : 10) + (guint) val;
+			}
+			if (ch == 0 || !g_unichar_validate (ch)) {
+				as_node_markup_set_error (parser, text + i, error,
+							  "Character reference '%.*s' "
+							  "does not encode a permitted character",
+							  (gint) ent_len, ent);
+				return FALSE;
+			}
+			g_string_append_unichar (str, ch);
+		} else {
+			as_node_markup_set_error (parser, text + i, error,
+						  "Entity name '%.*s' is not known",
+						  (gint) ent_len, ent);
+			return FALSE;
+		}
+		i = (gsize) (ent_end - text);
+	}
+	return TRUE;
+}
+
+static gboolean
+as_node_markup_parse_text (AsNodeMarkupParser *parser,
+			   AsNodeToXmlHelper *helper,
+			   const gchar *text,
+			   gsize text_len,
+			   GError **error)
+{
+	if (text_len == 0)
+		return TRUE;
+
+	/* only whitespace is allowed outside of elements */
+	if (parser->stack->len == 0) {
+		const gchar *tmp = as_node_markup_skip_whitespace (text, text + text_len);
+		if (tmp == text + text_len)
+			return TRUE;
+		as_node_markup_set_error (parser, tmp, error,
+					  "Text is not allowed outside of an element");
+		return FALSE;
+	}
+
+	/* nothing to unescape, so use the input buffer directly */
+	if (memchr (text, '&', text_len) == NULL &&
+	    memchr (text, '\r', text_len) == NULL) {
+		AsNodeData *data = helper->current->data;
+
+		/* the whole cdata is a run of the source, so refer to it
+		 * rather than copying it */
+		if (helper->use_slices &&
+		    !helper->is_em_text &&
+		    !helper->is_code_text &&
+		    !data->is_cdata_ignore &&
+		    data->cdata == NULL &&
+		    text_len <= G_MAXUINT32 &&
+		    as_node_markup_skip_whitespace (text, text + text_len) < text + text_len) {
+			data->cdata_const = text;
+			data->cdata_len = (guint32) text_len;
+			data->is_cdata_const = TRUE;
+			data->is_cdata_slice = TRUE;
+			return TRUE;
+		}
+		as_node_text_cb (NULL, text, text_len, helper, error);
+		return *error == NULL;
+	}
+	g_string_truncate (parser->scratch, 0);
+	if (!as_node_markup_unescape (parser, parser->scratch,
+				      text, text_len, FALSE, error))
+		return FALSE;
+	as_node_text_cb (NULL, parser->scratch->str, parser->scratch->len,
+			 helper, error);
+	return *error == NULL;
+}
+
+static const gchar *
+as_node_markup_parse_passthrough (AsNodeMarkupParser *parser,
+				  AsNodeToXmlHelper *helper,
+				  const gchar *p,
+				  GError **error)
+{
+	const gchar *end = parser->end;
+	const gchar *found = NULL;
+	gsize len = (gsize) (end - p);
+
+	if (len >= 4 && memcmp (p, "<!--", 4) == 0) {
+		found = g_strstr_len (p + 4, (gssize) len - 4, "-->");
+		if (found != NULL)
+			found += 3;
+	} else if (len >= 9 && memcmp (p, "<![CDATA[", 9) == 0) {
+		found = g_strstr_len (p + 9, (gssize) len - 9, "]]>");
+		if (found != NULL)
+			found += 3;
+	} else if (p[1] == '?') {
+		found = g_strstr_len (p + 2, (gssize) len - 2, "?>");
+		if (found != NULL)
+			found += 2;
+	} else {
+		guint depth = 0;
+
+		/* <!DOCTYPE> may contain an internal subset in brackets */
+		for (const gchar *tmp = p + 2; tmp < end; tmp++) {
+			if (*tmp == '[') {
+				depth++;
+			} else if (*tmp == ']' && depth > 0) {
+				depth--;
+			} else if (*tmp == '>' && depth == 0) {
+				found = tmp + 1;
+				break;
+			}
+		}
+	}
+	if (found == NULL) {
+		as_node_markup_set_error (parser, p, error,
+					  "Document ended unexpectedly inside "
+					  "a comment or processing instruction");
+		return NULL;
+	}
+	as_node_passthrough_cb (NULL, p, (gsize) (found - p), helper, error);
+	if (*error != NULL)
+		return NULL;
+	return found;
+}
+
+static const gchar *
+as_node_markup_parse_end_tag (AsNodeMarkupParser *parser,
+			      AsNodeToXmlHelper *helper,
+			      const gchar *p,
+			      GError **error)
+{
+	AsNodeMarkupSlice *open;
+	const gchar *name = p + 2;
+	const gchar *tmp = as_node_markup_scan_name (name, parser->end);
+	gsize name_len = (gsize) (tmp - name);
+
+	tmp = as_node_markup_skip_whitespace (tmp, parser->end);
+	if (name_len == 0 || tmp >= parser->end || *tmp != '>') {
+		as_node_markup_set_error (parser, p, error,
+					  "Invalid closing tag");
+		return NULL;
+	}
+	if (parser->stack->len == 0) {
+		as_node_markup_set_error (parser, p, error,
+					  "Element '%.*s' was closed, "
+					  "no element is currently open",
+					  (gint) name_len, name);
+		return NULL;
+	}
+	open = &g_array_index (parser->stack, AsNodeMarkupSlice,
+			       parser->stack->len - 1);
+	if (open->len != name_len || memcmp (open->str, name, name_len) != 0) {
+		as_node_markup_set_error (parser, p, error,
+					  "Element '%.*s' was closed, but the "
+					  "currently open element is '%.*s'",
+					  (gint) name_len, name,
+					  (gint) open->len, open->str);
+		return NULL;
+	}
+	g_array_set_size (parser->stack, parser->stack->len - 1);
+
+	g_string_truncate (parser->scratch, 0);
+	g_string_append_len (parser->scratch, name, (gssize) name_len);
+	as_node_end_element_cb (NULL, parser->scratch->str, helper, error);
+	if (*error != NULL)
+		return NULL;
+	return tmp + 1;
+}
+
+/* large children of a component that are only parsed when first used */
+static gboolean
+as_node_markup_should_defer (AsNodeToXmlHelper *helper)
+{
+	AsNodeData *data = helper->current->data;
+
+	if ((helper->flags & AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA) == 0)
+		return FALSE;
+	if (!helper->use_slices || data->is_cdata_ignore || !data->is_tag_valid)
+		return FALSE;
+	if (as_node_get_tag (helper->current->parent) != AS_TAG_COMPONENT)
+		return FALSE;
+	switch (data->tag) {
+	case AS_TAG_SCREENSHOTS:
+	case AS_TAG_REVIEWS:
+	case AS_TAG_CONTENT_RATING:
+	case AS_TAG_AGREEMENT:
+	case AS_TAG_RELEASES:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* finds the end of the element without creating any nodes, only checking
+ * that the tags balance; the contents are checked when parsed later */
+static const gchar *
+as_node_markup_skip_element (AsNodeMarkupParser *parser,
+			     const gchar *p,
+			     const AsNodeMarkupSlice *open,
+			     GError **error)
+{
+	const gchar *end = parser->end;
+	guint depth = 0;
+
+	while (TRUE) {
+		const gchar *tag = memchr (p, '<', (gsize) (end - p));
+		const gchar *found = NULL;
+		gsize len;
+
+		if (tag == NULL || tag + 1 >= end) {
+			as_node_markup_set_error (parser, p, error,
+						  "Document ended unexpectedly "
+						  "inside element '%.*s'",
+						  (gint) open->len, open->str);
+			return NULL;
+		}
+		len = (gsize) (end - tag);
+		if (len >= 4 && memcmp (tag, "<!--", 4) == 0) {
+			found = g_strstr_len (tag + 4, (gssize) len - 4, "-->");
+		} else if (len >= 9 && memcmp (tag, "<![CDATA[", 9) == 0) {
+			found = g_strstr_len (tag + 9, (gssize) len - 9, "]]>");
+		} else if (tag[1] == '?') {
+			found = g_strstr_len (tag + 2, (gssize) len - 2, "?>");
+		} else if (tag[1] == '!') {
+			found = memchr (tag, '>', len);
+		} else if (tag[1] == '/') {
+			const gchar *name = tag + 2;
+			gsize name_len;
+
+			found = memchr (name, '>', len - 2);
+			if (found != NULL && depth == 0) {
+				name_len = (gsize) (as_node_markup_scan_name (name, found) - name);
+				if (name_len != open->len ||
+				    memcmp (name, open->str, name_len) != 0) {
+					as_node_markup_set_error (parser, tag, error,
+								  "Element '%.*s' was closed, but the "
+								  "currently open element is '%.*s'",
+								  (gint) name_len, name,
+								  (gint) open->len, open->str);
+					return NULL;
+				}
+				return found + 1;
+			}
+			depth--;
+		} else {
+			gchar quote = '\0';
+
+			/* a '>' may appear inside an attribute value */
+			for (const gchar *tmp = tag + 1; tmp < end; tmp++) {
+				if (quote != '\0') {
+					if (*tmp == quote)
+						quote = '\0';
+				} else if (*tmp == '"' || *tmp == '\'') {
+					quote = *tmp;
+				} else if (*tmp == '>') {
+					found = tmp;
+					break;
+				}
+			}
+			if (found != NULL && found[-1] != '/')
+				depth++;
+		}
+		if (found == NULL) {
+			as_node_markup_set_error (parser, tag, error,
+						  "Document ended unexpectedly "
+						  "inside element '%.*s'",
+						  (gint) open->len, open->str);
+			return NULL;
+		}
+		p = found + 1;
+	}
+}
+
+static const gchar *
+as_node_markup_parse_start_tag (AsNodeMarkupParser *parser,
+				AsNodeToXmlHelper *helper,
+				const gchar *p,
+				GError **error)
+{
+	AsNodeMarkupSlice open;
+	const gchar *end = parser->end;
+	const gchar *tmp;
+	gboolean is_empty = FALSE;
+
+	/* element name */
+	open.str = p + 1;
+	tmp = as_node_markup_scan_name (open.str, end);
+	open.len = (gsize) (tmp - open.str);
+	if (open.len == 0) {
+		as_node_markup_set_error (parser, p, error,
+					  "Expected an element name after '<'");
+		return NULL;
+	}
+
+	/* names and values are packed into one NUL-separated buffer */
+	g_string_truncate (parser->scratch, 0);
+	g_string_append_len (parser->scratch, open.str, (gssize) open.len);
+	g_string_append_c (parser->scratch, '\0');
+	g_array_set_size (parser->offsets, 0);
+	while (TRUE) {
+		const gchar *attr;
+		const gchar *value_end;
+		gsize offset;
+		gchar quote;
+
+		tmp = as_node_markup_skip_whitespace (tmp, end);
+		if (tmp >= end) {
+			as_node_markup_set_error (parser, p, error,
+						  "Document ended unexpectedly "
+						  "inside element '%.*s'",
+						  (gint) open.len, open.str);
+			return NULL;
+		}
+		if (*tmp == '>') {
+			tmp++;
+			break;
+		}
+		if (*tmp == '/') {
+			if (tmp + 1 < end && tmp[1] == '>') {
+				is_empty = TRUE;
+				tmp += 2;
+				break;
+			}
+			as_node_markup_set_error (parser, tmp, error,
+						  "Odd character '/', expected '>'");
+			return NULL;
+		}
+
+		/* attribute name */
+		attr = tmp;
+		tmp = as_node_markup_scan_name (attr, end);
+		if (tmp == attr) {
+			as_node_markup_set_error (parser, tmp, error,
+						  "Unexpected character '%c' in "
+						  "element '%.*s'", *tmp,
+						  (gint) open.len, open.str);
+			return NULL;
+		}
+		offset = parser->scratch->len;
+		g_array_append_val (parser->offsets, offset);
+		g_string_append_len (parser->scratch, attr, tmp - attr);
+		g_string_append_c (parser->scratch, '\0');
+
+		/* attribute value */
+		tmp = as_node_markup_skip_whitespace (tmp, end);
+		if (tmp >= end || *tmp != '=') {
+			as_node_markup_set_error (parser, tmp, error,
+						  "Attribute '%.*s' has no value",
+						  (gint) (tmp - attr), attr);
+			return NULL;
+		}
+		tmp = as_node_markup_skip_whitespace (tmp + 1, end);
+		if (tmp >= end || (*tmp != '"' && *tmp != '\'')) {
+			as_node_markup_set_error (parser, tmp, error,
+						  "Expected a quote to begin "
+						  "an attribute value");
+			return NULL;
+		}
+		quote = *tmp++;
+		value_end = memchr (tmp, quote, (gsize) (end - tmp));
+		if (value_end == NULL ||
+		    memchr (tmp, '<', (gsize) (value_end - tmp)) != NULL) {
+			as_node_markup_set_error (parser, tmp, error,
+						  "Unterminated attribute value");
+			return NULL;
+		}
+		offset = parser->scratch->len;
+		g_array_append_val (parser->offsets, offset);
+		if (!as_node_markup_unescape (parser, parser->scratch, tmp,
+					      (gsize) (value_end - tmp),
+					      TRUE, error))
+			return NULL;
+		g_string_append_c (parser->scratch, '\0');
+		tmp = value_end + 1;
+	}
+
+	/* the scratch buffer is now stable, so point into it */
+	g_ptr_array_set_size (parser->attr_names, 0);
+	g_ptr_array_set_size (parser->attr_values, 0);
+	for (guint i = 0; i < parser->offsets->len; i += 2) {
+		gsize name_off = g_array_index (parser->offsets, gsize, i);
+		gsize value_off = g_array_index (parser->offsets, gsize, i + 1);
+		g_ptr_array_add (parser->attr_names, parser->scratch->str + name_off);
+		g_ptr_array_add (parser->attr_values, parser->scratch->str + value_off);
+	}
+	g_ptr_array_add (parser->attr_names, NULL);
+	g_ptr_array_add (parser->attr_values, NULL);
+
+	as_node_start_element_cb (NULL, parser->scratch->str,
+				  (const gchar **) parser->attr_names->pdata,
+				  (const gchar **) parser->attr_values->pdata,
+				  helper, error);
+	if (*error != NULL)
+		return NULL;
+
+	/* keep the whole element as a slice of the source to parse later */
+	if (!is_empty && as_node_markup_should_defer (helper)) {
+		AsNodeRoot *root_data = ((AsNodeData *) helper->current->data)->root;
+		tmp = as_node_markup_skip_element (parser, tmp, &open, error);
+		if (tmp == NULL)
+			return NULL;
+		if (root_data->raw == NULL) {
+			root_data->raw = g_hash_table_new_full (g_direct_hash,
+								g_direct_equal,
+								NULL,
+								(GDestroyNotify) g_bytes_unref);
+		}
+		g_hash_table_insert (root_data->raw, helper->current,
+				     g_bytes_new_from_bytes (root_data->source,
+							     (gsize) (p - parser->data),
+							     (gsize) (tmp - p)));
+		is_empty = TRUE;
+	}
+
+	/* <foo/> is the same as <foo></foo> */
+	if (is_empty) {
+		as_node_end_element_cb (NULL, parser->scratch->str, helper, error);
+		if (*error != NULL)
+			return NULL;
+		return tmp;
+	}
+	g_array_append_val (parser->stack, open);
+	return tmp;
+}
+
+static gboolean
+as_node_markup_parse (AsNodeMarkupParser *parser,
+		      AsNodeToXmlHelper *helper,
+		      GError **error)
+{
+	const gchar *p = parser->data;
+	const gchar *end = parser->end;
+
+	while (p < end) {
+		const gchar *tag = memchr (p, '<', (gsize) (end - p));
+
+		/* any trailing text is not terminated by a tag, and is
+		 * ignored just as GMarkup did without an end_parse() */
+		if (tag == NULL)
+			break;
+
+		/* text up to the next tag */
+		if (!as_node_markup_parse_text (parser, helper, p,
+						(gsize) (tag - p), error))
+			return FALSE;
+		if (tag + 1 >= end) {
+			as_node_markup_set_error (parser, tag, error,
+						  "Document ended unexpectedly "
+						  "just after an open angle bracket '<'");
+			return FALSE;
+		}
+		if (tag[1] == '/')
+			p = as_node_markup_parse_end_tag (parser, helper, tag, error);
+		else if (tag[1] == '!' || tag[1] == '?')
+			p = as_node_markup_parse_passthrough (parser, helper, tag, error);
+		else
+			p = as_node_markup_parse_start_tag (parser, helper, tag, error);
+		if (p == NULL)
+			return FALSE;
+	}
+	return TRUE;
+}
+
 static AsNode *
 as_node_from_xml_internal (const gchar *data, gssize data_sz,
+			   GBytes *source,
 			   AsNodeFromXmlFlags flags,
+			   guint stream_depth,
+			   AsNodeStreamFunc stream_func,
+			   gpointer stream_user_data,
 			   GError **error)
 {
 	AsNodeToXmlHelper helper = {0};
+	AsNodeMarkupParser parser = {0};
 	AsNode *root = NULL;
 	gboolean ret;
+	gsize len;
 	g_autoptr(GError) error_local = NULL;
-	g_autoptr(GMarkupParseContext) ctx = NULL;
-	const GMarkupParser parser = {
-		as_node_start_element_cb,
-		as_node_end_element_cb,
-		as_node_text_cb,
-		as_node_passthrough_cb,
-		NULL };
+	g_autoptr(GString) scratch = g_string_new (NULL);
+	g_autoptr(GArray) offsets = g_array_new (FALSE, FALSE, sizeof(gsize));
+	g_autoptr(GArray) stack = g_array_new (FALSE, FALSE, sizeof(AsNodeMarkupSlice));
+	g_autoptr(GPtrArray) attr_names = g_ptr_array_new ();
+	g_autoptr(GPtrArray) attr_values = g_ptr_array_new ();
 
 	g_return_val_if_fail (data != NULL, NULL);
 
+	/* ignore any trailing NUL bytes */
+	len = data_sz < 0 ? strlen (data) : (gsize) data_sz;
+	while (len > 0 && data[len - 1] == '\0')
+		len--;
+	if (!g_utf8_validate (data, (gssize) len, NULL)) {
+		g_set_error_literal (error,
+				     AS_NODE_ERROR,
+				     AS_NODE_ERROR_FAILED,
+				     "Invalid UTF-8 encoded text");
+		return NULL;
+	}
+
 	root = as_node_new ();
 	helper.flags = flags;
 	helper.current = root;
 	helper.locales = g_get_language_names ();
-	ctx = g_markup_parse_context_new (&parser,
-					  G_MARKUP_PREFIX_ERROR_POSITION,
-					  &helper,
-					  NULL);
-	ret = g_markup_parse_context_parse (ctx, data, data_sz, &error_local);
+	helper.stream_depth = stream_depth;
+	helper.stream_func = stream_func;
+	helper.stream_user_data = stream_user_data;
+	((AsNodeData *) root->data)->root->flags = flags;
+	if (source != NULL) {
+		AsNodeRoot *root_data = ((AsNodeData *) root->data)->root;
+		root_data->source = g_bytes_ref (source);
+		helper.use_slices = TRUE;
+	}
+	parser.data = data;
+	parser.end = data + len;
+	parser.scratch = scratch;
+	parser.offsets = offsets;
+	parser.stack = stack;
+	parser.attr_names = attr_names;
+	parser.attr_values = attr_values;
+	ret = as_node_markup_parse (&parser, &helper, &error_local);
 	if (!ret) {
-		g_set_error_literal (error,
-				     AS_NODE_ERROR,
-				     AS_NODE_ERROR_FAILED,
-				     error_local->message);
+		/* keep the domain and code from the stream function */
+		if (helper.stream_failed) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+		} else {
+			g_set_error_literal (error,
+					     AS_NODE_ERROR,
+					     AS_NODE_ERROR_FAILED,
+					     error_local->message);
+		}
 		as_node_unref (root);
 		return NULL;
 	}
@@ -898,6 +1806,9 @@ as_node_from_xml_internal (const gchar *data, gssize data_sz,
  *
  * Parses XML data into a DOM tree.
  *
+ * The tree keeps a reference to @bytes, and text that does not need to be
+ * unescaped or reflowed is only copied out of it when it is first used.
+ *
  * Returns: (transfer none): A populated #AsNode tree
  *
  * Since: 0.7.6
@@ -909,7 +1820,10 @@ as_node_from_bytes (GBytes *bytes, AsNodeFromXmlFlags flags, GError **error)
 	const gchar *buf;
 	g_return_val_if_fail (bytes != NULL, NULL);
 	buf = g_bytes_get_data (bytes, &sz);
-	return as_node_from_xml_internal (buf, (gssize) sz, flags, error);
+	if (buf == NULL)
+		buf = "";
+	return as_node_from_xml_internal (buf, (gssize) sz, bytes, flags,
+					  0, NULL, NULL, error);
 }
 
 /**
@@ -927,7 +1841,8 @@ as_node_from_bytes (GBytes *bytes, AsNodeFromXmlFlags flags, GError **error)
 AsNode *
 as_node_from_xml (const gchar *data, AsNodeFromXmlFlags flags, GError **error)
 {
-	return as_node_from_xml_internal (data, -1, flags, error);
+	return as_node_from_xml_internal (data, -1, NULL, flags,
+					  0, NULL, NULL, error);
 }
 
 /**
@@ -964,24 +1879,14 @@ as_node_to_file (const AsNode *root,
 					error);
 }
 
-/**
- * as_node_from_file: (skip)
- * @file: file
- * @flags: #AsNodeFromXmlFlags, e.g. %AS_NODE_FROM_XML_FLAG_NONE
- * @cancellable: A #GCancellable, or %NULL
- * @error: A #GError or %NULL
- *
- * Parses an XML file into a DOM tree.
- *
- * Returns: (transfer none): A populated #AsNode tree
- *
- * Since: 0.1.0
- **/
-AsNode *
-as_node_from_file (GFile *file,
-		   AsNodeFromXmlFlags flags,
-		   GCancellable *cancellable,
-		   GError **error)
+static AsNode *
+as_node_from_file_internal (GFile *file,
+			    AsNodeFromXmlFlags flags,
+			    guint stream_depth,
+			    AsNodeStreamFunc stream_func,
+			    gpointer stream_user_data,
+			    GCancellable *cancellable,
+			    GError **error)
 {
 	AsNodeToXmlHelper helper = {0};
 	GError *error_local = NULL;
@@ -1037,11 +1942,59 @@ as_node_from_file (GFile *file,
 		return NULL;
 	}
 
-	/* parse */
+	/* uncompressed files are mapped rather than copied; the mapping is not
+	 * kept by the tree, so the file can change on disk once parsed */
+	if (conv == NULL && (flags & AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA) == 0) {
+		g_autofree gchar *fn = g_file_get_path (file);
+		g_autoptr(GMappedFile) mapped_file = NULL;
+		if (fn != NULL)
+			mapped_file = g_mapped_file_new (fn, FALSE, NULL);
+		if (mapped_file != NULL) {
+			const gchar *buf = g_mapped_file_get_contents (mapped_file);
+			if (buf == NULL)
+				buf = "";
+			return as_node_from_xml_internal (buf,
+							  (gssize) g_mapped_file_get_length (mapped_file),
+							  NULL, flags,
+							  stream_depth, stream_func,
+							  stream_user_data, error);
+		}
+	}
+
+	/* otherwise the whole decompressed file is read into memory, which is
+	 * kept for the slices of deferred data, unless a compressed file is
+	 * being streamed, where the point is to never hold all of it at once */
+	if (conv == NULL || stream_func == NULL ||
+	    (flags & AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA) > 0) {
+		const gchar *buf;
+		gsize sz = 0;
+		g_autoptr(GBytes) bytes = NULL;
+		g_autoptr(GOutputStream) ostream = NULL;
+
+		ostream = g_memory_output_stream_new_resizable ();
+		if (g_output_stream_splice (ostream, stream_data,
+					    G_OUTPUT_STREAM_SPLICE_CLOSE_TARGET,
+					    cancellable, error) < 0)
+			return NULL;
+		bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (ostream));
+		buf = g_bytes_get_data (bytes, &sz);
+		if (buf == NULL)
+			buf = "";
+		return as_node_from_xml_internal (buf, (gssize) sz,
+						  (flags & AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA) ? bytes : NULL,
+						  flags,
+						  stream_depth, stream_func,
+						  stream_user_data, error);
+	}
+
+	/* parse a compressed stream in chunks */
 	root = as_node_new ();
 	helper.flags = flags;
 	helper.current = root;
 	helper.locales = g_get_language_names ();
+	helper.stream_depth = stream_depth;
+	helper.stream_func = stream_func;
+	helper.stream_user_data = stream_user_data;
 	ctx = g_markup_parse_context_new (&parser,
 					  G_MARKUP_PREFIX_ERROR_POSITION,
 					  &helper,
@@ -1058,11 +2011,16 @@ as_node_from_file (GFile *file,
 						    len,
 						    &error_local);
 		if (!ret) {
-			g_set_error_literal (error,
-					     AS_NODE_ERROR,
-					     AS_NODE_ERROR_FAILED,
-					     error_local->message);
-			g_error_free (error_local);
+			/* keep the domain and code from the stream function */
+			if (helper.stream_failed) {
+				g_propagate_error (error, error_local);
+			} else {
+				g_set_error_literal (error,
+						     AS_NODE_ERROR,
+						     AS_NODE_ERROR_FAILED,
+						     error_local->message);
+				g_error_free (error_local);
+			}
 			as_node_unref (root);
 			return NULL;
 		}
@@ -1084,6 +2042,69 @@ as_node_from_file (GFile *file,
 	return root;
 }
 
+/**
+ * as_node_from_file: (skip)
+ * @file: file
+ * @flags: #AsNodeFromXmlFlags, e.g. %AS_NODE_FROM_XML_FLAG_NONE
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: A #GError or %NULL
+ *
+ * Parses an XML file into a DOM tree.
+ *
+ * If @flags contains %AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA then the whole
+ * decompressed file is read into one buffer, which is kept for as long as
+ * the tree or any deferred data taken from it exists. This is intentional:
+ * the deferred data refers to the buffer rather than copying each part.
+ *
+ * Returns: (transfer none): A populated #AsNode tree
+ *
+ * Since: 0.1.0
+ **/
+AsNode *
+as_node_from_file (GFile *file,
+		   AsNodeFromXmlFlags flags,
+		   GCancellable *cancellable,
+		   GError **error)
+{
+	return as_node_from_file_internal (file, flags, 0, NULL, NULL,
+					   cancellable, error);
+}
+
+/**
+ * as_node_from_file_stream: (skip)
+ * @file: file
+ * @flags: #AsNodeFromXmlFlags, e.g. %AS_NODE_FROM_XML_FLAG_NONE
+ * @depth: the depth of the nodes to stream, where the root node is 1
+ * @func: a #AsNodeStreamFunc
+ * @user_data: user data to pass to @func
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: A #GError or %NULL
+ *
+ * Parses an XML file, calling @func for each node at @depth as soon as its
+ * end tag has been parsed. The node and its children are freed when @func
+ * returns, and so the returned tree does not contain any nodes at @depth.
+ *
+ * If @func returns %FALSE then parsing stops and the error set by @func is
+ * returned unchanged.
+ *
+ * Returns: (transfer full): A partially populated #AsNode tree
+ *
+ * Since: 0.8.5
+ **/
+AsNode *
+as_node_from_file_stream (GFile *file,
+			  AsNodeFromXmlFlags flags,
+			  guint depth,
+			  AsNodeStreamFunc func,
+			  gpointer user_data,
+			  GCancellable *cancellable,
+			  GError **error)
+{
+	g_return_val_if_fail (func != NULL, NULL);
+	return as_node_from_file_internal (file, flags, depth, func, user_data,
+					   cancellable, error);
+}
+
 static AsNode *
 as_node_get_child_node (const AsNode *root, const gchar *name,
 			const gchar *attr_key, const gchar *attr_value)
@@ -1166,6 +2187,39 @@ as_node_set_name (AsNode *node, const gchar *name)
 	as_node_data_set_name (root, data, name, AS_NODE_INSERT_FLAG_NONE);
 }
 
+/**
+ * as_node_get_raw: (skip)
+ * @node: a #AsNode
+ * @flags: (out) (optional): the #AsNodeFromXmlFlags the tree was parsed with
+ *
+ * Gets the unparsed XML of a node that was not parsed because the tree was
+ * loaded with %AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA. The node itself has
+ * the element name and attributes, but no children.
+ *
+ * The returned data refers to the source of the tree, so it can be parsed
+ * with as_node_from_bytes() using @flags after the tree has been freed.
+ *
+ * Return value: (transfer none): the element as XML, or %NULL if not deferred
+ *
+ * Since: 0.8.5
+ **/
+GBytes *
+as_node_get_raw (const AsNode *node, AsNodeFromXmlFlags *flags)
+{
+	AsNodeRoot *root;
+
+	g_return_val_if_fail (node != NULL, NULL);
+
+	if (node->data == NULL)
+		return NULL;
+	root = ((AsNodeData *) node->data)->root;
+	if (root->raw == NULL)
+		return NULL;
+	if (flags != NULL)
+		*flags = root->flags;
+	return g_hash_table_lookup (root->raw, node);
+}
+
 /**
  * as_node_get_data_as_refstr: (skip)
  * @node: a #AsNode
@@ -1188,6 +2242,7 @@ as_node_get_data_as_refstr (const AsNode *node)
 		return NULL;
 	if (data->cdata == NULL || data->cdata[0] == '\0')
 		return NULL;
+	as_node_cdata_from_slice (data);
 	as_node_cdata_to_raw (data);
 	return data->cdata;
 }
@@ -1280,7 +2335,13 @@ as_node_set_data (AsNode *node,
 	data = (AsNodeData *) node->data;
 	if (data->is_root_node)
 		return;
+	if (data->is_cdata_slice) {
+		data->cdata = NULL;
+		data->is_cdata_slice = FALSE;
+		data->is_cdata_const = FALSE;
+	}
 	as_ref_string_assign_safe (&data->cdata, cdata);
+	data->root->has_heap_strings = TRUE;
 	data->is_cdata_escaped = insert_flags & AS_NODE_INSERT_FLAG_PRE_ESCAPED;
 }
 
@@ -1413,6 +2474,8 @@ as_node_remove_attribute (AsNode *node, const gchar *key)
 {
 	AsNodeAttr *attr;
 	AsNodeData *data;
+	AsNodeRoot *root_data;
+	GList *link;
 
 	g_return_if_fail (node != NULL);
 	g_return_if_fail (key != NULL);
@@ -1423,8 +2486,10 @@ as_node_remove_attribute (AsNode *node, const gchar *key)
 	attr = as_node_attr_find (data, key);
 	if (attr == NULL)
 		return;
-	data->attrs = g_list_remove_all (data->attrs, attr);
-	as_node_attr_free (attr);
+	link = g_list_find (data->attrs, attr);
+	data->attrs = g_list_remove_link (data->attrs, link);
+	root_data = data->root;
+	as_node_root_free (&root_data->free_attrs, link);
 }
 
 /**
@@ -1601,19 +2666,22 @@ as_node_insert (AsNode *parent,
 	const gchar *key;
 	const gchar *value;
 	AsNodeData *data;
+	AsNode *node;
 	AsNode *root = g_node_get_root (parent);
 	guint i;
 	va_list args;
 
 	g_return_val_if_fail (name != NULL, NULL);
 
-	data = g_slice_new0 (AsNodeData);
+	node = as_node_alloc (root);
+	data = node->data;
 	as_node_data_set_name (root, data, name, insert_flags);
 	if (cdata != NULL) {
 		if (insert_flags & AS_NODE_INSERT_FLAG_BASE64_ENCODED)
 			data->cdata = as_node_insert_line_breaks (cdata, 76);
 		else
 			data->cdata = as_ref_string_new (cdata);
+		data->root->has_heap_strings = TRUE;
 	}
 	data->is_cdata_escaped = insert_flags & AS_NODE_INSERT_FLAG_PRE_ESCAPED;
 
@@ -1630,7 +2698,7 @@ as_node_insert (AsNode *parent,
 	}
 	va_end (args);
 
-	return g_node_insert_data (parent, -1, data);
+	return g_node_insert (parent, -1, node);
 }
 
 static gint
@@ -1657,6 +2725,7 @@ as_node_insert_localized (AsNode *parent,
 			  AsNodeInsertFlags insert_flags)
 {
 	AsNodeData *data;
+	AsNode *node;
 	AsNode *root = g_node_get_root (parent);
 	GList *l;
 	const gchar *key;
@@ -1670,17 +2739,20 @@ as_node_insert_localized (AsNode *parent,
 	value_c = g_hash_table_lookup (localized, "C");
 	if (value_c == NULL)
 		return;
-	data = g_slice_new0 (AsNodeData);
+	node = as_node_alloc (root);
+	data = node->data;
 	as_node_data_set_name (root, data, name, insert_flags);
 	if (insert_flags & AS_NODE_INSERT_FLAG_NO_MARKUP) {
 		g_autofree gchar *tmp = as_markup_convert_simple (value_c, NULL);
 		data->cdata = as_ref_string_new (tmp);
+		data->root->has_heap_strings = TRUE;
 		data->is_cdata_escaped = FALSE;
 	} else {
 		data->cdata = as_ref_string_new (value_c);
+		data->root->has_heap_strings = TRUE;
 		data->is_cdata_escaped = insert_flags & AS_NODE_INSERT_FLAG_PRE_ESCAPED;
 	}
-	g_node_insert_data (parent, -1, data);
+	g_node_insert (parent, -1, node);
 
 	/* add the other localized values */
 	list = g_hash_table_get_keys (localized);
@@ -1695,18 +2767,21 @@ as_node_insert_localized (AsNode *parent,
 		if ((insert_flags & AS_NODE_INSERT_FLAG_DEDUPE_LANG) > 0 &&
 		    g_strcmp0 (value_c, value) == 0)
 			continue;
-		data = g_slice_new0 (AsNodeData);
+		node = as_node_alloc (root);
+		data = node->data;
 		as_node_attr_insert (root, data, "xml:lang", key);
 		as_node_data_set_name (root, data, name, insert_flags);
 		if (insert_flags & AS_NODE_INSERT_FLAG_NO_MARKUP) {
 			g_autofree gchar *tmp = as_markup_convert_simple (value, NULL);
 			data->cdata = as_ref_string_new (tmp);
+			data->root->has_heap_strings = TRUE;
 			data->is_cdata_escaped = FALSE;
 		} else {
 			data->cdata = as_ref_string_new (value);
+			data->root->has_heap_strings = TRUE;
 			data->is_cdata_escaped = insert_flags & AS_NODE_INSERT_FLAG_PRE_ESCAPED;
 		}
-		g_node_insert_data (parent, -1, data);
+		g_node_insert (parent, -1, node);
 	}
 }
 
@@ -1730,6 +2805,7 @@ as_node_insert_hash (AsNode *parent,
 		     AsNodeInsertFlags insert_flags)
 {
 	AsNodeData *data;
+	AsNode *node;
 	AsNode *root = g_node_get_root (parent);
 	GList *l;
 	GList *list;
@@ -1744,9 +2820,11 @@ as_node_insert_hash (AsNode *parent,
 	for (l = list; l != NULL; l = l->next) {
 		key = l->data;
 		value = g_hash_table_lookup (hash, key);
-		data = g_slice_new0 (AsNodeData);
+		node = as_node_alloc (root);
+		data = node->data;
 		as_node_data_set_name (root, data, name, insert_flags);
 		data->cdata = as_ref_string_new (!swapped ? value : key);
+		data->root->has_heap_strings = TRUE;
 		data->is_cdata_escaped = insert_flags & AS_NODE_INSERT_FLAG_PRE_ESCAPED;
 		if (!swapped) {
 			if (key != NULL && key[0] != '\0')
@@ -1755,7 +2833,7 @@ as_node_insert_hash (AsNode *parent,
 			if (value != NULL && value[0] != '\0')
 				as_node_attr_insert (root, data, attr_key, value);
 		}
-		g_node_insert_data (parent, -1, data);
+		g_node_insert (parent, -1, node);
 	}
 	g_list_free (list);
 }
@@ -1801,6 +2879,7 @@ as_node_get_localized (const AsNode *node, const gchar *key)
 		xml_lang = as_node_attr_lookup (data, "xml:lang");
 		if (g_strcmp0 (xml_lang, "x-test") == 0)
 			continue;
+		as_node_cdata_from_slice (data);
 
 		g_hash_table_insert (hash,
 				     as_ref_string_ref (xml_lang != NULL ? xml_lang : xml_lang_c),
@@ -2191,6 +3270,150 @@ struct _AsNodeContext {
 	AsRefString	*media_base_url;
 };
 
+static void
+as_node_to_variant_internal (const AsNode *node,
+			     guint16 depth,
+			     GVariantBuilder *builder)
+{
+	AsNodeData *data = node->data;
+	AsNodeAttr *attr;
+	AsNode *c;
+	GList *l;
+	GVariantBuilder attrs;
+
+	/* pre-escaped markup has to be parsed into real nodes so that loading
+	 * the variant gives exactly the same tree as loading the XML */
+	if (data->is_cdata_escaped &&
+	    data->cdata != NULL &&
+	    g_strstr_len (data->cdata, -1, "<") != NULL) {
+		const gchar *name = as_tag_data_get_name (data);
+		g_autofree gchar *attr_str = as_node_get_attr_string (data);
+		g_autofree gchar *xml = NULL;
+		g_autoptr(AsNode) fragment = NULL;
+		xml = g_strdup_printf ("<%s%s>%s</%s>",
+				       name, attr_str, data->cdata, name);
+		fragment = as_node_from_xml (xml, AS_NODE_FROM_XML_FLAG_NONE, NULL);
+		if (fragment != NULL && fragment->children != NULL) {
+			as_node_to_variant_internal (fragment->children,
+						     depth, builder);
+			return;
+		}
+	}
+
+	g_variant_builder_init (&attrs, G_VARIANT_TYPE ("a(ss)"));
+	for (l = data->attrs; l != NULL; l = l->next) {
+		attr = l->data;
+		g_variant_builder_add (&attrs, "(ss)", attr->key, attr->value);
+	}
+	g_variant_builder_add (builder, "(qsmsa(ss))",
+			       depth,
+			       as_tag_data_get_name (data),
+			       as_node_get_data (node),
+			       &attrs);
+	for (c = node->children; c != NULL; c = c->next)
+		as_node_to_variant_internal (c, depth + 1, builder);
+}
+
+/**
+ * as_node_to_variant: (skip)
+ * @node: a #AsNode
+ *
+ * Flattens the node and all of its children into a #GVariant of type
+ * `a(qsmsa(ss))` where each entry is the depth, name, data and attributes
+ * of a node in pre-order.
+ *
+ * Returns: (transfer floating): a #GVariant
+ *
+ * Since: 0.8.5
+ **/
+GVariant *
+as_node_to_variant (const AsNode *node)
+{
+	GVariantBuilder builder;
+	g_return_val_if_fail (node != NULL, NULL);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(qsmsa(ss))"));
+	as_node_to_variant_internal (node, 0, &builder);
+	return g_variant_builder_end (&builder);
+}
+
+/**
+ * as_node_array_to_variant: (skip)
+ * @nodes: (element-type AsNode): sibling #AsNode objects
+ *
+ * Flattens each node and all of its children into one #GVariant of the same
+ * type as as_node_to_variant(), with every node of @nodes at depth 0 so that
+ * as_node_from_variant() adds them all as children of the new root.
+ *
+ * Returns: (transfer floating): a #GVariant
+ *
+ * Since: 0.8.5
+ **/
+GVariant *
+as_node_array_to_variant (GPtrArray *nodes)
+{
+	GVariantBuilder builder;
+	g_return_val_if_fail (nodes != NULL, NULL);
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(qsmsa(ss))"));
+	for (guint i = 0; i < nodes->len; i++)
+		as_node_to_variant_internal (g_ptr_array_index (nodes, i), 0, &builder);
+	return g_variant_builder_end (&builder);
+}
+
+/**
+ * as_node_from_variant: (skip)
+ * @value: a #GVariant of type `a(qsmsa(ss))`
+ * @error: A #GError or %NULL
+ *
+ * Creates a DOM tree from data created by as_node_to_variant().
+ *
+ * Returns: (transfer full): A populated #AsNode tree, or %NULL for error
+ *
+ * Since: 0.8.5
+ **/
+AsNode *
+as_node_from_variant (GVariant *value, GError **error)
+{
+	GVariantIter iter;
+	GVariantIter *attrs = NULL;
+	const gchar *cdata = NULL;
+	const gchar *name = NULL;
+	guint16 depth = 0;
+	g_autoptr(AsNode) root = as_node_new ();
+	g_autoptr(GPtrArray) parents = g_ptr_array_new ();
+
+	g_return_val_if_fail (value != NULL, NULL);
+
+	g_ptr_array_add (parents, root);
+	g_variant_iter_init (&iter, value);
+	while (g_variant_iter_next (&iter, "(q&sm&sa(ss))",
+				    &depth, &name, &cdata, &attrs)) {
+		AsNode *node;
+		const gchar *key;
+		const gchar *val;
+
+		/* the parent has to be already added */
+		if (depth >= parents->len) {
+			g_variant_iter_free (attrs);
+			g_set_error (error,
+				     AS_NODE_ERROR,
+				     AS_NODE_ERROR_INVALID_MARKUP,
+				     "invalid depth %u for %s",
+				     depth, name);
+			return NULL;
+		}
+		node = as_node_insert (g_ptr_array_index (parents, depth),
+				       name, cdata,
+				       AS_NODE_INSERT_FLAG_NONE,
+				       NULL);
+		while (g_variant_iter_next (attrs, "(&s&s)", &key, &val))
+			as_node_add_attribute (node, key, val);
+		g_variant_iter_free (attrs);
+		g_ptr_array_set_size (parents, depth + 1);
+		g_ptr_array_add (parents, node);
+	}
+	return g_steal_pointer (&root);
+}
+
 /**
  * as_node_context_new: (skip)
  *
@@ -17,7 +17,8 @@ struct _AsProfile
 	GPtrArray	*current;
 	GPtrArray	*archived;
 	GMutex		 mutex;
-	GThread		*unthreaded;
+	guint		 unthreaded;	/* thread serial */
+	GHashTable	*threads;	/* of thread serial:tid */
 	guint		 autodump_id;
 	guint		 autoprune_duration;
 	guint		 duration_min;
@@ -25,6 +26,8 @@ struct _AsProfile
 
 typedef struct {
 	gchar		*id;
+	gchar		*name;		/* without the thread prefix */
+	guint		 tid;
 	gint64		 time_start;
 	gint64		 time_stop;
 	gboolean	 threaded;
@@ -39,11 +42,14 @@ struct _AsProfileTask
 };
 
 static gpointer as_profile_object = NULL;
+static GPrivate as_profile_thread_serial;
+static gint as_profile_thread_serial_last = 0;
 
 static void
 as_profile_item_free (AsProfileItem *item)
 {
 	g_free (item->id);
+	g_free (item->name);
 	g_free (item);
 }
 
@@ -197,6 +203,140 @@ as_profile_dump_safe (AsProfile *profile)
 	}
 }
 
+/* unlike the GThread pointer this is never reused after a thread exits */
+static guint
+as_profile_get_thread_serial (void)
+{
+	guint serial = GPOINTER_TO_UINT (g_private_get (&as_profile_thread_serial));
+	if (serial == 0) {
+		serial = (guint) g_atomic_int_add (&as_profile_thread_serial_last, 1) + 1;
+		g_private_set (&as_profile_thread_serial, GUINT_TO_POINTER (serial));
+	}
+	return serial;
+}
+
+/* the main thread is always 1, and other threads are numbered when first seen */
+static guint
+as_profile_get_tid_safe (AsProfile *profile, guint serial)
+{
+	guint tid;
+	if (serial == profile->unthreaded)
+		return 1;
+	tid = GPOINTER_TO_UINT (g_hash_table_lookup (profile->threads,
+						     GUINT_TO_POINTER (serial)));
+	if (tid == 0) {
+		tid = g_hash_table_size (profile->threads) + 2;
+		g_hash_table_insert (profile->threads,
+				     GUINT_TO_POINTER (serial),
+				     GUINT_TO_POINTER (tid));
+	}
+	return tid;
+}
+
+static void
+as_profile_json_append_string (GString *str, const gchar *value)
+{
+	g_string_append_c (str, '"');
+	for (const gchar *tmp = value; *tmp != '\0'; tmp++) {
+		switch (*tmp) {
+		case '"':
+			g_string_append (str, "\\\"");
+			break;
+		case '\\':
+			g_string_append (str, "\\\\");
+			break;
+		default:
+			if ((guchar) *tmp < 0x20) {
+				g_string_append_printf (str, "\\u%04x", (guint) *tmp);
+				break;
+			}
+			g_string_append_c (str, *tmp);
+			break;
+		}
+	}
+	g_string_append_c (str, '"');
+}
+
+/* the thread names are always output first */
+static void
+as_profile_json_append_item (GString *str, AsProfileItem *item, const gchar *ph)
+{
+	g_string_append (str, ",\n{\"name\":");
+	as_profile_json_append_string (str, item->name);
+	g_string_append_printf (str, ",\"cat\":\"%s\",\"ph\":\"%s\","
+				"\"pid\":1,\"tid\":%u,\"ts\":%" G_GINT64_FORMAT,
+				item->threaded ? "threaded" : "default",
+				ph, item->tid, item->time_start);
+	if (item->time_stop >= item->time_start && g_strcmp0 (ph, "X") == 0) {
+		g_string_append_printf (str, ",\"dur\":%" G_GINT64_FORMAT,
+					item->time_stop - item->time_start);
+	}
+	g_string_append_c (str, '}');
+}
+
+static GString *
+as_profile_export_json_safe (AsProfile *profile)
+{
+	GHashTableIter iter;
+	gpointer value;
+	GString *str = g_string_new ("[\n");
+
+	/* name the threads */
+	g_string_append (str, "{\"name\":\"thread_name\",\"ph\":\"M\","
+			 "\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}}");
+	g_hash_table_iter_init (&iter, profile->threads);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		g_string_append_printf (str, ",\n{\"name\":\"thread_name\","
+					"\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+					"\"args\":{\"name\":\"thread-%u\"}}",
+					GPOINTER_TO_UINT (value),
+					GPOINTER_TO_UINT (value));
+	}
+
+	/* complete events, with tasks still running only having a start */
+	g_ptr_array_sort (profile->archived, as_profile_sort_cb);
+	for (guint i = 0; i < profile->archived->len; i++) {
+		AsProfileItem *item = g_ptr_array_index (profile->archived, i);
+		as_profile_json_append_item (str, item, "X");
+	}
+	for (guint i = 0; i < profile->current->len; i++) {
+		AsProfileItem *item = g_ptr_array_index (profile->current, i);
+		as_profile_json_append_item (str, item, "B");
+	}
+	g_string_append (str, "\n]\n");
+	return str;
+}
+
+/**
+ * as_profile_export_json:
+ * @profile: A #AsProfile
+ * @filename: A filename to write to
+ * @error: A #GError or %NULL
+ *
+ * Writes all the profiled events to a file in the Chrome Trace Event format,
+ * which can be loaded into tools such as chrome://tracing or Perfetto.
+ *
+ * Each thread is shown separately, and tasks that started other tasks are
+ * shown nested inside them.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+as_profile_export_json (AsProfile *profile, const gchar *filename, GError **error)
+{
+	g_autoptr(GString) str = NULL;
+
+	g_return_val_if_fail (AS_IS_PROFILE (profile), FALSE);
+	g_return_val_if_fail (filename != NULL, FALSE);
+
+	g_mutex_lock (&profile->mutex);
+	str = as_profile_export_json_safe (profile);
+	g_mutex_unlock (&profile->mutex);
+	return g_file_set_contents (filename, str->str, (gssize) str->len, error);
+}
+
 /**
  * as_profile_start:
  * @profile: A #AsProfile
@@ -234,7 +374,7 @@ as_profile_start (AsProfile *profile, const gchar *fmt, ...)
 AsProfileTask *
 as_profile_start_literal (AsProfile *profile, const gchar *id)
 {
-	GThread *self;
+	guint self;
 	AsProfileItem *item;
 	AsProfileTask *ptask = NULL;
 	g_autofree gchar *id_thr = NULL;
@@ -248,9 +388,9 @@ as_profile_start_literal (AsProfile *profile, const gchar *id)
 		as_profile_prune_safe (profile, profile->autoprune_duration);
 
 	/* only use the thread ID when not using the main thread */
-	self = g_thread_self ();
+	self = as_profile_get_thread_serial ();
 	if (self != profile->unthreaded) {
-		id_thr = g_strdup_printf ("%p~%s", self, id);
+		id_thr = g_strdup_printf ("%u~%s", self, id);
 	} else {
 		id_thr = g_strdup (id);
 	}
@@ -266,6 +406,8 @@ as_profile_start_literal (AsProfile *profile, const gchar *id)
 	/* add new item */
 	item = g_new0 (AsProfileItem, 1);
 	item->id = g_strdup (id_thr);
+	item->name = g_strdup (id);
+	item->tid = as_profile_get_tid_safe (profile, self);
 	item->time_start = g_get_real_time ();
 	g_ptr_array_add (profile->current, item);
 	g_debug ("run %s", id_thr);
@@ -280,7 +422,7 @@ as_profile_start_literal (AsProfile *profile, const gchar *id)
 static void
 as_profile_task_free_internal (AsProfile *profile, const gchar *id)
 {
-	GThread *self;
+	guint self;
 	AsProfileItem *item;
 	gdouble elapsed_ms;
 	g_autofree gchar *id_thr = NULL;
@@ -290,9 +432,9 @@ as_profile_task_free_internal (AsProfile *profile, const gchar *id)
 	g_return_if_fail (id != NULL);
 
 	/* only use the thread ID when not using the main thread */
-	self = g_thread_self ();
+	self = as_profile_get_thread_serial ();
 	if (self != profile->unthreaded) {
-		id_thr = g_strdup_printf ("%p~%s", self, id);
+		id_thr = g_strdup_printf ("%u~%s", self, id);
 	} else {
 		id_thr = g_strdup (id);
 	}
@@ -452,6 +594,7 @@ as_profile_finalize (GObject *object)
 	g_ptr_array_foreach (profile->current, (GFunc) as_profile_item_free, NULL);
 	g_ptr_array_unref (profile->current);
 	g_ptr_array_unref (profile->archived);
+	g_hash_table_unref (profile->threads);
 	g_mutex_clear (&profile->mutex);
 
 	G_OBJECT_CLASS (as_profile_parent_class)->finalize (object);
@@ -469,7 +612,8 @@ as_profile_init (AsProfile *profile)
 {
 	profile->duration_min = 5;
 	profile->current = g_ptr_array_new ();
-	profile->unthreaded = g_thread_self ();
+	profile->unthreaded = as_profile_get_thread_serial ();
+	profile->threads = g_hash_table_new (g_direct_hash, g_direct_equal);
 	profile->archived = g_ptr_array_new_with_free_func ((GDestroyNotify) as_profile_item_free);
 	g_mutex_init (&profile->mutex);
 }
@@ -30,6 +30,9 @@ void		 as_profile_clear		(AsProfile	*profile);
 void		 as_profile_prune		(AsProfile	*profile,
 						 guint		 duration);
 void		 as_profile_dump		(AsProfile	*profile);
+gboolean	 as_profile_export_json		(AsProfile	*profile,
+						 const gchar	*filename,
+						 GError		**error);
 void		 as_profile_set_autodump	(AsProfile	*profile,
 						 guint		 delay);
 void		 as_profile_set_autoprune	(AsProfile	*profile,
@@ -15,7 +15,7 @@
 
 #include "as-agreement-private.h"
 #include "as-app-private.h"
-#include "as-app-builder.h"
+#include "as-app-builder-private.h"
 #include "as-bundle-private.h"
 #include "as-translation-private.h"
 #include "as-checksum-private.h"
@@ -29,13 +29,13 @@
 #include "as-monitor.h"
 #include "as-node-private.h"
 #include "as-problem.h"
+#include "as-profile.h"
 #include "as-launchable-private.h"
 #include "as-provide-private.h"
 #include "as-ref-string.h"
 #include "as-release-private.h"
 #include "as-suggest-private.h"
 #include "as-screenshot-private.h"
-#include "as-store.h"
 #include "as-tag.h"
 #include "as-utils-private.h"
 #include "as-yaml.h"
@@ -372,6 +372,61 @@ as_test_app_builder_gettext_func (void)
 	g_assert_cmpint (g_list_length (list), ==, 2);
 }
 
+/* loads a directory into a table of filename to data like a package */
+static void
+as_test_app_builder_load_files (GHashTable *files, const gchar *path, const gchar *prefix)
+{
+	const gchar *tmp;
+	g_autoptr(GDir) dir = g_dir_open (path, 0, NULL);
+	g_assert (dir != NULL);
+	while ((tmp = g_dir_read_name (dir)) != NULL) {
+		g_autofree gchar *fn = g_build_filename (path, tmp, NULL);
+		g_autofree gchar *key = g_build_filename (prefix, tmp, NULL);
+		gboolean ret;
+		gchar *data = NULL;
+		gsize len = 0;
+		if (g_file_test (fn, G_FILE_TEST_IS_DIR)) {
+			as_test_app_builder_load_files (files, fn, key);
+			continue;
+		}
+		ret = g_file_get_contents (fn, &data, &len, NULL);
+		g_assert (ret);
+		g_hash_table_insert (files, g_steal_pointer (&key),
+				     g_bytes_new_take (data, len));
+	}
+}
+
+static void
+as_test_app_builder_gettext_files_func (void)
+{
+	GError *error = NULL;
+	gboolean ret;
+	g_autofree gchar *fn = NULL;
+	g_autoptr(AsApp) app = as_app_new ();
+	g_autoptr(AsTranslation) translation = as_translation_new ();
+	g_autoptr(GHashTable) files = NULL;
+	g_autoptr(GList) list = NULL;
+
+	/* the same files as the prefix, but in memory */
+	fn = as_test_get_filename ("usr");
+	g_assert (fn != NULL);
+	files = g_hash_table_new_full (g_str_hash, g_str_equal,
+				       g_free, (GDestroyNotify) g_bytes_unref);
+	as_test_app_builder_load_files (files, fn, "/usr");
+	as_translation_set_kind (translation, AS_TRANSLATION_KIND_GETTEXT);
+	as_translation_set_id (translation, "app");
+	as_app_add_translation (app, translation);
+	ret = as_app_builder_search_translations_files (app, files, "/usr", 25,
+							AS_APP_BUILDER_FLAG_NONE,
+							&error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (as_app_get_language (app, "en_GB"), ==, 100);
+	g_assert_cmpint (as_app_get_language (app, "ru"), ==, 33);
+	list = as_app_get_languages (app);
+	g_assert_cmpint (g_list_length (list), ==, 2);
+}
+
 static void
 as_test_app_builder_gettext_nodomain_func (void)
 {
@@ -2807,6 +2862,92 @@ as_test_node_sort_func (void)
 	g_assert_cmpstr (str->str, ==, "<a>aaa</a><b>bbb</b><c>ccc</c><d>ddd</d>");
 }
 
+static void
+as_test_node_unlink_func (void)
+{
+	AsNode *n1;
+	AsNode *n2;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(AsNode) root = NULL;
+	g_autoptr(GString) str = NULL;
+
+	root = as_node_from_xml ("<a><b>b&amp;b</b><c><d>ddd</d></c></a>", 0, &error);
+	g_assert_no_error (error);
+	g_assert (root != NULL);
+
+	/* take a subtree out of the tree and free it on its own */
+	n1 = as_node_find (root, "a/c");
+	g_assert (n1 != NULL);
+	g_node_unlink (n1);
+	n2 = as_node_insert (n1, "e", "eee", 0, NULL);
+	g_assert (n2 != NULL);
+	g_assert_cmpstr (as_node_get_data (as_node_find (n1, "d")), ==, "ddd");
+	as_node_unref (n1);
+
+	/* the rest of the tree is unaffected */
+	n1 = as_node_insert (as_node_find (root, "a"), "f", "fff", 0, NULL);
+	g_assert (n1 != NULL);
+	str = as_node_to_xml (root, AS_NODE_TO_XML_FLAG_NONE);
+	g_assert_cmpstr (str->str, ==, "<a><b>b&amp;b</b><f>fff</f></a>");
+}
+
+static void
+as_test_node_defer_func (void)
+{
+	AsNode *n;
+	AsNodeFromXmlFlags flags = AS_NODE_FROM_XML_FLAG_NONE;
+	const gchar *xml =
+		"<components><component><id>a</id>"
+		"<releases><release version=\"1\"><description>"
+		"<p>a &gt; b</p><!-- </releases> -->"
+		"</description></release></releases>"
+		"</component></components>";
+	g_autoptr(AsNode) root = NULL;
+	g_autoptr(AsNode) root2 = NULL;
+	g_autoptr(GBytes) bytes = g_bytes_new_static (xml, strlen (xml));
+	g_autoptr(GBytes) raw = NULL;
+	g_autoptr(GError) error = NULL;
+
+	root = as_node_from_bytes (bytes,
+				   AS_NODE_FROM_XML_FLAG_LITERAL_TEXT |
+				   AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA,
+				   &error);
+	g_assert_no_error (error);
+	g_assert (root != NULL);
+
+	/* other children are parsed as normal */
+	n = as_node_find (root, "components/component/id");
+	g_assert (n != NULL);
+	g_assert_cmpstr (as_node_get_data (n), ==, "a");
+	g_assert (as_node_get_raw (n, NULL) == NULL);
+
+	/* the releases are kept as XML without any children */
+	n = as_node_find (root, "components/component/releases");
+	g_assert (n != NULL);
+	g_assert (n->children == NULL);
+	raw = g_bytes_ref (as_node_get_raw (n, &flags));
+	g_assert_cmpint (flags & AS_NODE_FROM_XML_FLAG_LITERAL_TEXT, !=, 0);
+	g_assert_cmpint (g_bytes_get_size (raw), ==,
+			 strlen (strstr (xml, "<releases>")) - strlen ("</component></components>"));
+
+	/* and can be parsed when the tree is gone */
+	g_clear_pointer (&root, as_node_unref);
+	root2 = as_node_from_bytes (raw, AS_NODE_FROM_XML_FLAG_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (root2 != NULL);
+	n = as_node_find (root2, "releases/release/description/p");
+	g_assert (n != NULL);
+	g_assert_cmpstr (as_node_get_data (n), ==, "a > b");
+
+	/* the element still has to be closed */
+	g_clear_pointer (&root2, as_node_unref);
+	g_clear_pointer (&bytes, g_bytes_unref);
+	bytes = g_bytes_new_static ("<component><releases><release/></component>", 43);
+	root2 = as_node_from_bytes (bytes, AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA, &error);
+	g_assert_error (error, AS_NODE_ERROR, AS_NODE_ERROR_FAILED);
+	g_assert (root2 == NULL);
+}
+
 static void
 as_test_node_func (void)
 {
@@ -2853,6 +2994,18 @@ as_test_node_func (void)
 	g_assert (n2 == NULL);
 	n2 = as_node_find (root, "apps//id");
 	g_assert (n2 == NULL);
+
+	/* free a subtree and reuse the memory for new nodes */
+	n2 = as_node_find (root, "apps/id");
+	as_node_unref (n2);
+	g_assert (as_node_find (root, "apps/id") == NULL);
+	g_assert_cmpint (g_node_n_nodes (root, G_TRAVERSE_ALL), ==, 2);
+	n2 = as_node_insert (n1, "name", "hal", 0, "xml:lang", "en_GB", NULL);
+	g_assert (n2 != NULL);
+	g_assert_cmpstr (as_node_get_data (n2), ==, "hal");
+	g_assert_cmpstr (as_node_get_attribute (n2, "xml:lang"), ==, "en_GB");
+	g_assert_cmpstr (as_node_get_attribute (n2, "enabled"), ==, NULL);
+	g_assert (as_node_find (root, "apps/name") == n2);
 }
 
 static void
@@ -2884,6 +3037,7 @@ as_test_node_xml_func (void)
 	AsNode *root;
 	GString *xml;
 	GHashTable *hashtable;
+	GBytes *bytes;
 
 	/* invalid XML */
 	root = as_node_from_xml ("<moo>", 0, &error);
@@ -2942,6 +3096,52 @@ as_test_node_xml_func (void)
 	g_string_free (xml, TRUE);
 	as_node_unref (root);
 
+	/* entities, character references and empty elements */
+	root = as_node_from_xml ("<foo><bar key='a &amp; b'/>"
+				 "<baz>&lt;x&gt; &#65;&#x42;</baz></foo>",
+				 0, &error);
+	g_assert_no_error (error);
+	g_assert (root != NULL);
+	n2 = as_node_find (root, "foo/bar");
+	g_assert (n2 != NULL);
+	g_assert_cmpstr (as_node_get_attribute (n2, "key"), ==, "a & b");
+	g_assert_cmpstr (as_node_get_data (n2), ==, NULL);
+	n2 = as_node_find (root, "foo/baz");
+	g_assert (n2 != NULL);
+	g_assert_cmpstr (as_node_get_data (n2), ==, "<x> AB");
+	as_node_unref (root);
+	root = as_node_from_xml ("<foo>&unknown;</foo>", 0, &error);
+	g_assert_error (error, AS_NODE_ERROR, AS_NODE_ERROR_FAILED);
+	g_assert (root == NULL);
+	g_clear_error (&error);
+	root = as_node_from_xml ("<foo key=\"value></foo>", 0, &error);
+	g_assert_error (error, AS_NODE_ERROR, AS_NODE_ERROR_FAILED);
+	g_assert (root == NULL);
+	g_clear_error (&error);
+
+	/* text referring to the source buffer */
+	bytes = g_bytes_new_take (g_strdup ("<foo><bar>a &gt; b</bar>"
+					    "<baz>c > d</baz>"
+					    "<qux> e\n f </qux>"
+					    "<p>g <em>h</em></p></foo>"), 82);
+	root = as_node_from_bytes (bytes, 0, &error);
+	g_bytes_unref (bytes);
+	g_assert_no_error (error);
+	g_assert (root != NULL);
+	n2 = as_node_find (root, "foo/bar");
+	g_assert_cmpstr (as_node_get_data (n2), ==, "a > b");
+	n2 = as_node_find (root, "foo/qux");
+	g_assert_cmpstr (as_node_get_data (n2), ==, "e f");
+	n2 = as_node_find (root, "foo/p");
+	g_assert_cmpstr (as_node_get_data (n2), ==, "g <em>h</em>");
+	n2 = as_node_find (root, "foo/baz");
+	xml = as_node_to_xml (n2, AS_NODE_TO_XML_FLAG_NONE);
+	g_assert_cmpstr (xml->str, ==, "<baz>c &gt; d</baz>");
+	g_string_free (xml, TRUE);
+	as_node_set_data (n2, "replaced", AS_NODE_INSERT_FLAG_NONE);
+	g_assert_cmpstr (as_node_get_data (n2), ==, "replaced");
+	as_node_unref (root);
+
 	/* support em and code tags */
 	root = as_node_from_xml (valid_em_code, 0, &error);
 	g_assert_no_error (error);
@@ -3123,6 +3323,70 @@ as_test_node_localized_func (void)
 	as_node_unref (root);
 }
 
+static gboolean
+as_test_node_stream_cb (AsNode *node, gpointer user_data, GError **error)
+{
+	guint *cnt = (guint *) user_data;
+	g_assert_cmpstr (as_node_get_name (node), ==, "component");
+	g_assert_cmpstr (as_node_get_data (as_node_find (node, "id")), ==,
+			 *cnt == 0 ? "one" : "two");
+	(*cnt)++;
+	return TRUE;
+}
+
+static gboolean
+as_test_node_stream_abort_cb (AsNode *node, gpointer user_data, GError **error)
+{
+	guint *cnt = (guint *) user_data;
+	(*cnt)++;
+	g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED, "abort");
+	return FALSE;
+}
+
+static void
+as_test_node_stream_func (void)
+{
+	AsNode *n;
+	gboolean ret;
+	guint cnt = 0;
+	const gchar *fn = "/tmp/as-test-node-stream.xml";
+	const gchar *xml =
+		"<components origin=\"fedora\">"
+		"<component><id>one</id></component>"
+		"<component><id>two</id></component>"
+		"</components>";
+	g_autoptr(AsNode) root = NULL;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file = g_file_new_for_path (fn);
+
+	ret = g_file_set_contents (fn, xml, -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	root = as_node_from_file_stream (file, AS_NODE_FROM_XML_FLAG_NONE, 3,
+					 as_test_node_stream_cb, &cnt,
+					 NULL, &error);
+	g_assert_no_error (error);
+	g_assert (root != NULL);
+	g_assert_cmpint (cnt, ==, 2);
+
+	/* the streamed nodes have been freed */
+	n = as_node_find (root, "components");
+	g_assert (n != NULL);
+	g_assert_cmpstr (as_node_get_attribute (n, "origin"), ==, "fedora");
+	g_assert (n->children == NULL);
+	g_clear_pointer (&root, as_node_unref);
+
+	/* the stream function can stop the parser */
+	cnt = 0;
+	root = as_node_from_file_stream (file, AS_NODE_FROM_XML_FLAG_NONE, 3,
+					 as_test_node_stream_abort_cb, &cnt,
+					 NULL, &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+	g_assert (root == NULL);
+	g_assert_cmpint (cnt, ==, 1);
+	(void)g_unlink (fn);
+}
+
 static void
 as_test_node_localized_wrap_func (void)
 {
@@ -3316,16 +3580,126 @@ as_test_app_screenshot_func (void)
 	g_assert_cmpint (as_screenshot_get_kind (ss), ==, AS_SCREENSHOT_KIND_NORMAL);
 }
 
+static gpointer
+as_test_profile_thread_cb (gpointer user_data)
+{
+	AsProfile *profile = AS_PROFILE (user_data);
+	g_autoptr(AsProfileTask) ptask = NULL;
+	ptask = as_profile_start_literal (profile, "thread");
+	return NULL;
+}
+
+static void
+as_test_profile_func (void)
+{
+	GThread *thread;
+	gboolean ret;
+	const gchar *fn = "/tmp/as-test-profile.json";
+	g_autofree gchar *data = NULL;
+	g_autoptr(AsProfile) profile = as_profile_new ();
+	g_autoptr(GError) error = NULL;
+
+	as_profile_clear (profile);
+	{
+		g_autoptr(AsProfileTask) ptask = NULL;
+		ptask = as_profile_start (profile, "parent{%s}", "\"quoted\"");
+		as_profile_task_set_threaded (ptask, TRUE);
+		thread = g_thread_new ("as-test-profile", as_test_profile_thread_cb, profile);
+		g_thread_join (thread);
+
+		/* the GThread may be reused, but this is a different thread */
+		thread = g_thread_new ("as-test-profile", as_test_profile_thread_cb, profile);
+		g_thread_join (thread);
+	}
+
+	/* each task is a complete event on its own thread */
+	ret = as_profile_export_json (profile, fn, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = g_file_get_contents (fn, &data, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert (g_str_has_prefix (data, "[\n{\"name\":\"thread_name\""));
+	g_assert (g_strstr_len (data, -1, "{\"name\":\"parent{\\\"quoted\\\"}\","
+				"\"cat\":\"threaded\",\"ph\":\"X\",\"pid\":1,\"tid\":1,") != NULL);
+	g_assert (g_strstr_len (data, -1, "{\"name\":\"thread\",\"cat\":\"default\","
+				"\"ph\":\"X\",\"pid\":1,\"tid\":2,") != NULL);
+	g_assert (g_strstr_len (data, -1, "{\"name\":\"thread\",\"cat\":\"default\","
+				"\"ph\":\"X\",\"pid\":1,\"tid\":3,") != NULL);
+	g_assert (g_str_has_suffix (data, "}\n]\n"));
+}
+
+static void
+as_test_stemmer_check (AsStemmer *stemmer, const gchar *value, const gchar *expected)
+{
+	g_autoptr(AsRefString) stem = as_stemmer_process (stemmer, value);
+	g_assert_cmpstr (stem, ==, expected);
+}
+
+static void
+as_test_stemmer_func (void)
+{
+	AsRefString *stem1;
+	AsRefString *stem2;
+	g_autoptr(AsStemmer) stemmer = as_stemmer_new_for_locale ("C");
+	g_autoptr(AsStemmer) stemmer_de = as_stemmer_new_for_locale ("de_DE.UTF-8");
+	g_autoptr(AsStemmer) stemmer_fr = as_stemmer_new_for_locale ("fr");
+	g_autoptr(AsStemmer) stemmer_default = NULL;
+
+	/* Porter */
+	as_test_stemmer_check (stemmer, "caresses", "caress");
+	as_test_stemmer_check (stemmer, "ponies", "poni");
+	as_test_stemmer_check (stemmer, "cats", "cat");
+	as_test_stemmer_check (stemmer, "agreed", "agre");
+	as_test_stemmer_check (stemmer, "hopping", "hop");
+	as_test_stemmer_check (stemmer, "filing", "file");
+	as_test_stemmer_check (stemmer, "happy", "happi");
+	as_test_stemmer_check (stemmer, "relational", "relat");
+	as_test_stemmer_check (stemmer, "generalization", "gener");
+	as_test_stemmer_check (stemmer, "adoption", "adopt");
+	as_test_stemmer_check (stemmer, "controlling", "control");
+	as_test_stemmer_check (stemmer, "Software", "softwar");
+	as_test_stemmer_check (stemmer, "is", "is");
+
+	/* not words */
+	as_test_stemmer_check (stemmer, "c++", "c++");
+	as_test_stemmer_check (stemmer, "x-planes", "x-planes");
+
+	/* light stemmers */
+	as_test_stemmer_check (stemmer_de, "Anwendungen", "anwendung");
+	as_test_stemmer_check (stemmer_de, "Bilder", "bild");
+	as_test_stemmer_check (stemmer_fr, "journaux", "journal");
+	as_test_stemmer_check (stemmer_fr, "éditrices", "éditric");
+
+	/* the same word is only stemmed once */
+	stem1 = as_stemmer_process (stemmer, "installing");
+	stem2 = as_stemmer_process (stemmer, "installing");
+	g_assert_cmpstr (stem1, ==, "instal");
+	g_assert (stem1 == stem2);
+	as_ref_string_unref (stem1);
+	as_ref_string_unref (stem2);
+
+	/* the default stemmer does not depend on the locale */
+	g_setenv ("LANGUAGE", "de", TRUE);
+	stemmer_default = as_stemmer_new ();
+	g_unsetenv ("LANGUAGE");
+	as_test_stemmer_check (stemmer_default, "relational", "relat");
+	as_test_stemmer_check (stemmer_default, "Bilder", "bilder");
+}
+
 static void
 as_test_app_search_func (void)
 {
 	const gchar *all[] = { "gnome", "install", "software", NULL };
 	const gchar *none[] = { "gnome", "xxx", "software", NULL };
 	const gchar *mime[] = { "application/vnd.oasis.opendocument.text", NULL };
+	guint32 id;
 	g_auto(GStrv) tokens = NULL;
 	g_autoptr(AsApp) app = NULL;
 	g_autoptr(GHashTable) search_blacklist = NULL;
 	g_autoptr(AsStemmer) stemmer = as_stemmer_new ();
+	g_autoptr(AsTokenDict) token_dict = as_token_dict_new ();
+	g_autoptr(AsRefString) rstr = NULL;
 
 	app = as_app_new ();
 	as_app_set_stemmer (app, stemmer);
@@ -3366,6 +3740,551 @@ as_test_app_search_func (void)
 
 	/* do not add short or common keywords */
 	g_assert_cmpint (as_app_search_matches (app, "and"), ==, 0);
+
+	/* moving to a shared dictionary keeps the matches */
+	rstr = as_ref_string_new ("unrelated");
+	as_token_dict_insert (token_dict, rstr);
+	as_app_set_token_dict (app, token_dict);
+	g_assert (as_app_get_token_dict (app) == token_dict);
+	g_assert_cmpint (as_token_dict_get_size (token_dict), >, 1);
+	g_assert_cmpint (as_app_search_matches (app, "software"), ==, 352);
+	g_assert_cmpint (as_app_search_matches (app, "soft"), ==, 88);
+	g_assert_cmpint (as_app_search_matches (app, "unrelated"), ==, 0);
+
+	/* get several tokens while holding the lock */
+	g_assert (as_token_dict_lookup (token_dict, "unrelated", &id));
+	as_token_dict_reader_lock (token_dict);
+	g_assert_cmpstr (as_token_dict_get_unlocked (token_dict, id), ==, "unrelated");
+	g_assert (as_token_dict_get_unlocked (token_dict, G_MAXUINT32) == NULL);
+	as_token_dict_reader_unlock (token_dict);
+}
+
+static void
+as_test_store_search_check (AsStore *store, const gchar *search, guint expected)
+{
+	GPtrArray *apps_all = as_store_get_apps (store);
+	guint cnt = 0;
+	g_auto(GStrv) tokens = as_utils_search_tokenize (search);
+	g_autoptr(GArray) scores = NULL;
+	g_autoptr(GPtrArray) apps = as_store_search (store, search);
+	g_autoptr(GPtrArray) apps_full = NULL;
+
+	/* the index has to agree with searching each app in turn */
+	for (guint i = 0; i < apps_all->len; i++) {
+		AsApp *app = g_ptr_array_index (apps_all, i);
+		if (tokens == NULL || as_app_search_matches_all (app, tokens) == 0)
+			continue;
+		g_assert (g_ptr_array_index (apps, cnt) == app);
+		cnt++;
+	}
+	g_assert_cmpint (apps->len, ==, cnt);
+	g_assert_cmpint (apps->len, ==, expected);
+
+	/* the same apps, with the best match first */
+	apps_full = as_store_search_full (store, search, 0, &scores);
+	g_assert_cmpint (apps_full->len, ==, expected);
+	g_assert_cmpint (scores->len, ==, expected);
+	for (guint i = 0; i < apps_full->len; i++) {
+		AsApp *app = g_ptr_array_index (apps_full, i);
+		guint score = g_array_index (scores, guint, i);
+		g_assert_cmpint (score >> 4, ==, as_app_search_matches_all (app, tokens));
+		if (i > 0)
+			g_assert_cmpint (score, <=, g_array_index (scores, guint, i - 1));
+	}
+}
+
+static void
+as_test_store_search_func (void)
+{
+	g_autoptr(AsApp) app1 = as_app_new ();
+	g_autoptr(AsApp) app2 = as_app_new ();
+	g_autoptr(AsApp) app3 = as_app_new ();
+	g_autoptr(AsStore) store = as_store_new ();
+
+	as_app_set_id (app1, "org.gnome.Software.desktop");
+	as_app_set_name (app1, NULL, "GNOME Software");
+	as_app_set_comment (app1, NULL, "Install and remove software");
+	as_store_add_app (store, app1);
+	as_app_set_id (app2, "org.gnome.Builder.desktop");
+	as_app_set_name (app2, NULL, "GNOME Builder");
+	as_app_set_comment (app2, NULL, "Develop software for GNOME");
+	as_store_add_app (store, app2);
+	as_app_set_id (app3, "org.inkscape.Inkscape.desktop");
+	as_app_set_name (app3, NULL, "Inkscape");
+	as_app_set_comment (app3, NULL, "Vector graphics editor");
+	as_store_add_app (store, app3);
+
+	as_test_store_search_check (store, "gnome", 2);
+	as_test_store_search_check (store, "gnome software", 2);
+	as_test_store_search_check (store, "install software", 1);
+	as_test_store_search_check (store, "soft", 2);
+	as_test_store_search_check (store, "inkscape", 1);
+	as_test_store_search_check (store, "vector graphics", 1);
+	as_test_store_search_check (store, "gnome xxx", 0);
+	as_test_store_search_check (store, "xxx", 0);
+	as_test_store_search_check (store, "a", 0);
+
+	/* the index is invalidated when the store changes */
+	as_store_remove_app (store, app2);
+	as_test_store_search_check (store, "gnome", 1);
+	as_store_add_app (store, app2);
+	as_test_store_search_check (store, "gnome", 2);
+
+	/* and when the tokens of an app change after it was added */
+	as_test_store_search_check (store, "drawing", 0);
+	as_app_add_keyword (app3, NULL, "Drawing");
+	as_test_store_search_check (store, "drawing", 1);
+
+	/* and when the fields that are tokenized change */
+	as_store_set_search_match (store, AS_APP_SEARCH_MATCH_NAME);
+	as_test_store_search_check (store, "install software", 0);
+	as_test_store_search_check (store, "gnome", 2);
+	as_store_set_search_match (store, AS_APP_SEARCH_MATCH_LAST);
+	as_test_store_search_check (store, "install software", 1);
+}
+
+static void
+as_test_store_search_prune_func (void)
+{
+	AsTokenDict *token_dict;
+	guint32 id;
+	guint size;
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autoptr(GPtrArray) apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+
+	for (guint i = 0; i < 3; i++) {
+		g_autofree gchar *id_app = g_strdup_printf ("org.example.App%u.desktop", i);
+		AsApp *app = as_app_new ();
+		as_app_set_id (app, id_app);
+		as_app_set_name (app, NULL, "Example");
+		as_app_add_keyword (app, NULL, i == 0 ? "zebra" : "rainbow");
+		as_store_add_app (store, app);
+		g_ptr_array_add (apps, app);
+	}
+	as_test_store_search_check (store, "zebra", 1);
+	token_dict = as_app_get_token_dict (g_ptr_array_index (apps, 2));
+	g_assert (as_token_dict_lookup (token_dict, "zebra", &id));
+	size = as_token_dict_get_size (token_dict);
+
+	/* removing one app keeps the dictionary */
+	as_store_remove_app (store, g_ptr_array_index (apps, 0));
+	g_assert (as_app_get_token_dict (g_ptr_array_index (apps, 2)) == token_dict);
+
+	/* once most apps are removed it only has the tokens still in use */
+	as_store_remove_app (store, g_ptr_array_index (apps, 1));
+	token_dict = as_app_get_token_dict (g_ptr_array_index (apps, 2));
+	g_assert (!as_token_dict_lookup (token_dict, "zebra", &id));
+	g_assert_cmpint (as_token_dict_get_size (token_dict), <, size);
+	as_test_store_search_check (store, "zebra", 0);
+	as_test_store_search_check (store, "rainbow", 1);
+	as_test_store_search_check (store, "example", 1);
+}
+
+static void
+as_test_store_search_locale_func (void)
+{
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autoptr(AsStore) store_de = as_store_new ();
+
+	/* English is the default */
+	g_assert_cmpstr (as_store_get_search_locale (store), ==, NULL);
+	as_store_set_search_locale (store_de, "de_DE.UTF-8");
+	g_assert_cmpstr (as_store_get_search_locale (store_de), ==, "de_DE.UTF-8");
+
+	/* the plural is only removed by the German stemmer */
+	for (guint i = 0; i < 2; i++) {
+		g_autoptr(AsApp) app = as_app_new ();
+		as_app_set_id (app, "org.example.Bilder.desktop");
+		as_app_set_name (app, NULL, "Bilder");
+		as_store_add_app (i == 0 ? store : store_de, app);
+	}
+	as_test_store_search_check (store, "bilder", 1);
+	as_test_store_search_check (store, "bildern", 0);
+	as_test_store_search_check (store_de, "bilder", 1);
+	as_test_store_search_check (store_de, "bildern", 1);
+
+	/* changing the locale stems the apps already in the store again */
+	as_store_set_search_locale (store, "de_DE.UTF-8");
+	as_test_store_search_check (store, "bilder", 1);
+	as_test_store_search_check (store, "bildern", 1);
+	as_store_set_search_locale (store_de, NULL);
+	as_test_store_search_check (store_de, "bilder", 1);
+	as_test_store_search_check (store_de, "bildern", 0);
+}
+
+/* writes 100 components, with an extra keyword on the first one */
+static void
+as_test_store_search_cache_write (const gchar *fn, const gchar *keyword)
+{
+	gboolean ret;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GString) xml = g_string_new ("<components version=\"0.9\">\n");
+
+	for (guint i = 0; i < 100; i++) {
+		g_string_append_printf (xml,
+					"<component type=\"desktop\">"
+					"<id>org.example.App%03u</id>"
+					"<name>%s</name>"
+					"<summary>Install and remove software</summary>",
+					i, i % 10 == 0 ? "Tenth Example" : "Example");
+		if (i == 0 && keyword != NULL) {
+			g_string_append_printf (xml,
+						"<keywords><keyword>%s</keyword></keywords>",
+						keyword);
+		}
+		g_string_append (xml, "</component>\n");
+	}
+	g_string_append (xml, "</components>\n");
+	ret = g_file_set_contents (fn, xml->str, -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+}
+
+static AsStore *
+as_test_store_search_cache_new (const gchar *cache_dir, const gchar *fn)
+{
+	AsStore *store = as_store_new ();
+	gboolean ret;
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file = g_file_new_for_path (fn);
+
+	as_store_set_search_cache_dir (store, cache_dir);
+	ret = as_store_from_file (store, file, NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	return store;
+}
+
+static void
+as_test_store_search_cache_func (void)
+{
+	const gchar *fn;
+	gboolean ret;
+	guint32 hdr[5];
+	guint n_files = 0;
+	g_autofree gchar *cache_dir = NULL;
+	g_autofree gchar *fn_cache = NULL;
+	g_autofree gchar *fn_xml = NULL;
+	g_autofree gchar *tmp_dir = NULL;
+	g_autoptr(AsApp) app = NULL;
+	g_autoptr(AsStore) store1 = NULL;
+	g_autoptr(AsStore) store2 = NULL;
+	g_autoptr(AsStore) store3 = NULL;
+	g_autoptr(AsStore) store4 = NULL;
+	g_autoptr(AsStore) store5 = NULL;
+	g_autoptr(AsStore) store6 = NULL;
+	g_autoptr(AsStore) store7 = NULL;
+	g_autoptr(AsStore) store8 = NULL;
+	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GError) error = NULL;
+
+	tmp_dir = g_dir_make_tmp ("as-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	g_assert (tmp_dir != NULL);
+	cache_dir = g_build_filename (tmp_dir, "cache", NULL);
+	fn_xml = g_build_filename (tmp_dir, "apps.xml", NULL);
+	as_test_store_search_cache_write (fn_xml, NULL);
+
+	/* the tokens are saved the first time */
+	store1 = as_test_store_search_cache_new (cache_dir, fn_xml);
+	as_store_load_search_cache (store1);
+	as_test_store_search_check (store1, "tenth", 10);
+	dir = g_dir_open (cache_dir, 0, &error);
+	g_assert_no_error (error);
+	g_assert (dir != NULL);
+	fn = g_dir_read_name (dir);
+	g_assert (fn != NULL);
+	g_assert (g_str_has_suffix (fn, ".cache"));
+	fn_cache = g_build_filename (cache_dir, fn, NULL);
+
+	/* and then give the same results */
+	store2 = as_test_store_search_cache_new (cache_dir, fn_xml);
+	as_store_load_search_cache (store2);
+	as_test_store_search_check (store2, "tenth", 10);
+	as_test_store_search_check (store2, "install software", 100);
+	as_test_store_search_check (store2, "exam", 100);
+
+	/* a store with different apps does not share the same file */
+	store3 = as_test_store_search_cache_new (cache_dir, fn_xml);
+	app = as_app_new ();
+	as_app_set_id (app, "org.example.Other");
+	as_app_set_name (app, NULL, "Other");
+	as_store_add_app (store3, app);
+	as_store_load_search_cache (store3);
+	as_test_store_search_check (store3, "tenth", 10);
+	as_test_store_search_check (store3, "other", 1);
+	g_dir_rewind (dir);
+	while (g_dir_read_name (dir) != NULL)
+		n_files++;
+	g_assert_cmpint (n_files, ==, 2);
+
+	/* nor does a store with different search settings */
+	store4 = as_test_store_search_cache_new (cache_dir, fn_xml);
+	as_store_set_search_match (store4, AS_APP_SEARCH_MATCH_NAME);
+	as_store_load_search_cache (store4);
+	as_test_store_search_check (store4, "tenth", 10);
+	as_test_store_search_check (store4, "install software", 0);
+
+	/* the saved tokens are not used once the source file changes */
+	as_test_store_search_cache_write (fn_xml, "zebra");
+	store5 = as_test_store_search_cache_new (cache_dir, fn_xml);
+	as_store_load_search_cache (store5);
+	as_test_store_search_check (store5, "zebra", 1);
+	as_test_store_search_check (store5, "tenth", 10);
+
+	/* even if the size is the same and the mtime has not moved on */
+	as_test_store_search_cache_write (fn_xml, "horse");
+	store8 = as_test_store_search_cache_new (cache_dir, fn_xml);
+	as_store_load_search_cache (store8);
+	as_test_store_search_check (store8, "horse", 1);
+	as_test_store_search_check (store8, "zebra", 0);
+
+	/* a header with impossible sizes is ignored rather than trusted */
+	memcpy (hdr, "ASSEARCH", 8);
+	hdr[2] = 2;
+	hdr[3] = G_MAXUINT32;
+	hdr[4] = G_MAXUINT32;
+	ret = g_file_set_contents (fn_cache, (const gchar *) hdr, sizeof (hdr), &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	store6 = as_test_store_search_cache_new (cache_dir, fn_xml);
+	as_store_load_search_cache (store6);
+	as_test_store_search_check (store6, "tenth", 10);
+
+	/* as is a file from an older version of the format */
+	hdr[2] = 1;
+	hdr[3] = 0;
+	hdr[4] = 0;
+	ret = g_file_set_contents (fn_cache, (const gchar *) hdr, sizeof (hdr), &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	store7 = as_test_store_search_cache_new (cache_dir, fn_xml);
+	as_store_load_search_cache (store7);
+	as_test_store_search_check (store7, "tenth", 10);
+}
+
+static void
+as_test_store_search_full_func (void)
+{
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autoptr(GArray) scores = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
+
+	/* enough apps to be searched in several threads */
+	for (guint i = 0; i < 10000; i++) {
+		g_autofree gchar *id = g_strdup_printf ("org.example.App%05u", i);
+		g_autoptr(AsApp) app = as_app_new ();
+		as_app_set_id (app, id);
+		as_app_set_name (app, NULL, i % 100 == 0 ? "Hundred" : "Example");
+		as_app_set_comment (app, NULL, i % 7 == 0 ? "Some hundred" : "Something else");
+		as_store_add_app (store, app);
+	}
+	as_test_store_search_check (store, "hundred", 100 + 1429 - 15);
+
+	/* only the best results, where the name matches */
+	apps = as_store_search_full (store, "hundred", 10, &scores);
+	g_assert_cmpint (apps->len, ==, 10);
+	g_assert_cmpint (scores->len, ==, 10);
+	g_assert_cmpstr (as_app_get_id (g_ptr_array_index (apps, 0)), ==, "org.example.App00000");
+	g_assert_cmpstr (as_app_get_id (g_ptr_array_index (apps, 1)), ==, "org.example.App00700");
+	g_assert_cmpstr (as_app_get_id (g_ptr_array_index (apps, 2)), ==, "org.example.App01400");
+	g_assert_cmpint (g_array_index (scores, guint, 0), >, g_array_index (scores, guint, 9));
+}
+
+static gpointer
+as_test_store_threads_cb (gpointer user_data)
+{
+	AsStore *store = AS_STORE (user_data);
+	for (guint i = 0; i < 1000; i++) {
+		g_autofree gchar *id = g_strdup_printf ("app%u.desktop", i % 100);
+		g_autofree gchar *pkgname = g_strdup_printf ("app%u", i % 100);
+		g_autoptr(GPtrArray) apps = NULL;
+		g_assert (as_store_get_app_by_id (store, id) != NULL);
+		g_assert (as_store_get_app_by_pkgname (store, pkgname) != NULL);
+		g_assert (as_store_get_app_by_provide (store, AS_PROVIDE_KIND_BINARY,
+						       pkgname) != NULL);
+		apps = as_store_search (store, pkgname);
+		g_assert_cmpint (apps->len, >=, 1);
+	}
+	return NULL;
+}
+
+static void
+as_test_store_threads_func (void)
+{
+	GThread *threads[8];
+	g_autoptr(AsStore) store = as_store_new ();
+
+	for (guint i = 0; i < 100; i++) {
+		g_autofree gchar *id = g_strdup_printf ("app%u.desktop", i);
+		g_autofree gchar *pkgname = g_strdup_printf ("app%u", i);
+		g_autoptr(AsApp) app = as_app_new ();
+		g_autoptr(AsProvide) provide = as_provide_new ();
+		as_app_set_id (app, id);
+		as_app_set_name (app, NULL, pkgname);
+		as_app_add_pkgname (app, pkgname);
+		as_provide_set_kind (provide, AS_PROVIDE_KIND_BINARY);
+		as_provide_set_value (provide, pkgname);
+		as_app_add_provide (app, provide);
+		as_store_add_app (store, app);
+	}
+
+	/* the lazily built indexes are shared by all the readers */
+	for (guint i = 0; i < G_N_ELEMENTS (threads); i++)
+		threads[i] = g_thread_new ("as-test-store", as_test_store_threads_cb, store);
+	for (guint i = 0; i < G_N_ELEMENTS (threads); i++)
+		g_thread_join (threads[i]);
+}
+
+static void
+as_test_store_cache_func (void)
+{
+	AsApp *app;
+	AsFormat *format;
+	gboolean ret;
+	const gchar *src = "/tmp/as-test-store-cache.xml";
+	const gchar *xml_src =
+		"<components origin=\"fedora\" version=\"0.8\">\n"
+		"<component type=\"desktop\">\n"
+		"<id>org.gnome.Software.desktop</id>\n"
+		"<pkgname>gnome-software</pkgname>\n"
+		"<name>Software</name>\n"
+		"<name xml:lang=\"de\">Anwendungen</name>\n"
+		"<description><p>Install &amp; remove software</p>"
+		"<ul><li>Updates</li></ul></description>\n"
+		"<keywords><keyword>Store</keyword></keywords>\n"
+		"<icon type=\"stock\">org.gnome.Software</icon>\n"
+		"<url type=\"homepage\">https://wiki.gnome.org/Apps/Software</url>\n"
+		"<provides><binary>gnome-software</binary></provides>\n"
+		"<releases><release version=\"3.28.0\" timestamp=\"1520000000\"/></releases>\n"
+		"</component>\n"
+		"<component type=\"desktop\" merge=\"append\">\n"
+		"<id>org.gnome.Builder.desktop</id>\n"
+		"<categories><category>Development</category></categories>\n"
+		"</component>\n"
+		"</components>\n";
+	g_autoptr(AsApp) app_merge = NULL;
+	g_autoptr(AsStore) store1 = as_store_new ();
+	g_autoptr(AsStore) store2 = as_store_new ();
+	g_autoptr(AsStore) store3 = as_store_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file_cache = g_file_new_for_path ("/tmp/as-test-store.cache");
+	g_autoptr(GFile) file_src = g_file_new_for_path (src);
+	g_autoptr(GString) xml1 = NULL;
+	g_autoptr(GString) xml2 = NULL;
+
+	/* load from XML and write the cache */
+	ret = g_file_set_contents (src, xml_src, -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = as_store_from_file (store1, file_src, NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	as_app_set_state (as_store_get_app_by_id (store1, "org.gnome.Software.desktop"),
+			  AS_APP_STATE_INSTALLED);
+	ret = as_store_to_cache (store1, file_cache, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* load from the cache */
+	ret = as_store_from_cache (store2, file_cache, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (as_store_get_size (store2), ==, 1);
+	app = as_store_get_app_by_id (store2, "org.gnome.Software.desktop");
+	g_assert (app != NULL);
+	g_assert_cmpstr (as_app_get_origin (app), ==, "fedora");
+	g_assert_cmpint (as_app_get_state (app), ==, AS_APP_STATE_INSTALLED);
+	g_assert_cmpstr (as_app_get_id_filename (app), ==, "org.gnome.Software");
+	g_assert_cmpstr (as_app_get_description (app, NULL), ==,
+			 as_app_get_description (as_store_get_app_by_id (store1, "org.gnome.Software.desktop"), NULL));
+	format = as_app_get_format_by_kind (app, AS_FORMAT_KIND_APPSTREAM);
+	g_assert (format != NULL);
+	g_assert_cmpstr (as_format_get_filename (format), ==, src);
+	g_assert_cmpstr (as_store_get_version (store2), ==, "0.8");
+	g_assert (as_store_get_app_by_provide (store2, AS_PROVIDE_KIND_BINARY,
+					       "gnome-software") == app);
+	g_assert_cmpint (as_app_get_releases(app)->len, ==, 1);
+	xml1 = as_store_to_xml (store1, AS_NODE_TO_XML_FLAG_NONE);
+	xml2 = as_store_to_xml (store2, AS_NODE_TO_XML_FLAG_NONE);
+	g_assert_cmpstr (xml1->str, ==, xml2->str);
+
+	/* the merge components are used for apps added later */
+	app_merge = as_app_new ();
+	as_app_set_id (app_merge, "org.gnome.Builder.desktop");
+	as_store_add_app (store2, app_merge);
+	g_assert (as_app_has_category (app_merge, "Development"));
+
+	/* the cache is invalid when the source changes */
+	ret = g_file_set_contents (src, "<components/>", -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = as_store_from_cache (store3, file_cache, NULL, &error);
+	g_assert_error (error, AS_STORE_ERROR, AS_STORE_ERROR_FAILED);
+	g_assert (!ret);
+	g_assert_cmpint (as_store_get_size (store3), ==, 0);
+	g_clear_error (&error);
+	(void)g_unlink (src);
+	(void)g_unlink ("/tmp/as-test-store.cache");
+}
+
+static void
+as_test_store_cache_dir_func (void)
+{
+	gboolean ret;
+	const gchar *desktop =
+		"[Desktop Entry]\n"
+		"Type=Application\n"
+		"Name=Test\n"
+		"Icon=test\n"
+		"Exec=test\n";
+	g_autofree gchar *fn_cache = NULL;
+	g_autofree gchar *fn_new = NULL;
+	g_autofree gchar *fn_old = NULL;
+	g_autofree gchar *tmpdir = NULL;
+	g_autoptr(AsStore) store1 = as_store_new ();
+	g_autoptr(AsStore) store2 = as_store_new ();
+	g_autoptr(AsStore) store3 = as_store_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file_cache = NULL;
+
+	tmpdir = g_dir_make_tmp ("as-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	g_assert (tmpdir != NULL);
+	fn_old = g_build_filename (tmpdir, "old.desktop", NULL);
+	fn_new = g_build_filename (tmpdir, "new.desktop", NULL);
+	fn_cache = g_strdup_printf ("%s.cache", tmpdir);
+	file_cache = g_file_new_for_path (fn_cache);
+	ret = g_file_set_contents (fn_old, desktop, -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+
+	/* the directory is part of the cache key */
+	ret = as_store_load_path (store1, tmpdir, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (as_store_get_size (store1), ==, 1);
+	ret = as_store_to_cache (store1, file_cache, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = as_store_from_cache (store2, file_cache, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	g_assert_cmpint (as_store_get_size (store2), ==, 1);
+
+	/* a file that did not exist when the cache was written */
+	ret = g_file_set_contents (fn_new, desktop, -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	ret = as_store_from_cache (store3, file_cache, NULL, &error);
+	g_assert_error (error, AS_STORE_ERROR, AS_STORE_ERROR_FAILED);
+	g_assert (!ret);
+	g_assert_cmpint (as_store_get_size (store3), ==, 0);
+
+	(void)g_unlink (fn_old);
+	(void)g_unlink (fn_new);
+	(void)g_unlink (fn_cache);
+	(void)g_rmdir (tmpdir);
 }
 
 /* load and save embedded icons */
@@ -4115,9 +5034,11 @@ as_test_store_provides_func (void)
 	AsApp *app;
 	gboolean ret;
 	g_autoptr(GError) error = NULL;
+	g_autoptr(AsProvide) provide = NULL;
 	g_autoptr(AsStore) store = NULL;
 	g_autoptr(GPtrArray) apps1 = NULL;
 	g_autoptr(GPtrArray) apps2 = NULL;
+	g_autoptr(GPtrArray) apps3 = NULL;
 
 	/* create a store and add a single app */
 	store = as_store_new ();
@@ -4158,6 +5079,73 @@ as_test_store_provides_func (void)
 					      AS_PROVIDE_KIND_FIRMWARE_FLASHED,
 					      "beefdead");
 	g_assert_cmpint (apps2->len, ==, 0);
+
+	/* the index is updated when apps are added and removed */
+	ret = as_store_from_xml (store,
+		"<components version=\"0.6\">"
+		"<component type=\"desktop\">"
+		"<id>test2.desktop</id>"
+		"<provides>"
+		"<firmware type=\"flashed\">beefdead</firmware>"
+		"</provides>"
+		"<launchable type=\"desktop-id\">test2.desktop</launchable>"
+		"</component>"
+		"</components>", NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	app = as_store_get_app_by_provide (store,
+					   AS_PROVIDE_KIND_FIRMWARE_FLASHED,
+					   "beefdead");
+	g_assert_cmpstr (as_app_get_id (app), ==, "test2.desktop");
+	app = as_store_get_app_by_launchable (store,
+					      AS_LAUNCHABLE_KIND_DESKTOP_ID,
+					      "test2.desktop");
+	g_assert_cmpstr (as_app_get_id (app), ==, "test2.desktop");
+	as_store_remove_app_by_id (store, "test2.desktop");
+	app = as_store_get_app_by_launchable (store,
+					      AS_LAUNCHABLE_KIND_DESKTOP_ID,
+					      "test2.desktop");
+	g_assert (app == NULL);
+	app = as_store_get_app_by_provide (store,
+					   AS_PROVIDE_KIND_FIRMWARE_FLASHED,
+					   "beefdead");
+	g_assert (app == NULL);
+
+	/* provides added after the app was added are indexed */
+	app = as_store_get_app_by_id (store, "test.desktop");
+	g_assert (app != NULL);
+	provide = as_provide_new ();
+	as_provide_set_kind (provide, AS_PROVIDE_KIND_FIRMWARE_FLASHED);
+	as_provide_set_value (provide, "cafecafe");
+	as_app_add_provide (app, provide);
+	app = as_store_get_app_by_provide (store,
+					   AS_PROVIDE_KIND_FIRMWARE_FLASHED,
+					   "cafecafe");
+	g_assert_cmpstr (as_app_get_id (app), ==, "test.desktop");
+
+	/* even when another app already had the same provide */
+	app = as_app_new ();
+	as_app_set_id (app, "test3.desktop");
+	as_store_add_app (store, app);
+	as_app_add_provide (app, provide);
+	g_object_unref (app);
+	apps3 = as_store_get_apps_by_provide (store,
+					      AS_PROVIDE_KIND_FIRMWARE_FLASHED,
+					      "cafecafe");
+	g_assert_cmpint (apps3->len, ==, 2);
+	app = as_store_get_app_by_provide (store,
+					   AS_PROVIDE_KIND_FIRMWARE_FLASHED,
+					   "cafecafe");
+	g_assert_cmpstr (as_app_get_id (app), ==, "test.desktop");
+
+	/* apps that were removed are no longer indexed */
+	as_store_remove_app_by_id (store, "test3.desktop");
+	g_assert_cmpint (as_store_get_size (store), ==, 1);
+	g_clear_pointer (&apps3, g_ptr_array_unref);
+	apps3 = as_store_get_apps_by_provide (store,
+					      AS_PROVIDE_KIND_FIRMWARE_FLASHED,
+					      "cafecafe");
+	g_assert_cmpint (apps3->len, ==, 1);
 }
 
 static void
@@ -4474,6 +5462,270 @@ as_test_store_speed_search_func (void)
 		}
 	}
 	g_print ("hot=%.2f ms: ", (g_timer_elapsed (timer, NULL) * 1000) / (gdouble) loops);
+
+	/* search using the store index */
+	g_timer_reset (timer);
+	for (i = 0; i < loops; i++) {
+		g_autoptr(GPtrArray) results = as_store_search (store, "xxx");
+		g_assert_cmpint (results->len, ==, 0);
+	}
+	g_print ("index=%.2f ms: ", (g_timer_elapsed (timer, NULL) * 1000) / (gdouble) loops);
+}
+
+static AsStore *
+as_test_store_load_parallel_new (const gchar *destdir, guint32 flags, guint max_threads)
+{
+	gboolean ret;
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autoptr(GError) error = NULL;
+
+	as_store_set_destdir (store, destdir);
+	as_store_set_max_threads (store, max_threads);
+	ret = as_store_load (store, flags, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	return g_steal_pointer (&store);
+}
+
+static void
+as_test_store_load_parallel_func (void)
+{
+	const gchar *destdir = "/tmp/as-test-parallel";
+	const gchar *xmls = "/tmp/as-test-parallel/usr/share/app-info/xmls";
+	guint32 flags = AS_STORE_LOAD_FLAG_APP_INFO_SYSTEM;
+	g_autoptr(AsStore) store1 = NULL;
+	g_autoptr(AsStore) store2 = NULL;
+	g_autoptr(AsStore) store3 = NULL;
+	g_autoptr(GString) xml1 = NULL;
+	g_autoptr(GString) xml2 = NULL;
+	g_autoptr(GString) xml3 = NULL;
+
+	/* the same component in several files with different priorities,
+	 * where every other file uses the origin from the filename */
+	(void)g_mkdir_with_parents (xmls, 0700);
+	for (guint i = 0; i < 8; i++) {
+		gboolean ret;
+		g_autofree gchar *fn = NULL;
+		g_autofree gchar *origin = NULL;
+		g_autofree gchar *xml = NULL;
+		g_autoptr(GError) error = NULL;
+		fn = g_strdup_printf ("%s/remote%u.xml", xmls, i);
+		if (i % 2 == 0)
+			origin = g_strdup_printf (" origin=\"remote%u\"", i);
+		xml = g_strdup_printf ("<components%s "
+				       "version=\"0.9\">"
+				       "<component type=\"desktop\" priority=\"%u\">"
+				       "<id>org.gnome.Software.desktop</id>"
+				       "<name>Software %u</name>"
+				       "</component>"
+				       "<component type=\"desktop\">"
+				       "<id>app%u.desktop</id>"
+				       "</component>"
+				       "<component type=\"desktop\" merge=\"append\">"
+				       "<id>org.gnome.Software.desktop</id>"
+				       "<keywords><keyword>key%u</keyword></keywords>"
+				       "</component>"
+				       "</components>",
+				       origin != NULL ? origin : "",
+				       i % 3, i, i, i);
+		ret = g_file_set_contents (fn, xml, -1, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+	}
+
+	/* the result has to be identical to loading each file in turn */
+	store1 = as_test_store_load_parallel_new (destdir, flags, 0);
+	store2 = as_test_store_load_parallel_new (destdir, flags | AS_STORE_LOAD_FLAG_PARALLEL, 0);
+	g_assert_cmpint (as_store_get_size (store1), ==, 9);
+	xml1 = as_store_to_xml (store1, AS_NODE_TO_XML_FLAG_NONE);
+	xml2 = as_store_to_xml (store2, AS_NODE_TO_XML_FLAG_NONE);
+	g_assert_cmpstr (xml1->str, ==, xml2->str);
+
+	/* and when limited to fewer threads than there are files */
+	store3 = as_test_store_load_parallel_new (destdir, flags | AS_STORE_LOAD_FLAG_PARALLEL, 2);
+	g_assert_cmpint (as_store_get_max_threads (store3), ==, 2);
+	xml3 = as_store_to_xml (store3, AS_NODE_TO_XML_FLAG_NONE);
+	g_assert_cmpstr (xml1->str, ==, xml3->str);
+	g_assert_cmpstr (as_app_get_origin (as_store_get_app_by_id (store2, "app1.desktop")), ==, "remote1");
+}
+
+static void
+as_test_store_lazy_func (void)
+{
+	AsApp *app;
+	AsRelease *rel;
+	gboolean ret;
+	const gchar *xml =
+		"<components version=\"0.9\">"
+		"<component type=\"desktop\">"
+		"<id>test.desktop</id>"
+		"<name>Test</name>"
+		"<description><p>Long description</p></description>"
+		"<screenshots><screenshot type=\"default\">"
+		"<image type=\"source\">http://a.png</image>"
+		"</screenshot></screenshots>"
+		"<content_rating type=\"oars-1.0\">"
+		"<content_attribute id=\"drugs-alcohol\">moderate</content_attribute>"
+		"</content_rating>"
+		"<releases>"
+		"<release version=\"1.2\" timestamp=\"1400000000\"/>"
+		"<release version=\"1.1\" timestamp=\"1300000000\"/>"
+		"</releases>"
+		"</component>"
+		"</components>";
+	g_autofree gchar *fn = NULL;
+	g_autofree gchar *tmpdir = NULL;
+	g_autoptr(AsStore) store1 = as_store_new ();
+	g_autoptr(AsStore) store2 = as_store_new ();
+	g_autoptr(AsStore) store3 = as_store_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GFile) file = NULL;
+	g_autoptr(GString) xml1 = NULL;
+	g_autoptr(GString) xml2 = NULL;
+	g_autoptr(GString) xml3 = NULL;
+
+	/* the deferred data is parsed when first used */
+	as_store_set_add_flags (store2, AS_STORE_ADD_FLAG_LAZY_PARSE);
+	ret = as_store_from_xml (store2, xml, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	app = as_store_get_app_by_id (store2, "test.desktop");
+	g_assert (app != NULL);
+	g_assert_cmpstr (as_app_get_name (app, NULL), ==, "Test");
+	rel = as_app_get_release_default (app);
+	g_assert (rel != NULL);
+	g_assert_cmpstr (as_release_get_version (rel), ==, "1.2");
+	g_assert_cmpint (as_app_get_releases(app)->len, ==, 2);
+	g_assert_cmpint (as_app_get_screenshots(app)->len, ==, 1);
+	g_assert_cmpint (as_app_get_content_ratings(app)->len, ==, 1);
+	g_assert_cmpstr (as_app_get_description (app, NULL), ==,
+			 "<p>Long description</p>");
+
+	/* the result has to be identical to parsing everything up front */
+	ret = as_store_from_xml (store1, xml, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	xml1 = as_store_to_xml (store1, AS_NODE_TO_XML_FLAG_NONE);
+	xml2 = as_store_to_xml (store2, AS_NODE_TO_XML_FLAG_NONE);
+	g_assert_cmpstr (xml1->str, ==, xml2->str);
+
+	/* files are kept in memory while anything is still deferred */
+	tmpdir = g_dir_make_tmp ("as-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	g_assert (tmpdir != NULL);
+	fn = g_build_filename (tmpdir, "lazy.xml", NULL);
+	ret = g_file_set_contents (fn, xml, -1, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	file = g_file_new_for_path (fn);
+	as_store_set_add_flags (store3, AS_STORE_ADD_FLAG_LAZY_PARSE);
+	ret = as_store_from_file (store3, file, NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_assert (ret);
+	(void)g_unlink (fn);
+	(void)g_rmdir (tmpdir);
+	app = as_store_get_app_by_id (store3, "test.desktop");
+	g_assert (app != NULL);
+	g_assert_cmpint (as_app_get_releases(app)->len, ==, 2);
+	xml3 = as_store_to_xml (store3, AS_NODE_TO_XML_FLAG_NONE);
+	g_assert_cmpstr (xml1->str, ==, xml3->str);
+}
+
+static void
+as_test_store_to_file_func (void)
+{
+	const gchar *names[] = { "store.xml", "store.xml.gz", NULL };
+	guint32 flags = AS_NODE_TO_XML_FLAG_ADD_HEADER |
+			AS_NODE_TO_XML_FLAG_FORMAT_MULTILINE |
+			AS_NODE_TO_XML_FLAG_FORMAT_INDENT;
+	g_autofree gchar *tmpdir = NULL;
+	g_autoptr(AsStore) store = as_store_new ();
+	g_autoptr(GError) error = NULL;
+	g_autoptr(GString) xml = NULL;
+
+	tmpdir = g_dir_make_tmp ("as-self-test-XXXXXX", &error);
+	g_assert_no_error (error);
+	g_assert (tmpdir != NULL);
+
+	/* an empty store is a single empty element */
+	xml = as_store_to_xml (store, AS_NODE_TO_XML_FLAG_NONE);
+	g_assert_cmpstr (xml->str, ==, "<components version=\"0.14\"/>");
+	g_string_free (g_steal_pointer (&xml), TRUE);
+
+	/* enough components that the output is written in several chunks */
+	as_store_set_origin (store, "test");
+	for (guint i = 0; i < 1000; i++) {
+		g_autofree gchar *id = g_strdup_printf ("app%04u.desktop", i);
+		g_autoptr(AsApp) app = as_app_new ();
+		as_app_set_id (app, id);
+		as_app_set_kind (app, AS_APP_KIND_DESKTOP);
+		as_app_set_name (app, NULL, "Name");
+		as_app_set_comment (app, NULL, "A summary that is long enough");
+		as_app_set_description (app, NULL, "<p>A &amp; B</p>");
+		as_store_add_app (store, app);
+	}
+	xml = as_store_to_xml (store, flags);
+	g_assert (xml->len > 64 * 1024);
+
+	/* components may be converted in several threads, but the result has
+	 * to be identical to converting one tree holding them all */
+	{
+		AsNode *node_apps;
+		g_autoptr(AsNode) root = as_node_new ();
+		g_autoptr(AsNodeContext) ctx = as_node_context_new ();
+		g_autoptr(GPtrArray) apps = as_store_dup_apps (store);
+		g_autoptr(GString) xml_serial = NULL;
+		g_autoptr(GString) xml_threaded = NULL;
+
+		as_node_context_set_version (ctx, "0.14");
+		as_node_context_set_output (ctx, AS_FORMAT_KIND_APPSTREAM);
+		node_apps = as_node_insert (root, "components", NULL, 0,
+					    "origin", "test",
+					    "version", "0.14",
+					    NULL);
+		for (guint i = 0; i < apps->len; i++) {
+			AsApp *app = g_ptr_array_index (apps, i);
+			as_app_node_insert (app, node_apps, ctx);
+		}
+		xml_serial = as_node_to_xml (root, flags);
+		g_assert_cmpstr (xml->str, ==, xml_serial->str);
+
+		/* several threads and batches, whatever the number of CPUs */
+		as_store_set_max_threads (store, 4);
+		xml_threaded = as_store_to_xml (store, flags);
+		g_assert_cmpstr (xml_threaded->str, ==, xml_serial->str);
+		as_store_set_max_threads (store, 0);
+	}
+
+	/* the file has to match the string exactly */
+	for (guint i = 0; names[i] != NULL; i++) {
+		gboolean ret;
+		g_autofree gchar *fn = g_build_filename (tmpdir, names[i], NULL);
+		AsApp *app;
+		g_autoptr(AsStore) store2 = as_store_new ();
+		g_autoptr(GFile) file = g_file_new_for_path (fn);
+
+		ret = as_store_to_file (store, file, flags, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		if (i == 0) {
+			g_autofree gchar *data = NULL;
+			ret = g_file_get_contents (fn, &data, NULL, &error);
+			g_assert_no_error (error);
+			g_assert (ret);
+			g_assert_cmpstr (data, ==, xml->str);
+		}
+		ret = as_store_from_file (store2, file, NULL, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (ret);
+		g_assert_cmpint (as_store_get_size (store2), ==, 1000);
+		app = as_store_get_app_by_id (store2, "app0999.desktop");
+		g_assert (app != NULL);
+		g_assert_cmpstr (as_app_get_description (app, NULL), ==,
+				 "<p>A &amp; B</p>");
+		(void)g_unlink (fn);
+	}
+	(void)g_rmdir (tmpdir);
 }
 
 static void
@@ -5868,6 +7120,7 @@ main (int argc, char **argv)
 	g_test_add_func ("/AppStream/app{launchable:fallback}", as_test_app_launchable_fallback_func);
 	g_test_add_func ("/AppStream/app{builder:gettext}", as_test_app_builder_gettext_func);
 	g_test_add_func ("/AppStream/app{builder:gettext-nodomain}", as_test_app_builder_gettext_nodomain_func);
+	g_test_add_func ("/AppStream/app{builder:gettext-files}", as_test_app_builder_gettext_files_func);
 	g_test_add_func ("/AppStream/app{builder:qt}", as_test_app_builder_qt_func);
 	g_test_add_func ("/AppStream/app{builder:qt-subdir}", as_test_app_builder_qt_subdir_func);
 	g_test_add_func ("/AppStream/app{translated}", as_test_app_translated_func);
@@ -5881,11 +7134,15 @@ main (int argc, char **argv)
 	g_test_add_func ("/AppStream/app{parse-file:desktop}", as_test_app_parse_file_desktop_func);
 	g_test_add_func ("/AppStream/app{no-markup}", as_test_app_no_markup_func);
 	g_test_add_func ("/AppStream/app{subsume}", as_test_app_subsume_func);
+	g_test_add_func ("/AppStream/profile", as_test_profile_func);
+	g_test_add_func ("/AppStream/stemmer", as_test_stemmer_func);
 	g_test_add_func ("/AppStream/app{search}", as_test_app_search_func);
 	g_test_add_func ("/AppStream/app{screenshot}", as_test_app_screenshot_func);
 	g_test_add_func ("/AppStream/markup{import-html}", as_test_markup_import_html);
 	g_test_add_func ("/AppStream/node", as_test_node_func);
 	g_test_add_func ("/AppStream/node{reflow}", as_test_node_reflow_text_func);
+	g_test_add_func ("/AppStream/node{unlink}", as_test_node_unlink_func);
+	g_test_add_func ("/AppStream/node{defer}", as_test_node_defer_func);
 	g_test_add_func ("/AppStream/node{xml}", as_test_node_xml_func);
 	g_test_add_func ("/AppStream/node{hash}", as_test_node_hash_func);
 	g_test_add_func ("/AppStream/node{no-dup-c}", as_test_node_no_dup_c_func);
@@ -5894,6 +7151,7 @@ main (int argc, char **argv)
 	g_test_add_func ("/AppStream/node{localized-wrap2}", as_test_node_localized_wrap2_func);
 	g_test_add_func ("/AppStream/node{intltool}", as_test_node_intltool_func);
 	g_test_add_func ("/AppStream/node{sort}", as_test_node_sort_func);
+	g_test_add_func ("/AppStream/node{stream}", as_test_node_stream_func);
 	g_test_add_func ("/AppStream/utils", as_test_utils_func);
 	g_test_add_func ("/AppStream/utils{markup-import}", as_test_utils_markup_import_func);
 	g_test_add_func ("/AppStream/utils{version}", as_test_utils_version_func);
@@ -5935,6 +7193,17 @@ main (int argc, char **argv)
 	g_test_add_func ("/AppStream/store{validate}", as_test_store_validate_func);
 	g_test_add_func ("/AppStream/store{embedded}", as_test_store_embedded_func);
 	g_test_add_func ("/AppStream/store{provides}", as_test_store_provides_func);
+	g_test_add_func ("/AppStream/store{search}", as_test_store_search_func);
+	g_test_add_func ("/AppStream/store{search-prune}", as_test_store_search_prune_func);
+	g_test_add_func ("/AppStream/store{search-locale}", as_test_store_search_locale_func);
+	g_test_add_func ("/AppStream/store{search-full}", as_test_store_search_full_func);
+	g_test_add_func ("/AppStream/store{search-cache}", as_test_store_search_cache_func);
+	g_test_add_func ("/AppStream/store{load-parallel}", as_test_store_load_parallel_func);
+	g_test_add_func ("/AppStream/store{lazy}", as_test_store_lazy_func);
+	g_test_add_func ("/AppStream/store{to-file}", as_test_store_to_file_func);
+	g_test_add_func ("/AppStream/store{threads}", as_test_store_threads_func);
+	g_test_add_func ("/AppStream/store{cache}", as_test_store_cache_func);
+	g_test_add_func ("/AppStream/store{cache-dir}", as_test_store_cache_dir_func);
 	g_test_add_func ("/AppStream/store{local-appdata}", as_test_store_local_appdata_func);
 	if (g_test_slow ()) {
 		g_test_add_func ("/AppStream/store{speed-appstream}", as_test_store_speed_appstream_func);
@@ -7,24 +7,473 @@
 
 #include "config.h"
 
+#include <string.h>
 #include <glib/gi18n.h>
 
 #include "as-stemmer.h"
 #include "as-ref-string.h"
 
+/* the number of recently stemmed words to remember */
+#define AS_STEMMER_CACHE_SIZE_MAX	50000
+
+typedef struct {
+	const gchar		*suffix;
+	const gchar		*replacement;	/* never longer than suffix */
+	const gchar		*preceding;	/* allowed chars before suffix */
+} AsStemmerRule;
+
+typedef struct {
+	const gchar		*lang;
+	guint			 min_stem;	/* in characters */
+	const AsStemmerRule	*steps[3];
+} AsStemmerLanguage;
+
+typedef struct {
+	gchar			*key;
+	AsRefString		*stem;
+	GList			 link;		/* in AsStemmer->lru */
+} AsStemmerItem;
+
 struct _AsStemmer
 {
 	GObject			 parent_instance;
+	const AsStemmerLanguage	*language;	/* NULL for English */
+	GMutex			 mutex;
+	GHashTable		*cache;		/* of gchar*:AsStemmerItem */
+	GQueue			 lru;		/* of AsStemmerItem, newest first */
 };
 
 G_DEFINE_TYPE (AsStemmer, as_stemmer, G_TYPE_OBJECT)
 
+/* Porter, "An algorithm for suffix stripping", 1980 */
+static const AsStemmerRule as_stemmer_porter_step2[] = {
+	{ "ational",	"ate",	NULL },
+	{ "tional",	"tion",	NULL },
+	{ "enci",	"ence",	NULL },
+	{ "anci",	"ance",	NULL },
+	{ "izer",	"ize",	NULL },
+	{ "bli",	"ble",	NULL },
+	{ "alli",	"al",	NULL },
+	{ "entli",	"ent",	NULL },
+	{ "eli",	"e",	NULL },
+	{ "ousli",	"ous",	NULL },
+	{ "ization",	"ize",	NULL },
+	{ "ation",	"ate",	NULL },
+	{ "ator",	"ate",	NULL },
+	{ "alism",	"al",	NULL },
+	{ "iveness",	"ive",	NULL },
+	{ "fulness",	"ful",	NULL },
+	{ "ousness",	"ous",	NULL },
+	{ "aliti",	"al",	NULL },
+	{ "iviti",	"ive",	NULL },
+	{ "biliti",	"ble",	NULL },
+	{ "logi",	"log",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_porter_step3[] = {
+	{ "icate",	"ic",	NULL },
+	{ "ative",	"",	NULL },
+	{ "alize",	"al",	NULL },
+	{ "iciti",	"ic",	NULL },
+	{ "ical",	"ic",	NULL },
+	{ "ful",	"",	NULL },
+	{ "ness",	"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_porter_step4[] = {
+	{ "al",		"",	NULL },
+	{ "ance",	"",	NULL },
+	{ "ence",	"",	NULL },
+	{ "er",		"",	NULL },
+	{ "ic",		"",	NULL },
+	{ "able",	"",	NULL },
+	{ "ible",	"",	NULL },
+	{ "ant",	"",	NULL },
+	{ "ement",	"",	NULL },
+	{ "ment",	"",	NULL },
+	{ "ent",	"",	NULL },
+	{ "ion",	"",	"st" },
+	{ "ou",		"",	NULL },
+	{ "ism",	"",	NULL },
+	{ "ate",	"",	NULL },
+	{ "iti",	"",	NULL },
+	{ "ous",	"",	NULL },
+	{ "ive",	"",	NULL },
+	{ "ize",	"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+/* light stemmers that only remove inflectional suffixes, after Savoy */
+static const AsStemmerRule as_stemmer_de_step1[] = {
+	{ "innen",	"in",	NULL },
+	{ "ungen",	"ung",	NULL },
+	{ "ern",	"",	NULL },
+	{ "em",		"",	NULL },
+	{ "en",		"",	NULL },
+	{ "er",		"",	NULL },
+	{ "es",		"",	NULL },
+	{ "e",		"",	NULL },
+	{ "s",		"",	"bdfghklmnrt" },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_fr_step1[] = {
+	{ "eaux",	"eau",	NULL },
+	{ "aux",	"al",	NULL },
+	{ "s",		"",	NULL },
+	{ "x",		"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_fr_step2[] = {
+	{ "euse",	"eux",	NULL },
+	{ "ière",	"ier",	NULL },
+	{ "ive",	"if",	NULL },
+	{ "ienne",	"ien",	NULL },
+	{ "enne",	"en",	NULL },
+	{ "ée",		"é",	NULL },
+	{ "e",		"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_es_step1[] = {
+	{ "ces",	"z",	NULL },
+	{ "es",		"",	NULL },
+	{ "s",		"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_es_step2[] = {
+	{ "a",		"",	NULL },
+	{ "o",		"",	NULL },
+	{ "e",		"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_it_step1[] = {
+	{ "chi",	"c",	NULL },
+	{ "ghi",	"g",	NULL },
+	{ "che",	"c",	NULL },
+	{ "ghe",	"g",	NULL },
+	{ "ii",		"i",	NULL },
+	{ "i",		"",	NULL },
+	{ "e",		"",	NULL },
+	{ "a",		"",	NULL },
+	{ "o",		"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_pt_step1[] = {
+	{ "ões",	"ão",	NULL },
+	{ "ães",	"ão",	NULL },
+	{ "ais",	"al",	NULL },
+	{ "éis",	"el",	NULL },
+	{ "óis",	"ol",	NULL },
+	{ "ns",		"m",	NULL },
+	{ "res",	"r",	NULL },
+	{ "s",		"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_nl_step1[] = {
+	{ "heden",	"heid",	NULL },
+	{ "ingen",	"ing",	NULL },
+	{ "en",		"",	NULL },
+	{ "s",		"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerRule as_stemmer_nl_step2[] = {
+	{ "e",		"",	NULL },
+	{ NULL,		NULL,	NULL }
+};
+
+static const AsStemmerLanguage as_stemmer_languages[] = {
+	{ "de",	4,	{ as_stemmer_de_step1, NULL, NULL } },
+	{ "fr",	3,	{ as_stemmer_fr_step1, as_stemmer_fr_step2, NULL } },
+	{ "es",	3,	{ as_stemmer_es_step1, as_stemmer_es_step2, NULL } },
+	{ "it",	3,	{ as_stemmer_it_step1, NULL, NULL } },
+	{ "pt",	3,	{ as_stemmer_pt_step1, as_stemmer_es_step2, NULL } },
+	{ "nl",	3,	{ as_stemmer_nl_step1, as_stemmer_nl_step2, NULL } },
+	{ NULL,	0,	{ NULL, NULL, NULL } }
+};
+
+typedef struct {
+	gchar			*b;		/* the word */
+	gint			 k;		/* offset of the last char */
+	gint			 j;		/* offset before the suffix */
+} AsStemmerPorter;
+
+static gboolean
+as_stemmer_porter_cons (AsStemmerPorter *z, gint i)
+{
+	switch (z->b[i]) {
+	case 'a':
+	case 'e':
+	case 'i':
+	case 'o':
+	case 'u':
+		return FALSE;
+	case 'y':
+		return i == 0 ? TRUE : !as_stemmer_porter_cons (z, i - 1);
+	default:
+		return TRUE;
+	}
+}
+
+/* the number of vowel-consonant sequences before the suffix */
+static gint
+as_stemmer_porter_m (AsStemmerPorter *z)
+{
+	gint n = 0;
+	gint i = 0;
+
+	while (TRUE) {
+		if (i > z->j)
+			return n;
+		if (!as_stemmer_porter_cons (z, i))
+			break;
+		i++;
+	}
+	i++;
+	while (TRUE) {
+		while (TRUE) {
+			if (i > z->j)
+				return n;
+			if (as_stemmer_porter_cons (z, i))
+				break;
+			i++;
+		}
+		i++;
+		n++;
+		while (TRUE) {
+			if (i > z->j)
+				return n;
+			if (!as_stemmer_porter_cons (z, i))
+				break;
+			i++;
+		}
+		i++;
+	}
+}
+
+static gboolean
+as_stemmer_porter_vowel_in_stem (AsStemmerPorter *z)
+{
+	for (gint i = 0; i <= z->j; i++) {
+		if (!as_stemmer_porter_cons (z, i))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static gboolean
+as_stemmer_porter_double_cons (AsStemmerPorter *z, gint i)
+{
+	if (i < 1)
+		return FALSE;
+	if (z->b[i] != z->b[i - 1])
+		return FALSE;
+	return as_stemmer_porter_cons (z, i);
+}
+
+/* consonant-vowel-consonant where the last is not w, x or y */
+static gboolean
+as_stemmer_porter_cvc (AsStemmerPorter *z, gint i)
+{
+	if (i < 2 ||
+	    !as_stemmer_porter_cons (z, i) ||
+	    as_stemmer_porter_cons (z, i - 1) ||
+	    !as_stemmer_porter_cons (z, i - 2))
+		return FALSE;
+	return z->b[i] != 'w' && z->b[i] != 'x' && z->b[i] != 'y';
+}
+
+static gboolean
+as_stemmer_porter_ends (AsStemmerPorter *z, const gchar *s)
+{
+	gint len = (gint) strlen (s);
+	if (len > z->k + 1)
+		return FALSE;
+	if (memcmp (z->b + z->k - len + 1, s, len) != 0)
+		return FALSE;
+	z->j = z->k - len;
+	return TRUE;
+}
+
+static void
+as_stemmer_porter_set_to (AsStemmerPorter *z, const gchar *s)
+{
+	gint len = (gint) strlen (s);
+	memmove (z->b + z->j + 1, s, len);
+	z->k = z->j + len;
+}
+
+/* only the longest matching suffix is considered */
+static void
+as_stemmer_porter_rules (AsStemmerPorter *z, const AsStemmerRule *rules, gint m_min)
+{
+	for (guint i = 0; rules[i].suffix != NULL; i++) {
+		if (!as_stemmer_porter_ends (z, rules[i].suffix))
+			continue;
+		if (rules[i].preceding != NULL &&
+		    (z->j < 0 || strchr (rules[i].preceding, z->b[z->j]) == NULL))
+			return;
+		if (as_stemmer_porter_m (z) > m_min)
+			as_stemmer_porter_set_to (z, rules[i].replacement);
+		return;
+	}
+}
+
+/* plurals and -ed or -ing */
+static void
+as_stemmer_porter_step1ab (AsStemmerPorter *z)
+{
+	if (z->b[z->k] == 's') {
+		if (as_stemmer_porter_ends (z, "sses"))
+			z->k -= 2;
+		else if (as_stemmer_porter_ends (z, "ies"))
+			as_stemmer_porter_set_to (z, "i");
+		else if (z->b[z->k - 1] != 's')
+			z->k--;
+	}
+	if (as_stemmer_porter_ends (z, "eed")) {
+		if (as_stemmer_porter_m (z) > 0)
+			z->k--;
+	} else if ((as_stemmer_porter_ends (z, "ed") ||
+		    as_stemmer_porter_ends (z, "ing")) &&
+		   as_stemmer_porter_vowel_in_stem (z)) {
+		z->k = z->j;
+		if (as_stemmer_porter_ends (z, "at")) {
+			as_stemmer_porter_set_to (z, "ate");
+		} else if (as_stemmer_porter_ends (z, "bl")) {
+			as_stemmer_porter_set_to (z, "ble");
+		} else if (as_stemmer_porter_ends (z, "iz")) {
+			as_stemmer_porter_set_to (z, "ize");
+		} else if (as_stemmer_porter_double_cons (z, z->k)) {
+			gchar ch = z->b[z->k--];
+			if (ch == 'l' || ch == 's' || ch == 'z')
+				z->k++;
+		} else {
+			z->j = z->k;
+			if (as_stemmer_porter_m (z) == 1 &&
+			    as_stemmer_porter_cvc (z, z->k)) {
+				as_stemmer_porter_set_to (z, "e");
+			}
+		}
+	}
+}
+
+/* terminal y to i when there is another vowel in the stem */
+static void
+as_stemmer_porter_step1c (AsStemmerPorter *z)
+{
+	if (as_stemmer_porter_ends (z, "y") && as_stemmer_porter_vowel_in_stem (z))
+		z->b[z->k] = 'i';
+}
+
+/* remove a final -e and change -ll to -l */
+static void
+as_stemmer_porter_step5 (AsStemmerPorter *z)
+{
+	z->j = z->k;
+	if (z->b[z->k] == 'e') {
+		gint a = as_stemmer_porter_m (z);
+		if (a > 1 || (a == 1 && !as_stemmer_porter_cvc (z, z->k - 1)))
+			z->k--;
+	}
+	if (z->b[z->k] == 'l' &&
+	    as_stemmer_porter_double_cons (z, z->k) &&
+	    as_stemmer_porter_m (z) > 1)
+		z->k--;
+}
+
+/* the word has to be lowercase ASCII */
+static void
+as_stemmer_porter (gchar *word)
+{
+	AsStemmerPorter z = { word, (gint) strlen (word) - 1, 0 };
+
+	/* too short */
+	if (z.k <= 1)
+		return;
+
+	as_stemmer_porter_step1ab (&z);
+	if (z.k > 0) {
+		as_stemmer_porter_step1c (&z);
+		as_stemmer_porter_rules (&z, as_stemmer_porter_step2, 0);
+		as_stemmer_porter_rules (&z, as_stemmer_porter_step3, 0);
+		as_stemmer_porter_rules (&z, as_stemmer_porter_step4, 1);
+		as_stemmer_porter_step5 (&z);
+	}
+	word[z.k + 1] = '\0';
+}
+
+/* the first matching rule in each step is applied */
+static void
+as_stemmer_light (const AsStemmerLanguage *language, GString *word)
+{
+	for (guint i = 0; i < G_N_ELEMENTS (language->steps); i++) {
+		const AsStemmerRule *rules = language->steps[i];
+		if (rules == NULL)
+			break;
+		for (guint j = 0; rules[j].suffix != NULL; j++) {
+			gsize len = strlen (rules[j].suffix);
+			const gchar *prev;
+			if (len >= word->len)
+				continue;
+			if (memcmp (word->str + word->len - len, rules[j].suffix, len) != 0)
+				continue;
+			if ((guint) g_utf8_strlen (word->str, (gssize) (word->len - len)) < language->min_stem)
+				break;
+			prev = g_utf8_find_prev_char (word->str, word->str + word->len - len);
+			if (rules[j].preceding != NULL &&
+			    (prev == NULL || strchr (rules[j].preceding, *prev) == NULL))
+				break;
+			g_string_truncate (word, word->len - len);
+			g_string_append (word, rules[j].replacement);
+			break;
+		}
+	}
+}
+
+static AsRefString *
+as_stemmer_stem (AsStemmer *stemmer, const gchar *value)
+{
+	gboolean is_ascii = TRUE;
+	g_autofree gchar *value_casefold = NULL;
+	g_autoptr(GString) word = NULL;
+
+	/* only stem words and not things like 'c++' or 'x-plane' */
+	value_casefold = g_utf8_casefold (value, -1);
+	word = g_string_new (value_casefold);
+	for (const gchar *tmp = word->str; *tmp != '\0'; tmp = g_utf8_next_char (tmp)) {
+		gunichar ch = g_utf8_get_char (tmp);
+		if (!g_unichar_isalpha (ch))
+			return as_ref_string_new_with_length (word->str, word->len);
+		if (ch > 0x7f)
+			is_ascii = FALSE;
+	}
+
+	if (stemmer->language != NULL) {
+		as_stemmer_light (stemmer->language, word);
+	} else if (is_ascii) {
+		as_stemmer_porter (word->str);
+		g_string_set_size (word, strlen (word->str));
+	}
+	return as_ref_string_new_with_length (word->str, word->len);
+}
+
 /**
  * as_stemmer_process:
  * @stemmer: A #AsStemmer
  * @value: The input string
  *
- * Stems a string using the Porter algorithm.
+ * Stems a string using the Porter algorithm for English, or a light stemmer
+ * that removes the plural and gender suffixes for some other languages.
+ * Recently stemmed words are remembered and are not stemmed again.
  *
  * Since: 0.2.2
  *
@@ -33,25 +482,120 @@ G_DEFINE_TYPE (AsStemmer, as_stemmer, G_TYPE_OBJECT)
 AsRefString *
 as_stemmer_process (AsStemmer *stemmer, const gchar *value)
 {
-	g_autofree gchar *value_casefold = NULL;
-	value_casefold = g_utf8_casefold (value, -1);
-	return as_ref_string_new (value_casefold);
+	AsStemmerItem *item;
+	AsRefString *stem;
+
+	/* already stemmed */
+	g_mutex_lock (&stemmer->mutex);
+	item = g_hash_table_lookup (stemmer->cache, value);
+	if (item != NULL) {
+		g_queue_unlink (&stemmer->lru, &item->link);
+		g_queue_push_head_link (&stemmer->lru, &item->link);
+		stem = as_ref_string_ref (item->stem);
+		g_mutex_unlock (&stemmer->mutex);
+		return stem;
+	}
+	g_mutex_unlock (&stemmer->mutex);
+
+	/* do not hold the lock while stemming */
+	stem = as_stemmer_stem (stemmer, value);
+
+	/* another thread may have added the same word */
+	g_mutex_lock (&stemmer->mutex);
+	if (g_hash_table_lookup (stemmer->cache, value) == NULL) {
+		item = g_new0 (AsStemmerItem, 1);
+		item->key = g_strdup (value);
+		item->stem = as_ref_string_ref (stem);
+		item->link.data = item;
+		g_hash_table_insert (stemmer->cache, item->key, item);
+		g_queue_push_head_link (&stemmer->lru, &item->link);
+
+		/* forget the least recently used word */
+		if (stemmer->lru.length > AS_STEMMER_CACHE_SIZE_MAX) {
+			GList *link = g_queue_pop_tail_link (&stemmer->lru);
+			AsStemmerItem *item_old = link->data;
+			g_hash_table_remove (stemmer->cache, item_old->key);
+		}
+	}
+	g_mutex_unlock (&stemmer->mutex);
+	return stem;
+}
+
+static void
+as_stemmer_item_free (AsStemmerItem *item)
+{
+	g_free (item->key);
+	as_ref_string_unref (item->stem);
+	g_free (item);
+}
+
+static void
+as_stemmer_finalize (GObject *object)
+{
+	AsStemmer *stemmer = AS_STEMMER (object);
+
+	g_hash_table_unref (stemmer->cache);
+	g_mutex_clear (&stemmer->mutex);
+
+	G_OBJECT_CLASS (as_stemmer_parent_class)->finalize (object);
 }
 
 static void
 as_stemmer_class_init (AsStemmerClass *klass)
 {
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = as_stemmer_finalize;
 }
 
 static void
 as_stemmer_init (AsStemmer *stemmer)
 {
+	g_mutex_init (&stemmer->mutex);
+	g_queue_init (&stemmer->lru);
+	stemmer->cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+						NULL, (GDestroyNotify) as_stemmer_item_free);
+}
+
+static const AsStemmerLanguage *
+as_stemmer_language_find (const gchar *locale)
+{
+	for (guint i = 0; as_stemmer_languages[i].lang != NULL; i++) {
+		const gchar *lang = as_stemmer_languages[i].lang;
+		gsize len = strlen (lang);
+		if (strncmp (locale, lang, len) != 0)
+			continue;
+		if (locale[len] == '\0' || locale[len] == '_' ||
+		    locale[len] == '.' || locale[len] == '@')
+			return &as_stemmer_languages[i];
+	}
+	return NULL;
+}
+
+/**
+ * as_stemmer_new_for_locale:
+ * @locale: A locale, e.g. "de_DE.UTF-8"
+ *
+ * Creates a new #AsStemmer for a specific locale. Locales without a light
+ * stemmer use the Porter algorithm.
+ *
+ * Returns: (transfer full): a #AsStemmer
+ *
+ * Since: 0.8.5
+ **/
+AsStemmer *
+as_stemmer_new_for_locale (const gchar *locale)
+{
+	AsStemmer *stemmer = g_object_new (AS_TYPE_STEMMER, NULL);
+	if (locale != NULL)
+		stemmer->language = as_stemmer_language_find (locale);
+	return AS_STEMMER (stemmer);
 }
 
 /**
  * as_stemmer_new:
  *
- * Creates a new #AsStemmer.
+ * Creates a new #AsStemmer using the English Porter algorithm, whatever the
+ * current locale. Use as_stemmer_new_for_locale() for other languages.
  *
  * Returns: (transfer full): a #AsStemmer
  *
@@ -60,6 +604,5 @@ as_stemmer_init (AsStemmer *stemmer)
 AsStemmer *
 as_stemmer_new (void)
 {
-	AsStemmer *stemmer = g_object_new (AS_TYPE_STEMMER, NULL);
-	return AS_STEMMER (stemmer);
+	return as_stemmer_new_for_locale (NULL);
 }
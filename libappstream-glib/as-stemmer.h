@@ -18,6 +18,7 @@ G_BEGIN_DECLS
 G_DECLARE_FINAL_TYPE (AsStemmer, as_stemmer, AS, STEMMER, GObject)
 
 AsStemmer	*as_stemmer_new			(void);
+AsStemmer	*as_stemmer_new_for_locale	(const gchar	*locale);
 AsRefString	*as_stemmer_process		(AsStemmer	*stemmer,
 						 const gchar	*value);
 
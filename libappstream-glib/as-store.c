@@ -23,6 +23,8 @@
 
 #include "config.h"
 
+#include <string.h>
+
 #include "as-app-private.h"
 #include "as-node-private.h"
 #include "as-problem.h"
@@ -30,13 +32,15 @@
 #include "as-monitor.h"
 #include "as-ref-string.h"
 #include "as-stemmer.h"
-#include "as-store.h"
 #include "as-utils-private.h"
 #include "as-yaml.h"
 #include "as-store-cab.h"
 
 #define AS_API_VERSION_NEWEST	"0.14"
 
+#define AS_STORE_CACHE_VERSION	4
+#define AS_STORE_CACHE_TYPE	"(umsmsmsa(stt)a" AS_APP_VARIANT_TYPE "a" AS_APP_VARIANT_TYPE ")"
+
 typedef enum {
 	AS_STORE_PROBLEM_NONE			= 0,
 	AS_STORE_PROBLEM_LEGACY_ROOT		= 1 << 0,
@@ -54,11 +58,19 @@ typedef struct
 	GHashTable		*hash_merge_id;	/* of GPtrArray of AsApp{id} */
 	GHashTable		*hash_unique_id;	/* of AsApp{unique_id} */
 	GHashTable		*hash_pkgname;	/* of AsApp{pkgname} */
-	GMutex			 mutex;
+	GHashTable		*hash_provide;	/* of GPtrArray of AsApp{kind:value} */
+	GHashTable		*hash_launchable; /* of GPtrArray of AsApp{kind:value} */
+	GHashTable		*hash_index_keys; /* of AsStoreIndexEntry{AsApp} */
+	GHashTable		*hash_index_dirty; /* of AsApp, changed since indexed */
+	GMutex			 index_dirty_mutex;
+	GRWLock			 rw_lock;
+	GMutex			 index_mutex;	/* for building indexes when reading */
+	GMutex			 to_xml_mutex;	/* converting apps sorts their arrays */
 	AsMonitor		*monitor;
 	GHashTable		*metadata_indexes;	/* GHashTable{key} */
 	GHashTable		*appinfo_dirs;	/* GHashTable{path:AsStorePathData} */
 	GHashTable		*search_blacklist;	/* GHashTable{AsRefString:1} */
+	GHashTable		*cache_sources;	/* GHashTable{filename} */
 	guint32			 add_flags;
 	guint32			 watch_flags;
 	guint32			 problems;
@@ -68,6 +80,14 @@ typedef struct
 	gboolean		 is_pending_changed_signal;
 	AsProfile		*profile;
 	AsStemmer		*stemmer;
+	gchar			*search_locale;
+	AsTokenDict		*token_dict;	/* shared by all the apps */
+	guint			 token_dict_removed; /* apps since it was created */
+	gchar			*search_cache_dir;
+	GPtrArray		*search_index;	/* of AsStoreSearchToken, sorted */
+	GArray			*search_index_generations; /* of guint, per app */
+	GThreadPool		*search_pool;	/* of AsStoreSearchSlice */
+	guint			 max_threads;	/* or 0 for one per CPU */
 } AsStorePrivate;
 
 typedef struct {
@@ -75,6 +95,22 @@ typedef struct {
 	gchar			*arch;
 } AsStorePathData;
 
+typedef struct {
+	AsStore			*store;
+	AsApp			*app;
+	GPtrArray		*keys;		/* of provide and launchable keys */
+} AsStoreIndexEntry;
+
+typedef struct {
+	guint			 idx;		/* into priv->array */
+	guint16			 match;		/* AsAppTokenType */
+} AsStoreSearchHit;
+
+typedef struct {
+	AsRefString		*token;
+	GArray			*hits;		/* of AsStoreSearchHit */
+} AsStoreSearchToken;
+
 G_DEFINE_TYPE_WITH_PRIVATE (AsStore, as_store, G_TYPE_OBJECT)
 
 enum {
@@ -89,6 +125,39 @@ static guint signals [SIGNAL_LAST] = { 0 };
 
 #define GET_PRIVATE(o) (as_store_get_instance_private (o))
 
+/* like GRWLockReaderLocker and GRWLockWriterLocker, which need GLib 2.62 */
+typedef void AsStoreReaderLocker;
+typedef void AsStoreWriterLocker;
+
+static inline AsStoreReaderLocker *
+as_store_reader_locker_new (GRWLock *rw_lock)
+{
+	g_rw_lock_reader_lock (rw_lock);
+	return (AsStoreReaderLocker *) rw_lock;
+}
+
+static inline void
+as_store_reader_locker_free (AsStoreReaderLocker *locker)
+{
+	g_rw_lock_reader_unlock ((GRWLock *) locker);
+}
+
+static inline AsStoreWriterLocker *
+as_store_writer_locker_new (GRWLock *rw_lock)
+{
+	g_rw_lock_writer_lock (rw_lock);
+	return (AsStoreWriterLocker *) rw_lock;
+}
+
+static inline void
+as_store_writer_locker_free (AsStoreWriterLocker *locker)
+{
+	g_rw_lock_writer_unlock ((GRWLock *) locker);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AsStoreReaderLocker, as_store_reader_locker_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (AsStoreWriterLocker, as_store_writer_locker_free)
+
 /**
  * as_store_error_quark:
  *
@@ -113,6 +182,9 @@ as_store_finalize (GObject *object)
 	AsStore *store = AS_STORE (object);
 	AsStorePrivate *priv = GET_PRIVATE (store);
 
+	/* stop watching the apps while they are still alive */
+	g_hash_table_unref (priv->hash_index_keys);
+
 	g_free (priv->destdir);
 	g_free (priv->origin);
 	g_free (priv->builder_id);
@@ -121,6 +193,9 @@ as_store_finalize (GObject *object)
 	g_object_unref (priv->monitor);
 	g_object_unref (priv->profile);
 	g_object_unref (priv->stemmer);
+	g_free (priv->search_locale);
+	g_object_unref (priv->token_dict);
+	g_free (priv->search_cache_dir);
 	g_hash_table_unref (priv->hash_id);
 	g_hash_table_unref (priv->hash_merge_id);
 	g_hash_table_unref (priv->hash_unique_id);
@@ -128,7 +203,20 @@ as_store_finalize (GObject *object)
 	g_hash_table_unref (priv->metadata_indexes);
 	g_hash_table_unref (priv->appinfo_dirs);
 	g_hash_table_unref (priv->search_blacklist);
-	g_mutex_clear (&priv->mutex);
+	g_hash_table_unref (priv->cache_sources);
+	if (priv->search_index != NULL)
+		g_ptr_array_unref (priv->search_index);
+	if (priv->search_index_generations != NULL)
+		g_array_unref (priv->search_index_generations);
+	if (priv->search_pool != NULL)
+		g_thread_pool_free (priv->search_pool, FALSE, TRUE);
+	g_hash_table_unref (priv->hash_provide);
+	g_hash_table_unref (priv->hash_launchable);
+	g_hash_table_unref (priv->hash_index_dirty);
+	g_rw_lock_clear (&priv->rw_lock);
+	g_mutex_clear (&priv->index_mutex);
+	g_mutex_clear (&priv->index_dirty_mutex);
+	g_mutex_clear (&priv->to_xml_mutex);
 
 	G_OBJECT_CLASS (as_store_parent_class)->finalize (object);
 }
@@ -254,6 +342,38 @@ as_store_changed_uninhibit_cb (void *v)
 
 #define _cleanup_uninhibit_ __attribute__ ((cleanup(as_store_changed_uninhibit_cb)))
 
+/* must be called with the priv->rw_lock writer lock held */
+static void
+as_store_invalidate_indexes (AsStore *store)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_clear_pointer (&priv->search_index, g_ptr_array_unref);
+	g_clear_pointer (&priv->search_index_generations, g_array_unref);
+}
+
+/* tokens are never removed from the dictionary, so once more apps have been
+ * removed than are left it is rebuilt from the remaining apps; must be
+ * called with the priv->rw_lock writer lock held */
+static void
+as_store_prune_token_dict (AsStore *store, guint removed)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_autoptr(AsTokenDict) token_dict = NULL;
+
+	priv->token_dict_removed += removed;
+	if (priv->token_dict_removed <= priv->array->len)
+		return;
+	priv->token_dict_removed = 0;
+
+	/* removed apps keep using the old dictionary */
+	token_dict = as_token_dict_new ();
+	for (guint i = 0; i < priv->array->len; i++) {
+		AsApp *app = g_ptr_array_index (priv->array, i);
+		as_app_set_token_dict (app, token_dict);
+	}
+	g_set_object (&priv->token_dict, token_dict);
+}
+
 static GPtrArray *
 _dup_app_array (GPtrArray *array)
 {
@@ -328,11 +448,11 @@ guint
 as_store_get_size (AsStore *store)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), 0);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 	return priv->array->len;
 }
 
@@ -350,11 +470,11 @@ GPtrArray *
 as_store_get_apps (AsStore *store)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 	return priv->array;
 }
 
@@ -373,11 +493,11 @@ as_store_dup_apps (AsStore *store)
 {
 
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 	return _dup_app_array (priv->array);
 }
 
@@ -393,16 +513,23 @@ void
 as_store_remove_all (AsStore *store)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	g_autoptr(GMutexLocker) locker = NULL;
+	guint removed;
+	g_autoptr(AsStoreWriterLocker) locker = NULL;
 
 	g_return_if_fail (AS_IS_STORE (store));
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_writer_locker_new (&priv->rw_lock);
+	removed = priv->array->len;
+	g_hash_table_remove_all (priv->hash_index_keys);
 	g_ptr_array_set_size (priv->array, 0);
+	as_store_prune_token_dict (store, removed);
 	g_hash_table_remove_all (priv->hash_id);
 	g_hash_table_remove_all (priv->hash_merge_id);
 	g_hash_table_remove_all (priv->hash_unique_id);
 	g_hash_table_remove_all (priv->hash_pkgname);
+	g_hash_table_remove_all (priv->hash_provide);
+	g_hash_table_remove_all (priv->hash_launchable);
+	as_store_invalidate_indexes (store);
 }
 
 static void
@@ -464,13 +591,14 @@ as_store_get_apps_by_metadata (AsStore *store,
 	GHashTable *index;
 	GPtrArray *apps;
 	guint i;
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 
 	/* do we have this indexed? */
+	g_mutex_lock (&priv->index_mutex);
 	index = g_hash_table_lookup (priv->metadata_indexes, key);
 	if (index != NULL) {
 		if (g_hash_table_size (index) == 0) {
@@ -478,10 +606,12 @@ as_store_get_apps_by_metadata (AsStore *store,
 			index = g_hash_table_lookup (priv->metadata_indexes, key);
 		}
 		apps = g_hash_table_lookup (index, value);
-		if (apps != NULL)
-			return _dup_app_array (apps);
-		return g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+		apps = apps != NULL ? _dup_app_array (apps) :
+			g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+		g_mutex_unlock (&priv->index_mutex);
+		return apps;
 	}
+	g_mutex_unlock (&priv->index_mutex);
 
 	/* find all the apps with this specific metadata key */
 	apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
@@ -512,11 +642,11 @@ as_store_get_apps_by_id (AsStore *store, const gchar *id)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
 	GPtrArray *apps;
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 
 	apps = g_hash_table_lookup (priv->hash_id, id);
 	if (apps != NULL)
@@ -539,11 +669,11 @@ GPtrArray *
 as_store_get_apps_by_id_merge (AsStore *store, const gchar *id)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 	return g_hash_table_lookup (priv->hash_merge_id, id);
 }
 
@@ -563,11 +693,11 @@ as_store_dup_apps_by_id_merge (AsStore *store, const gchar *id)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
 	GPtrArray *apps;
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 
 	apps = g_hash_table_lookup (priv->hash_merge_id, id);
 	if (apps != NULL)
@@ -591,11 +721,11 @@ void
 as_store_add_metadata_index (AsStore *store, const gchar *key)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreWriterLocker) locker = NULL;
 
 	g_return_if_fail (AS_IS_STORE (store));
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_writer_locker_new (&priv->rw_lock);
 	as_store_regen_metadata_index_key (store, key);
 }
 
@@ -618,11 +748,11 @@ as_store_get_app_by_id (AsStore *store, const gchar *id)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
 	GPtrArray *apps;
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 	apps = g_hash_table_lookup (priv->hash_id, id);
 	if (apps == NULL)
 		return NULL;
@@ -669,7 +799,7 @@ as_store_get_app_by_app (AsStore *store, AsApp *app)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
 	guint i;
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->mutex);
+	g_autoptr(AsStoreReaderLocker) locker = as_store_reader_locker_new (&priv->rw_lock);
 
 	for (i = 0; i < priv->array->len; i++) {
 		AsApp *app_tmp = g_ptr_array_index (priv->array, i);
@@ -705,7 +835,7 @@ as_store_get_app_by_unique_id (AsStore *store,
 
 	/* no globs */
 	if ((search_flags & AS_STORE_SEARCH_FLAG_USE_WILDCARDS) == 0) {
-		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->mutex);
+		g_autoptr(AsStoreReaderLocker) locker = as_store_reader_locker_new (&priv->rw_lock);
 		return g_hash_table_lookup (priv->hash_unique_id, unique_id);
 	}
 
@@ -716,6 +846,246 @@ as_store_get_app_by_unique_id (AsStore *store,
 	return as_store_get_app_by_app (store, app_tmp);
 }
 
+/* the first character is 'p' for provides and 'l' for launchables */
+static gchar *
+as_store_index_key (gchar prefix, guint kind, const gchar *value)
+{
+	return g_strdup_printf ("%c%u:%s", prefix, kind, value);
+}
+
+static GHashTable *
+as_store_index_get_hash (AsStore *store, const gchar *key)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	return key[0] == 'p' ? priv->hash_provide : priv->hash_launchable;
+}
+
+/* called with the AsApp watcher lock held, perhaps by a thread that already
+ * holds priv->rw_lock, so the app is only reindexed on the next lookup */
+static void
+as_store_app_provides_changed_cb (AsApp *app, gpointer user_data)
+{
+	AsStore *store = (AsStore *) user_data;
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_mutex_lock (&priv->index_dirty_mutex);
+	g_hash_table_add (priv->hash_index_dirty, app);
+	g_mutex_unlock (&priv->index_dirty_mutex);
+}
+
+static void
+as_store_index_entry_free (AsStoreIndexEntry *entry)
+{
+	AsStorePrivate *priv = GET_PRIVATE (entry->store);
+	as_app_remove_provides_watcher (entry->app,
+					as_store_app_provides_changed_cb,
+					entry->store);
+	g_mutex_lock (&priv->index_dirty_mutex);
+	g_hash_table_remove (priv->hash_index_dirty, entry->app);
+	g_mutex_unlock (&priv->index_dirty_mutex);
+	g_ptr_array_unref (entry->keys);
+	g_free (entry);
+}
+
+static gboolean
+as_store_index_keys_contains (GPtrArray *keys, const gchar *key)
+{
+	if (keys == NULL)
+		return FALSE;
+	for (guint i = 0; i < keys->len; i++) {
+		if (g_strcmp0 (g_ptr_array_index (keys, i), key) == 0)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* must be called with the priv->rw_lock writer lock held */
+static void
+as_store_index_remove_app (AsStore *store, AsApp *app)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	AsStoreIndexEntry *entry = g_hash_table_lookup (priv->hash_index_keys, app);
+
+	if (entry == NULL)
+		return;
+	for (guint i = 0; i < entry->keys->len; i++) {
+		const gchar *key = g_ptr_array_index (entry->keys, i);
+		GHashTable *hash = as_store_index_get_hash (store, key);
+		GPtrArray *apps = g_hash_table_lookup (hash, key);
+		if (apps == NULL)
+			continue;
+		g_ptr_array_remove (apps, app);
+		if (apps->len == 0)
+			g_hash_table_remove (hash, key);
+	}
+	g_hash_table_remove (priv->hash_index_keys, app);
+}
+
+/* adds or refreshes the provide and launchable entries for an app in the
+ * store, keeping the existing entries where they are so the first app in each
+ * bucket is still the first one that was added;
+ * must be called with the priv->rw_lock writer lock held */
+static void
+as_store_index_add_app (AsStore *store, AsApp *app)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	AsStoreIndexEntry *entry;
+	GPtrArray *keys_old = NULL;
+	GPtrArray *launchables = as_app_get_launchables (app);
+	GPtrArray *provides = as_app_get_provides (app);
+	g_autoptr(GPtrArray) keys = g_ptr_array_new_with_free_func (g_free);
+
+	for (guint i = 0; i < provides->len; i++) {
+		AsProvide *tmp = g_ptr_array_index (provides, i);
+		gchar *key;
+		if (as_provide_get_value (tmp) == NULL)
+			continue;
+		key = as_store_index_key ('p', as_provide_get_kind (tmp),
+					  as_provide_get_value (tmp));
+		if (as_store_index_keys_contains (keys, key)) {
+			g_free (key);
+			continue;
+		}
+		g_ptr_array_add (keys, key);
+	}
+	for (guint i = 0; i < launchables->len; i++) {
+		AsLaunchable *tmp = g_ptr_array_index (launchables, i);
+		gchar *key;
+		if (as_launchable_get_value (tmp) == NULL)
+			continue;
+		key = as_store_index_key ('l', as_launchable_get_kind (tmp),
+					  as_launchable_get_value (tmp));
+		if (as_store_index_keys_contains (keys, key)) {
+			g_free (key);
+			continue;
+		}
+		g_ptr_array_add (keys, key);
+	}
+
+	/* drop anything the app no longer has */
+	entry = g_hash_table_lookup (priv->hash_index_keys, app);
+	if (entry != NULL)
+		keys_old = entry->keys;
+	for (guint i = 0; keys_old != NULL && i < keys_old->len; i++) {
+		const gchar *key = g_ptr_array_index (keys_old, i);
+		GHashTable *hash;
+		GPtrArray *apps;
+		if (as_store_index_keys_contains (keys, key))
+			continue;
+		hash = as_store_index_get_hash (store, key);
+		apps = g_hash_table_lookup (hash, key);
+		if (apps == NULL)
+			continue;
+		g_ptr_array_remove (apps, app);
+		if (apps->len == 0)
+			g_hash_table_remove (hash, key);
+	}
+
+	/* append anything new */
+	for (guint i = 0; i < keys->len; i++) {
+		const gchar *key = g_ptr_array_index (keys, i);
+		GHashTable *hash;
+		GPtrArray *apps;
+		if (as_store_index_keys_contains (keys_old, key))
+			continue;
+		hash = as_store_index_get_hash (store, key);
+		apps = g_hash_table_lookup (hash, key);
+		if (apps == NULL) {
+			apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+			g_hash_table_insert (hash, g_strdup (key), apps);
+		}
+		g_ptr_array_add (apps, g_object_ref (app));
+	}
+
+	/* the app tells the store about any provides added later */
+	if (entry == NULL) {
+		entry = g_new0 (AsStoreIndexEntry, 1);
+		entry->store = store;
+		entry->app = app;
+		g_hash_table_insert (priv->hash_index_keys, app, entry);
+		as_app_add_provides_watcher (app,
+					     as_store_app_provides_changed_cb,
+					     store);
+	} else {
+		g_ptr_array_unref (entry->keys);
+	}
+	entry->keys = g_steal_pointer (&keys);
+}
+
+/* reindexes the apps that have gained provides or launchables since they
+ * were indexed; must be called without the priv->rw_lock held */
+static void
+as_store_index_flush (AsStore *store)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	GHashTableIter iter;
+	gpointer key;
+	guint dirty;
+	g_autoptr(GHashTable) apps = NULL;
+
+	g_mutex_lock (&priv->index_dirty_mutex);
+	dirty = g_hash_table_size (priv->hash_index_dirty);
+	g_mutex_unlock (&priv->index_dirty_mutex);
+	if (dirty == 0)
+		return;
+
+	/* apps are removed from the dirty set when they leave the index, which
+	 * needs the writer lock, so these are all still in the store */
+	g_rw_lock_writer_lock (&priv->rw_lock);
+	g_mutex_lock (&priv->index_dirty_mutex);
+	apps = priv->hash_index_dirty;
+	priv->hash_index_dirty = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_mutex_unlock (&priv->index_dirty_mutex);
+	g_hash_table_iter_init (&iter, apps);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		as_store_index_add_app (store, AS_APP (key));
+	g_rw_lock_writer_unlock (&priv->rw_lock);
+}
+
+/* keep the same order as priv->array after it has been sorted;
+ * must be called with the priv->rw_lock writer lock held */
+static void
+as_store_index_sort (AsStore *store, GCompareFunc func)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init (&iter, priv->hash_provide);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		g_ptr_array_sort ((GPtrArray *) value, func);
+	g_hash_table_iter_init (&iter, priv->hash_launchable);
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+		g_ptr_array_sort ((GPtrArray *) value, func);
+}
+
+/**
+ * as_store_reindex_app:
+ * @store: a #AsStore instance.
+ * @app: a #AsApp that is already in the store.
+ *
+ * Updates the provide and launchable indexes for an application that has had
+ * provides or launchables removed since it was added to the store.
+ *
+ * Provides and launchables that are added to the application are indexed
+ * automatically the next time the store is searched for one.
+ *
+ * Since: 0.8.5
+ **/
+void
+as_store_reindex_app (AsStore *store, AsApp *app)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_autoptr(AsStoreWriterLocker) locker = NULL;
+
+	g_return_if_fail (AS_IS_STORE (store));
+	g_return_if_fail (AS_IS_APP (app));
+
+	locker = as_store_writer_locker_new (&priv->rw_lock);
+	if (!g_hash_table_contains (priv->hash_index_keys, app))
+		return;
+	as_store_index_add_app (store, app);
+}
+
 /**
  * as_store_get_app_by_provide:
  * @store: a #AsStore instance.
@@ -731,35 +1101,24 @@ as_store_get_app_by_unique_id (AsStore *store,
 AsApp *
 as_store_get_app_by_provide (AsStore *store, AsProvideKind kind, const gchar *value)
 {
-	AsApp *app;
-	AsProvide *tmp;
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	guint i;
-	guint j;
-	GPtrArray *provides;
-	g_autoptr(GMutexLocker) locker = NULL;
+	GPtrArray *apps;
+	g_autofree gchar *key = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 	g_return_val_if_fail (kind != AS_PROVIDE_KIND_UNKNOWN, NULL);
 	g_return_val_if_fail (value != NULL, NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	as_store_index_flush (store);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 
 	/* find an application that provides something */
-	for (i = 0; i < priv->array->len; i++) {
-		app = g_ptr_array_index (priv->array, i);
-		provides = as_app_get_provides (app);
-		for (j = 0; j < provides->len; j++) {
-			tmp = g_ptr_array_index (provides, j);
-			if (kind != as_provide_get_kind (tmp))
-				continue;
-			if (g_strcmp0 (as_provide_get_value (tmp), value) != 0)
-				continue;
-			return app;
-		}
-	}
-	return NULL;
-
+	key = as_store_index_key ('p', kind, value);
+	apps = g_hash_table_lookup (priv->hash_provide, key);
+	if (apps == NULL)
+		return NULL;
+	return g_ptr_array_index (apps, 0);
 }
 
 /**
@@ -778,28 +1137,22 @@ AsApp *
 as_store_get_app_by_launchable (AsStore *store, AsLaunchableKind kind, const gchar *value)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	g_autoptr(GMutexLocker) locker = NULL;
+	GPtrArray *apps;
+	g_autofree gchar *key = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 	g_return_val_if_fail (kind != AS_LAUNCHABLE_KIND_UNKNOWN, NULL);
 	g_return_val_if_fail (value != NULL, NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
-
-	for (guint i = 0; i < priv->array->len; i++) {
-		AsApp *app = g_ptr_array_index (priv->array, i);
-		GPtrArray *launchables = as_app_get_launchables (app);
-		for (guint j = 0; j < launchables->len; j++) {
-			AsLaunchable *tmp = g_ptr_array_index (launchables, j);
-			if (kind != as_launchable_get_kind (tmp))
-				continue;
-			if (g_strcmp0 (as_launchable_get_value (tmp), value) != 0)
-				continue;
-			return app;
-		}
-	}
-	return NULL;
+	as_store_index_flush (store);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 
+	key = as_store_index_key ('l', kind, value);
+	apps = g_hash_table_lookup (priv->hash_launchable, key);
+	if (apps == NULL)
+		return NULL;
+	return g_ptr_array_index (apps, 0);
 }
 
 /**
@@ -818,29 +1171,23 @@ GPtrArray *
 as_store_get_apps_by_provide (AsStore *store, AsProvideKind kind, const gchar *value)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	GPtrArray *apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
-	g_autoptr(GMutexLocker) locker = NULL;
+	GPtrArray *apps;
+	g_autofree gchar *key = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 	g_return_val_if_fail (kind != AS_PROVIDE_KIND_UNKNOWN, NULL);
 	g_return_val_if_fail (value != NULL, NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	as_store_index_flush (store);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 
 	/* find an application that provides something */
-	for (guint i = 0; i < priv->array->len; i++) {
-		AsApp *app = g_ptr_array_index (priv->array, i);
-		GPtrArray *provides = as_app_get_provides (app);
-		for (guint j = 0; j < provides->len; j++) {
-			AsProvide *tmp = g_ptr_array_index (provides, j);
-			if (kind != as_provide_get_kind (tmp))
-				continue;
-			if (g_strcmp0 (as_provide_get_value (tmp), value) != 0)
-				continue;
-			g_ptr_array_add (apps, g_object_ref (app));
-		}
-	}
-	return apps;
+	key = as_store_index_key ('p', kind, value);
+	apps = g_hash_table_lookup (priv->hash_provide, key);
+	if (apps == NULL)
+		return g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	return _dup_app_array (apps);
 }
 
 /**
@@ -860,12 +1207,12 @@ as_store_get_app_by_id_ignore_prefix (AsStore *store, const gchar *id)
 	AsApp *app;
 	AsStorePrivate *priv = GET_PRIVATE (store);
 	guint i;
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 	g_return_val_if_fail (id != NULL, NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 
 	/* find an application that provides something */
 	for (i = 0; i < priv->array->len; i++) {
@@ -1060,11 +1407,11 @@ as_store_get_app_by_pkgname (AsStore *store, const gchar *pkgname)
 	AsApp *app;
 	AsStorePrivate *priv = GET_PRIVATE (store);
 	guint i;
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_reader_locker_new (&priv->rw_lock);
 
 	/* in most cases, we can use the cache */
 	app = g_hash_table_lookup (priv->hash_pkgname, pkgname);
@@ -1105,7 +1452,7 @@ as_store_get_app_by_pkgnames (AsStore *store, gchar **pkgnames)
 	g_return_val_if_fail (pkgnames != NULL, NULL);
 
 	for (i = 0; pkgnames[i] != NULL; i++) {
-		g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->mutex);
+		g_autoptr(AsStoreReaderLocker) locker = as_store_reader_locker_new (&priv->rw_lock);
 		app = g_hash_table_lookup (priv->hash_pkgname, pkgnames[i]);
 		if (app != NULL)
 			return app;
@@ -1134,7 +1481,7 @@ as_store_remove_app (AsStore *store, AsApp *app)
 	g_signal_emit (store, signals[SIGNAL_APP_REMOVED], 0, app);
 
 	/* only remove this specific unique app */
-	g_mutex_lock (&priv->mutex);
+	g_rw_lock_writer_lock (&priv->rw_lock);
 	apps = g_hash_table_lookup (priv->hash_id, as_app_get_id (app));
 	if (apps != NULL) {
 		g_ptr_array_remove (apps, app);
@@ -1146,9 +1493,12 @@ as_store_remove_app (AsStore *store, AsApp *app)
 	}
 
 	g_hash_table_remove (priv->hash_unique_id, as_app_get_unique_id (app));
-	g_ptr_array_remove (priv->array, app);
+	as_store_index_remove_app (store, app);
+	if (g_ptr_array_remove (priv->array, app))
+		as_store_prune_token_dict (store, 1);
 	g_hash_table_remove_all (priv->metadata_indexes);
-	g_mutex_unlock (&priv->mutex);
+	as_store_invalidate_indexes (store);
+	g_rw_lock_writer_unlock (&priv->rw_lock);
 
 	/* removed */
 	as_store_perhaps_emit_changed (store, "remove-app");
@@ -1167,16 +1517,17 @@ void
 as_store_remove_app_by_id (AsStore *store, const gchar *id)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
+	guint removed = 0;
 	g_autoptr(GPtrArray) apps = NULL;
 
 	g_return_if_fail (AS_IS_STORE (store));
 
-	g_mutex_lock (&priv->mutex);
+	g_rw_lock_writer_lock (&priv->rw_lock);
 	if (!g_hash_table_remove (priv->hash_id, id)) {
-		g_mutex_unlock (&priv->mutex);
+		g_rw_lock_writer_unlock (&priv->rw_lock);
 		return;
 	}
-	g_mutex_unlock (&priv->mutex);
+	g_rw_lock_writer_unlock (&priv->rw_lock);
 
 	apps = as_store_dup_apps (store);
 	for (guint i = 0; i < apps->len; i++) {
@@ -1188,15 +1539,19 @@ as_store_remove_app_by_id (AsStore *store, const gchar *id)
 		/* emit before removal */
 		g_signal_emit (store, signals[SIGNAL_APP_REMOVED], 0, app);
 
-		g_mutex_lock (&priv->mutex);
-		g_ptr_array_remove (priv->array, app);
+		g_rw_lock_writer_lock (&priv->rw_lock);
+		as_store_index_remove_app (store, app);
+		if (g_ptr_array_remove (priv->array, app))
+			removed++;
 		g_hash_table_remove (priv->hash_unique_id,
 				     as_app_get_unique_id (app));
-		g_mutex_unlock (&priv->mutex);
+		g_rw_lock_writer_unlock (&priv->rw_lock);
 	}
-	g_mutex_lock (&priv->mutex);
+	g_rw_lock_writer_lock (&priv->rw_lock);
+	as_store_prune_token_dict (store, removed);
 	g_hash_table_remove_all (priv->metadata_indexes);
-	g_mutex_unlock (&priv->mutex);
+	as_store_invalidate_indexes (store);
+	g_rw_lock_writer_unlock (&priv->rw_lock);
 
 	/* removed */
 	as_store_perhaps_emit_changed (store, "remove-app-by-id");
@@ -1303,7 +1658,7 @@ as_store_add_app (AsStore *store, AsApp *app)
 		AsAppMergeKind merge_kind = as_app_get_merge_kind (app);
 		g_autoptr(GPtrArray) apps_changed = NULL;
 
-		g_mutex_lock (&priv->mutex);
+		g_rw_lock_writer_lock (&priv->rw_lock);
 		apps = g_hash_table_lookup (priv->hash_merge_id, id);
 		if (apps == NULL) {
 			apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
@@ -1315,7 +1670,7 @@ as_store_add_app (AsStore *store, AsApp *app)
 			 as_app_merge_kind_to_string (merge_kind),
 			 as_app_get_unique_id (app));
 		g_ptr_array_add (apps, g_object_ref (app));
-		g_mutex_unlock (&priv->mutex);
+		g_rw_lock_writer_unlock (&priv->rw_lock);
 
 		/* apply to existing components */
 		flags |= AS_APP_SUBSUME_FLAG_NO_OVERWRITE;
@@ -1324,7 +1679,7 @@ as_store_add_app (AsStore *store, AsApp *app)
 
 		apps_changed = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 
-		g_mutex_lock (&priv->mutex);
+		g_rw_lock_writer_lock (&priv->rw_lock);
 		for (i = 0; i < priv->array->len; i++) {
 			AsApp *app_tmp = g_ptr_array_index (priv->array, i);
 			if (g_strcmp0 (as_app_get_id (app_tmp), id) != 0)
@@ -1333,9 +1688,12 @@ as_store_add_app (AsStore *store, AsApp *app)
 				 as_app_merge_kind_to_string (merge_kind),
 				 id, as_app_get_unique_id (app_tmp));
 			as_app_subsume_full (app_tmp, app, flags);
+			as_store_index_add_app (store, app_tmp);
 			g_ptr_array_add (apps_changed, g_object_ref (app_tmp));
 		}
-		g_mutex_unlock (&priv->mutex);
+		if (apps_changed->len > 0)
+			as_store_invalidate_indexes (store);
+		g_rw_lock_writer_unlock (&priv->rw_lock);
 		for (i = 0; i < apps_changed->len; i++) {
 			AsApp *app_tmp = g_ptr_array_index (apps_changed, i);
 			/* emit after changes have been made */
@@ -1346,7 +1704,7 @@ as_store_add_app (AsStore *store, AsApp *app)
 	}
 
 	/* is there any merge components to add to this app */
-	g_mutex_lock (&priv->mutex);
+	g_rw_lock_reader_lock (&priv->rw_lock);
 	apps = g_hash_table_lookup (priv->hash_merge_id, id);
 	if (apps != NULL) {
 		for (i = 0; i < apps->len; i++) {
@@ -1363,17 +1721,17 @@ as_store_add_app (AsStore *store, AsApp *app)
 			as_app_subsume_full (app, app_tmp, flags);
 		}
 	}
-	g_mutex_unlock (&priv->mutex);
+	g_rw_lock_reader_unlock (&priv->rw_lock);
 
 	/* find the item */
 	if (priv->add_flags & AS_STORE_ADD_FLAG_USE_UNIQUE_ID) {
 		item = as_store_get_app_by_app (store, app);
 	} else {
-		g_mutex_lock (&priv->mutex);
+		g_rw_lock_reader_lock (&priv->rw_lock);
 		apps = g_hash_table_lookup (priv->hash_id, id);
 		if (apps != NULL && apps->len > 0)
 			item = g_ptr_array_index (apps, 0);
-		g_mutex_unlock (&priv->mutex);
+		g_rw_lock_reader_unlock (&priv->rw_lock);
 	}
 	if (item != NULL) {
 		AsFormat *app_format = as_app_get_format_default (app);
@@ -1419,6 +1777,10 @@ as_store_add_app (AsStore *store, AsApp *app)
 				as_app_subsume_full (app, item,
 						     AS_APP_SUBSUME_FLAG_BOTH_WAYS |
 						     AS_APP_SUBSUME_FLAG_DEDUPE);
+				g_rw_lock_writer_lock (&priv->rw_lock);
+				as_store_index_add_app (store, item);
+				as_store_invalidate_indexes (store);
+				g_rw_lock_writer_unlock (&priv->rw_lock);
 				return;
 			}
 			if (as_format_get_kind (app_format) == AS_FORMAT_KIND_DESKTOP &&
@@ -1429,6 +1791,10 @@ as_store_add_app (AsStore *store, AsApp *app)
 				as_app_subsume_full (app, item,
 						     AS_APP_SUBSUME_FLAG_BOTH_WAYS |
 						     AS_APP_SUBSUME_FLAG_DEDUPE);
+				g_rw_lock_writer_lock (&priv->rw_lock);
+				as_store_index_add_app (store, item);
+				as_store_invalidate_indexes (store);
+				g_rw_lock_writer_unlock (&priv->rw_lock);
 				return;
 			}
 
@@ -1485,6 +1851,10 @@ as_store_add_app (AsStore *store, AsApp *app)
 				as_app_subsume_full (app, item,
 						     AS_APP_SUBSUME_FLAG_BOTH_WAYS |
 						     AS_APP_SUBSUME_FLAG_DEDUPE);
+				g_rw_lock_writer_lock (&priv->rw_lock);
+				as_store_index_add_app (store, item);
+				as_store_invalidate_indexes (store);
+				g_rw_lock_writer_unlock (&priv->rw_lock);
 				return;
 			}
 		}
@@ -1500,8 +1870,15 @@ as_store_add_app (AsStore *store, AsApp *app)
 		as_store_remove_app (store, item);
 	}
 
+	/* add helper objects before the app can be found by a search, as
+	 * the token cache may be converted to use the new dictionary */
+	g_rw_lock_writer_lock (&priv->rw_lock);
+	as_app_set_stemmer (app, priv->stemmer);
+	as_app_set_token_dict (app, priv->token_dict);
+	as_app_set_search_blacklist (app, priv->search_blacklist);
+	as_app_set_search_match (app, priv->search_match);
+
 	/* create hash of id:[apps] if required */
-	g_mutex_lock (&priv->mutex);
 	apps = g_hash_table_lookup (priv->hash_id, id);
 	if (apps == NULL) {
 		apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
@@ -1523,12 +1900,9 @@ as_store_add_app (AsStore *store, AsApp *app)
 				     g_strdup (pkgname),
 				     g_object_ref (app));
 	}
-	g_mutex_unlock (&priv->mutex);
-
-	/* add helper objects */
-	as_app_set_stemmer (app, priv->stemmer);
-	as_app_set_search_blacklist (app, priv->search_blacklist);
-	as_app_set_search_match (app, priv->search_match);
+	as_store_index_add_app (store, app);
+	as_store_invalidate_indexes (store);
+	g_rw_lock_writer_unlock (&priv->rw_lock);
 
 	/* added */
 	g_signal_emit (store, signals[SIGNAL_APP_ADDED], 0, app);
@@ -1610,76 +1984,100 @@ as_store_fixup_id_prefix (AsApp *app, const gchar *id_prefix)
 	as_app_set_id (app, id);
 }
 
-static gboolean
-as_store_from_root (AsStore *store,
-		    AsNode *root,
-		    AsAppScope scope,
-		    const gchar *icon_prefix,
-		    const gchar *source_filename,
-		    const gchar *arch,
-		    guint32 load_flags,
-		    GError **error)
+typedef struct {
+	AsStore			*store;
+	AsAppScope		 scope;
+	const gchar		*icon_prefix;
+	const gchar		*source_filename;
+	const gchar		*arch;
+	guint32			 load_flags;
+	const gchar		*origin_fallback;	/* when not using the store */
+	GPtrArray		*apps;		/* if set, apps are added here */
+	gboolean		 prepared;
+	gchar			*id_prefix_app;
+	AsNodeContext		*ctx;
+	AsFormat		*format;
+	AsRefString		*icon_path_str;
+	AsRefString		*origin_str;
+} AsStoreRootHelper;
+
+static void
+as_store_root_helper_clear (AsStoreRootHelper *helper)
+{
+	g_free (helper->id_prefix_app);
+	if (helper->ctx != NULL)
+		as_node_context_free (helper->ctx);
+	if (helper->format != NULL)
+		g_object_unref (helper->format);
+	if (helper->icon_path_str != NULL)
+		as_ref_string_unref (helper->icon_path_str);
+	if (helper->origin_str != NULL)
+		as_ref_string_unref (helper->origin_str);
+}
+
+/* sets the store properties from the <components> node */
+static void
+as_store_root_apply (AsStore *store, AsNode *apps)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	AsNode *apps;
-	AsNode *n;
+	const gchar *tmp;
+
+	if (g_strcmp0 (as_node_get_name (apps), "applications") == 0)
+		priv->problems |= AS_STORE_PROBLEM_LEGACY_ROOT;
+
+	/* get version */
+	tmp = as_node_get_attribute (apps, "version");
+	if (tmp != NULL)
+		priv->api_version = g_strdup (tmp);
+
+	/* set in the XML file */
+	tmp = as_node_get_attribute (apps, "origin");
+	if (tmp != NULL)
+		as_store_set_origin (store, tmp);
+
+	/* set in the XML file */
+	tmp = as_node_get_attribute (apps, "builder_id");
+	if (tmp != NULL)
+		as_store_set_builder_id (store, tmp);
+}
+
+/* process the <components> node before any of the children are added, where
+ * @origin is the store origin before the node was read; this does not modify
+ * the store and so is safe to call from a thread */
+static void
+as_store_root_helper_setup (AsStoreRootHelper *helper,
+			    AsNode *apps,
+			    const gchar *origin)
+{
+	AsAppScope scope = helper->scope;
+	const gchar *source_filename = helper->source_filename;
+	const gchar *icon_prefix = helper->icon_prefix;
 	const gchar *tmp;
 	const gchar *origin_delim = ":";
 	gchar *str;
-	g_autoptr(AsNodeContext) ctx = NULL;
 	g_autofree gchar *icon_path = NULL;
 	g_autofree gchar *id_prefix_app = NULL;
 	g_autofree gchar *origin_app = NULL;
 	g_autofree gchar *origin_app_icons = NULL;
-	_cleanup_uninhibit_ guint32 *tok = NULL;
-	g_autoptr(AsFormat) format = NULL;
-	g_autoptr(AsProfileTask) ptask = NULL;
-	g_autoptr(AsRefString) icon_path_str = NULL;
-	g_autoptr(AsRefString) origin_str = NULL;
 	gboolean origin_is_flatpak;
 
-	g_return_val_if_fail (AS_IS_STORE (store), FALSE);
+	helper->prepared = TRUE;
 
 	/* make throws us under a bus, yet again */
 	tmp = g_getenv ("AS_SELF_TEST_PREFIX_DELIM");
 	if (tmp != NULL)
 		origin_delim = tmp;
 
-	/* profile */
-	ptask = as_profile_start_literal (priv->profile, "AsStore:store-from-root");
-	g_assert (ptask != NULL);
-
-	/* emit once when finished */
-	tok = as_store_changed_inhibit (store);
-
-	apps = as_node_find (root, "components");
-	if (apps == NULL) {
-		apps = as_node_find (root, "applications");
-		if (apps == NULL) {
-			g_set_error_literal (error,
-					     AS_STORE_ERROR,
-					     AS_STORE_ERROR_FAILED,
-					     "No valid root node specified");
-			return FALSE;
-		}
-		priv->problems |= AS_STORE_PROBLEM_LEGACY_ROOT;
-	}
-
-	/* get version */
-	tmp = as_node_get_attribute (apps, "version");
-	if (tmp != NULL)
-		priv->api_version = g_strdup (tmp);
-
 	/* set in the XML file */
 	tmp = as_node_get_attribute (apps, "origin");
 	if (tmp != NULL)
-		as_store_set_origin (store, tmp);
+		origin = tmp;
 
 	/* origin has prefix already specified in the XML */
-	if (priv->origin != NULL) {
-		str = g_strstr_len (priv->origin, -1, origin_delim);
+	if (origin != NULL) {
+		str = g_strstr_len (origin, -1, origin_delim);
 		if (str != NULL) {
-			id_prefix_app = g_strdup (priv->origin);
+			id_prefix_app = g_strdup (origin);
 			str = g_strstr_len (id_prefix_app, -1, origin_delim);
 			if (str != NULL) {
 				str[0] = '\0';
@@ -1689,7 +2087,7 @@ as_store_from_root (AsStore *store,
 		}
 	}
 
-	origin_is_flatpak = g_strcmp0 (priv->origin, "flatpak") == 0;
+	origin_is_flatpak = g_strcmp0 (origin, "flatpak") == 0;
 
 	/* special case flatpak symlinks -- scope:name.xml.gz */
 	if (origin_app == NULL &&
@@ -1722,14 +2120,14 @@ as_store_from_root (AsStore *store,
 	/* fallback */
 	if (origin_app == NULL && !origin_is_flatpak) {
 		id_prefix_app = g_strdup (as_app_scope_to_string (scope));
-		origin_app = g_strdup (priv->origin);
-		origin_app_icons = g_strdup (priv->origin);
+		origin_app = g_strdup (origin);
+		origin_app_icons = g_strdup (origin);
 	}
 
 	/* print what cleverness we did */
-	if (g_strcmp0 (origin_app, priv->origin) != 0) {
+	if (g_strcmp0 (origin_app, origin) != 0) {
 		g_debug ("using app origin of '%s' rather than '%s'",
-			 origin_app, priv->origin);
+			 origin_app, origin);
 	}
 
 	/* guess the icon path after we've read the origin and then look for
@@ -1752,73 +2150,258 @@ as_store_from_root (AsStore *store,
 	}
 	g_debug ("using icon path %s", icon_path);
 
-	/* set in the XML file */
-	tmp = as_node_get_attribute (apps, "builder_id");
-	if (tmp != NULL)
-		as_store_set_builder_id (store, tmp);
-
 	/* create refcounted versions */
 	if (origin_app != NULL)
-		origin_str = as_ref_string_new (origin_app);
+		helper->origin_str = as_ref_string_new (origin_app);
 	if (icon_path != NULL)
-		icon_path_str = as_ref_string_new (icon_path);
+		helper->icon_path_str = as_ref_string_new (icon_path);
 
 	/* create format for all added apps */
-	format = as_format_new ();
-	as_format_set_kind (format, AS_FORMAT_KIND_APPSTREAM);
+	helper->format = as_format_new ();
+	as_format_set_kind (helper->format, AS_FORMAT_KIND_APPSTREAM);
 	if (source_filename != NULL)
-		as_format_set_filename (format, source_filename);
+		as_format_set_filename (helper->format, source_filename);
 
-	ctx = as_node_context_new ();
-	for (n = apps->children; n != NULL; n = n->next) {
-		g_autoptr(GError) error_local = NULL;
-		g_autoptr(AsApp) app = NULL;
-		if (as_node_get_tag (n) != AS_TAG_COMPONENT)
-			continue;
+	helper->scope = scope;
+	helper->id_prefix_app = g_steal_pointer (&id_prefix_app);
+	helper->ctx = as_node_context_new ();
+}
 
-		/* do the filtering here */
-		if (priv->filter != 0) {
-			if (g_strcmp0 (as_node_get_name (n), "component") == 0) {
-				AsAppKind kind_tmp;
-				tmp = as_node_get_attribute (n, "type");
-				kind_tmp = as_app_kind_from_string (tmp);
-				if ((priv->filter & (1u << kind_tmp)) == 0)
-					continue;
-			}
+/* process the <components> node before any of the children are added */
+static void
+as_store_root_helper_prepare (AsStoreRootHelper *helper, AsNode *apps)
+{
+	AsStorePrivate *priv = GET_PRIVATE (helper->store);
+	as_store_root_apply (helper->store, apps);
+	as_store_root_helper_setup (helper, apps, priv->origin);
+}
+
+/* flags used when parsing each component from XML */
+static guint32
+as_store_get_parse_flags (AsStore *store)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	if (priv->add_flags & AS_STORE_ADD_FLAG_LAZY_PARSE)
+		return AS_APP_PARSE_FLAG_LAZY;
+	return AS_APP_PARSE_FLAG_NONE;
+}
+
+static gboolean
+as_store_root_helper_add_component (AsStoreRootHelper *helper,
+				    AsNode *n,
+				    GError **error)
+{
+	AsStore *store = helper->store;
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	const gchar *tmp;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(AsApp) app = NULL;
+
+	if (as_node_get_tag (n) != AS_TAG_COMPONENT)
+		return TRUE;
+
+	/* do the filtering here */
+	if (priv->filter != 0) {
+		if (g_strcmp0 (as_node_get_name (n), "component") == 0) {
+			AsAppKind kind_tmp;
+			tmp = as_node_get_attribute (n, "type");
+			kind_tmp = as_app_kind_from_string (tmp);
+			if ((priv->filter & (1u << kind_tmp)) == 0)
+				return TRUE;
 		}
+	}
 
-		app = as_app_new ();
-		if (icon_path_str != NULL)
-			as_app_set_icon_path_rstr (app, icon_path_str);
-		if (arch != NULL)
-			as_app_add_arch (app, arch);
-		as_app_add_format (app, format);
-		as_app_set_scope (app, scope);
-		if (!as_app_node_parse (app, n, ctx, &error_local)) {
-			g_set_error (error,
-				     AS_STORE_ERROR,
-				     AS_STORE_ERROR_FAILED,
-				     "Failed to parse root: %s",
-				     error_local->message);
-			return FALSE;
+	app = as_app_new ();
+	if (helper->icon_path_str != NULL)
+		as_app_set_icon_path_rstr (app, helper->icon_path_str);
+	if (helper->arch != NULL)
+		as_app_add_arch (app, helper->arch);
+	as_app_add_format (app, helper->format);
+	as_app_set_scope (app, helper->scope);
+	if (!as_app_node_parse_full (app, n, as_store_get_parse_flags (store),
+				     helper->ctx, &error_local)) {
+		g_set_error (error,
+			     AS_STORE_ERROR,
+			     AS_STORE_ERROR_FAILED,
+			     "Failed to parse root: %s",
+			     error_local->message);
+		return FALSE;
+	}
+
+	/* filter out non-merge types */
+	if (helper->load_flags & AS_STORE_LOAD_FLAG_ONLY_MERGE_APPS) {
+		if (as_app_get_merge_kind (app) != AS_APP_MERGE_KIND_REPLACE &&
+		    as_app_get_merge_kind (app) != AS_APP_MERGE_KIND_APPEND) {
+			return TRUE;
 		}
+	}
 
-		/* filter out non-merge types */
-		if (load_flags & AS_STORE_LOAD_FLAG_ONLY_MERGE_APPS) {
-			if (as_app_get_merge_kind (app) != AS_APP_MERGE_KIND_REPLACE &&
-			    as_app_get_merge_kind (app) != AS_APP_MERGE_KIND_APPEND) {
-				continue;
-			}
+	/* set the ID prefix */
+	if ((priv->add_flags & AS_STORE_ADD_FLAG_USE_UNIQUE_ID) == 0)
+		as_store_fixup_id_prefix (app, helper->id_prefix_app);
+
+	if (helper->origin_str != NULL)
+		as_app_set_origin_rstr (app, helper->origin_str);
+
+	/* added to the store later */
+	if (helper->apps != NULL) {
+		g_ptr_array_add (helper->apps, g_steal_pointer (&app));
+		return TRUE;
+	}
+	as_store_add_app (store, app);
+	return TRUE;
+}
+
+static AsNode *
+as_store_root_find_apps (AsNode *root, GError **error)
+{
+	AsNode *apps;
+	apps = as_node_find (root, "components");
+	if (apps != NULL)
+		return apps;
+	apps = as_node_find (root, "applications");
+	if (apps != NULL)
+		return apps;
+	g_set_error_literal (error,
+			     AS_STORE_ERROR,
+			     AS_STORE_ERROR_FAILED,
+			     "No valid root node specified");
+	return NULL;
+}
+
+static gboolean
+as_store_from_root (AsStore *store,
+		    AsNode *root,
+		    AsAppScope scope,
+		    const gchar *icon_prefix,
+		    const gchar *source_filename,
+		    const gchar *arch,
+		    guint32 load_flags,
+		    GError **error)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	AsNode *apps;
+	AsNode *n;
+	AsStoreRootHelper helper = {
+		.store = store,
+		.scope = scope,
+		.icon_prefix = icon_prefix,
+		.source_filename = source_filename,
+		.arch = arch,
+		.load_flags = load_flags,
+	};
+	_cleanup_uninhibit_ guint32 *tok = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+
+	g_return_val_if_fail (AS_IS_STORE (store), FALSE);
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsStore:store-from-root");
+	g_assert (ptask != NULL);
+
+	/* emit once when finished */
+	tok = as_store_changed_inhibit (store);
+
+	apps = as_store_root_find_apps (root, error);
+	if (apps == NULL)
+		return FALSE;
+	as_store_root_helper_prepare (&helper, apps);
+	for (n = apps->children; n != NULL; n = n->next) {
+		if (!as_store_root_helper_add_component (&helper, n, error)) {
+			as_store_root_helper_clear (&helper);
+			return FALSE;
 		}
+	}
+	as_store_root_helper_clear (&helper);
 
-		/* set the ID prefix */
-		if ((priv->add_flags & AS_STORE_ADD_FLAG_USE_UNIQUE_ID) == 0)
-			as_store_fixup_id_prefix (app, id_prefix_app);
+	/* add addon kinds to their parent AsApp */
+	as_store_match_addons (store);
 
-		if (origin_str != NULL)
-			as_app_set_origin_rstr (app, origin_str);
-		as_store_add_app (store, app);
+	/* this store has changed */
+	as_store_changed_uninhibit (&tok);
+	as_store_perhaps_emit_changed (store, "from-root");
+
+	return TRUE;
+}
+
+static gboolean
+as_store_from_file_stream_cb (AsNode *node, gpointer user_data, GError **error)
+{
+	AsStoreRootHelper *helper = (AsStoreRootHelper *) user_data;
+	const gchar *tmp = as_node_get_name (node->parent);
+
+	/* only components in the root node are parsed */
+	if (g_strcmp0 (tmp, "components") != 0 &&
+	    g_strcmp0 (tmp, "applications") != 0)
+		return TRUE;
+	if (!helper->prepared)
+		as_store_root_helper_prepare (helper, node->parent);
+	return as_store_root_helper_add_component (helper, node, error);
+}
+
+/* parses each component as soon as it has been read, rather than building
+ * a tree of the entire file and then calling as_store_from_root() */
+static gboolean
+as_store_from_file_stream (AsStore *store,
+			   GFile *file,
+			   AsNodeFromXmlFlags flags,
+			   AsAppScope scope,
+			   const gchar *icon_prefix,
+			   const gchar *source_filename,
+			   const gchar *arch,
+			   guint32 load_flags,
+			   GCancellable *cancellable,
+			   GError **error)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	AsStoreRootHelper helper = {
+		.store = store,
+		.scope = scope,
+		.icon_prefix = icon_prefix,
+		.source_filename = source_filename,
+		.arch = arch,
+		.load_flags = load_flags,
+	};
+	_cleanup_uninhibit_ guint32 *tok = NULL;
+	g_autoptr(AsNode) root = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsStore:store-from-root");
+	g_assert (ptask != NULL);
+
+	/* emit once when finished */
+	tok = as_store_changed_inhibit (store);
+
+	/* root is depth 1, <components> is 2 and <component> is 3 */
+	root = as_node_from_file_stream (file, flags, 3,
+					 as_store_from_file_stream_cb,
+					 &helper,
+					 cancellable,
+					 &error_local);
+	if (root == NULL) {
+		as_store_root_helper_clear (&helper);
+		if (g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+			g_propagate_error (error, g_steal_pointer (&error_local));
+			return FALSE;
+		}
+		g_set_error (error,
+			     AS_STORE_ERROR,
+			     AS_STORE_ERROR_FAILED,
+			     "Failed to parse %s file: %s",
+			     source_filename, error_local->message);
+		return FALSE;
+	}
+
+	/* no components, but the root node still has to be valid */
+	if (!helper.prepared) {
+		AsNode *apps = as_store_root_find_apps (root, error);
+		if (apps == NULL)
+			return FALSE;
+		as_store_root_helper_prepare (&helper, apps);
 	}
+	as_store_root_helper_clear (&helper);
 
 	/* add addon kinds to their parent AsApp */
 	as_store_match_addons (store);
@@ -2034,16 +2617,16 @@ as_store_watch_source_added (AsStore *store, const gchar *filename)
 	g_debug ("parsing new file %s from %s", filename, dirname);
 
 	/* we helpfully saved this */
-	g_mutex_lock (&priv->mutex);
+	g_rw_lock_reader_lock (&priv->rw_lock);
 	path_data = g_hash_table_lookup (priv->appinfo_dirs, filename);
 	if (path_data == NULL)
 		path_data = g_hash_table_lookup (priv->appinfo_dirs, dirname);
 	if (path_data == NULL) {
 		g_warning ("no path data for %s", dirname);
-		g_mutex_unlock (&priv->mutex);
+		g_rw_lock_reader_unlock (&priv->rw_lock);
 		return;
 	}
-	g_mutex_unlock (&priv->mutex);
+	g_rw_lock_reader_unlock (&priv->rw_lock);
 
 	file = g_file_new_for_path (filename);
 	/* Do not watch the file for changes: we're already watching its
@@ -2136,9 +2719,9 @@ as_store_add_path_data (AsStore *store,
 	}
 
 	/* check not already exists */
-	g_mutex_lock (&priv->mutex);
+	g_rw_lock_reader_lock (&priv->rw_lock);
 	path_data = g_hash_table_lookup (priv->appinfo_dirs, path);
-	g_mutex_unlock (&priv->mutex);
+	g_rw_lock_reader_unlock (&priv->rw_lock);
 	if (path_data != NULL) {
 		if (path_data->scope != scope ||
 		    g_strcmp0 (path_data->arch, arch) != 0) {
@@ -2161,9 +2744,20 @@ as_store_add_path_data (AsStore *store,
 	path_data = g_slice_new0 (AsStorePathData);
 	path_data->scope = scope;
 	path_data->arch = g_strdup (arch);
-	g_mutex_lock (&priv->mutex);
+	g_rw_lock_writer_lock (&priv->rw_lock);
 	g_hash_table_insert (priv->appinfo_dirs, g_strdup (path), path_data);
-	g_mutex_unlock (&priv->mutex);
+	g_rw_lock_writer_unlock (&priv->rw_lock);
+}
+
+/* any file or directory that was scanned, even if nothing was loaded from it,
+ * so that as_store_from_cache() can notice new and filtered files */
+static void
+as_store_add_cache_source (AsStore *store, const gchar *filename)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_autoptr(AsStoreWriterLocker) locker = as_store_writer_locker_new (&priv->rw_lock);
+	if (!g_hash_table_contains (priv->cache_sources, filename))
+		g_hash_table_add (priv->cache_sources, g_strdup (filename));
 }
 
 static gboolean
@@ -2180,8 +2774,6 @@ as_store_from_file_internal (AsStore *store,
 	guint32 flags = AS_NODE_FROM_XML_FLAG_LITERAL_TEXT;
 	g_autofree gchar *filename = NULL;
 	g_autofree gchar *icon_prefix = NULL;
-	g_autoptr(GError) error_local = NULL;
-	g_autoptr(AsNode) root = NULL;
 	g_autoptr(AsProfileTask) ptask = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), FALSE);
@@ -2192,6 +2784,7 @@ as_store_from_file_internal (AsStore *store,
 				  "AsStore:store-from-file{%s}",
 				  filename);
 	g_assert (ptask != NULL);
+	as_store_add_cache_source (store, filename);
 
 	/* a DEP-11 file */
 	if (g_strstr_len (filename, -1, ".yml") != NULL) {
@@ -2209,18 +2802,13 @@ as_store_from_file_internal (AsStore *store,
 	/* an AppStream XML file */
 	if (priv->add_flags & AS_STORE_ADD_FLAG_ONLY_NATIVE_LANGS)
 		flags |= AS_NODE_FROM_XML_FLAG_ONLY_NATIVE_LANGS;
-	root = as_node_from_file (file, flags, cancellable, &error_local);
-	if (root == NULL && g_error_matches (error_local, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
-		g_propagate_error (error, g_steal_pointer (&error_local));
-		return FALSE;
-	} else if (root == NULL) {
-		g_set_error (error,
-			     AS_STORE_ERROR,
-			     AS_STORE_ERROR_FAILED,
-			     "Failed to parse %s file: %s",
-			     filename, error_local->message);
+	if (priv->add_flags & AS_STORE_ADD_FLAG_LAZY_PARSE)
+		flags |= AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA;
+	icon_prefix = g_path_get_dirname (filename);
+	if (!as_store_from_file_stream (store, file, flags, scope,
+					icon_prefix, filename, arch, load_flags,
+					cancellable, error))
 		return FALSE;
-	}
 
 	/* watch for file changes */
 	if (watch_flags > 0) {
@@ -2231,12 +2819,7 @@ as_store_from_file_internal (AsStore *store,
 					  error))
 			return FALSE;
 	}
-
-	/* icon prefix is the directory the XML has been found in */
-	icon_prefix = g_path_get_dirname (filename);
-	return as_store_from_root (store, root, scope,
-				   icon_prefix, filename, arch, load_flags,
-				   error);
+	return TRUE;
 }
 
 /**
@@ -2367,10 +2950,16 @@ as_store_from_xml (AsStore *store,
 	if (data[0] == '\0')
 		return TRUE;
 
-	/* load XML data */
+	/* load XML data, keeping a copy if parts are to be parsed later */
 	if (priv->add_flags & AS_STORE_ADD_FLAG_ONLY_NATIVE_LANGS)
 		flags |= AS_NODE_FROM_XML_FLAG_ONLY_NATIVE_LANGS;
-	root = as_node_from_xml (data, flags, &error_local);
+	if (priv->add_flags & AS_STORE_ADD_FLAG_LAZY_PARSE) {
+		g_autoptr(GBytes) bytes = g_bytes_new (data, strlen (data));
+		flags |= AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA;
+		root = as_node_from_bytes (bytes, flags, &error_local);
+	} else {
+		root = as_node_from_xml (data, flags, &error_local);
+	}
 	if (root == NULL) {
 		g_set_error (error,
 			     AS_STORE_ERROR,
@@ -2421,7 +3010,7 @@ as_store_check_apps_for_veto (AsStore *store)
 	guint i;
 	AsApp *app;
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->mutex);
+	g_autoptr(AsStoreWriterLocker) locker = as_store_writer_locker_new (&priv->rw_lock);
 
 	/* add any vetos */
 	for (i = 0; i < priv->array->len; i++) {
@@ -2467,30 +3056,111 @@ as_store_remove_apps_with_veto (AsStore *store)
 	as_store_perhaps_emit_changed (store, "remove-apps-with-veto");
 }
 
-/**
- * as_store_to_xml:
- * @store: a #AsStore instance.
- * @flags: the AsNodeToXmlFlags, e.g. %AS_NODE_TO_XML_FLAG_NONE.
- *
- * Outputs an XML representation of all the applications in the store.
- *
- * Returns: A #GString
- *
- * Since: 0.1.0
- **/
-GString *
-as_store_to_xml (AsStore *store, guint32 flags)
+/* called with each chunk of XML as it is produced */
+typedef gboolean (*AsStoreXmlFunc)	(GString	*xml,
+					 gpointer	 user_data,
+					 GError		**error);
+
+#define AS_STORE_XML_CHUNK_SIZE		(64 * 1024)
+#define AS_STORE_XML_APPS_PER_THREAD	256
+
+typedef struct {
+	GPtrArray	*apps;
+	AsNodeContext	*ctx;
+	guint32		 flags;
+	GMutex		 mutex;
+	GCond		 cond;
+	guint		 n_pending;	/* slices not yet converted */
+} AsStoreXmlHelper;
+
+typedef struct {
+	guint		 lo;
+	guint		 hi;
+	GString		*xml;
+} AsStoreXmlSlice;
+
+/* each slice converts its own range of components using a private node tree
+ * of the same depth, so no node is shared between threads and the text is
+ * the same as if the components were converted in turn */
+static void
+as_store_to_xml_slice_cb (gpointer data, gpointer user_data)
+{
+	AsStoreXmlSlice *slice = (AsStoreXmlSlice *) data;
+	AsStoreXmlHelper *helper = (AsStoreXmlHelper *) user_data;
+	AsNode *node_apps;
+	g_autoptr(AsNode) node_root = as_node_new ();
+
+	node_apps = as_node_insert (node_root, "components", NULL, 0, NULL);
+	for (guint i = slice->lo; i < slice->hi; i++) {
+		AsApp *app = g_ptr_array_index (helper->apps, i);
+		AsNode *node_app = as_app_node_insert (app, node_apps, helper->ctx);
+		as_node_to_xml_append (slice->xml, node_app, helper->flags);
+		as_node_unref (node_app);
+	}
+
+	/* wake up the caller when the whole batch is done */
+	g_mutex_lock (&helper->mutex);
+	if (--helper->n_pending == 0)
+		g_cond_signal (&helper->cond);
+	g_mutex_unlock (&helper->mutex);
+}
+
+/* passes the XML produced so far to @func if there is enough of it; this
+ * is called with the reader lock held, which is dropped if @func fails */
+static gboolean
+as_store_to_xml_flush (AsStore *store,
+		       GString *xml,
+		       AsStoreXmlFunc func,
+		       gpointer user_data,
+		       GError **error)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+
+	if (func == NULL || xml->len < AS_STORE_XML_CHUNK_SIZE)
+		return TRUE;
+
+	/* @func may block on I/O or use the store */
+	g_rw_lock_reader_unlock (&priv->rw_lock);
+	if (!func (xml, user_data, error))
+		return FALSE;
+	g_string_truncate (xml, 0);
+	g_rw_lock_reader_lock (&priv->rw_lock);
+	return TRUE;
+}
+
+/* the number of threads to split work between */
+static guint
+as_store_get_n_threads (AsStore *store)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	if (priv->max_threads == 0)
+		return g_get_num_processors ();
+	return priv->max_threads;
+}
+
+/* only one component per thread is converted to a node tree at a time, and
+ * @func is called whenever enough XML has been produced; the output is
+ * identical to calling as_node_to_xml() on a tree holding every component;
+ * this must be called with priv->to_xml_mutex held, and @func must not
+ * convert the store to XML again */
+static gboolean
+as_store_to_xml_chunked_unlocked (AsStore *store,
+				  guint32 flags,
+				  GString *xml,
+				  AsStoreXmlFunc func,
+				  gpointer user_data,
+				  GError **error)
 {
-	AsApp *app;
 	AsStorePrivate *priv = GET_PRIVATE (store);
+	AsStoreXmlHelper helper;
 	AsNode *node_apps;
-	AsNode *node_root;
-	GString *xml;
 	gboolean output_trusted = FALSE;
-	guint i;
+	guint n_threads;
+	GThreadPool *pool = NULL;
+	g_autoptr(AsNode) node_root = NULL;
 	g_autoptr(AsNodeContext) ctx = NULL;
-
-	g_return_val_if_fail (AS_IS_STORE (store), NULL);
+	g_autoptr(GError) error_pool = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
 
 	/* check categories of apps about to be written */
 	as_store_check_apps_for_veto (store);
@@ -2521,21 +3191,135 @@ as_store_to_xml (AsStore *store, guint32 flags)
 	as_node_context_set_output (ctx, AS_FORMAT_KIND_APPSTREAM);
 	as_node_context_set_output_trusted (ctx, output_trusted);
 
-	g_mutex_lock (&priv->mutex);
-
-	/* sort by ID */
+	/* sort by ID, which changes the store */
+	g_rw_lock_writer_lock (&priv->rw_lock);
 	g_ptr_array_sort (priv->array, as_store_apps_sort_cb);
+	as_store_index_sort (store, as_store_apps_sort_cb);
+	as_store_invalidate_indexes (store);
+	g_rw_lock_writer_unlock (&priv->rw_lock);
+
+	/* the apps are converted from a snapshot, and only the reader lock is
+	 * held so that the store can still be searched meanwhile */
+	g_rw_lock_reader_lock (&priv->rw_lock);
+	apps = _dup_app_array (priv->array);
+	g_ptr_array_sort (apps, as_store_apps_sort_cb);
+
+	if ((flags & AS_NODE_TO_XML_FLAG_ADD_HEADER) > 0)
+		g_string_append (xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+
+	/* an empty <components/> */
+	if (apps->len == 0) {
+		g_rw_lock_reader_unlock (&priv->rw_lock);
+		as_node_to_xml_append (xml, node_apps, flags);
+		return func == NULL || func (xml, user_data, error);
+	}
 
-	/* add applications */
-	for (i = 0; i < priv->array->len; i++) {
-		app = g_ptr_array_index (priv->array, i);
-		as_app_node_insert (app, node_apps, ctx);
+	/* add applications, freeing each tree as soon as it is converted */
+	as_node_to_xml_start (xml, node_apps, flags);
+	n_threads = apps->len / AS_STORE_XML_APPS_PER_THREAD;
+	n_threads = CLAMP (n_threads, 1, as_store_get_n_threads (store));
+	if (n_threads > 1) {
+		pool = g_thread_pool_new (as_store_to_xml_slice_cb, &helper,
+					  (gint) n_threads, FALSE, &error_pool);
+		if (pool == NULL) {
+			g_debug ("converting to XML serially: %s",
+				 error_pool->message);
+		}
+	}
+	if (pool == NULL) {
+		for (guint i = 0; i < apps->len; i++) {
+			AsApp *app = g_ptr_array_index (apps, i);
+			AsNode *node_app = as_app_node_insert (app, node_apps, ctx);
+			as_node_to_xml_append (xml, node_app, flags);
+			as_node_unref (node_app);
+			if (!as_store_to_xml_flush (store, xml, func, user_data, error))
+				return FALSE;
+		}
+	} else {
+		gboolean ret = TRUE;
+		guint batch_size = n_threads * AS_STORE_XML_APPS_PER_THREAD;
+		g_autofree AsStoreXmlSlice *slices = g_new0 (AsStoreXmlSlice, n_threads);
+
+		/* convert a batch of components in each pass so that the
+		 * memory used does not depend on the size of the store */
+		helper.apps = apps;
+		helper.ctx = ctx;
+		helper.flags = flags;
+		g_mutex_init (&helper.mutex);
+		g_cond_init (&helper.cond);
+		for (guint i = 0; i < n_threads; i++)
+			slices[i].xml = g_string_new (NULL);
+		for (guint lo = 0; lo < apps->len; lo += batch_size) {
+			guint hi = MIN (lo + batch_size, apps->len);
+
+			helper.n_pending = n_threads;
+			for (guint i = 0; i < n_threads; i++) {
+				slices[i].lo = lo + (guint) (((guint64) (hi - lo) * i) / n_threads);
+				slices[i].hi = lo + (guint) (((guint64) (hi - lo) * (i + 1)) / n_threads);
+				g_string_truncate (slices[i].xml, 0);
+				g_thread_pool_push (pool, &slices[i], NULL);
+			}
+			g_mutex_lock (&helper.mutex);
+			while (helper.n_pending > 0)
+				g_cond_wait (&helper.cond, &helper.mutex);
+			g_mutex_unlock (&helper.mutex);
+
+			/* join in sorted order */
+			for (guint i = 0; i < n_threads; i++)
+				g_string_append_len (xml, slices[i].xml->str,
+						     (gssize) slices[i].xml->len);
+			if (!as_store_to_xml_flush (store, xml, func, user_data, error)) {
+				ret = FALSE;
+				break;
+			}
+		}
+		g_thread_pool_free (pool, FALSE, TRUE);
+		g_mutex_clear (&helper.mutex);
+		g_cond_clear (&helper.cond);
+		for (guint i = 0; i < n_threads; i++)
+			g_string_free (slices[i].xml, TRUE);
+		if (!ret)
+			return FALSE;
 	}
+	g_rw_lock_reader_unlock (&priv->rw_lock);
+	as_node_to_xml_end (xml, node_apps, flags);
+	return func == NULL || func (xml, user_data, error);
+}
+
+static gboolean
+as_store_to_xml_chunked (AsStore *store,
+			 guint32 flags,
+			 GString *xml,
+			 AsStoreXmlFunc func,
+			 gpointer user_data,
+			 GError **error)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->to_xml_mutex);
+	return as_store_to_xml_chunked_unlocked (store, flags, xml, func,
+						 user_data, error);
+}
+
+/**
+ * as_store_to_xml:
+ * @store: a #AsStore instance.
+ * @flags: the AsNodeToXmlFlags, e.g. %AS_NODE_TO_XML_FLAG_NONE.
+ *
+ * Outputs an XML representation of all the applications in the store.
+ *
+ * Returns: A #GString
+ *
+ * Since: 0.1.0
+ **/
+GString *
+as_store_to_xml (AsStore *store, guint32 flags)
+{
+	GString *xml;
 
-	g_mutex_unlock (&priv->mutex);
+	g_return_val_if_fail (AS_IS_STORE (store), NULL);
 
-	xml = as_node_to_xml (node_root, flags);
-	as_node_unref (node_root);
+	xml = g_string_new ("");
+	as_store_to_xml_chunked (store, flags, xml, NULL, NULL, NULL);
 	return xml;
 }
 
@@ -2557,11 +3341,11 @@ as_store_convert_icons (AsStore *store, AsIconKind kind, GError **error)
 	AsStorePrivate *priv = GET_PRIVATE (store);
 	AsApp *app;
 	guint i;
-	g_autoptr(GMutexLocker) locker = NULL;
+	g_autoptr(AsStoreWriterLocker) locker = NULL;
 
 	g_return_val_if_fail (AS_IS_STORE (store), FALSE);
 
-	locker = g_mutex_locker_new (&priv->mutex);
+	locker = as_store_writer_locker_new (&priv->rw_lock);
 
 	/* convert application icons */
 	for (i = 0; i < priv->array->len; i++) {
@@ -2572,6 +3356,29 @@ as_store_convert_icons (AsStore *store, AsIconKind kind, GError **error)
 	return TRUE;
 }
 
+typedef struct {
+	GOutputStream		*out;
+	GCancellable		*cancellable;
+} AsStoreToFileHelper;
+
+static gboolean
+as_store_to_file_write_cb (GString *xml, gpointer user_data, GError **error)
+{
+	AsStoreToFileHelper *helper = (AsStoreToFileHelper *) user_data;
+	return g_output_stream_write_all (helper->out, xml->str, xml->len,
+					  NULL, helper->cancellable, error);
+}
+
+/* closing with a cancelled cancellable leaves any existing file untouched,
+ * rather than replacing it with a partial file */
+static void
+as_store_to_file_abort (GFileOutputStream *out)
+{
+	g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+	g_cancellable_cancel (cancellable);
+	g_output_stream_close (G_OUTPUT_STREAM (out), cancellable, NULL);
+}
+
 /**
  * as_store_to_file:
  * @store: a #AsStore instance.
@@ -2593,41 +3400,47 @@ as_store_to_file (AsStore *store,
 		  GCancellable *cancellable,
 		  GError **error)
 {
+	AsStoreToFileHelper helper = { NULL, cancellable };
+	GFileCreateFlags create_flags = G_FILE_CREATE_REPLACE_DESTINATION;
+	gboolean compressed;
 	g_autoptr(GError) error_local = NULL;
-	g_autoptr(GOutputStream) out2 = NULL;
+	g_autoptr(GFileOutputStream) out_file = NULL;
 	g_autoptr(GOutputStream) out = NULL;
 	g_autoptr(GZlibCompressor) compressor = NULL;
-	g_autoptr(GString) xml = NULL;
+	g_autoptr(GString) xml = g_string_new ("");
 	g_autofree gchar *basename = NULL;
 
 	/* check if compressed */
 	basename = g_file_get_basename (file);
-	if (g_strstr_len (basename, -1, ".gz") == NULL) {
-		xml = as_store_to_xml (store, flags);
-		if (!g_file_replace_contents (file, xml->str, xml->len,
-					      NULL,
-					      FALSE,
-					      G_FILE_CREATE_REPLACE_DESTINATION,
-					      NULL,
-					      cancellable,
-					      &error_local)) {
-			g_set_error (error,
-				     AS_STORE_ERROR,
-				     AS_STORE_ERROR_FAILED,
-				     "Failed to write file: %s",
-				     error_local->message);
-			return FALSE;
-		}
-		return TRUE;
+	compressed = g_strstr_len (basename, -1, ".gz") != NULL;
+	if (compressed)
+		create_flags = G_FILE_CREATE_NONE;
+	out_file = g_file_replace (file, NULL, FALSE, create_flags,
+				   cancellable, &error_local);
+	if (out_file == NULL) {
+		g_set_error (error,
+			     AS_STORE_ERROR,
+			     AS_STORE_ERROR_FAILED,
+			     "Failed to write file: %s",
+			     error_local->message);
+		return FALSE;
 	}
 
 	/* compress as a gzip file */
-	compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
-	out = g_memory_output_stream_new_resizable ();
-	out2 = g_converter_output_stream_new (out, G_CONVERTER (compressor));
-	xml = as_store_to_xml (store, flags);
-	if (!g_output_stream_write_all (out2, xml->str, xml->len,
-					NULL, NULL, &error_local)) {
+	if (compressed) {
+		compressor = g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1);
+		out = g_converter_output_stream_new (G_OUTPUT_STREAM (out_file),
+						     G_CONVERTER (compressor));
+	} else {
+		out = g_object_ref (G_OUTPUT_STREAM (out_file));
+	}
+
+	/* write each chunk as soon as it is ready */
+	helper.out = out;
+	if (!as_store_to_xml_chunked (store, flags, xml,
+				      as_store_to_file_write_cb, &helper,
+				      &error_local)) {
+		as_store_to_file_abort (out_file);
 		g_set_error (error,
 			     AS_STORE_ERROR,
 			     AS_STORE_ERROR_FAILED,
@@ -2635,7 +3448,8 @@ as_store_to_file (AsStore *store,
 			     error_local->message);
 		return FALSE;
 	}
-	if (!g_output_stream_close (out2, NULL, &error_local)) {
+	if (!g_output_stream_close (out, cancellable, &error_local)) {
+		as_store_to_file_abort (out_file);
 		g_set_error (error,
 			     AS_STORE_ERROR,
 			     AS_STORE_ERROR_FAILED,
@@ -2643,14 +3457,147 @@ as_store_to_file (AsStore *store,
 			     error_local->message);
 		return FALSE;
 	}
+	return TRUE;
+}
+
+/* the mtime is in microseconds so that adding a file to a directory is
+ * noticed even if the directory was written in the same second */
+static void
+as_store_cache_get_file_info (const gchar *filename, guint64 *mtime, guint64 *size)
+{
+	g_autoptr(GFile) file = g_file_new_for_path (filename);
+	g_autoptr(GFileInfo) info = NULL;
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL, NULL);
+	if (info == NULL) {
+		*mtime = 0;
+		*size = 0;
+		return;
+	}
+	*mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC +
+		 g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	*size = (guint64) g_file_info_get_size (info);
+}
+
+/**
+ * as_store_to_cache:
+ * @store: a #AsStore instance.
+ * @file: file
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: A #GError or %NULL
+ *
+ * Writes a binary cache of all the applications in the store which can be
+ * loaded using as_store_from_cache() without parsing any XML.
+ *
+ * The cache records the modification time and size of every file and
+ * directory that was scanned when loading the store, including files that no
+ * applications were added from, and is only valid while these are unchanged.
+ * The cache is only readable on the machine that wrote it.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+as_store_to_cache (AsStore *store,
+		   GFile *file,
+		   GCancellable *cancellable,
+		   GError **error)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value_tmp;
+	GVariantBuilder builder_apps;
+	GVariantBuilder builder_merges;
+	GVariantBuilder builder_sources;
+	g_autoptr(AsNodeContext) ctx = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GHashTable) sources = NULL;
+	g_autoptr(GVariant) value = NULL;
+
+	g_return_val_if_fail (AS_IS_STORE (store), FALSE);
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsStore:to-cache");
+
+	ctx = as_node_context_new ();
+	as_node_context_set_version (ctx, priv->api_version);
+	as_node_context_set_output (ctx, AS_FORMAT_KIND_APPSTREAM);
+	as_node_context_set_output_trusted (ctx, TRUE);
+
+	/* each app is stored as typed values so no XML has to be parsed */
+	sources = g_hash_table_new (g_str_hash, g_str_equal);
+	g_variant_builder_init (&builder_apps, G_VARIANT_TYPE ("a" AS_APP_VARIANT_TYPE));
+	g_rw_lock_reader_lock (&priv->rw_lock);
+	g_hash_table_iter_init (&iter, priv->cache_sources);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		g_hash_table_add (sources, key);
+	for (guint i = 0; i < priv->array->len; i++) {
+		AsApp *app = g_ptr_array_index (priv->array, i);
+		GPtrArray *formats = as_app_get_formats (app);
+		for (guint j = 0; j < formats->len; j++) {
+			AsFormat *format = g_ptr_array_index (formats, j);
+			const gchar *filename = as_format_get_filename (format);
+			if (filename != NULL)
+				g_hash_table_add (sources, (gpointer) filename);
+		}
+		g_variant_builder_add_value (&builder_apps,
+					     as_app_to_variant (app, ctx));
+	}
+
+	/* the merge components have already been applied to the apps above,
+	 * but are needed for any apps added after loading the cache */
+	g_variant_builder_init (&builder_merges, G_VARIANT_TYPE ("a" AS_APP_VARIANT_TYPE));
+	g_hash_table_iter_init (&iter, priv->hash_merge_id);
+	while (g_hash_table_iter_next (&iter, NULL, &value_tmp)) {
+		GPtrArray *merges = value_tmp;
+		for (guint i = 0; i < merges->len; i++) {
+			AsApp *app = g_ptr_array_index (merges, i);
+			GPtrArray *formats = as_app_get_formats (app);
+			for (guint j = 0; j < formats->len; j++) {
+				AsFormat *format = g_ptr_array_index (formats, j);
+				const gchar *filename = as_format_get_filename (format);
+				if (filename != NULL)
+					g_hash_table_add (sources, (gpointer) filename);
+			}
+			g_variant_builder_add_value (&builder_merges,
+						     as_app_to_variant (app, ctx));
+		}
+	}
+
+	/* key the cache on the source files */
+	g_variant_builder_init (&builder_sources, G_VARIANT_TYPE ("a(stt)"));
+	g_hash_table_iter_init (&iter, sources);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		guint64 mtime;
+		guint64 size;
+		as_store_cache_get_file_info (key, &mtime, &size);
+		g_variant_builder_add (&builder_sources, "(stt)", key, mtime, size);
+	}
+	value = g_variant_ref_sink (g_variant_new (AS_STORE_CACHE_TYPE,
+						   (guint32) AS_STORE_CACHE_VERSION,
+						   priv->api_version,
+						   priv->origin,
+						   priv->builder_id,
+						   &builder_sources,
+						   &builder_apps,
+						   &builder_merges));
+	g_rw_lock_reader_unlock (&priv->rw_lock);
 
 	/* write file */
 	if (!g_file_replace_contents (file,
-		g_memory_output_stream_get_data (G_MEMORY_OUTPUT_STREAM (out)),
-		g_memory_output_stream_get_data_size (G_MEMORY_OUTPUT_STREAM (out)),
+				      g_variant_get_data (value),
+				      g_variant_get_size (value),
 				      NULL,
 				      FALSE,
-				      G_FILE_CREATE_NONE,
+				      G_FILE_CREATE_REPLACE_DESTINATION,
 				      NULL,
 				      cancellable,
 				      &error_local)) {
@@ -2664,6 +3611,205 @@ as_store_to_file (AsStore *store,
 	return TRUE;
 }
 
+static gboolean
+as_store_cache_load_apps (AsStore *store, GVariantIter *iter,
+			  AsNodeContext *ctx, GPtrArray *apps, GError **error)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+
+	while (TRUE) {
+		g_autoptr(AsApp) app = NULL;
+		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GVariant) value_app = g_variant_iter_next_value (iter);
+		if (value_app == NULL)
+			break;
+		app = as_app_new ();
+		if (!as_app_from_variant (app, value_app,
+					  as_store_get_parse_flags (store),
+					  ctx, &error_local)) {
+			g_set_error (error,
+				     AS_STORE_ERROR,
+				     AS_STORE_ERROR_FAILED,
+				     "Failed to load cache: %s",
+				     error_local->message);
+			return FALSE;
+		}
+
+		/* do the filtering here */
+		if (priv->filter != 0 &&
+		    (priv->filter & (1u << as_app_get_kind (app))) == 0)
+			continue;
+		g_ptr_array_add (apps, g_steal_pointer (&app));
+	}
+	return TRUE;
+}
+
+/**
+ * as_store_from_cache:
+ * @store: a #AsStore instance.
+ * @file: a #GFile created using as_store_to_cache()
+ * @cancellable: A #GCancellable, or %NULL
+ * @error: A #GError or %NULL
+ *
+ * Adds the applications from a binary cache to the store. The file is mapped
+ * into memory rather than being read and no XML is parsed.
+ *
+ * If any of the files the cache was created from have been modified, or the
+ * cache cannot be loaded, then an error is returned without adding any
+ * applications and the caller should load the store as normal.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+as_store_from_cache (AsStore *store,
+		     GFile *file,
+		     GCancellable *cancellable,
+		     GError **error)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	GVariantIter *iter_apps = NULL;
+	GVariantIter *iter_merges = NULL;
+	GVariantIter *iter_sources = NULL;
+	const gchar *api_version = NULL;
+	const gchar *builder_id = NULL;
+	const gchar *origin = NULL;
+	const gchar *source;
+	guint32 version = 0;
+	guint64 mtime;
+	guint64 size;
+	gboolean ret = TRUE;
+	_cleanup_uninhibit_ guint32 *tok = NULL;
+	g_autofree gchar *filename = NULL;
+	g_autoptr(AsNodeContext) ctx = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GBytes) bytes = NULL;
+	g_autoptr(GError) error_local = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
+	g_autoptr(GPtrArray) apps = NULL;
+	g_autoptr(GPtrArray) merges = NULL;
+	g_autoptr(GPtrArray) sources = g_ptr_array_new ();
+	g_autoptr(GVariant) value = NULL;
+
+	g_return_val_if_fail (AS_IS_STORE (store), FALSE);
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsStore:from-cache");
+
+	/* map the file */
+	filename = g_file_get_path (file);
+	if (filename == NULL) {
+		g_set_error_literal (error,
+				     AS_STORE_ERROR,
+				     AS_STORE_ERROR_FAILED,
+				     "Cache has no local path");
+		return FALSE;
+	}
+	mapped_file = g_mapped_file_new (filename, FALSE, &error_local);
+	if (mapped_file == NULL) {
+		g_set_error (error,
+			     AS_STORE_ERROR,
+			     AS_STORE_ERROR_FAILED,
+			     "Failed to map cache: %s",
+			     error_local->message);
+		return FALSE;
+	}
+	bytes = g_mapped_file_get_bytes (mapped_file);
+	value = g_variant_ref_sink (g_variant_new_from_bytes (G_VARIANT_TYPE (AS_STORE_CACHE_TYPE),
+							      bytes, FALSE));
+	g_variant_get (value, "(um&sm&sm&sa(stt)a" AS_APP_VARIANT_TYPE "a" AS_APP_VARIANT_TYPE ")",
+		       &version, &api_version, &origin, &builder_id,
+		       &iter_sources, &iter_apps, &iter_merges);
+	if (version != AS_STORE_CACHE_VERSION) {
+		g_set_error (error,
+			     AS_STORE_ERROR,
+			     AS_STORE_ERROR_FAILED,
+			     "Cache version %u is not supported",
+			     version);
+		ret = FALSE;
+		goto out;
+	}
+
+	/* check none of the source files have changed */
+	while (g_variant_iter_next (iter_sources, "(&stt)", &source, &mtime, &size)) {
+		guint64 mtime_now;
+		guint64 size_now;
+		as_store_cache_get_file_info (source, &mtime_now, &size_now);
+		if (mtime != mtime_now || size != size_now) {
+			g_set_error (error,
+				     AS_STORE_ERROR,
+				     AS_STORE_ERROR_FAILED,
+				     "Cache is out of date as %s changed",
+				     source);
+			ret = FALSE;
+			goto out;
+		}
+		g_ptr_array_add (sources, (gpointer) source);
+	}
+
+	/* load every app before changing the store so that it is not left
+	 * half populated if the cache is invalid */
+	ctx = as_node_context_new ();
+	if (api_version != NULL)
+		as_node_context_set_version (ctx, api_version);
+	apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	if (!as_store_cache_load_apps (store, iter_apps, ctx, apps, error)) {
+		ret = FALSE;
+		goto out;
+	}
+	merges = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	if (!as_store_cache_load_apps (store, iter_merges, ctx, merges, error)) {
+		ret = FALSE;
+		goto out;
+	}
+
+	/* set the store properties */
+	if (api_version != NULL)
+		as_store_set_version (store, api_version);
+	if (origin != NULL)
+		as_store_set_origin (store, origin);
+	if (builder_id != NULL)
+		as_store_set_builder_id (store, builder_id);
+	for (guint i = 0; i < sources->len; i++)
+		as_store_add_cache_source (store, g_ptr_array_index (sources, i));
+
+	/* emit once when finished */
+	tok = as_store_changed_inhibit (store);
+	for (guint i = 0; i < apps->len; i++)
+		as_store_add_app (store, g_ptr_array_index (apps, i));
+
+	/* the cached apps already have the merge components applied, so only
+	 * record them for apps that are added later */
+	g_rw_lock_writer_lock (&priv->rw_lock);
+	for (guint i = 0; i < merges->len; i++) {
+		AsApp *app = g_ptr_array_index (merges, i);
+		GPtrArray *merges_id;
+		merges_id = g_hash_table_lookup (priv->hash_merge_id,
+						 as_app_get_id (app));
+		if (merges_id == NULL) {
+			merges_id = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+			g_hash_table_insert (priv->hash_merge_id,
+					     g_strdup (as_app_get_id (app)),
+					     merges_id);
+		}
+		g_ptr_array_add (merges_id, g_object_ref (app));
+	}
+	g_rw_lock_writer_unlock (&priv->rw_lock);
+
+	/* add addon kinds to their parent AsApp */
+	as_store_match_addons (store);
+
+	/* this store has changed */
+	as_store_changed_uninhibit (&tok);
+	as_store_perhaps_emit_changed (store, "from-cache");
+out:
+	g_variant_iter_free (iter_sources);
+	g_variant_iter_free (iter_apps);
+	g_variant_iter_free (iter_merges);
+	return ret;
+}
+
 /**
  * as_store_get_origin:
  * @store: a #AsStore instance.
@@ -2884,6 +4030,10 @@ as_store_get_add_flags (AsStore *store)
  * NOTE: Using %AS_STORE_ADD_FLAG_PREFER_LOCAL may be a privacy risk depending on
  * your level of paranoia, and should not be used by default.
  *
+ * NOTE: Using %AS_STORE_ADD_FLAG_LAZY_PARSE keeps each decompressed XML file in
+ * memory while any application loaded from it still has unparsed data, as
+ * the unparsed data refers to the file rather than being copied.
+ *
  * Since: 0.2.2
  **/
 void
@@ -2894,6 +4044,43 @@ as_store_set_add_flags (AsStore *store, guint32 add_flags)
 	priv->add_flags = add_flags;
 }
 
+/**
+ * as_store_get_max_threads:
+ * @store: a #AsStore instance.
+ *
+ * Gets the maximum number of threads the store uses.
+ *
+ * Returns: the number of threads, or 0 for one per CPU
+ *
+ * Since: 0.8.5
+ **/
+guint
+as_store_get_max_threads (AsStore *store)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_return_val_if_fail (AS_IS_STORE (store), 0);
+	return priv->max_threads;
+}
+
+/**
+ * as_store_set_max_threads:
+ * @store: a #AsStore instance.
+ * @max_threads: the number of threads, or 0 for one per CPU
+ *
+ * Sets the maximum number of threads used to parse files when loading with
+ * %AS_STORE_LOAD_FLAG_PARALLEL and to search the store. This has to be set
+ * before the store is first searched.
+ *
+ * Since: 0.8.5
+ **/
+void
+as_store_set_max_threads (AsStore *store, guint max_threads)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_return_if_fail (AS_IS_STORE (store));
+	priv->max_threads = max_threads;
+}
+
 /**
  * as_store_get_watch_flags:
  * @store: a #AsStore instance.
@@ -2929,10 +4116,9 @@ as_store_set_watch_flags (AsStore *store, guint32 watch_flags)
 	priv->watch_flags = watch_flags;
 }
 
-static gboolean
-as_store_guess_origin_fallback (AsStore *store,
-				const gchar *filename,
-				GError **error)
+/* this does not use the store and so is safe to call from a thread */
+static gchar *
+as_store_get_origin_fallback (const gchar *filename, GError **error)
 {
 	gchar *tmp;
 	g_autofree gchar *origin_fallback = NULL;
@@ -2951,11 +4137,23 @@ as_store_guess_origin_fallback (AsStore *store,
 			     "AppStream metadata name %s not valid, "
 			     "expected .xml[.*] or .yml[.*]",
 			     filename);
-		return FALSE;
+		return NULL;
 	}
 	tmp[0] = '\0';
+	return g_steal_pointer (&origin_fallback);
+}
+
+static gboolean
+as_store_guess_origin_fallback (AsStore *store,
+				const gchar *filename,
+				GError **error)
+{
+	g_autofree gchar *origin_fallback = NULL;
 
 	/* load this specific file */
+	origin_fallback = as_store_get_origin_fallback (filename, error);
+	if (origin_fallback == NULL)
+		return FALSE;
 	as_store_set_origin (store, origin_fallback);
 	return TRUE;
 }
@@ -2994,6 +4192,217 @@ as_store_load_app_info_file (AsStore *store,
 					    error);
 }
 
+typedef struct {
+	AsStore		*store;
+	AsAppScope	 scope;
+	const gchar	*arch;
+	guint32		 load_flags;
+	guint32		 parse_flags;	/* AsNodeFromXmlFlags or AsAppParseFlags */
+	GCancellable	*cancellable;
+} AsStoreLoadHelper;
+
+typedef struct {
+	gchar		*basename;
+	gchar		*filename;
+	AsNode		*root;		/* without the components */
+	GPtrArray	*apps;		/* of AsApp, from the components */
+	AsApp		*app;
+	GError		*error;
+} AsStoreLoadItem;
+
+/* directories with fewer files than this are always loaded serially */
+#define AS_STORE_LOAD_PARALLEL_MIN_FILES	4
+
+static AsStoreLoadItem *
+as_store_load_item_new (const gchar *path, const gchar *basename)
+{
+	AsStoreLoadItem *item = g_new0 (AsStoreLoadItem, 1);
+	item->basename = g_strdup (basename);
+	item->filename = g_build_filename (path, basename, NULL);
+	return item;
+}
+
+static void
+as_store_load_item_free (AsStoreLoadItem *item)
+{
+	if (item->root != NULL)
+		as_node_unref (item->root);
+	if (item->apps != NULL)
+		g_ptr_array_unref (item->apps);
+	if (item->app != NULL)
+		g_object_unref (item->app);
+	if (item->error != NULL)
+		g_error_free (item->error);
+	g_free (item->basename);
+	g_free (item->filename);
+	g_free (item);
+}
+
+/* the results are only used once all the threads have finished, so the
+ * store is always modified in the same order as when loading serially */
+static void
+as_store_load_items_parallel (AsStoreLoadHelper *helper,
+			      GPtrArray *items,
+			      GFunc func)
+{
+	AsStorePrivate *priv = GET_PRIVATE (helper->store);
+	GThreadPool *pool = NULL;
+	guint n_threads = MIN (as_store_get_n_threads (helper->store), items->len);
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GError) error_local = NULL;
+
+	/* profile */
+	ptask = as_profile_start (priv->profile,
+				  "AsStore:load-parallel{%u}",
+				  items->len);
+	as_profile_task_set_threaded (ptask, TRUE);
+
+	if (n_threads > 1) {
+		pool = g_thread_pool_new (func, helper, (gint) n_threads,
+					  TRUE, &error_local);
+		if (pool == NULL) {
+			g_debug ("loading files serially: %s",
+				 error_local->message);
+		}
+	}
+	if (pool == NULL) {
+		for (guint i = 0; i < items->len; i++)
+			func (g_ptr_array_index (items, i), helper);
+		return;
+	}
+	for (guint i = 0; i < items->len; i++)
+		g_thread_pool_push (pool, g_ptr_array_index (items, i), NULL);
+	g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+static gboolean
+as_store_load_app_info_stream_cb (AsNode *node, gpointer user_data, GError **error)
+{
+	AsStoreRootHelper *helper = (AsStoreRootHelper *) user_data;
+	const gchar *tmp = as_node_get_name (node->parent);
+
+	/* only components in the root node are parsed */
+	if (g_strcmp0 (tmp, "components") != 0 &&
+	    g_strcmp0 (tmp, "applications") != 0)
+		return TRUE;
+	if (!helper->prepared)
+		as_store_root_helper_setup (helper, node->parent, helper->origin_fallback);
+	return as_store_root_helper_add_component (helper, node, error);
+}
+
+static void
+as_store_load_app_info_item_cb (gpointer data, gpointer user_data)
+{
+	AsStoreLoadItem *item = (AsStoreLoadItem *) data;
+	AsStoreLoadHelper *helper = (AsStoreLoadHelper *) user_data;
+	AsStoreRootHelper root_helper = {
+		.store = helper->store,
+		.scope = helper->scope,
+		.arch = helper->arch,
+		.load_flags = helper->load_flags,
+	};
+	g_autofree gchar *icon_prefix = NULL;
+	g_autofree gchar *origin_fallback = NULL;
+	g_autoptr(GFile) file = NULL;
+
+	/* DEP-11, cab archives and ignored files are loaded later */
+	if (g_strstr_len (item->filename, -1, ".yml") != NULL)
+		return;
+	if (g_str_has_suffix (item->filename, ".cab"))
+		return;
+	if (helper->load_flags & AS_STORE_LOAD_FLAG_ONLY_UNCOMPRESSED &&
+	    g_str_has_suffix (item->filename, ".gz"))
+		return;
+
+	/* the same as as_store_guess_origin_fallback() would set */
+	origin_fallback = as_store_get_origin_fallback (item->filename, NULL);
+	if (origin_fallback == NULL)
+		return;
+
+	/* parse each component as it is read, as in as_store_from_file_stream(),
+	 * but keep the apps to add to the store in the main thread */
+	icon_prefix = g_path_get_dirname (item->filename);
+	root_helper.icon_prefix = icon_prefix;
+	root_helper.source_filename = item->filename;
+	root_helper.origin_fallback = origin_fallback;
+	root_helper.apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	file = g_file_new_for_path (item->filename);
+	item->root = as_node_from_file_stream (file,
+					       helper->parse_flags,
+					       3,
+					       as_store_load_app_info_stream_cb,
+					       &root_helper,
+					       helper->cancellable,
+					       &item->error);
+	item->apps = g_steal_pointer (&root_helper.apps);
+	as_store_root_helper_clear (&root_helper);
+}
+
+static gboolean
+as_store_load_app_info_item (AsStore *store,
+			     AsAppScope scope,
+			     AsStoreLoadItem *item,
+			     const gchar *arch,
+			     guint32 flags,
+			     GCancellable *cancellable,
+			     GError **error)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	AsNode *apps;
+	_cleanup_uninhibit_ guint32 *tok = NULL;
+	g_autoptr(AsProfileTask) ptask = NULL;
+
+	/* not parsed in a thread */
+	if (item->root == NULL && item->error == NULL) {
+		return as_store_load_app_info_file (store,
+						    scope,
+						    item->filename,
+						    arch,
+						    flags,
+						    cancellable,
+						    error);
+	}
+	if (item->error != NULL) {
+		if (g_error_matches (item->error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
+			g_propagate_error (error, g_steal_pointer (&item->error));
+			return FALSE;
+		}
+		g_set_error (error,
+			     AS_STORE_ERROR,
+			     AS_STORE_ERROR_FAILED,
+			     "Failed to parse %s file: %s",
+			     item->filename, item->error->message);
+		return FALSE;
+	}
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile, "AsStore:store-from-root");
+	g_assert (ptask != NULL);
+
+	/* emit once when finished */
+	tok = as_store_changed_inhibit (store);
+
+	/* the apps were created in the thread, but the store properties
+	 * are only set here */
+	if (!as_store_guess_origin_fallback (store, item->filename, error))
+		return FALSE;
+	apps = as_store_root_find_apps (item->root, error);
+	if (apps == NULL)
+		return FALSE;
+	as_store_root_apply (store, apps);
+	for (guint i = 0; i < item->apps->len; i++)
+		as_store_add_app (store, g_ptr_array_index (item->apps, i));
+
+	/* add addon kinds to their parent AsApp */
+	as_store_match_addons (store);
+
+	/* this store has changed */
+	as_store_changed_uninhibit (&tok);
+	as_store_perhaps_emit_changed (store, "from-root");
+
+	return TRUE;
+}
+
 static gboolean
 as_store_load_app_info (AsStore *store,
 			AsAppScope scope,
@@ -3007,12 +4416,12 @@ as_store_load_app_info (AsStore *store,
 	_cleanup_uninhibit_ guint32 *tok = NULL;
 
 	/* Don't add the same dir twice, we're monitoring it for changes anyway */
-	g_mutex_lock (&priv->mutex);
+	g_rw_lock_reader_lock (&priv->rw_lock);
 	if (g_hash_table_contains (priv->appinfo_dirs, path)) {
-		g_mutex_unlock (&priv->mutex);
+		g_rw_lock_reader_unlock (&priv->rw_lock);
 		return TRUE;
 	}
-	g_mutex_unlock (&priv->mutex);
+	g_rw_lock_reader_unlock (&priv->rw_lock);
 
 	/* emit once when finished */
 	tok = as_store_changed_inhibit (store);
@@ -3022,6 +4431,7 @@ as_store_load_app_info (AsStore *store,
 		const gchar *tmp;
 		g_autoptr(GDir) dir = NULL;
 		g_autoptr(GError) error_local = NULL;
+		g_autoptr(GPtrArray) items = NULL;
 		dir = g_dir_open (path, 0, &error_local);
 		if (dir == NULL) {
 			if (flags & AS_STORE_LOAD_FLAG_IGNORE_INVALID) {
@@ -3037,22 +4447,48 @@ as_store_load_app_info (AsStore *store,
 			return FALSE;
 		}
 
+		items = g_ptr_array_new_with_free_func ((GDestroyNotify) as_store_load_item_free);
 		while ((tmp = g_dir_read_name (dir)) != NULL) {
-			GError *error_store = NULL;
-			g_autofree gchar *filename_md = NULL;
+			AsStoreLoadItem *item;
 			if (g_strcmp0 (tmp, "icons") == 0)
 				continue;
-			filename_md = g_build_filename (path, tmp, NULL);
-			if (!as_store_load_app_info_file (store,
+			item = as_store_load_item_new (path, tmp);
+			as_store_add_cache_source (store, item->filename);
+			g_ptr_array_add (items, item);
+		}
+
+		/* parse the XML files in threads */
+		if (flags & AS_STORE_LOAD_FLAG_PARALLEL &&
+		    items->len >= AS_STORE_LOAD_PARALLEL_MIN_FILES) {
+			AsStoreLoadHelper helper = {
+				.store = store,
+				.scope = scope,
+				.arch = arch,
+				.load_flags = flags,
+				.parse_flags = AS_NODE_FROM_XML_FLAG_LITERAL_TEXT,
+				.cancellable = cancellable,
+			};
+			if (priv->add_flags & AS_STORE_ADD_FLAG_ONLY_NATIVE_LANGS)
+				helper.parse_flags |= AS_NODE_FROM_XML_FLAG_ONLY_NATIVE_LANGS;
+			if (priv->add_flags & AS_STORE_ADD_FLAG_LAZY_PARSE)
+				helper.parse_flags |= AS_NODE_FROM_XML_FLAG_DEFER_LARGE_DATA;
+			as_store_load_items_parallel (&helper, items,
+						      as_store_load_app_info_item_cb);
+		}
+
+		for (guint i = 0; i < items->len; i++) {
+			AsStoreLoadItem *item = g_ptr_array_index (items, i);
+			GError *error_store = NULL;
+			if (!as_store_load_app_info_item (store,
 							  scope,
-							  filename_md,
+							  item,
 							  arch,
 							  flags,
 							  cancellable,
 							  &error_store)) {
 				if (flags & AS_STORE_LOAD_FLAG_IGNORE_INVALID) {
 					g_warning ("Ignoring invalid AppStream file %s: %s",
-						   filename_md, error_store->message);
+						   item->filename, error_store->message);
 					g_clear_error (&error_store);
 				} else {
 					g_propagate_error (error, error_store);
@@ -3063,6 +4499,7 @@ as_store_load_app_info (AsStore *store,
 	}
 
 	/* watch the directories for changes, even if it does not exist yet */
+	as_store_add_cache_source (store, path);
 	as_store_add_path_data (store, path, scope, arch);
 	if (!as_monitor_add_directory (priv->monitor,
 				       path,
@@ -3100,6 +4537,76 @@ as_store_load_installed_file_is_valid (const gchar *filename)
 	return FALSE;
 }
 
+/* returns TRUE if the file does not need to be parsed */
+static gboolean
+as_store_load_installed_skip (AsStore *store,
+			      const gchar *filename,
+			      const gchar *basename)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	AsApp *app_tmp;
+
+	if ((priv->add_flags & AS_STORE_ADD_FLAG_PREFER_LOCAL) > 0)
+		return FALSE;
+	app_tmp = as_store_get_app_by_id (store, basename);
+	if (app_tmp == NULL ||
+	    as_app_get_format_by_kind (app_tmp, AS_FORMAT_KIND_DESKTOP) == NULL)
+		return FALSE;
+	as_app_set_state (app_tmp, AS_APP_STATE_INSTALLED);
+	g_debug ("not parsing %s as %s already exists", filename, basename);
+	return TRUE;
+}
+
+/* this does not modify the store, and so is safe to call from a thread */
+static AsApp *
+as_store_load_installed_app (AsStore *store,
+			     AsAppScope scope,
+			     const gchar *filename,
+			     guint32 parse_flags,
+			     GError **error)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	GPtrArray *icons;
+	g_autoptr(AsApp) app = NULL;
+
+	app = as_app_new ();
+	as_app_set_scope (app, scope);
+	if (!as_app_parse_file (app, filename, parse_flags, error))
+		return NULL;
+
+	/* convert any UNKNOWN icons to LOCAL */
+	icons = as_app_get_icons (app);
+	for (guint i = 0; i < icons->len; i++) {
+		AsIcon *icon = g_ptr_array_index (icons, i);
+		if (as_icon_get_kind (icon) == AS_ICON_KIND_UNKNOWN)
+			as_icon_set_kind (icon, AS_ICON_KIND_STOCK);
+	}
+
+	/* set the ID prefix */
+	if ((priv->add_flags & AS_STORE_ADD_FLAG_USE_UNIQUE_ID) == 0)
+		as_store_fixup_id_prefix (app, as_app_scope_to_string (scope));
+
+	/* as these are added from installed AppData files then all the
+	 * releases can also be marked as installed */
+	as_store_set_app_installed (app);
+
+	/* set lower priority than AppStream entries */
+	as_app_set_priority (app, -1);
+	return g_steal_pointer (&app);
+}
+
+static void
+as_store_load_installed_item_cb (gpointer data, gpointer user_data)
+{
+	AsStoreLoadItem *item = (AsStoreLoadItem *) data;
+	AsStoreLoadHelper *helper = (AsStoreLoadHelper *) user_data;
+	item->app = as_store_load_installed_app (helper->store,
+						 helper->scope,
+						 item->filename,
+						 helper->parse_flags,
+						 &item->error);
+}
+
 static gboolean
 as_store_load_installed (AsStore *store,
 			 guint32 flags,
@@ -3109,10 +4616,11 @@ as_store_load_installed (AsStore *store,
 			 GError **error)
 {
 	guint32 parse_flags = AS_APP_PARSE_FLAG_USE_HEURISTICS;
+	gboolean parallel;
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	GError *error_local = NULL;
 	const gchar *tmp;
 	g_autoptr(GDir) dir = NULL;
+	g_autoptr(GPtrArray) items = NULL;
 	_cleanup_uninhibit_ guint32 *tok = NULL;
 	g_autoptr(AsProfileTask) ptask = NULL;
 
@@ -3125,6 +4633,7 @@ as_store_load_installed (AsStore *store,
 		return FALSE;
 
 	/* watch the directories for changes */
+	as_store_add_cache_source (store, path);
 	as_store_add_path_data (store, path, scope, NULL);
 	if (!as_monitor_add_directory (priv->monitor,
 				       path,
@@ -3146,63 +4655,65 @@ as_store_load_installed (AsStore *store,
 	if (priv->add_flags & AS_STORE_ADD_FLAG_ONLY_NATIVE_LANGS)
 		parse_flags |= AS_APP_PARSE_FLAG_ONLY_NATIVE_LANGS;
 
+	items = g_ptr_array_new_with_free_func ((GDestroyNotify) as_store_load_item_free);
 	while ((tmp = g_dir_read_name (dir)) != NULL) {
-		AsApp *app_tmp;
-		GPtrArray *icons;
-		guint i;
-		g_autofree gchar *filename = NULL;
-		g_autoptr(AsApp) app = NULL;
-		filename = g_build_filename (path, tmp, NULL);
+		g_autofree gchar *filename = g_build_filename (path, tmp, NULL);
+		as_store_add_cache_source (store, filename);
 		if (!as_store_load_installed_file_is_valid (filename))
 			continue;
-		if ((priv->add_flags & AS_STORE_ADD_FLAG_PREFER_LOCAL) == 0) {
-			app_tmp = as_store_get_app_by_id (store, tmp);
-			if (app_tmp != NULL &&
-			    as_app_get_format_by_kind (app_tmp, AS_FORMAT_KIND_DESKTOP) != NULL) {
-				as_app_set_state (app_tmp, AS_APP_STATE_INSTALLED);
-				g_debug ("not parsing %s as %s already exists",
-					 filename, tmp);
-				continue;
-			}
+		g_ptr_array_add (items, as_store_load_item_new (path, tmp));
+	}
+
+	/* parse all the files in threads, although any that would have been
+	 * skipped are still ignored when adding them to the store */
+	parallel = flags & AS_STORE_LOAD_FLAG_PARALLEL &&
+		   items->len >= AS_STORE_LOAD_PARALLEL_MIN_FILES;
+	if (parallel) {
+		AsStoreLoadHelper helper = {
+			.store = store,
+			.scope = scope,
+			.load_flags = flags,
+			.parse_flags = parse_flags,
+			.cancellable = cancellable,
+		};
+		as_store_load_items_parallel (&helper, items,
+					      as_store_load_installed_item_cb);
+	}
+
+	for (guint i = 0; i < items->len; i++) {
+		AsStoreLoadItem *item = g_ptr_array_index (items, i);
+		g_autoptr(AsApp) app = NULL;
+		g_autoptr(GError) error_local = NULL;
+
+		if (as_store_load_installed_skip (store, item->filename, item->basename))
+			continue;
+		if (parallel) {
+			app = g_steal_pointer (&item->app);
+			error_local = g_steal_pointer (&item->error);
+		} else {
+			app = as_store_load_installed_app (store,
+							   scope,
+							   item->filename,
+							   parse_flags,
+							   &error_local);
 		}
-		app = as_app_new ();
-		as_app_set_scope (app, scope);
-		if (!as_app_parse_file (app, filename, parse_flags, &error_local)) {
+		if (app == NULL) {
 			if (g_error_matches (error_local,
 					     AS_APP_ERROR,
 					     AS_APP_ERROR_INVALID_TYPE)) {
-				g_debug ("Ignoring %s: %s", filename,
+				g_debug ("Ignoring %s: %s", item->filename,
 					 error_local->message);
-				g_clear_error (&error_local);
 				continue;
 			}
-			g_propagate_error (error, error_local);
+			g_propagate_error (error, g_steal_pointer (&error_local));
 			return FALSE;
 		}
 
-		/* convert any UNKNOWN icons to LOCAL */
-		icons = as_app_get_icons (app);
-		for (i = 0; i < icons->len; i++) {
-			AsIcon *icon = g_ptr_array_index (icons, i);
-			if (as_icon_get_kind (icon) == AS_ICON_KIND_UNKNOWN)
-				as_icon_set_kind (icon, AS_ICON_KIND_STOCK);
-		}
-
-		/* set the ID prefix */
-		if ((priv->add_flags & AS_STORE_ADD_FLAG_USE_UNIQUE_ID) == 0)
-			as_store_fixup_id_prefix (app, as_app_scope_to_string (scope));
-
 		/* do not load applications with vetos */
 		if ((flags & AS_STORE_LOAD_FLAG_ALLOW_VETO) == 0 &&
 		    as_app_get_vetos(app)->len > 0)
 			continue;
 
-		/* as these are added from installed AppData files then all the
-		 * releases can also be marked as installed */
-		as_store_set_app_installed (app);
-
-		/* set lower priority than AppStream entries */
-		as_app_set_priority (app, -1);
 		as_store_add_app (store, app);
 	}
 
@@ -3230,7 +4741,36 @@ gboolean
 as_store_load_path (AsStore *store, const gchar *path,
 		    GCancellable *cancellable, GError **error)
 {
-	return as_store_load_installed (store, AS_STORE_LOAD_FLAG_NONE,
+	return as_store_load_path_full (store, path,
+					AS_STORE_LOAD_FLAG_NONE,
+					cancellable, error);
+}
+
+/**
+ * as_store_load_path_full:
+ * @store: a #AsStore instance.
+ * @path: A path to load
+ * @flags: #AsStoreLoadFlags, e.g. %AS_STORE_LOAD_FLAG_PARALLEL
+ * @cancellable: a #GCancellable.
+ * @error: A #GError or %NULL.
+ *
+ * Loads the store from a specific path. If %AS_STORE_LOAD_FLAG_PARALLEL is
+ * used then the files are parsed using multiple threads, but are added to
+ * the store in the same order as they are found.
+ *
+ * Returns: %TRUE for success
+ *
+ * Since: 0.8.5
+ **/
+gboolean
+as_store_load_path_full (AsStore *store,
+			 const gchar *path,
+			 guint32 flags,
+			 GCancellable *cancellable,
+			 GError **error)
+{
+	g_return_val_if_fail (AS_IS_STORE (store), FALSE);
+	return as_store_load_installed (store, flags,
 					AS_APP_SCOPE_UNKNOWN,
 					path, cancellable, error);
 }
@@ -3454,42 +4994,371 @@ as_store_search_per_user (AsStore *store,
 			return FALSE;
 	}
 
-	/* AppData */
-	if ((flags & AS_STORE_LOAD_FLAG_APPDATA) > 0) {
-		g_autofree gchar *dest = NULL;
-		dest = g_build_filename (g_get_user_data_dir (), "appdata", NULL);
-		if (!as_store_search_installed (store, flags, AS_APP_SCOPE_USER,
-						dest, cancellable, error))
+	/* AppData */
+	if ((flags & AS_STORE_LOAD_FLAG_APPDATA) > 0) {
+		g_autofree gchar *dest = NULL;
+		dest = g_build_filename (g_get_user_data_dir (), "appdata", NULL);
+		if (!as_store_search_installed (store, flags, AS_APP_SCOPE_USER,
+						dest, cancellable, error))
+			return FALSE;
+	}
+
+	/* MetaInfo */
+	if ((flags & AS_STORE_LOAD_FLAG_APPDATA) > 0) {
+		g_autofree gchar *dest = NULL;
+		dest = g_build_filename (g_get_user_data_dir (), "metainfo", NULL);
+		if (!as_store_search_installed (store, flags, AS_APP_SCOPE_USER,
+						dest, cancellable, error))
+			return FALSE;
+	}
+
+	/* desktop files */
+	if ((flags & AS_STORE_LOAD_FLAG_DESKTOP) > 0) {
+		g_autofree gchar *dest = NULL;
+		dest = g_build_filename (g_get_user_data_dir (), "applications", NULL);
+		if (!as_store_search_installed (store, flags, AS_APP_SCOPE_USER,
+						dest, cancellable, error))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* the saved token caches are only valid for the same version and locales,
+ * and the format version has to be bumped when the layout changes */
+#define AS_STORE_SEARCH_CACHE_MAGIC		"ASSEARCH"
+#define AS_STORE_SEARCH_CACHE_VERSION		2
+
+typedef struct {
+	gchar			 magic[8];
+	guint32			 version;
+	guint32			 n_tokens;
+	guint32			 n_apps;
+} AsStoreSearchCacheHeader;
+
+typedef struct {
+	gchar			 checksum[64];	/* SHA-256 in hex of the sources */
+	guint32			 n_tokens;
+} AsStoreSearchCacheApp;
+
+typedef struct {
+	guint32			 idx;		/* into the strings */
+	guint32			 match;		/* AsAppTokenType */
+} AsStoreSearchCacheToken;
+
+typedef struct {
+	AsStore			*store;
+	GPtrArray		*apps;		/* of AsApp */
+	gchar			**checksums;	/* same order as ->apps, may have NULLs */
+	GHashTable		*entries;	/* checksum : AsStoreSearchCacheApp */
+	guint32			*ids;		/* of the strings in ->token_dict */
+	guint			 n_ids;
+	guint			 n_entries;
+	guint			 n_checksums;	/* apps that can be saved */
+	volatile gint		 n_missing;
+} AsStoreSearchCacheHelper;
+
+static gint
+as_store_search_cache_id_sort_cb (gconstpointer a, gconstpointer b)
+{
+	return g_strcmp0 (*(const gchar **) a, *(const gchar **) b);
+}
+
+/* each set of applications gets a different file so that stores loaded
+ * from different sources do not keep replacing each other's cache */
+static gchar *
+as_store_search_cache_get_filename (AsStore *store, GPtrArray *apps)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	const gchar * const *locales = g_get_language_names ();
+	g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+	g_autofree gchar *basename = NULL;
+	g_autoptr(GPtrArray) ids = g_ptr_array_sized_new (apps->len);
+
+	g_autofree gchar *search_match = NULL;
+	g_autoptr(GList) blacklist = NULL;
+
+	g_checksum_update (checksum, (const guchar *) PACKAGE_VERSION, -1);
+	if (priv->search_locale != NULL) {
+		g_checksum_update (checksum, (const guchar *) "\nstem:", -1);
+		g_checksum_update (checksum, (const guchar *) priv->search_locale, -1);
+	}
+	for (guint i = 0; locales[i] != NULL; i++) {
+		g_checksum_update (checksum, (const guchar *) "\n", 1);
+		g_checksum_update (checksum, (const guchar *) locales[i], -1);
+	}
+
+	/* the same text gives different tokens for other settings */
+	search_match = g_strdup_printf ("\nmatch:%u", priv->search_match);
+	g_checksum_update (checksum, (const guchar *) search_match, -1);
+	blacklist = g_hash_table_get_keys (priv->search_blacklist);
+	blacklist = g_list_sort (blacklist, (GCompareFunc) g_strcmp0);
+	for (GList *l = blacklist; l != NULL; l = l->next) {
+		g_checksum_update (checksum, (const guchar *) "\nblacklist:", -1);
+		g_checksum_update (checksum, (const guchar *) l->data, -1);
+	}
+	for (guint i = 0; i < apps->len; i++) {
+		AsApp *app = g_ptr_array_index (apps, i);
+		g_ptr_array_add (ids, (gpointer) as_app_get_unique_id (app));
+	}
+	g_ptr_array_sort (ids, as_store_search_cache_id_sort_cb);
+	for (guint i = 0; i < ids->len; i++) {
+		const gchar *id = g_ptr_array_index (ids, i);
+		g_checksum_update (checksum, (const guchar *) "\n", 1);
+		if (id != NULL)
+			g_checksum_update (checksum, (const guchar *) id, -1);
+	}
+	basename = g_strdup_printf ("search-%s.cache",
+				    g_checksum_get_string (checksum));
+	return g_build_filename (priv->search_cache_dir, basename, NULL);
+}
+
+/* the size and modification time are not enough, as a file can be replaced
+ * in the same second, or by a package that preserves the mtime */
+static gchar *
+as_store_search_cache_hash_file (const gchar *fn)
+{
+	g_autoptr(GMappedFile) mapped_file = NULL;
+
+	mapped_file = g_mapped_file_new (fn, FALSE, NULL);
+	if (mapped_file == NULL)
+		return NULL;
+	return g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+					    (const guchar *) g_mapped_file_get_contents (mapped_file),
+					    g_mapped_file_get_length (mapped_file));
+}
+
+/* adds the files that @app was loaded from, or returns %FALSE if there are
+ * none, as an app created in memory can change without anything on disk
+ * changing */
+static gboolean
+as_store_search_cache_add_sources (GChecksum *checksum,
+				   AsApp *app,
+				   GHashTable *hashes)
+{
+	GPtrArray *formats = as_app_get_formats (app);
+	gboolean ret = FALSE;
+
+	g_checksum_update (checksum, (const guchar *) "\napp:", -1);
+	if (as_app_get_unique_id (app) != NULL)
+		g_checksum_update (checksum, (const guchar *) as_app_get_unique_id (app), -1);
+	for (guint i = 0; i < formats->len; i++) {
+		AsFormat *format = g_ptr_array_index (formats, i);
+		const gchar *fn = as_format_get_filename (format);
+		gchar *hash;
+		if (fn == NULL)
+			continue;
+
+		/* many apps are loaded from the same file */
+		hash = g_hash_table_lookup (hashes, fn);
+		if (hash == NULL) {
+			hash = as_store_search_cache_hash_file (fn);
+			if (hash == NULL)
+				return FALSE;
+			g_hash_table_insert (hashes, g_strdup (fn), hash);
+		}
+		g_checksum_update (checksum, (const guchar *) "\nfile:", -1);
+		g_checksum_update (checksum, (const guchar *) fn, -1);
+		g_checksum_update (checksum, (const guchar *) ";", -1);
+		g_checksum_update (checksum, (const guchar *) hash, -1);
+		ret = TRUE;
+	}
+	return ret;
+}
+
+/* identifies the token cache of @app by the contents of the files it and
+ * anything merged into it were loaded from, without parsing any of the
+ * text, so that apps loaded lazily do not have to be parsed; returns %NULL
+ * if the tokens cannot be saved; must be called with priv->rw_lock held */
+static gchar *
+as_store_search_cache_get_checksum (AsStore *store, AsApp *app, GHashTable *hashes)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	GPtrArray *addons = as_app_get_addons (app);
+	GPtrArray *merges = NULL;
+	g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+	if (!as_store_search_cache_add_sources (checksum, app, hashes))
+		return NULL;
+	for (guint i = 0; i < addons->len; i++) {
+		AsApp *donor = g_ptr_array_index (addons, i);
+		if (!as_store_search_cache_add_sources (checksum, donor, hashes))
+			return NULL;
+	}
+	if (as_app_get_id (app) != NULL)
+		merges = g_hash_table_lookup (priv->hash_merge_id, as_app_get_id (app));
+	for (guint i = 0; merges != NULL && i < merges->len; i++) {
+		AsApp *donor = g_ptr_array_index (merges, i);
+		if (!as_store_search_cache_add_sources (checksum, donor, hashes))
+			return NULL;
+	}
+	return g_strdup (g_checksum_get_string (checksum));
+}
+
+/* adds the saved token caches to @helper, or returns %FALSE if invalid */
+static gboolean
+as_store_search_cache_parse (AsStoreSearchCacheHelper *helper,
+			     const guint8 *data,
+			     gsize len)
+{
+	AsStorePrivate *priv = GET_PRIVATE (helper->store);
+	AsStoreSearchCacheHeader hdr;
+	gsize off = sizeof (AsStoreSearchCacheHeader);
+
+	if (len < off)
+		return FALSE;
+	memcpy (&hdr, data, sizeof (hdr));
+	if (memcmp (hdr.magic, AS_STORE_SEARCH_CACHE_MAGIC, sizeof (hdr.magic)) != 0)
+		return FALSE;
+	if (hdr.version != AS_STORE_SEARCH_CACHE_VERSION)
+		return FALSE;
+
+	/* each string needs at least a NUL byte and each app a header, so
+	 * never allocate more than the file could possibly contain */
+	if (hdr.n_tokens > len - off)
+		return FALSE;
+	if (hdr.n_apps > (len - off - hdr.n_tokens) / sizeof (AsStoreSearchCacheApp))
+		return FALSE;
+
+	/* the string table, mapped to the IDs used by this store */
+	helper->ids = g_new0 (guint32, hdr.n_tokens);
+	helper->n_ids = hdr.n_tokens;
+	for (guint32 i = 0; i < hdr.n_tokens; i++) {
+		const gchar *str = (const gchar *) data + off;
+		const gchar *end = memchr (str, '\0', len - off);
+		g_autoptr(AsRefString) rstr = NULL;
+		if (end == NULL)
 			return FALSE;
+		rstr = as_ref_string_new_with_length (str, (gsize) (end - str));
+		helper->ids[i] = as_token_dict_insert (priv->token_dict, rstr);
+		off += (gsize) (end - str) + 1;
 	}
 
-	/* MetaInfo */
-	if ((flags & AS_STORE_LOAD_FLAG_APPDATA) > 0) {
-		g_autofree gchar *dest = NULL;
-		dest = g_build_filename (g_get_user_data_dir (), "metainfo", NULL);
-		if (!as_store_search_installed (store, flags, AS_APP_SCOPE_USER,
-						dest, cancellable, error))
+	/* each app, looked up by the checksum when required */
+	for (guint32 i = 0; i < hdr.n_apps; i++) {
+		AsStoreSearchCacheApp app;
+		if (len - off < sizeof (app))
 			return FALSE;
+		memcpy (&app, data + off, sizeof (app));
+		if ((len - off - sizeof (app)) / sizeof (AsStoreSearchCacheToken) < app.n_tokens)
+			return FALSE;
+		g_hash_table_insert (helper->entries,
+				     g_strndup (app.checksum, sizeof (app.checksum)),
+				     (gpointer) (data + off));
+		off += sizeof (app) + app.n_tokens * sizeof (AsStoreSearchCacheToken);
 	}
+	helper->n_entries = hdr.n_apps;
+	return off == len;
+}
 
-	/* desktop files */
-	if ((flags & AS_STORE_LOAD_FLAG_DESKTOP) > 0) {
-		g_autofree gchar *dest = NULL;
-		dest = g_build_filename (g_get_user_data_dir (), "applications", NULL);
-		if (!as_store_search_installed (store, flags, AS_APP_SCOPE_USER,
-						dest, cancellable, error))
+static gboolean
+as_store_search_cache_load_app (AsStoreSearchCacheHelper *helper,
+				AsApp *app,
+				const gchar *checksum)
+{
+	AsStorePrivate *priv = GET_PRIVATE (helper->store);
+	AsStoreSearchCacheApp entry;
+	const guint8 *data;
+	g_autoptr(GArray) token_cache = NULL;
+
+	if (as_app_get_token_dict (app) != priv->token_dict)
+		return FALSE;
+	data = g_hash_table_lookup (helper->entries, checksum);
+	if (data == NULL)
+		return FALSE;
+	memcpy (&entry, data, sizeof (entry));
+	data += sizeof (entry);
+	token_cache = g_array_sized_new (FALSE, FALSE, sizeof (AsAppToken), entry.n_tokens);
+	for (guint32 i = 0; i < entry.n_tokens; i++) {
+		AsStoreSearchCacheToken tmp;
+		AsAppToken token;
+		memcpy (&tmp, data + i * sizeof (tmp), sizeof (tmp));
+		if (tmp.idx >= helper->n_ids)
 			return FALSE;
+		token.id = helper->ids[tmp.idx];
+		token.match = (AsAppTokenType) tmp.match;
+		g_array_append_val (token_cache, token);
 	}
-	return TRUE;
+	return as_app_set_token_cache (app, token_cache);
 }
 
 static void
 as_store_load_search_cache_cb (gpointer data, gpointer user_data)
 {
-	g_autoptr(AsApp) app = AS_APP (data);
+	AsStoreSearchCacheHelper *helper = (AsStoreSearchCacheHelper *) user_data;
+	guint idx = GPOINTER_TO_UINT (data) - 1;
+	AsApp *app = g_ptr_array_index (helper->apps, idx);
+
+	/* reuse the saved tokens if the source files have not changed */
+	if (helper->checksums != NULL && helper->checksums[idx] != NULL) {
+		if (as_store_search_cache_load_app (helper, app, helper->checksums[idx]))
+			return;
+		g_atomic_int_inc (&helper->n_missing);
+	}
 	as_app_search_matches (app, NULL);
 }
 
+static gboolean
+as_store_search_cache_save (AsStoreSearchCacheHelper *helper,
+			    const gchar *filename,
+			    GError **error)
+{
+	AsStoreSearchCacheHeader hdr;
+	g_autofree gchar *dirname = NULL;
+	g_autoptr(GByteArray) buf = g_byte_array_new ();
+	g_autoptr(GByteArray) buf_apps = g_byte_array_new ();
+	g_autoptr(GHashTable) strings = g_hash_table_new (g_str_hash, g_str_equal);
+
+	/* each app refers to a table of unique strings */
+	memset (&hdr, 0, sizeof (hdr));
+	memcpy (hdr.magic, AS_STORE_SEARCH_CACHE_MAGIC, sizeof (hdr.magic));
+	hdr.version = AS_STORE_SEARCH_CACHE_VERSION;
+	g_byte_array_append (buf, (const guint8 *) &hdr, sizeof (hdr));
+	for (guint i = 0; i < helper->apps->len; i++) {
+		AsApp *app = g_ptr_array_index (helper->apps, i);
+		AsStoreSearchCacheApp entry;
+		AsTokenDict *token_dict;
+		GArray *token_cache;
+
+		if (helper->checksums[i] == NULL)
+			continue;
+		token_cache = as_app_get_token_cache (app);
+		token_dict = as_app_get_token_dict (app);
+		memcpy (entry.checksum, helper->checksums[i], sizeof (entry.checksum));
+		entry.n_tokens = token_cache->len;
+		g_byte_array_append (buf_apps, (const guint8 *) &entry, sizeof (entry));
+		for (guint j = 0; j < token_cache->len; j++) {
+			AsAppToken *token = &g_array_index (token_cache, AsAppToken, j);
+			AsRefString *str = as_token_dict_get (token_dict, token->id);
+			AsStoreSearchCacheToken tmp;
+			gpointer idx = g_hash_table_lookup (strings, str);
+			if (idx == NULL) {
+				idx = GUINT_TO_POINTER (hdr.n_tokens + 1);
+				g_hash_table_insert (strings, str, idx);
+				g_byte_array_append (buf, (const guint8 *) str,
+						     (guint) strlen (str) + 1);
+				hdr.n_tokens++;
+			}
+			tmp.idx = GPOINTER_TO_UINT (idx) - 1;
+			tmp.match = token->match;
+			g_byte_array_append (buf_apps, (const guint8 *) &tmp, sizeof (tmp));
+		}
+		hdr.n_apps++;
+	}
+	memcpy (buf->data, &hdr, sizeof (hdr));
+	g_byte_array_append (buf, buf_apps->data, buf_apps->len);
+
+	dirname = g_path_get_dirname (filename);
+	if (g_mkdir_with_parents (dirname, 0700) != 0) {
+		g_set_error (error,
+			     AS_STORE_ERROR,
+			     AS_STORE_ERROR_FAILED,
+			     "Failed to create %s", dirname);
+		return FALSE;
+	}
+	return g_file_set_contents (filename, (const gchar *) buf->data,
+				    (gssize) buf->len, error);
+}
+
 /**
  * as_store_load_search_cache:
  * @store: a #AsStore instance.
@@ -3498,6 +5367,13 @@ as_store_load_search_cache_cb (gpointer data, gpointer user_data)
  * all the search keywords for all applications in the store to be
  * pre-processed at one time in multiple threads rather than on demand.
  *
+ * If a search cache directory has been set using
+ * as_store_set_search_cache_dir() then the tokens are saved there, and
+ * any application whose source files have the same contents uses the
+ * saved tokens rather than processing the text again. Applications that were
+ * not loaded from a file are always processed. Each set of applications is
+ * saved to a different file.
+ *
  * Note: Calling as_app_search_matches() automatically generates the search
  * cache for the #AsApp object if it has not already been generated.
  *
@@ -3507,9 +5383,12 @@ void
 as_store_load_search_cache (AsStore *store)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	guint i;
+	AsStoreSearchCacheHelper helper = { NULL };
 	GThreadPool *pool;
+	g_autofree gchar *filename = NULL;
 	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GError) error_pool = NULL;
+	g_autoptr(GMappedFile) mapped_file = NULL;
 
 	g_return_if_fail (AS_IS_STORE (store));
 
@@ -3518,17 +5397,561 @@ as_store_load_search_cache (AsStore *store)
 					  "AsStore:load-token-cache");
 	as_profile_task_set_threaded (ptask, TRUE);
 
-	/* load the token cache for each app in multiple threads */
+	g_rw_lock_reader_lock (&priv->rw_lock);
+	helper.store = store;
+	helper.apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	for (guint i = 0; i < priv->array->len; i++)
+		g_ptr_array_add (helper.apps, g_object_ref (g_ptr_array_index (priv->array, i)));
+	helper.entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	if (priv->search_cache_dir != NULL) {
+		g_autoptr(GHashTable) hashes = NULL;
+		filename = as_store_search_cache_get_filename (store, helper.apps);
+		helper.checksums = g_new0 (gchar *, helper.apps->len + 1);
+		hashes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+		for (guint i = 0; i < helper.apps->len; i++) {
+			AsApp *app = g_ptr_array_index (helper.apps, i);
+			helper.checksums[i] = as_store_search_cache_get_checksum (store, app, hashes);
+			if (helper.checksums[i] != NULL)
+				helper.n_checksums++;
+		}
+		mapped_file = g_mapped_file_new (filename, FALSE, NULL);
+		if (mapped_file != NULL &&
+		    !as_store_search_cache_parse (&helper,
+						  (const guint8 *) g_mapped_file_get_contents (mapped_file),
+						  g_mapped_file_get_length (mapped_file))) {
+			g_debug ("ignoring invalid search cache %s", filename);
+			g_hash_table_remove_all (helper.entries);
+			helper.n_entries = 0;
+		}
+	}
+
+	/* load the token cache for each app in multiple threads; the lock is
+	 * held until saved so that the dictionary cannot be pruned meanwhile */
 	pool = g_thread_pool_new (as_store_load_search_cache_cb,
-				  store, 4, TRUE, NULL);
-	g_assert (pool != NULL);
-	g_mutex_lock (&priv->mutex);
-	for (i = 0; i < priv->array->len; i++) {
+				  &helper, 4, TRUE, &error_pool);
+	if (pool == NULL) {
+		g_debug ("loading search cache serially: %s", error_pool->message);
+		for (guint i = 0; i < helper.apps->len; i++)
+			as_store_load_search_cache_cb (GUINT_TO_POINTER (i + 1), &helper);
+	} else {
+		for (guint i = 0; i < helper.apps->len; i++)
+			g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+		g_thread_pool_free (pool, FALSE, TRUE);
+	}
+
+	/* save for next time if anything changed */
+	if (filename != NULL &&
+	    (helper.n_missing > 0 ||
+	     helper.n_entries != helper.n_checksums)) {
+		g_autoptr(GError) error_local = NULL;
+		if (!as_store_search_cache_save (&helper, filename, &error_local)) {
+			g_debug ("failed to save search cache: %s",
+				 error_local->message);
+		}
+	}
+	g_rw_lock_reader_unlock (&priv->rw_lock);
+	for (guint i = 0; helper.checksums != NULL && i < helper.apps->len; i++)
+		g_free (helper.checksums[i]);
+	g_free (helper.checksums);
+	g_ptr_array_unref (helper.apps);
+	g_hash_table_unref (helper.entries);
+	g_free (helper.ids);
+}
+
+/**
+ * as_store_set_search_cache_dir:
+ * @store: a #AsStore instance.
+ * @search_cache_dir: (nullable): a directory, or %NULL to disable
+ *
+ * Sets the directory used by as_store_load_search_cache() to save the search
+ * tokens of each application. The default is %NULL, which means the search
+ * tokens are not saved.
+ *
+ * Since: 0.8.5
+ **/
+void
+as_store_set_search_cache_dir (AsStore *store, const gchar *search_cache_dir)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_return_if_fail (AS_IS_STORE (store));
+	g_free (priv->search_cache_dir);
+	priv->search_cache_dir = g_strdup (search_cache_dir);
+}
+
+static void
+as_store_search_token_free (AsStoreSearchToken *st)
+{
+	as_ref_string_unref (st->token);
+	g_array_unref (st->hits);
+	g_free (st);
+}
+
+static gint
+as_store_search_token_sort_cb (gconstpointer a, gconstpointer b)
+{
+	AsStoreSearchToken *st1 = *((AsStoreSearchToken **) a);
+	AsStoreSearchToken *st2 = *((AsStoreSearchToken **) b);
+	return strcmp (st1->token, st2->token);
+}
+
+/* the index is out of date if the token cache of any app was invalidated,
+ * for instance by adding a keyword after the app was added to the store */
+static gboolean
+as_store_search_index_is_valid (AsStore *store)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	if (priv->search_index == NULL)
+		return FALSE;
+	for (guint i = 0; i < priv->array->len; i++) {
 		AsApp *app = g_ptr_array_index (priv->array, i);
-		g_thread_pool_push (pool, g_object_ref (app), NULL);
+		guint generation = g_array_index (priv->search_index_generations, guint, i);
+		if (as_app_get_token_cache_generation (app) != generation)
+			return FALSE;
 	}
-	g_mutex_unlock (&priv->mutex);
-	g_thread_pool_free (pool, FALSE, TRUE);
+	return TRUE;
+}
+
+/* must be called with priv->rw_lock held; returns a reference so that the
+ * index can be replaced by another reader while this one is searching it */
+static GPtrArray *
+as_store_search_index_ensure (AsStore *store)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_autoptr(AsProfileTask) ptask = NULL;
+	g_autoptr(GPtrArray) tokens = NULL;
+	g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&priv->index_mutex);
+
+	/* already valid */
+	if (as_store_search_index_is_valid (store))
+		return g_ptr_array_ref (priv->search_index);
+
+	/* profile */
+	ptask = as_profile_start_literal (priv->profile,
+					  "AsStore:create-search-index");
+
+	/* invert each token cache, adding the hits in store order */
+	g_clear_pointer (&priv->search_index, g_ptr_array_unref);
+	g_clear_pointer (&priv->search_index_generations, g_array_unref);
+	priv->search_index = g_ptr_array_new_with_free_func ((GDestroyNotify) as_store_search_token_free);
+	priv->search_index_generations = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+							    priv->array->len);
+	tokens = g_ptr_array_new ();
+	for (guint i = 0; i < priv->array->len; i++) {
+		AsApp *app = g_ptr_array_index (priv->array, i);
+		guint generation = as_app_get_token_cache_generation (app);
+		GArray *token_cache = as_app_get_token_cache (app);
+		AsTokenDict *token_dict = as_app_get_token_dict (app);
+		g_array_append_val (priv->search_index_generations, generation);
+		for (guint j = 0; j < token_cache->len; j++) {
+			AsAppToken *token = &g_array_index (token_cache, AsAppToken, j);
+			AsRefString *tmp = as_token_dict_get (token_dict, token->id);
+			AsStoreSearchHit hit;
+			AsStoreSearchToken *st;
+			guint32 id = token->id;
+
+			/* also in another store */
+			if (token_dict != priv->token_dict)
+				id = as_token_dict_insert (priv->token_dict, tmp);
+			if (id >= tokens->len)
+				g_ptr_array_set_size (tokens, (gint) id + 1);
+			st = g_ptr_array_index (tokens, id);
+			if (st == NULL) {
+				st = g_new0 (AsStoreSearchToken, 1);
+				st->token = as_ref_string_ref (tmp);
+				st->hits = g_array_new (FALSE, FALSE, sizeof (AsStoreSearchHit));
+				g_ptr_array_index (tokens, id) = st;
+				g_ptr_array_add (priv->search_index, st);
+			}
+			hit.idx = i;
+			hit.match = token->match;
+			g_array_append_val (st->hits, hit);
+		}
+	}
+
+	/* sort so that prefix matches are a contiguous range */
+	g_ptr_array_sort (priv->search_index, as_store_search_token_sort_cb);
+	return g_ptr_array_ref (priv->search_index);
+}
+
+/* returns the index of the first token >= @search */
+static guint
+as_store_search_index_lower_bound (GPtrArray *search_index, const gchar *search)
+{
+	guint lo = 0;
+	guint hi = search_index->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		AsStoreSearchToken *st = g_ptr_array_index (search_index, mid);
+		if (strcmp (st->token, search) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* returns the index of the first hit for an app >= @idx */
+static guint
+as_store_search_hits_lower_bound (GArray *hits, guint idx)
+{
+	guint lo = 0;
+	guint hi = hits->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		if (g_array_index (hits, AsStoreSearchHit, mid).idx < idx)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* scores the apps in the range @lo to @hi for all of the stemmed @terms,
+ * where @scores is the same as as_app_search_matches_all() and @counts is
+ * the number of tokens that matched; must be called with priv->rw_lock held */
+static void
+as_store_search_range (GPtrArray *search_index,
+		       AsRefString **stems,
+		       guint lo,
+		       guint hi,
+		       guint *scores,
+		       guint *counts)
+{
+	guint len = hi - lo;
+	g_autofree guint16 *exact = g_new0 (guint16, len);
+	g_autofree guint16 *partial = g_new0 (guint16, len);
+	g_autofree guint *hits = g_new0 (guint, len);
+
+	for (guint j = 0; stems[j] != NULL; j++) {
+		gboolean any = FALSE;
+
+		/* the exact match sorts first in the range of prefix matches */
+		memset (exact, 0, sizeof (guint16) * len);
+		memset (partial, 0, sizeof (guint16) * len);
+		memset (hits, 0, sizeof (guint) * len);
+		for (guint i = as_store_search_index_lower_bound (search_index, stems[j]);
+		     i < search_index->len; i++) {
+			AsStoreSearchToken *st = g_ptr_array_index (search_index, i);
+			gboolean is_exact;
+			if (!g_str_has_prefix (st->token, stems[j]))
+				break;
+			is_exact = strcmp (st->token, stems[j]) == 0;
+
+			/* the hits are in store order */
+			for (guint k = as_store_search_hits_lower_bound (st->hits, lo);
+			     k < st->hits->len; k++) {
+				AsStoreSearchHit *hit = &g_array_index (st->hits, AsStoreSearchHit, k);
+				if (hit->idx >= hi)
+					break;
+				if (is_exact)
+					exact[hit->idx - lo] = hit->match;
+				else
+					partial[hit->idx - lo] |= hit->match;
+				hits[hit->idx - lo]++;
+			}
+		}
+
+		/* all the terms have to match */
+		for (guint i = 0; i < len; i++) {
+			guint tmp = exact[i] != 0 ? (guint) exact[i] << 2 : partial[i];
+			if (j > 0 && scores[i] == 0)
+				continue;
+			if (tmp == 0) {
+				scores[i] = 0;
+				counts[i] = 0;
+				continue;
+			}
+			scores[i] |= tmp;
+			counts[i] += hits[i];
+			any = TRUE;
+		}
+
+		/* no need to look at the other terms */
+		if (!any)
+			break;
+	}
+}
+
+/* returns the stemmed search terms, or %NULL if nothing can match */
+static AsRefString **
+as_store_search_stem_terms (AsStore *store, const gchar *search)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_auto(GStrv) terms = NULL;
+	g_autoptr(GPtrArray) stems = NULL;
+
+	terms = as_utils_search_tokenize (search);
+	if (terms == NULL)
+		return NULL;
+	stems = g_ptr_array_new_with_free_func ((GDestroyNotify) as_ref_string_unref);
+	for (guint j = 0; terms[j] != NULL; j++) {
+		AsRefString *stem = as_stemmer_process (priv->stemmer, terms[j]);
+
+		/* a term that cannot be stemmed can never match */
+		if (stem == NULL)
+			return NULL;
+		g_ptr_array_add (stems, stem);
+	}
+	g_ptr_array_add (stems, NULL);
+	g_ptr_array_set_free_func (stems, NULL);
+	return (AsRefString **) g_ptr_array_free (g_steal_pointer (&stems), FALSE);
+}
+
+static void
+as_store_search_stems_free (AsRefString **stems)
+{
+	for (guint j = 0; stems[j] != NULL; j++)
+		as_ref_string_unref (stems[j]);
+	g_free (stems);
+}
+
+/**
+ * as_store_search:
+ * @store: a #AsStore instance.
+ * @search: the search terms, e.g. "gnome software"
+ *
+ * Searches all the applications in the store for all of the search terms.
+ * The results are identical to calling as_app_search_matches_all() on each
+ * application with the output of as_utils_search_tokenize(), but an index of
+ * all the tokens in the store is used so that each search term only has to be
+ * looked up once.
+ *
+ * The index is created on first use and is created again when applications
+ * are added to or removed from the store, or when the search tokens of any
+ * application have changed.
+ *
+ * Returns: (transfer container) (element-type AsApp): matching applications
+ *
+ * Since: 0.8.5
+ **/
+GPtrArray *
+as_store_search (AsStore *store, const gchar *search)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	AsRefString **stems;
+	GPtrArray *apps;
+	g_autofree guint *counts = NULL;
+	g_autofree guint *scores = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
+	g_autoptr(GPtrArray) search_index = NULL;
+
+	g_return_val_if_fail (AS_IS_STORE (store), NULL);
+	g_return_val_if_fail (search != NULL, NULL);
+
+	apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	stems = as_store_search_stem_terms (store, search);
+	if (stems == NULL)
+		return apps;
+
+	locker = as_store_reader_locker_new (&priv->rw_lock);
+	search_index = as_store_search_index_ensure (store);
+	scores = g_new0 (guint, priv->array->len);
+	counts = g_new0 (guint, priv->array->len);
+	as_store_search_range (search_index, stems, 0, priv->array->len, scores, counts);
+	as_store_search_stems_free (stems);
+
+	/* return in store order */
+	for (guint i = 0; i < priv->array->len; i++) {
+		if (scores[i] == 0)
+			continue;
+		g_ptr_array_add (apps, g_object_ref (g_ptr_array_index (priv->array, i)));
+	}
+	return apps;
+}
+
+/* each thread searches at least this many apps */
+#define AS_STORE_SEARCH_APPS_PER_THREAD		2048
+
+/* the number of matched tokens that still affects the score */
+#define AS_STORE_SEARCH_COUNT_MAX		15
+
+typedef struct {
+	guint			 idx;		/* into priv->array */
+	guint			 score;
+} AsStoreSearchResult;
+
+typedef struct {
+	GPtrArray		*search_index;
+	AsRefString		**stems;
+	guint			 max_results;
+	GMutex			 mutex;		/* for ->results and ->pending */
+	GCond			 cond;
+	GArray			*results;	/* of AsStoreSearchResult */
+	guint			 pending;
+} AsStoreSearchHelper;
+
+typedef struct {
+	AsStoreSearchHelper	*helper;
+	guint			 lo;
+	guint			 hi;
+} AsStoreSearchSlice;
+
+/* best score first, then in store order so the result is stable */
+static gint
+as_store_search_result_sort_cb (gconstpointer a, gconstpointer b)
+{
+	const AsStoreSearchResult *r1 = a;
+	const AsStoreSearchResult *r2 = b;
+	if (r1->score != r2->score)
+		return r1->score > r2->score ? -1 : 1;
+	if (r1->idx != r2->idx)
+		return r1->idx < r2->idx ? -1 : 1;
+	return 0;
+}
+
+static void
+as_store_search_results_truncate (GArray *results, guint max_results)
+{
+	g_array_sort (results, as_store_search_result_sort_cb);
+	if (max_results > 0 && results->len > max_results)
+		g_array_set_size (results, max_results);
+}
+
+static void
+as_store_search_slice_cb (gpointer data, gpointer user_data)
+{
+	AsStoreSearchSlice *slice = (AsStoreSearchSlice *) data;
+	AsStoreSearchHelper *helper = slice->helper;
+	guint len = slice->hi - slice->lo;
+	g_autofree guint *counts = g_new0 (guint, len);
+	g_autofree guint *scores = g_new0 (guint, len);
+	g_autoptr(GArray) results = NULL;
+
+	as_store_search_range (helper->search_index, helper->stems,
+			       slice->lo, slice->hi, scores, counts);
+
+	/* only the best results of each slice can be in the final results */
+	results = g_array_new (FALSE, FALSE, sizeof (AsStoreSearchResult));
+	for (guint i = 0; i < len; i++) {
+		AsStoreSearchResult result;
+		if (scores[i] == 0)
+			continue;
+		result.idx = slice->lo + i;
+		result.score = scores[i] * (AS_STORE_SEARCH_COUNT_MAX + 1) +
+			       MIN (counts[i], AS_STORE_SEARCH_COUNT_MAX);
+		g_array_append_val (results, result);
+	}
+	as_store_search_results_truncate (results, helper->max_results);
+
+	g_mutex_lock (&helper->mutex);
+	g_array_append_vals (helper->results, results->data, results->len);
+	helper->pending--;
+	g_cond_signal (&helper->cond);
+	g_mutex_unlock (&helper->mutex);
+}
+
+/* the pool is created on the first search that needs it and is then shared
+ * by all the searches, which may run at the same time */
+static GThreadPool *
+as_store_search_pool_ensure (AsStore *store)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	if (g_once_init_enter (&priv->search_pool)) {
+		GThreadPool *pool;
+		pool = g_thread_pool_new (as_store_search_slice_cb, NULL,
+					  (gint) as_store_get_n_threads (store),
+					  FALSE, NULL);
+		g_once_init_leave (&priv->search_pool, pool);
+	}
+	return priv->search_pool;
+}
+
+/**
+ * as_store_search_full:
+ * @store: a #AsStore instance.
+ * @search: the search text, e.g. "gnome software"
+ * @max_results: the maximum number of results, or 0 for no limit
+ * @scores: (out) (optional) (element-type guint): the score of each result
+ *
+ * Searches all the applications in the store for all of the search terms,
+ * returning the best matches first.
+ *
+ * The applications that match are the same as for as_store_search(). The
+ * score is the value from as_app_search_matches_all(), so that a match in the
+ * name ranks higher than one in the description, and applications with the
+ * same flags are then ranked by how many of their tokens matched the terms.
+ * Applications with the same score are returned in store order.
+ *
+ * Large stores are searched using multiple threads, and the remaining terms
+ * are not looked up once nothing can match.
+ *
+ * Returns: (transfer container) (element-type AsApp): matching applications
+ *
+ * Since: 0.8.5
+ **/
+GPtrArray *
+as_store_search_full (AsStore *store,
+		      const gchar *search,
+		      guint max_results,
+		      GArray **scores)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	AsStoreSearchHelper helper;
+	GPtrArray *apps;
+	guint n_threads;
+	g_autofree AsStoreSearchSlice *slices = NULL;
+	g_autoptr(AsStoreReaderLocker) locker = NULL;
+
+	g_return_val_if_fail (AS_IS_STORE (store), NULL);
+	g_return_val_if_fail (search != NULL, NULL);
+
+	apps = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
+	if (scores != NULL)
+		*scores = g_array_new (FALSE, FALSE, sizeof (guint));
+	helper.stems = as_store_search_stem_terms (store, search);
+	if (helper.stems == NULL)
+		return apps;
+	helper.max_results = max_results;
+	helper.results = g_array_new (FALSE, FALSE, sizeof (AsStoreSearchResult));
+	helper.pending = 0;
+	g_mutex_init (&helper.mutex);
+	g_cond_init (&helper.cond);
+
+	/* the other threads rely on the lock held by this one */
+	locker = as_store_reader_locker_new (&priv->rw_lock);
+	helper.search_index = as_store_search_index_ensure (store);
+	n_threads = priv->array->len / AS_STORE_SEARCH_APPS_PER_THREAD;
+	n_threads = CLAMP (n_threads, 1, as_store_get_n_threads (store));
+	slices = g_new0 (AsStoreSearchSlice, n_threads);
+	for (guint i = 0; i < n_threads; i++) {
+		slices[i].helper = &helper;
+		slices[i].lo = (guint) (((guint64) priv->array->len * i) / n_threads);
+		slices[i].hi = (guint) (((guint64) priv->array->len * (i + 1)) / n_threads);
+	}
+
+	/* this thread searches the first slice while the pool does the rest */
+	helper.pending = n_threads;
+	if (n_threads > 1) {
+		GThreadPool *pool = as_store_search_pool_ensure (store);
+		for (guint i = 1; i < n_threads; i++) {
+			if (!g_thread_pool_push (pool, &slices[i], NULL))
+				as_store_search_slice_cb (&slices[i], NULL);
+		}
+	}
+	as_store_search_slice_cb (&slices[0], NULL);
+	g_mutex_lock (&helper.mutex);
+	while (helper.pending > 0)
+		g_cond_wait (&helper.cond, &helper.mutex);
+	g_mutex_unlock (&helper.mutex);
+
+	/* merge the best results from each slice */
+	as_store_search_results_truncate (helper.results, max_results);
+	for (guint i = 0; i < helper.results->len; i++) {
+		AsStoreSearchResult *result = &g_array_index (helper.results,
+							      AsStoreSearchResult, i);
+		g_ptr_array_add (apps, g_object_ref (g_ptr_array_index (priv->array,
+									result->idx)));
+		if (scores != NULL)
+			g_array_append_val (*scores, result->score);
+	}
+	as_store_search_stems_free (helper.stems);
+	g_ptr_array_unref (helper.search_index);
+	g_array_unref (helper.results);
+	g_mutex_clear (&helper.mutex);
+	g_cond_clear (&helper.cond);
+	return apps;
 }
 
 /**
@@ -3540,6 +5963,11 @@ as_store_load_search_cache (AsStore *store)
  *
  * Loads the store from the default locations.
  *
+ * If %AS_STORE_LOAD_FLAG_PARALLEL is used then the files in each location
+ * are parsed using multiple threads. The applications are still added to
+ * the store in the same order, and so the result is identical to loading
+ * each file in turn, although more memory is used while loading.
+ *
  * Returns: %TRUE for success
  *
  * Since: 0.1.2
@@ -3960,13 +6388,73 @@ as_store_create_search_blacklist (AsStore *store)
 	}
 }
 
+/**
+ * as_store_set_search_locale:
+ * @store: a #AsStore instance.
+ * @locale: (nullable): a locale, e.g. "de_DE.UTF-8", or %NULL for English
+ *
+ * Sets the language used to stem the search tokens of each application and
+ * the words that are searched for. German, French, Spanish, Italian,
+ * Portuguese and Dutch use a light stemmer and other locales use the Porter
+ * algorithm for English, which is also the default.
+ *
+ * The search tokens of the applications already in the store are created
+ * again using the new stemmer when they are next needed.
+ *
+ * Since: 0.8.5
+ **/
+void
+as_store_set_search_locale (AsStore *store, const gchar *locale)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_autoptr(AsStoreWriterLocker) locker = NULL;
+
+	g_return_if_fail (AS_IS_STORE (store));
+
+	locker = as_store_writer_locker_new (&priv->rw_lock);
+	g_free (priv->search_locale);
+	priv->search_locale = g_strdup (locale);
+	g_object_unref (priv->stemmer);
+	priv->stemmer = as_stemmer_new_for_locale (locale);
+
+	/* the blacklist has to match the stemmed tokens */
+	g_hash_table_remove_all (priv->search_blacklist);
+	as_store_create_search_blacklist (store);
+
+	/* the existing tokens were stemmed for the old locale */
+	for (guint i = 0; i < priv->array->len; i++) {
+		AsApp *app = g_ptr_array_index (priv->array, i);
+		as_app_set_stemmer (app, priv->stemmer);
+		as_app_invalidate_token_cache (app);
+	}
+	as_store_invalidate_indexes (store);
+}
+
+/**
+ * as_store_get_search_locale:
+ * @store: a #AsStore instance.
+ *
+ * Gets the language used to stem the search tokens.
+ *
+ * Returns: a locale, or %NULL for the default
+ *
+ * Since: 0.8.5
+ **/
+const gchar *
+as_store_get_search_locale (AsStore *store)
+{
+	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_return_val_if_fail (AS_IS_STORE (store), NULL);
+	return priv->search_locale;
+}
+
 /**
  * as_store_set_search_match:
  * @store: a #AsStore instance.
  * @search_match: the #AsAppSearchMatch, e.g. %AS_APP_SEARCH_MATCH_PKGNAME
  *
  * Sets the token match fields. The bitfield given here is used to choose what
- * is included in the token cache.
+ * is included in the token cache of each application in the store.
  *
  * Since: 0.6.5
  **/
@@ -3974,8 +6462,22 @@ void
 as_store_set_search_match (AsStore *store, guint16 search_match)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
+	g_autoptr(AsStoreWriterLocker) locker = NULL;
+
 	g_return_if_fail (AS_IS_STORE (store));
+
+	locker = as_store_writer_locker_new (&priv->rw_lock);
+	if (priv->search_match == search_match)
+		return;
 	priv->search_match = search_match;
+
+	/* the existing tokens were chosen using the old fields */
+	for (guint i = 0; i < priv->array->len; i++) {
+		AsApp *app = g_ptr_array_index (priv->array, i);
+		as_app_set_search_match (app, search_match);
+		as_app_invalidate_token_cache (app);
+	}
+	as_store_invalidate_indexes (store);
 }
 
 /**
@@ -4001,9 +6503,13 @@ static void
 as_store_init (AsStore *store)
 {
 	AsStorePrivate *priv = GET_PRIVATE (store);
-	g_mutex_init (&priv->mutex);
+	g_rw_lock_init (&priv->rw_lock);
+	g_mutex_init (&priv->index_mutex);
+	g_mutex_init (&priv->index_dirty_mutex);
+	g_mutex_init (&priv->to_xml_mutex);
 	priv->profile = as_profile_new ();
 	priv->stemmer = as_stemmer_new ();
+	priv->token_dict = as_token_dict_new ();
 	priv->api_version = g_strdup (AS_API_VERSION_NEWEST);
 	priv->array = g_ptr_array_new_with_free_func ((GDestroyNotify) g_object_unref);
 	priv->watch_flags = AS_STORE_WATCH_FLAG_NONE;
@@ -4032,6 +6538,15 @@ as_store_init (AsStore *store)
 						    g_str_equal,
 						    g_free,
 						    (GDestroyNotify) as_store_path_data_free);
+	priv->cache_sources = g_hash_table_new_full (g_str_hash, g_str_equal,
+						     g_free, NULL);
+	priv->hash_provide = g_hash_table_new_full (g_str_hash, g_str_equal,
+						    g_free, (GDestroyNotify) g_ptr_array_unref);
+	priv->hash_launchable = g_hash_table_new_full (g_str_hash, g_str_equal,
+						       g_free, (GDestroyNotify) g_ptr_array_unref);
+	priv->hash_index_keys = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+						       NULL, (GDestroyNotify) as_store_index_entry_free);
+	priv->hash_index_dirty = g_hash_table_new (g_direct_hash, g_direct_equal);
 	priv->monitor = as_monitor_new ();
 	g_signal_connect (priv->monitor, "changed",
 			  G_CALLBACK (as_store_monitor_changed_cb),
@@ -53,6 +53,7 @@ struct _AsStoreClass
  * @AS_STORE_LOAD_FLAG_IGNORE_INVALID:		Ignore invalid files
  * @AS_STORE_LOAD_FLAG_ONLY_UNCOMPRESSED:	Ignore compressed files
  * @AS_STORE_LOAD_FLAG_ONLY_MERGE_APPS:		Ignore non-wildcard matches
+ * @AS_STORE_LOAD_FLAG_PARALLEL:		Parse the files in each directory using multiple threads
  *
  * The flags to use when loading the store.
  **/
@@ -69,6 +70,7 @@ typedef enum {
 	AS_STORE_LOAD_FLAG_IGNORE_INVALID	= 1 << 8,	/* Since: 0.5.8 */
 	AS_STORE_LOAD_FLAG_ONLY_UNCOMPRESSED	= 1 << 9,	/* Since: 0.6.4 */
 	AS_STORE_LOAD_FLAG_ONLY_MERGE_APPS	= 1 << 10,	/* Since: 0.6.4 */
+	AS_STORE_LOAD_FLAG_PARALLEL		= 1 << 11,	/* Since: 0.8.5 */
 	/*< private >*/
 	AS_STORE_LOAD_FLAG_LAST
 } AsStoreLoadFlags;
@@ -84,6 +86,7 @@ typedef enum {
  * @AS_STORE_ADD_FLAG_USE_UNIQUE_ID:			Allow multiple apps with the same AppStream ID
  * @AS_STORE_ADD_FLAG_USE_MERGE_HEURISTIC:		Use a heuristic when adding merge components
  * @AS_STORE_ADD_FLAG_ONLY_NATIVE_LANGS:		Only load native languages
+ * @AS_STORE_ADD_FLAG_LAZY_PARSE:			Parse large data like releases on first use
  *
  * The flags to use when adding applications to the store.
  **/
@@ -93,6 +96,7 @@ typedef enum {
 	AS_STORE_ADD_FLAG_USE_UNIQUE_ID		= 1 << 1,	/* Since: 0.6.1 */
 	AS_STORE_ADD_FLAG_USE_MERGE_HEURISTIC	= 1 << 2,	/* Since: 0.6.1 */
 	AS_STORE_ADD_FLAG_ONLY_NATIVE_LANGS	= 1 << 3,	/* Since: 0.6.5 */
+	AS_STORE_ADD_FLAG_LAZY_PARSE		= 1 << 4,	/* Since: 0.8.5 */
 	/*< private >*/
 	AS_STORE_ADD_FLAG_LAST
 } AsStoreAddFlags;
@@ -179,6 +183,11 @@ gboolean	 as_store_load_path		(AsStore	*store,
 						 const gchar	*path,
 						 GCancellable	*cancellable,
 						 GError		**error);
+gboolean	 as_store_load_path_full	(AsStore	*store,
+						 const gchar	*path,
+						 guint32	 flags,
+						 GCancellable	*cancellable,
+						 GError		**error);
 void		 as_store_load_path_async	(AsStore	*store,
 						 const gchar	*path,
 						 GCancellable	*cancellable,
@@ -189,9 +198,20 @@ gboolean	 as_store_load_path_finish	(AsStore	*store,
 						 GError		**error);
 
 void		 as_store_load_search_cache	(AsStore	*store);
+void		 as_store_set_search_cache_dir	(AsStore	*store,
+						 const gchar	*search_cache_dir);
+GPtrArray	*as_store_search		(AsStore	*store,
+						 const gchar	*search);
+GPtrArray	*as_store_search_full		(AsStore	*store,
+						 const gchar	*search,
+						 guint		 max_results,
+						 GArray		**scores);
 void		 as_store_set_search_match	(AsStore	*store,
 						 guint16	 search_match);
 guint16		 as_store_get_search_match	(AsStore	*store);
+void		 as_store_set_search_locale	(AsStore	*store,
+						 const gchar	*locale);
+const gchar	*as_store_get_search_locale	(AsStore	*store);
 void		 as_store_remove_all		(AsStore	*store);
 GPtrArray	*as_store_get_apps		(AsStore	*store);
 GPtrArray	*as_store_dup_apps		(AsStore	*store);
@@ -236,6 +256,8 @@ void		 as_store_remove_app		(AsStore	*store,
 void		 as_store_remove_app_by_id	(AsStore	*store,
 						 const gchar	*id);
 void		 as_store_remove_apps_with_veto	(AsStore	*store);
+void		 as_store_reindex_app		(AsStore	*store,
+						 AsApp		*app);
 GString		*as_store_to_xml		(AsStore	*store,
 						 guint32	 flags);
 gboolean	 as_store_to_file		(AsStore	*store,
@@ -243,6 +265,14 @@ gboolean	 as_store_to_file		(AsStore	*store,
 						 guint32	 flags,
 						 GCancellable	*cancellable,
 						 GError		**error);
+gboolean	 as_store_to_cache		(AsStore	*store,
+						 GFile		*file,
+						 GCancellable	*cancellable,
+						 GError		**error);
+gboolean	 as_store_from_cache		(AsStore	*store,
+						 GFile		*file,
+						 GCancellable	*cancellable,
+						 GError		**error);
 gboolean	 as_store_convert_icons		(AsStore	*store,
 						 AsIconKind	 kind,
 						 GError		**error);
@@ -264,6 +294,9 @@ void		 as_store_set_version		(AsStore	*store,
 guint32		 as_store_get_add_flags		(AsStore	*store);
 void		 as_store_set_add_flags		(AsStore	*store,
 						 guint32	 add_flags);
+guint		 as_store_get_max_threads	(AsStore	*store);
+void		 as_store_set_max_threads	(AsStore	*store,
+						 guint		 max_threads);
 guint32		 as_store_get_watch_flags	(AsStore	*store);
 void		 as_store_set_watch_flags	(AsStore	*store,
 						 guint32	 watch_flags);
@@ -0,0 +1,34 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include "as-ref-string.h"
+
+G_BEGIN_DECLS
+
+#define AS_TYPE_TOKEN_DICT	(as_token_dict_get_type ())
+
+G_DECLARE_FINAL_TYPE (AsTokenDict, as_token_dict, AS, TOKEN_DICT, GObject)
+
+AsTokenDict	*as_token_dict_new		(void);
+guint32		 as_token_dict_insert		(AsTokenDict	*dict,
+						 AsRefString	*token);
+gboolean	 as_token_dict_lookup		(AsTokenDict	*dict,
+						 const gchar	*token,
+						 guint32	*id);
+AsRefString	*as_token_dict_get		(AsTokenDict	*dict,
+						 guint32	 id);
+AsRefString	*as_token_dict_get_unlocked	(AsTokenDict	*dict,
+						 guint32	 id);
+void		 as_token_dict_reader_lock	(AsTokenDict	*dict);
+void		 as_token_dict_reader_unlock	(AsTokenDict	*dict);
+guint		 as_token_dict_get_size		(AsTokenDict	*dict);
+
+G_END_DECLS
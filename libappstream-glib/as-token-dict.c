@@ -0,0 +1,205 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2016 Richard Hughes <richard@hughsie.com>
+ *
+ * SPDX-License-Identifier: LGPL-2.1+
+ */
+
+/* Maps each search token to a small integer so that applications only have
+ * to store the ID of each token, and tokens used by many applications are
+ * only stored once. Tokens are never removed, so an ID stays valid for the
+ * lifetime of the dictionary; a store creates a new dictionary for the
+ * remaining applications once enough of them have been removed. */
+
+#include "config.h"
+
+#include "as-token-dict-private.h"
+
+struct _AsTokenDict
+{
+	GObject			 parent_instance;
+	GRWLock			 rw_lock;
+	GHashTable		*ids;		/* of AsRefString:id+1 */
+	GPtrArray		*tokens;	/* of AsRefString, by id */
+};
+
+G_DEFINE_TYPE (AsTokenDict, as_token_dict, G_TYPE_OBJECT)
+
+/**
+ * as_token_dict_insert:
+ * @dict: A #AsTokenDict
+ * @token: A #AsRefString
+ *
+ * Adds a token to the dictionary if it does not already exist.
+ *
+ * Returns: the ID of the token
+ **/
+guint32
+as_token_dict_insert (AsTokenDict *dict, AsRefString *token)
+{
+	guint32 id;
+
+	g_rw_lock_reader_lock (&dict->rw_lock);
+	id = GPOINTER_TO_UINT (g_hash_table_lookup (dict->ids, token));
+	g_rw_lock_reader_unlock (&dict->rw_lock);
+	if (id > 0)
+		return id - 1;
+
+	/* check again, as another thread may have added it */
+	g_rw_lock_writer_lock (&dict->rw_lock);
+	id = GPOINTER_TO_UINT (g_hash_table_lookup (dict->ids, token));
+	if (id == 0) {
+		g_ptr_array_add (dict->tokens, as_ref_string_ref (token));
+		id = dict->tokens->len;
+		g_hash_table_insert (dict->ids, token, GUINT_TO_POINTER (id));
+	}
+	g_rw_lock_writer_unlock (&dict->rw_lock);
+	return id - 1;
+}
+
+/**
+ * as_token_dict_lookup:
+ * @dict: A #AsTokenDict
+ * @token: A token
+ * @id: (out): the ID of the token
+ *
+ * Finds the ID of a token.
+ *
+ * Returns: %TRUE if the token exists
+ **/
+gboolean
+as_token_dict_lookup (AsTokenDict *dict, const gchar *token, guint32 *id)
+{
+	guint32 tmp;
+
+	g_rw_lock_reader_lock (&dict->rw_lock);
+	tmp = GPOINTER_TO_UINT (g_hash_table_lookup (dict->ids, token));
+	g_rw_lock_reader_unlock (&dict->rw_lock);
+	if (tmp == 0)
+		return FALSE;
+	*id = tmp - 1;
+	return TRUE;
+}
+
+/**
+ * as_token_dict_get:
+ * @dict: A #AsTokenDict
+ * @id: the ID of a token
+ *
+ * Gets a token from the dictionary.
+ *
+ * Returns: (transfer none): the token, or %NULL if @id is invalid
+ **/
+AsRefString *
+as_token_dict_get (AsTokenDict *dict, guint32 id)
+{
+	AsRefString *token = NULL;
+
+	g_rw_lock_reader_lock (&dict->rw_lock);
+	if (id < dict->tokens->len)
+		token = g_ptr_array_index (dict->tokens, id);
+	g_rw_lock_reader_unlock (&dict->rw_lock);
+	return token;
+}
+
+/**
+ * as_token_dict_get_unlocked:
+ * @dict: A #AsTokenDict
+ * @id: the ID of a token
+ *
+ * Gets a token from the dictionary, which must be locked using
+ * as_token_dict_reader_lock(). This allows many tokens to be looked up
+ * while only taking the lock once.
+ *
+ * Returns: (transfer none): the token, or %NULL if @id is invalid
+ **/
+AsRefString *
+as_token_dict_get_unlocked (AsTokenDict *dict, guint32 id)
+{
+	if (id >= dict->tokens->len)
+		return NULL;
+	return g_ptr_array_index (dict->tokens, id);
+}
+
+/**
+ * as_token_dict_reader_lock:
+ * @dict: A #AsTokenDict
+ *
+ * Stops tokens being added until as_token_dict_reader_unlock() is called.
+ **/
+void
+as_token_dict_reader_lock (AsTokenDict *dict)
+{
+	g_rw_lock_reader_lock (&dict->rw_lock);
+}
+
+/**
+ * as_token_dict_reader_unlock:
+ * @dict: A #AsTokenDict
+ *
+ * Releases the lock taken by as_token_dict_reader_lock().
+ **/
+void
+as_token_dict_reader_unlock (AsTokenDict *dict)
+{
+	g_rw_lock_reader_unlock (&dict->rw_lock);
+}
+
+/**
+ * as_token_dict_get_size:
+ * @dict: A #AsTokenDict
+ *
+ * Gets the number of tokens in the dictionary.
+ *
+ * Returns: integer
+ **/
+guint
+as_token_dict_get_size (AsTokenDict *dict)
+{
+	guint size;
+
+	g_rw_lock_reader_lock (&dict->rw_lock);
+	size = dict->tokens->len;
+	g_rw_lock_reader_unlock (&dict->rw_lock);
+	return size;
+}
+
+static void
+as_token_dict_finalize (GObject *object)
+{
+	AsTokenDict *dict = AS_TOKEN_DICT (object);
+
+	g_hash_table_unref (dict->ids);
+	g_ptr_array_unref (dict->tokens);
+	g_rw_lock_clear (&dict->rw_lock);
+
+	G_OBJECT_CLASS (as_token_dict_parent_class)->finalize (object);
+}
+
+static void
+as_token_dict_class_init (AsTokenDictClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+	object_class->finalize = as_token_dict_finalize;
+}
+
+static void
+as_token_dict_init (AsTokenDict *dict)
+{
+	g_rw_lock_init (&dict->rw_lock);
+	dict->ids = g_hash_table_new (g_str_hash, g_str_equal);
+	dict->tokens = g_ptr_array_new_with_free_func ((GDestroyNotify) as_ref_string_unref);
+}
+
+/**
+ * as_token_dict_new:
+ *
+ * Creates a new #AsTokenDict.
+ *
+ * Returns: (transfer full): a #AsTokenDict
+ **/
+AsTokenDict *
+as_token_dict_new (void)
+{
+	return AS_TOKEN_DICT (g_object_new (AS_TYPE_TOKEN_DICT, NULL));
+}